@@ -1,1711 +1,3474 @@
-///////////////////////////////////////////////////////////////////////////////
-// FILE:          Arduino.cpp
-// PROJECT:       Micro-Manager
-// SUBSYSTEM:     DeviceAdapters
-//-----------------------------------------------------------------------------
-// DESCRIPTION:   Arduino adapter.  Needs accompanying firmware
-// COPYRIGHT:     University of California, San Francisco, 2008
-// LICENSE:       LGPL
-// 
-// AUTHOR:        Nico Stuurman, nico@cmp.ucsf.edu 11/09/2008
-//                automatic device detection by Karl Hoover
-//
-//
-
-#include "Arduino.h"
-#include "../../MMDevice/ModuleInterface.h"
-#include <sstream>
-#include <cstdio>
-
-#ifdef WIN32
-   #define WIN32_LEAN_AND_MEAN
-   #include <windows.h>
-   #define snprintf _snprintf 
-#endif
-
-const char* g_DeviceNameArduinoHub = "Arduino-Hub";
-const char* g_DeviceNameArduinoSwitch = "Arduino-Switch";
-const char* g_DeviceNameArduinoShutter = "Arduino-Shutter";
-const char* g_DeviceNameArduinoDA1 = "Arduino-DAC1";
-const char* g_DeviceNameArduinoDA2 = "Arduino-DAC2";
-const char* g_DeviceNameArduinoInput = "Arduino-Input";
-
-
-// Global info about the state of the Arduino.  This should be folded into a class
-const int g_Min_MMVersion = 1;
-const int g_Max_MMVersion = 2;
-const char* g_versionProp = "Version";
-const char* g_normalLogicString = "Normal";
-const char* g_invertedLogicString = "Inverted";
-
-const char* g_On = "On";
-const char* g_Off = "Off";
-
-// static lock
-MMThreadLock CArduinoHub::lock_;
-
-///////////////////////////////////////////////////////////////////////////////
-// Exported MMDevice API
-///////////////////////////////////////////////////////////////////////////////
-MODULE_API void InitializeModuleData()
-{
-   RegisterDevice(g_DeviceNameArduinoHub, MM::HubDevice, "Hub (required)");
-   RegisterDevice(g_DeviceNameArduinoSwitch, MM::StateDevice, "Digital out 8-bit");
-   RegisterDevice(g_DeviceNameArduinoShutter, MM::ShutterDevice, "Shutter");
-   RegisterDevice(g_DeviceNameArduinoDA1, MM::SignalIODevice, "DAC channel 1");
-   RegisterDevice(g_DeviceNameArduinoDA2, MM::SignalIODevice, "DAC channel 2");
-   RegisterDevice(g_DeviceNameArduinoInput, MM::GenericDevice, "ADC");
-}
-
-MODULE_API MM::Device* CreateDevice(const char* deviceName)
-{
-   if (deviceName == 0)
-      return 0;
-
-   if (strcmp(deviceName, g_DeviceNameArduinoHub) == 0)
-   {
-      return new CArduinoHub;
-   }
-   else if (strcmp(deviceName, g_DeviceNameArduinoSwitch) == 0)
-   {
-      return new CArduinoSwitch;
-   }
-   else if (strcmp(deviceName, g_DeviceNameArduinoShutter) == 0)
-   {
-      return new CArduinoShutter;
-   }
-   else if (strcmp(deviceName, g_DeviceNameArduinoDA1) == 0)
-   {
-      return new CArduinoDA(1); // channel 1
-   }
-   else if (strcmp(deviceName, g_DeviceNameArduinoDA2) == 0)
-   {
-      return new CArduinoDA(2); // channel 2
-   }
-   else if (strcmp(deviceName, g_DeviceNameArduinoInput) == 0)
-   {
-      return new CArduinoInput;
-   }
-
-   return 0;
-}
-
-MODULE_API void DeleteDevice(MM::Device* pDevice)
-{
-   delete pDevice;
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// CArduinoHUb implementation
-// ~~~~~~~~~~~~~~~~~~~~~~~~~~
-//
-CArduinoHub::CArduinoHub() :
-   initialized_ (false),
-   switchState_ (0),
-   shutterState_ (0)
-{
-   portAvailable_ = false;
-   invertedLogic_ = false;
-   timedOutputActive_ = false;
-
-   InitializeDefaultErrorMessages();
-
-   SetErrorText(ERR_PORT_OPEN_FAILED, "Failed opening Arduino USB device");
-   SetErrorText(ERR_BOARD_NOT_FOUND, "Did not find an Arduino board with the correct firmware.  Is the Arduino board connected to this serial port?");
-   SetErrorText(ERR_NO_PORT_SET, "Hub Device not found.  The Arduino Hub device is needed to create this device");
-   std::ostringstream errorText;
-   errorText << "The firmware version on the Arduino is not compatible with this adapter.  Please use firmware version ";
-   errorText <<  g_Min_MMVersion << " to " << g_Max_MMVersion;
-   SetErrorText(ERR_VERSION_MISMATCH, errorText.str().c_str());
-
-   CPropertyAction* pAct = new CPropertyAction(this, &CArduinoHub::OnPort);
-   CreateProperty(MM::g_Keyword_Port, "Undefined", MM::String, false, pAct, true);
-
-   pAct = new CPropertyAction(this, &CArduinoHub::OnLogic);
-   CreateProperty("Logic", g_invertedLogicString, MM::String, false, pAct, true);
-
-   AddAllowedValue("Logic", g_invertedLogicString);
-   AddAllowedValue("Logic", g_normalLogicString);
-}
-
-CArduinoHub::~CArduinoHub()
-{
-   Shutdown();
-}
-
-void CArduinoHub::GetName(char* name) const
-{
-   CDeviceUtils::CopyLimitedString(name, g_DeviceNameArduinoHub);
-}
-
-bool CArduinoHub::Busy()
-{
-   return false;
-}
-
-// private and expects caller to:
-// 1. guard the port
-// 2. purge the port
-int CArduinoHub::GetControllerVersion(int& version)
-{
-   int ret = DEVICE_OK;
-   unsigned char command[1];
-   command[0] = 30;
-   version = 0;
-
-   ret = WriteToComPort(port_.c_str(), (const unsigned char*) command, 1);
-   if (ret != DEVICE_OK)
-      return ret;
-
-   std::string answer;
-   ret = GetSerialAnswer(port_.c_str(), "\r\n", answer);
-   if (ret != DEVICE_OK)
-      return ret;
-
-   if (answer != "MM-Ard")
-      return ERR_BOARD_NOT_FOUND;
-
-   // Check version number of the Arduino
-   command[0] = 31;
-   ret = WriteToComPort(port_.c_str(), (const unsigned char*) command, 1);
-   if (ret != DEVICE_OK)
-      return ret;
-
-   std::string ans;
-   ret = GetSerialAnswer(port_.c_str(), "\r\n", ans);
-   if (ret != DEVICE_OK) {
-         return ret;
-   }
-   std::istringstream is(ans);
-   is >> version;
-
-   return ret;
-
-}
-
-bool CArduinoHub::SupportsDeviceDetection(void)
-{
-   return true;
-}
-
-MM::DeviceDetectionStatus CArduinoHub::DetectDevice(void)
-{
-   if (initialized_)
-      return MM::CanCommunicate;
-
-   // all conditions must be satisfied...
-   MM::DeviceDetectionStatus result = MM::Misconfigured;
-   char answerTO[MM::MaxStrLength];
-   
-   try
-   {
-      std::string portLowerCase = port_;
-      for( std::string::iterator its = portLowerCase.begin(); its != portLowerCase.end(); ++its)
-      {
-         *its = (char)tolower(*its);
-      }
-      if( 0< portLowerCase.length() &&  0 != portLowerCase.compare("undefined")  && 0 != portLowerCase.compare("unknown") )
-      {
-         result = MM::CanNotCommunicate;
-         // record the default answer time out
-         GetCoreCallback()->GetDeviceProperty(port_.c_str(), "AnswerTimeout", answerTO);
-
-         // device specific default communication parameters
-         // for Arduino Duemilanova
-         GetCoreCallback()->SetDeviceProperty(port_.c_str(), MM::g_Keyword_Handshaking, g_Off);
-         GetCoreCallback()->SetDeviceProperty(port_.c_str(), MM::g_Keyword_BaudRate, "57600" );
-         GetCoreCallback()->SetDeviceProperty(port_.c_str(), MM::g_Keyword_StopBits, "1");
-         // Arduino timed out in GetControllerVersion even if AnswerTimeout  = 300 ms
-         GetCoreCallback()->SetDeviceProperty(port_.c_str(), "AnswerTimeout", "500.0");
-         GetCoreCallback()->SetDeviceProperty(port_.c_str(), "DelayBetweenCharsMs", "0");
-         MM::Device* pS = GetCoreCallback()->GetDevice(this, port_.c_str());
-         pS->Initialize();
-         // The first second or so after opening the serial port, the Arduino is waiting for firmwareupgrades.  Simply sleep 2 seconds.
-         CDeviceUtils::SleepMs(2000);
-         MMThreadGuard myLock(lock_);
-         PurgeComPort(port_.c_str());
-         int v = 0;
-         int ret = GetControllerVersion(v);
-         // later, Initialize will explicitly check the version #
-         if( DEVICE_OK != ret )
-         {
-            LogMessageCode(ret,true);
-         }
-         else
-         {
-            // to succeed must reach here....
-            result = MM::CanCommunicate;
-         }
-         pS->Shutdown();
-         // always restore the AnswerTimeout to the default
-         GetCoreCallback()->SetDeviceProperty(port_.c_str(), "AnswerTimeout", answerTO);
-
-      }
-   }
-   catch(...)
-   {
-      LogMessage("Exception in DetectDevice!",false);
-   }
-
-   return result;
-}
-
-
-int CArduinoHub::Initialize()
-{
-   // Name
-   int ret = CreateProperty(MM::g_Keyword_Name, g_DeviceNameArduinoHub, MM::String, true);
-   if (DEVICE_OK != ret)
-      return ret;
-
-   // The first second or so after opening the serial port, the Arduino is waiting for firmwareupgrades.  Simply sleep 1 second.
-   CDeviceUtils::SleepMs(2000);
-
-   MMThreadGuard myLock(lock_);
-
-   // Check that we have a controller:
-   PurgeComPort(port_.c_str());
-   ret = GetControllerVersion(version_);
-   if( DEVICE_OK != ret)
-      return ret;
-
-   if (version_ < g_Min_MMVersion || version_ > g_Max_MMVersion)
-      return ERR_VERSION_MISMATCH;
-
-   CPropertyAction* pAct = new CPropertyAction(this, &CArduinoHub::OnVersion);
-   std::ostringstream sversion;
-   sversion << version_;
-   CreateProperty(g_versionProp, sversion.str().c_str(), MM::Integer, true, pAct);
-
-   ret = UpdateStatus();
-   if (ret != DEVICE_OK)
-      return ret;
-
-   // turn off verbose serial debug messages
-   // GetCoreCallback()->SetDeviceProperty(port_.c_str(), "Verbose", "0");
-
-   initialized_ = true;
-   return DEVICE_OK;
-}
-
-int CArduinoHub::DetectInstalledDevices()
-{
-   if (MM::CanCommunicate == DetectDevice()) 
-   {
-      std::vector<std::string> peripherals; 
-      peripherals.clear();
-      peripherals.push_back(g_DeviceNameArduinoSwitch);
-      peripherals.push_back(g_DeviceNameArduinoShutter);
-      peripherals.push_back(g_DeviceNameArduinoInput);
-      peripherals.push_back(g_DeviceNameArduinoDA1);
-      peripherals.push_back(g_DeviceNameArduinoDA2);
-      for (size_t i=0; i < peripherals.size(); i++) 
-      {
-         MM::Device* pDev = ::CreateDevice(peripherals[i].c_str());
-         if (pDev) 
-         {
-            AddInstalledDevice(pDev);
-         }
-      }
-   }
-
-   return DEVICE_OK;
-}
-
-
-
-int CArduinoHub::Shutdown()
-{
-   initialized_ = false;
-   return DEVICE_OK;
-}
-
-int CArduinoHub::OnPort(MM::PropertyBase* pProp, MM::ActionType pAct)
-{
-   if (pAct == MM::BeforeGet)
-   {
-      pProp->Set(port_.c_str());
-   }
-   else if (pAct == MM::AfterSet)
-   {
-      pProp->Get(port_);
-      portAvailable_ = true;
-   }
-   return DEVICE_OK;
-}
-
-int CArduinoHub::OnVersion(MM::PropertyBase* pProp, MM::ActionType pAct)
-{
-   if (pAct == MM::BeforeGet)
-   {
-      pProp->Set((long)version_);
-   }
-   return DEVICE_OK;
-}
-
-int CArduinoHub::OnLogic(MM::PropertyBase* pProp, MM::ActionType pAct)
-{
-   if (pAct == MM::BeforeGet)
-   {
-      if (invertedLogic_)
-         pProp->Set(g_invertedLogicString);
-      else
-         pProp->Set(g_normalLogicString);
-   } else if (pAct == MM::AfterSet)
-   {
-      std::string logic;
-      pProp->Get(logic);
-      if (logic.compare(g_invertedLogicString)==0)
-         invertedLogic_ = true;
-      else invertedLogic_ = false;
-   }
-   return DEVICE_OK;
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// CArduinoSwitch implementation
-// ~~~~~~~~~~~~~~~~~~~~~~~~~~
-
-CArduinoSwitch::CArduinoSwitch() : 
-   nrPatternsUsed_(0),
-   currentDelay_(0),
-   sequenceOn_(false),
-   blanking_(false),
-   initialized_(false),
-   numPos_(64), 
-   busy_(false)
-{
-   InitializeDefaultErrorMessages();
-
-   // add custom error messages
-   SetErrorText(ERR_UNKNOWN_POSITION, "Invalid position (state) specified");
-   SetErrorText(ERR_INITIALIZE_FAILED, "Initialization of the device failed");
-   SetErrorText(ERR_WRITE_FAILED, "Failed to write data to the device");
-   SetErrorText(ERR_CLOSE_FAILED, "Failed closing the device");
-   SetErrorText(ERR_COMMUNICATION, "Error in communication with Arduino board");
-   SetErrorText(ERR_NO_PORT_SET, "Hub Device not found.  The Arduino Hub device is needed to create this device");
-
-   for (unsigned int i=0; i < NUMPATTERNS; i++)
-      pattern_[i] = 0;
-
-   // Description
-   int ret = CreateProperty(MM::g_Keyword_Description, "Arduino digital output driver", MM::String, true);
-   assert(DEVICE_OK == ret);
-
-   // Name
-   ret = CreateProperty(MM::g_Keyword_Name, g_DeviceNameArduinoSwitch, MM::String, true);
-   assert(DEVICE_OK == ret);
-
-   // parent ID display
-   CreateHubIDProperty();
-
-}
-
-CArduinoSwitch::~CArduinoSwitch()
-{
-   Shutdown();
-}
-
-void CArduinoSwitch::GetName(char* name) const
-{
-   CDeviceUtils::CopyLimitedString(name, g_DeviceNameArduinoSwitch);
-}
-
-
-int CArduinoSwitch::Initialize()
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable()) {
-      return ERR_NO_PORT_SET;
-   }
-   char hubLabel[MM::MaxStrLength];
-   hub->GetLabel(hubLabel);
-   SetParentID(hubLabel); // for backward comp.
-
-   // set property list
-   // -----------------
-   
-   // create positions and labels
-   const int bufSize = 65;
-   char buf[bufSize];
-   for (long i=0; i<numPos_; i++)
-   {
-      snprintf(buf, bufSize, "%d", (unsigned)i);
-      SetPositionLabel(i, buf);
-   }
-
-   // State
-   // -----
-   CPropertyAction* pAct = new CPropertyAction (this, &CArduinoSwitch::OnState);
-   int nRet = CreateProperty(MM::g_Keyword_State, "0", MM::Integer, false, pAct);
-   if (nRet != DEVICE_OK)
-      return nRet;
-   SetPropertyLimits(MM::g_Keyword_State, 0, numPos_ - 1);
-
-   // Label
-   // -----
-   pAct = new CPropertyAction (this, &CStateBase::OnLabel);
-   nRet = CreateProperty(MM::g_Keyword_Label, "", MM::String, false, pAct);
-   if (nRet != DEVICE_OK)
-      return nRet;
-
-   pAct = new CPropertyAction(this, &CArduinoSwitch::OnSequence);
-   nRet = CreateProperty("Sequence", g_On, MM::String, false, pAct);
-   if (nRet != DEVICE_OK)
-      return nRet;
-   AddAllowedValue("Sequence", g_On);
-   AddAllowedValue("Sequence", g_Off);
-
-   // Starts "blanking" mode: goal is to synchronize laser light with camera exposure
-   std::string blankMode = "Blanking Mode";
-   pAct = new CPropertyAction(this, &CArduinoSwitch::OnBlanking);
-   nRet = CreateProperty(blankMode.c_str(), "Idle", MM::String, false, pAct);
-   if (nRet != DEVICE_OK)
-      return nRet;
-   AddAllowedValue(blankMode.c_str(), g_On);
-   AddAllowedValue(blankMode.c_str(), g_Off);
-
-   // Blank on TTL high or low
-   pAct = new CPropertyAction(this, &CArduinoSwitch::OnBlankingTriggerDirection);
-   nRet = CreateProperty("Blank On", "Low", MM::String, false, pAct);
-   if (nRet != DEVICE_OK)
-      return nRet;
-   AddAllowedValue("Blank On", "Low");
-   AddAllowedValue("Blank On", "High");
-
-   /*
-   // Starts producing timed digital output patterns 
-   // Parameters that influence the pattern are 'Repeat Timed Pattern', 'Delay', 'State' where the latter two are manipulated with the Get and SetPattern functions
-   std::string timedOutput = "Timed Output Mode";
-   pAct = new CPropertyAction(this, &CArduinoSwitch::OnStartTimedOutput);
-   nRet = CreateProperty(timedOutput.c_str(), "Idle", MM::String, false, pAct);
-   if (nRet != DEVICE_OK)
-      return nRet;
-   AddAllowedValue(timedOutput.c_str(), "Stop");
-   AddAllowedValue(timedOutput.c_str(), "Start");
-   AddAllowedValue(timedOutput.c_str(), "Running");
-   AddAllowedValue(timedOutput.c_str(), "Idle");
-
-   // Sets a delay (in ms) to be used in timed output mode
-   // This delay will be transferred to the Arduino using the Get and SetPattern commands
-   pAct = new CPropertyAction(this, &CArduinoSwitch::OnDelay);
-   nRet = CreateProperty("Delay (ms)", "0", MM::Integer, false, pAct);
-   if (nRet != DEVICE_OK)
-      return nRet;
-   SetPropertyLimits("Delay (ms)", 0, 65535);
-
-   // Repeat the timed Pattern this many times:
-   pAct = new CPropertyAction(this, &CArduinoSwitch::OnRepeatTimedPattern);
-   nRet = CreateProperty("Repeat Timed Pattern", "0", MM::Integer, false, pAct);
-   if (nRet != DEVICE_OK)
-      return nRet;
-   SetPropertyLimits("Repeat Timed Pattern", 0, 255);
-   */
-
-   nRet = UpdateStatus();
-   if (nRet != DEVICE_OK)
-      return nRet;
-
-   initialized_ = true;
-
-   return DEVICE_OK;
-}
-
-int CArduinoSwitch::Shutdown()
-{
-   initialized_ = false;
-   return DEVICE_OK;
-}
-
-int CArduinoSwitch::WriteToPort(long value)
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable()) {
-      return ERR_NO_PORT_SET;
-   }
-
-   MMThreadGuard myLock(hub->GetLock());
-
-   value = 63 & value;
-   if (hub->IsLogicInverted())
-      value = ~value;
-
-   hub->PurgeComPortH();
-
-   unsigned char command[2];
-   command[0] = 1;
-   command[1] = (unsigned char) value;
-   int ret = hub->WriteToComPortH((const unsigned char*) command, 2);
-   if (ret != DEVICE_OK)
-      return ret;
-
-   MM::MMTime startTime = GetCurrentMMTime();
-   unsigned long bytesRead = 0;
-   unsigned char answer[1];
-   while ((bytesRead < 1) && ( (GetCurrentMMTime() - startTime).getMsec() < 250)) {
-      ret = hub->ReadFromComPortH(answer, 1, bytesRead);
-      if (ret != DEVICE_OK)
-         return ret;
-   }
-   if (answer[0] != 1)
-      return ERR_COMMUNICATION;
-
-   hub->SetTimedOutput(false);
-
-   return DEVICE_OK;
-}
-
-int CArduinoSwitch::LoadSequence(unsigned size, unsigned char* seq)
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable())
-      return ERR_NO_PORT_SET;
-
-   hub->PurgeComPortH();
-
-   for (unsigned i=0; i < size; i++)
-   {
-      unsigned char value = seq[i];
-
-      value = 63 & value;
-      if (hub->IsLogicInverted())
-         value = ~value;
-
-      unsigned char command[3];
-      command[0] = 5;
-      command[1] = (unsigned char) i;
-      command[2] = value;
-      int ret = hub->WriteToComPortH((const unsigned char*) command, 3);
-      if (ret != DEVICE_OK)
-         return ret;
-
-
-      MM::MMTime startTime = GetCurrentMMTime();
-      unsigned long bytesRead = 0;
-      unsigned char answer[3];
-      while ((bytesRead < 3) && ( (GetCurrentMMTime() - startTime).getMsec() < 250)) {
-         unsigned long br;
-         ret = hub->ReadFromComPortH(answer + bytesRead, 3, br);
-      if (ret != DEVICE_OK)
-         return ret;
-      bytesRead += br;
-      }
-      if (answer[0] != 5)
-         return ERR_COMMUNICATION;
-
-   }
-
-   unsigned char command[2];
-   command[0] = 6;
-   command[1] = (unsigned char) size;
-   int ret = hub->WriteToComPortH((const unsigned char*) command, 2);
-   if (ret != DEVICE_OK)
-      return ret;
-
-   MM::MMTime startTime = GetCurrentMMTime();
-   unsigned long bytesRead = 0;
-   unsigned char answer[2];
-   while ((bytesRead < 2) && ( (GetCurrentMMTime() - startTime).getMsec() < 250)) {
-      unsigned long br;
-      ret = hub->ReadFromComPortH(answer + bytesRead, 2, br);
-      if (ret != DEVICE_OK)
-         return ret;
-      bytesRead += br;
-   }
-   if (answer[0] != 6)
-      return ERR_COMMUNICATION;
-
-   return DEVICE_OK;
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// Action handlers
-///////////////////////////////////////////////////////////////////////////////
-
-int CArduinoSwitch::OnState(MM::PropertyBase* pProp, MM::ActionType eAct)
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable())
-      return ERR_NO_PORT_SET;
-
-   if (eAct == MM::BeforeGet)
-   {
-      // nothing to do, let the caller use cached property
-   }
-   else if (eAct == MM::AfterSet)
-   {
-      long pos;
-      pProp->Get(pos);
-      hub->SetSwitchState(pos);
-      if (hub->GetShutterState() > 0)
-         return WriteToPort(pos);
-   }
-   else if (eAct == MM::IsSequenceable)                                      
-   {                                                                         
-      if (sequenceOn_)                                                       
-         pProp->SetSequenceable(NUMPATTERNS);                           
-      else                                                                   
-         pProp->SetSequenceable(0);                                          
-   } 
-   else if (eAct == MM::AfterLoadSequence)                                   
-   {                                                                         
-      std::vector<std::string> sequence = pProp->GetSequence();              
-      std::ostringstream os;
-      if (sequence.size() > NUMPATTERNS)                                
-         return DEVICE_SEQUENCE_TOO_LARGE;                                   
-      unsigned char* seq = new unsigned char[sequence.size()];               
-      for (unsigned int i=0; i < sequence.size(); i++)                       
-      {
-         std::istringstream os (sequence[i]);
-         int val;
-         os >> val;
-         seq[i] = (unsigned char) val;
-      }                                                                      
-      int ret = LoadSequence((unsigned) sequence.size(), seq);
-      if (ret != DEVICE_OK)                                                  
-         return ret;                                                         
-                                                                             
-      delete[] seq;                                                          
-   }                                                                         
-   else if (eAct == MM::StartSequence)
-   { 
-      MMThreadGuard myLock(hub->GetLock());
-
-      hub->PurgeComPortH();
-      unsigned char command[1];
-      command[0] = 8;
-      int ret = hub->WriteToComPortH((const unsigned char*) command, 1);
-      if (ret != DEVICE_OK)
-         return ret;
-
-      MM::MMTime startTime = GetCurrentMMTime();
-      unsigned long bytesRead = 0;
-      unsigned char answer[1];
-      while ((bytesRead < 1) && ( (GetCurrentMMTime() - startTime).getMsec() < 250)) {
-         unsigned long br;
-         ret = hub->ReadFromComPortH(answer + bytesRead, 1, br);
-         if (ret != DEVICE_OK)
-            return ret;
-         bytesRead += br;
-      }
-      if (answer[0] != 8)
-         return ERR_COMMUNICATION;
-   }
-   else if (eAct == MM::StopSequence)                                        
-   {
-      MMThreadGuard myLock(hub->GetLock());
-
-      unsigned char command[1];
-      command[0] = 9;
-      int ret = hub->WriteToComPortH((const unsigned char*) command, 1);
-      if (ret != DEVICE_OK)
-         return ret;
-
-      MM::MMTime startTime = GetCurrentMMTime();
-      unsigned long bytesRead = 0;
-      unsigned char answer[2];
-      while ((bytesRead < 2) && ( (GetCurrentMMTime() - startTime).getMsec() < 250)) {
-         unsigned long br;
-         ret = hub->ReadFromComPortH(answer + bytesRead, 2, br);
-         if (ret != DEVICE_OK)
-            return ret;
-         bytesRead += br;
-      }
-      if (answer[0] != 9)
-         return ERR_COMMUNICATION;
-
-      std::ostringstream os;
-      os << "Sequence had " << (int) answer[1] << " transitions";
-      LogMessage(os.str().c_str(), false);
-
-   }                                                                         
-
-   return DEVICE_OK;
-}
-
-int CArduinoSwitch::OnSequence(MM::PropertyBase* pProp, MM::ActionType eAct)
-{
-   if (eAct == MM::BeforeGet)
-   {
-      if (sequenceOn_)
-         pProp->Set(g_On);
-      else
-         pProp->Set(g_Off);
-   }
-   else if (eAct == MM::AfterSet)
-   {
-      std::string state;
-      pProp->Get(state);
-      if (state == g_On)
-         sequenceOn_ = true;
-      else
-         sequenceOn_ = false;
-   }
-   return DEVICE_OK;
-}
-
-int CArduinoSwitch::OnStartTimedOutput(MM::PropertyBase* pProp, MM::ActionType eAct)
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable())
-      return ERR_NO_PORT_SET;
-
-   if (eAct == MM::BeforeGet) {
-      if (hub->IsTimedOutputActive())
-         pProp->Set("Running");
-      else
-         pProp->Set("Idle");
-   }
-   else if (eAct == MM::AfterSet)
-   {
-      MMThreadGuard myLock(hub->GetLock());
-
-      std::string prop;
-      pProp->Get(prop);
-
-      if (prop =="Start") {
-         hub->PurgeComPortH();
-         unsigned char command[1];
-         command[0] = 12;
-         int ret = hub->WriteToComPortH((const unsigned char*) command, 1);
-         if (ret != DEVICE_OK)
-            return ret;
-
-         MM::MMTime startTime = GetCurrentMMTime();
-         unsigned long bytesRead = 0;
-         unsigned char answer[1];
-         while ((bytesRead < 1) && ( (GetCurrentMMTime() - startTime).getMsec() < 250)) {
-            unsigned long br;
-            ret = hub->ReadFromComPortH(answer + bytesRead, 1, br);
-            if (ret != DEVICE_OK)
-               return ret;
-            bytesRead += br;
-         }
-         if (answer[0] != 12)
-            return ERR_COMMUNICATION;
-         hub->SetTimedOutput(true);
-      } else {
-         unsigned char command[1];
-         command[0] = 9;
-         int ret = hub->WriteToComPortH((const unsigned char*) command, 1);
-         if (ret != DEVICE_OK)
-            return ret;
-
-         MM::MMTime startTime = GetCurrentMMTime();
-         unsigned long bytesRead = 0;
-         unsigned char answer[2];
-         while ((bytesRead < 2) && ( (GetCurrentMMTime() - startTime).getMsec() < 250)) {
-            unsigned long br;
-            ret = hub->ReadFromComPortH(answer + bytesRead, 2, br);
-            if (ret != DEVICE_OK)
-               return ret;
-            bytesRead += br;
-         }
-         if (answer[0] != 9)
-            return ERR_COMMUNICATION;
-         hub->SetTimedOutput(false);
-      }
-   }
-
-   return DEVICE_OK;
-}
-
-int CArduinoSwitch::OnBlanking(MM::PropertyBase* pProp, MM::ActionType eAct)
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable())
-      return ERR_NO_PORT_SET;
-
-   if (eAct == MM::BeforeGet) {
-      if (blanking_)
-         pProp->Set(g_On);
-      else
-         pProp->Set(g_Off);
-   }
-   else if (eAct == MM::AfterSet)
-   {
-      MMThreadGuard myLock(hub->GetLock());
-
-      std::string prop;
-      pProp->Get(prop);
-
-      if (prop == g_On && !blanking_) {
-         hub->PurgeComPortH();
-         unsigned char command[1];
-         command[0] = 20;
-         int ret = hub->WriteToComPortH((const unsigned char*) command, 1);
-         if (ret != DEVICE_OK)
-            return ret;
-
-         MM::MMTime startTime = GetCurrentMMTime();
-         unsigned long bytesRead = 0;
-         unsigned char answer[1];
-         while ((bytesRead < 1) && ( (GetCurrentMMTime() - startTime).getMsec() < 250)) {
-            unsigned long br;
-            ret = hub->ReadFromComPortH(answer + bytesRead, 1, br);
-            if (ret != DEVICE_OK)
-               return ret;
-            bytesRead += br;
-         }
-         if (answer[0] != 20)
-            return ERR_COMMUNICATION;
-         blanking_ = true;
-         hub->SetTimedOutput(false);
-         LogMessage("Switched blanking on", true);
-
-      } else if (prop == g_Off && blanking_){
-         unsigned char command[1];
-         command[0] = 21;
-         int ret = hub->WriteToComPortH((const unsigned char*) command, 1);
-         if (ret != DEVICE_OK)
-            return ret;
-
-         MM::MMTime startTime = GetCurrentMMTime();
-         unsigned long bytesRead = 0;
-         unsigned char answer[2];
-         while ((bytesRead < 2) && ( (GetCurrentMMTime() - startTime).getMsec() < 250)) {
-            unsigned long br;
-            ret = hub->ReadFromComPortH(answer + bytesRead, 2, br);
-            if (ret != DEVICE_OK)
-               return ret;
-            bytesRead += br;
-         }
-         if (answer[0] != 21)
-            return ERR_COMMUNICATION;
-         blanking_ = false;
-         hub->SetTimedOutput(false);
-         LogMessage("Switched blanking off", true);
-      }
-   }
-
-   return DEVICE_OK;
-}
-
-int CArduinoSwitch::OnBlankingTriggerDirection(MM::PropertyBase* pProp, MM::ActionType eAct)
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable())
-      return ERR_NO_PORT_SET;
-
-   if (eAct == MM::BeforeGet) {
-      // nothing to do, let the caller use cached property
-   }
-   else if (eAct == MM::AfterSet)
-   {
-      MMThreadGuard myLock(hub->GetLock());
-
-      std::string direction;
-      pProp->Get(direction);
-
-      hub->PurgeComPortH();
-      unsigned char command[2];
-      command[0] = 22;
-      if (direction == "Low") 
-         command[1] = 1;
-      else
-         command[1] = 0;
-
-      int ret = hub->WriteToComPortH((const unsigned char*) command, 2);
-      if (ret != DEVICE_OK)
-         return ret;
-
-      MM::MMTime startTime = GetCurrentMMTime();
-      unsigned long bytesRead = 0;
-      unsigned char answer[1];
-      while ((bytesRead < 1) && ( (GetCurrentMMTime() - startTime).getMsec() < 250)) {
-         unsigned long br;
-         ret = hub->ReadFromComPortH(answer + bytesRead, 1, br);
-         if (ret != DEVICE_OK)
-            return ret;
-         bytesRead += br;
-      }
-      if (answer[0] != 22)
-         return ERR_COMMUNICATION;
-
-   }
-
-   return DEVICE_OK;
-}
-
-int CArduinoSwitch::OnDelay(MM::PropertyBase* pProp, MM::ActionType eAct)
-{
-   if (eAct == MM::BeforeGet) {
-      pProp->Set((long int)currentDelay_);
-   }
-   else if (eAct == MM::AfterSet)
-   {
-      long prop;
-      pProp->Get(prop);
-      currentDelay_ = (int) prop;
-   }
-
-   return DEVICE_OK;
-}
-
-int CArduinoSwitch::OnRepeatTimedPattern(MM::PropertyBase* pProp, MM::ActionType eAct)
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable())
-      return ERR_NO_PORT_SET;
-
-   if (eAct == MM::BeforeGet) {
-   }
-   else if (eAct == MM::AfterSet)
-   {
-      MMThreadGuard myLock(hub->GetLock());
-
-      long prop;
-      pProp->Get(prop);
-
-      hub->PurgeComPortH();
-      unsigned char command[2];
-      command[0] = 11;
-      command[1] = (unsigned char) prop;
-
-      int ret = hub->WriteToComPortH((const unsigned char*) command, 2);
-      if (ret != DEVICE_OK)
-         return ret;
-
-      MM::MMTime startTime = GetCurrentMMTime();
-      unsigned long bytesRead = 0;
-      unsigned char answer[2];
-      while ((bytesRead < 2) && ( (GetCurrentMMTime() - startTime).getMsec() < 250)) {
-         unsigned long br;
-         ret = hub->ReadFromComPortH(answer + bytesRead, 2, br);
-         if (ret != DEVICE_OK)
-            return ret;
-         bytesRead += br;
-      }
-      if (answer[0] != 11)
-         return ERR_COMMUNICATION;
-
-      hub->SetTimedOutput(false);
-   }
-
-   return DEVICE_OK;
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// CArduinoDA implementation
-// ~~~~~~~~~~~~~~~~~~~~~~
-
-CArduinoDA::CArduinoDA(int channel) :
-      busy_(false), 
-      minV_(0.0), 
-      maxV_(5.0), 
-      volts_(0.0),
-      gatedVolts_(0.0),
-      channel_(channel), 
-      maxChannel_(2),
-      gateOpen_(true)
-{
-   InitializeDefaultErrorMessages();
-
-   // add custom error messages
-   SetErrorText(ERR_UNKNOWN_POSITION, "Invalid position (state) specified");
-   SetErrorText(ERR_INITIALIZE_FAILED, "Initialization of the device failed");
-   SetErrorText(ERR_WRITE_FAILED, "Failed to write data to the device");
-   SetErrorText(ERR_CLOSE_FAILED, "Failed closing the device");
-   SetErrorText(ERR_NO_PORT_SET, "Hub Device not found.  The Arduino Hub device is needed to create this device");
-
-   /* Channel property is not needed
-   CPropertyAction* pAct = new CPropertyAction(this, &CArduinoDA::OnChannel);
-   CreateProperty("Channel", channel_ == 1 ? "1" : "2", MM::Integer, false, pAct, true);
-   for (int i=1; i<= 2; i++){
-      std::ostringstream os;
-      os << i;
-      AddAllowedValue("Channel", os.str().c_str());
-   }
-   */
-
-   CPropertyAction* pAct = new CPropertyAction(this, &CArduinoDA::OnMaxVolt);
-   CreateProperty("MaxVolt", "5.0", MM::Float, false, pAct, true);
-
-   name_ = channel_ == 1 ? g_DeviceNameArduinoDA1 : g_DeviceNameArduinoDA2;
-
-   // Description
-   int nRet = CreateProperty(MM::g_Keyword_Description, "Arduino DAC driver", MM::String, true);
-   assert(DEVICE_OK == nRet);
-
-   // Name
-   nRet = CreateProperty(MM::g_Keyword_Name, name_.c_str(), MM::String, true);
-   assert(DEVICE_OK == nRet);
-
-   // parent ID display
-   CreateHubIDProperty();
-}
-
-CArduinoDA::~CArduinoDA()
-{
-   Shutdown();
-}
-
-void CArduinoDA::GetName(char* name) const
-{
-   CDeviceUtils::CopyLimitedString(name, name_.c_str());
-}
-
-
-int CArduinoDA::Initialize()
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable()) {
-      return ERR_NO_PORT_SET;
-   }
-   char hubLabel[MM::MaxStrLength];
-   hub->GetLabel(hubLabel);
-   SetParentID(hubLabel); // for backward comp.
-
-   // set property list
-   // -----------------
-   
-   // State
-   // -----
-   CPropertyAction* pAct = new CPropertyAction (this, &CArduinoDA::OnVolts);
-   int nRet = CreateProperty("Volts", "0.0", MM::Float, false, pAct);
-   if (nRet != DEVICE_OK)
-      return nRet;
-   SetPropertyLimits("Volts", minV_, maxV_);
-
-   nRet = UpdateStatus();
-   if (nRet != DEVICE_OK)
-      return nRet;
-
-   initialized_ = true;
-
-   return DEVICE_OK;
-}
-
-int CArduinoDA::Shutdown()
-{
-   initialized_ = false;
-   return DEVICE_OK;
-}
-
-int CArduinoDA::WriteToPort(unsigned long value)
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable())
-      return ERR_NO_PORT_SET;
-
-   MMThreadGuard myLock(hub->GetLock());
-
-   hub->PurgeComPortH();
-
-   unsigned char command[4];
-   command[0] = 3;
-   command[1] = (unsigned char) (channel_ -1);
-   command[2] = (unsigned char) (value / 256L);
-   command[3] = (unsigned char) (value & 255);
-   int ret = hub->WriteToComPortH((const unsigned char*) command, 4);
-   if (ret != DEVICE_OK)
-      return ret;
-
-   MM::MMTime startTime = GetCurrentMMTime();
-   unsigned long bytesRead = 0;
-   unsigned char answer[4];
-   while ((bytesRead < 4) && ( (GetCurrentMMTime() - startTime).getMsec() < 2500)) {
-      unsigned long bR;
-      ret = hub->ReadFromComPortH(answer + bytesRead, 4 - bytesRead, bR);
-      if (ret != DEVICE_OK)
-         return ret;
-      bytesRead += bR;
-   }
-   if (answer[0] != 3)
-      return ERR_COMMUNICATION;
-
-   hub->SetTimedOutput(false);
-
-   return DEVICE_OK;
-}
-
-
-int CArduinoDA::WriteSignal(double volts)
-{
-   long value = (long) ( (volts - minV_) / maxV_ * 4095);
-
-   std::ostringstream os;
-    os << "Volts: " << volts << " Max Voltage: " << maxV_ << " digital value: " << value;
-    LogMessage(os.str().c_str(), true);
-
-   return WriteToPort(value);
-}
-
-int CArduinoDA::SetSignal(double volts)
-{
-   volts_ = volts;
-   if (gateOpen_) {
-      gatedVolts_ = volts_;
-      return WriteSignal(volts_);
-   } else {
-      gatedVolts_ = 0;
-   }
-
-   return DEVICE_OK;
-}
-
-int CArduinoDA::SetGateOpen(bool open)
-{
-   if (open) {
-      gateOpen_ = true;
-      gatedVolts_ = volts_;
-      return WriteSignal(volts_);
-   } 
-   gateOpen_ = false;
-   gatedVolts_ = 0;
-   return WriteSignal(0.0);
-
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// Action handlers
-///////////////////////////////////////////////////////////////////////////////
-
-int CArduinoDA::OnVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
-{
-   if (eAct == MM::BeforeGet)
-   {
-      // nothing to do, let the caller use cached property
-   }
-   else if (eAct == MM::AfterSet)
-   {
-      double volts;
-      pProp->Get(volts);
-      return SetSignal(volts);
-   }
-
-   return DEVICE_OK;
-}
-
-int CArduinoDA::OnMaxVolt(MM::PropertyBase* pProp, MM::ActionType eAct)
-{
-   if (eAct == MM::BeforeGet)
-   {
-      pProp->Set(maxV_);
-   }
-   else if (eAct == MM::AfterSet)
-   {
-      pProp->Get(maxV_);
-      if (HasProperty("Volts"))
-         SetPropertyLimits("Volts", 0.0, maxV_);
-
-   }
-   return DEVICE_OK;
-}
-
-int CArduinoDA::OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct)
-{
-   if (eAct == MM::BeforeGet)
-   {
-      pProp->Set((long int)channel_);
-   }
-   else if (eAct == MM::AfterSet)
-   {
-      long channel;
-      pProp->Get(channel);
-      if (channel >=1 && ( (unsigned) channel <=maxChannel_) )
-         channel_ = channel;
-   }
-   return DEVICE_OK;
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// CArduinoShutter implementation
-// ~~~~~~~~~~~~~~~~~~~~~~~~~~~
-
-CArduinoShutter::CArduinoShutter() : initialized_(false), name_(g_DeviceNameArduinoShutter)
-{
-   InitializeDefaultErrorMessages();
-   EnableDelay();
-
-   SetErrorText(ERR_NO_PORT_SET, "Hub Device not found.  The Arduino Hub device is needed to create this device");
-
-   // Name
-   int ret = CreateProperty(MM::g_Keyword_Name, g_DeviceNameArduinoShutter, MM::String, true);
-   assert(DEVICE_OK == ret);
-
-   // Description
-   ret = CreateProperty(MM::g_Keyword_Description, "Arduino shutter driver", MM::String, true);
-   assert(DEVICE_OK == ret);
-
-   // parent ID display
-   CreateHubIDProperty();
-}
-
-CArduinoShutter::~CArduinoShutter()
-{
-   Shutdown();
-}
-
-void CArduinoShutter::GetName(char* name) const
-{
-   CDeviceUtils::CopyLimitedString(name, g_DeviceNameArduinoShutter);
-}
-
-bool CArduinoShutter::Busy()
-{
-   MM::MMTime interval = GetCurrentMMTime() - changedTime_;
-
-   if (interval < (1000.0 * GetDelayMs() ))
-      return true;
-   else
-       return false;
-}
-
-int CArduinoShutter::Initialize()
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable()) {
-      return ERR_NO_PORT_SET;
-   }
-   char hubLabel[MM::MaxStrLength];
-   hub->GetLabel(hubLabel);
-   SetParentID(hubLabel); // for backward comp.
-
-   // set property list
-   // -----------------
-   
-   // OnOff
-   // ------
-   CPropertyAction* pAct = new CPropertyAction (this, &CArduinoShutter::OnOnOff);
-   int ret = CreateProperty("OnOff", "0", MM::Integer, false, pAct);
-   if (ret != DEVICE_OK)
-      return ret;
-
-   // set shutter into the off state
-   //WriteToPort(0);
-
-   std::vector<std::string> vals;
-   vals.push_back("0");
-   vals.push_back("1");
-   ret = SetAllowedValues("OnOff", vals);
-   if (ret != DEVICE_OK)
-      return ret;
-
-   ret = UpdateStatus();
-   if (ret != DEVICE_OK)
-      return ret;
-
-   changedTime_ = GetCurrentMMTime();
-   initialized_ = true;
-
-   return DEVICE_OK;
-}
-
-int CArduinoShutter::Shutdown()
-{
-   if (initialized_)
-   {
-      initialized_ = false;
-   }
-   return DEVICE_OK;
-}
-
-int CArduinoShutter::SetOpen(bool open)
-{
-	std::ostringstream os;
-	os << "Request " << open;
-	LogMessage(os.str().c_str(), true);
-
-   if (open)
-      return SetProperty("OnOff", "1");
-   else
-      return SetProperty("OnOff", "0");
-}
-
-int CArduinoShutter::GetOpen(bool& open)
-{
-   char buf[MM::MaxStrLength];
-   int ret = GetProperty("OnOff", buf);
-   if (ret != DEVICE_OK)
-      return ret;
-   long pos = atol(buf);
-   pos > 0 ? open = true : open = false;
-
-   return DEVICE_OK;
-}
-
-int CArduinoShutter::Fire(double /*deltaT*/)
-{
-   return DEVICE_UNSUPPORTED_COMMAND;
-}
-
-int CArduinoShutter::WriteToPort(long value)
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable())
-      return ERR_NO_PORT_SET;
-
-   MMThreadGuard myLock(hub->GetLock());
-
-   value = 63 & value;
-   if (hub->IsLogicInverted())
-      value = ~value;
-
-   hub->PurgeComPortH();
-
-   unsigned char command[2];
-   command[0] = 1;
-   command[1] = (unsigned char) value;
-   int ret = hub->WriteToComPortH((const unsigned char*) command, 2);
-   if (ret != DEVICE_OK)
-      return ret;
-
-   MM::MMTime startTime = GetCurrentMMTime();
-   unsigned long bytesRead = 0;
-   unsigned char answer[1];
-   while ((bytesRead < 1) && ( (GetCurrentMMTime() - startTime).getMsec() < 250)) {
-      ret = hub->ReadFromComPortH(answer, 1, bytesRead);
-      if (ret != DEVICE_OK)
-         return ret;
-   }
-   if (answer[0] != 1)
-      return ERR_COMMUNICATION;
-
-   hub->SetTimedOutput(false);
-
-   return DEVICE_OK;
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// Action handlers
-///////////////////////////////////////////////////////////////////////////////
-
-int CArduinoShutter::OnOnOff(MM::PropertyBase* pProp, MM::ActionType eAct)
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (eAct == MM::BeforeGet)
-   {
-      // use cached state
-      pProp->Set((long)hub->GetShutterState());
-   }
-   else if (eAct == MM::AfterSet)
-   {
-      long pos;
-      pProp->Get(pos);
-      int ret;
-      if (pos == 0)
-         ret = WriteToPort(0); // turn everything off
-      else
-         ret = WriteToPort(hub->GetSwitchState()); // restore old setting
-      if (ret != DEVICE_OK)
-         return ret;
-      hub->SetShutterState(pos);
-      changedTime_ = GetCurrentMMTime();
-   }
-
-   return DEVICE_OK;
-}
-
-
-/*
- * Arduino input.  Can either be for all pins (0-6)
- * or for an individual pin only
- */
-
-CArduinoInput::CArduinoInput() :
-   mThread_(0),
-   pin_(0),
-   name_(g_DeviceNameArduinoInput)
-{
-   std::string errorText = "To use the Input function you need firmware version 2 or higher";
-   SetErrorText(ERR_VERSION_MISMATCH, errorText.c_str());
-
-   CreateProperty("Pin", "All", MM::String, false, 0, true);
-   AddAllowedValue("Pin", "All");
-   AddAllowedValue("Pin", "0");
-   AddAllowedValue("Pin", "1");
-   AddAllowedValue("Pin", "2");
-   AddAllowedValue("Pin", "3");
-   AddAllowedValue("Pin", "4");
-   AddAllowedValue("Pin", "5");
-
-   CreateProperty("Pull-Up-Resistor", g_On, MM::String, false, 0, true);
-   AddAllowedValue("Pull-Up-Resistor", g_On);
-   AddAllowedValue("Pull-Up-Resistor", g_Off);
-
-   // Name
-   int ret = CreateProperty(MM::g_Keyword_Name, name_.c_str(), MM::String, true);
-   assert(DEVICE_OK == ret);
-
-   // Description
-   ret = CreateProperty(MM::g_Keyword_Description, "Arduino shutter driver", MM::String, true);
-   assert(DEVICE_OK == ret);
-
-   // parent ID display
-   CreateHubIDProperty();
-}
-
-CArduinoInput::~CArduinoInput()
-{
-   Shutdown();
-}
-
-int CArduinoInput::Shutdown()
-{
-   if (initialized_)
-      delete(mThread_);
-   initialized_ = false;
-   return DEVICE_OK;
-}
-
-int CArduinoInput::Initialize()
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable()) {
-      return ERR_NO_PORT_SET;
-   }
-   char hubLabel[MM::MaxStrLength];
-   hub->GetLabel(hubLabel);
-   SetParentID(hubLabel); // for backward comp.
-
-   char ver[MM::MaxStrLength] = "0";
-   hub->GetProperty(g_versionProp, ver);
-   int version = atoi(ver);
-   if (version < 2)
-      return ERR_VERSION_MISMATCH;
-
-   int ret = GetProperty("Pin", pins_);
-   if (ret != DEVICE_OK)
-      return ret;
-   if (strcmp("All", pins_) != 0)
-      pin_ = atoi(pins_); 
-
-   ret = GetProperty("Pull-Up-Resistor", pullUp_);
-   if (ret != DEVICE_OK)
-      return ret;
- 
-   // Digital Input
-   CPropertyAction* pAct = new CPropertyAction (this, &CArduinoInput::OnDigitalInput);
-   ret = CreateProperty("DigitalInput", "0", MM::Integer, true, pAct);
-   if (ret != DEVICE_OK)
-      return ret;
-
-   int start = 0;
-   int end = 5;
-   if (strcmp("All", pins_) != 0) {
-      start = pin_;
-      end = pin_;
-   }
-
-   for (long i=start; i <=end; i++) 
-   {
-      CPropertyActionEx *pExAct = new CPropertyActionEx(this, &CArduinoInput::OnAnalogInput, i);
-      std::ostringstream os;
-      os << "AnalogInput" << i;
-      ret = CreateProperty(os.str().c_str(), "0.0", MM::Float, true, pExAct);
-      if (ret != DEVICE_OK)
-         return ret;
-      // set pull up resistor state for this pin
-      if (strcmp(g_On, pullUp_) == 0) {
-         SetPullUp(i, 1);
-      } else {
-         SetPullUp(i, 0);
-      }
-
-   }
-
-   mThread_ = new ArduinoInputMonitorThread(*this);
-   mThread_->Start();
-
-   initialized_ = true;
-
-   return DEVICE_OK;
-}
-
-void CArduinoInput::GetName(char* name) const
-{
-  CDeviceUtils::CopyLimitedString(name, name_.c_str());
-}
-
-bool CArduinoInput::Busy()
-{
-   return false;
-}
-
-int CArduinoInput::GetDigitalInput(long* state)
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable())
-      return ERR_NO_PORT_SET;
-
-   MMThreadGuard myLock(hub->GetLock());
-
-   unsigned char command[1];
-   command[0] = 40;
-
-   int ret = hub->WriteToComPortH((const unsigned char*) command, 1);
-   if (ret != DEVICE_OK)
-      return ret;
-
-   unsigned char answer[2];
-   ret = ReadNBytes(hub, 2, answer);
-   if (ret != DEVICE_OK)
-      return ret;
-
-   if (answer[0] != 40)
-      return ERR_COMMUNICATION;
-
-   if (strcmp("All", pins_) != 0) {
-      answer[1] = answer[1] >> pin_;
-      answer[1] &= answer[1] & 1;
-   }
-   
-   *state = (long) answer[1];
-
-   return DEVICE_OK;
-}
-
-int CArduinoInput::ReportStateChange(long newState)
-{
-   std::ostringstream os;
-   os << newState;
-   return OnPropertyChanged("DigitalInput", os.str().c_str());
-}
-
-
-///////////////////////////////////////////////////////////////////////////////
-// Action handlers
-///////////////////////////////////////////////////////////////////////////////
-
-int CArduinoInput::OnDigitalInput(MM::PropertyBase*  pProp, MM::ActionType eAct)
-{
-   if (eAct == MM::BeforeGet)
-   {
-      long state;
-      int ret = GetDigitalInput(&state);
-      if (ret != DEVICE_OK)
-         return ret;
-
-      pProp->Set(state);
-   }
-
-   return DEVICE_OK;
-}
-
-int CArduinoInput::OnAnalogInput(MM::PropertyBase* pProp, MM::ActionType eAct, long  channel )
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable())
-      return ERR_NO_PORT_SET;
-
-   if (eAct == MM::BeforeGet)
-   {
-      MMThreadGuard myLock(hub->GetLock());
-
-      unsigned char command[2];
-      command[0] = 41;
-      command[1] = (unsigned char) channel;
-
-      int ret = hub->WriteToComPortH((const unsigned char*) command, 2);
-      if (ret != DEVICE_OK)
-         return ret;
-
-      unsigned char answer[4];
-      ret = ReadNBytes(hub, 4, answer);
-      if (ret != DEVICE_OK)
-         return ret;
-
-      if (answer[0] != 41)
-         return ERR_COMMUNICATION;
-      if (answer[1] != channel)
-         return ERR_COMMUNICATION;
-
-      int tmp = answer[2];
-      tmp = tmp << 8;
-      tmp = tmp | answer[3];
-
-      pProp->Set((long) tmp);
-   }
-   return DEVICE_OK;
-}
-
-int CArduinoInput::SetPullUp(int pin, int state)
-{
-   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable())
-      return ERR_NO_PORT_SET;
-
-   MMThreadGuard myLock(hub->GetLock());
-
-   const int nrChrs = 3;
-   unsigned char command[nrChrs];
-   command[0] = 42;
-   command[1] = (unsigned char) pin;
-   command[2] = (unsigned char) state;
-
-   int ret = hub->WriteToComPortH((const unsigned char*) command, nrChrs);
-   if (ret != DEVICE_OK)
-      return ret;
-
-   unsigned char answer[3];
-   ret = ReadNBytes(hub, 3, answer);
-   if (ret != DEVICE_OK)
-      return ret;
-
-   if (answer[0] != 42)
-      return ERR_COMMUNICATION;
-   if (answer[1] != pin)
-      return ERR_COMMUNICATION;
-
-   return DEVICE_OK;
-}
-
-
-int CArduinoInput::ReadNBytes(CArduinoHub* hub, unsigned int n, unsigned char* answer)
-{
-   MM::MMTime startTime = GetCurrentMMTime();
-   unsigned long bytesRead = 0;
-   while ((bytesRead < n) && ( (GetCurrentMMTime() - startTime).getMsec() < 500)) {
-      unsigned long bR;
-      int ret = hub->ReadFromComPortH(answer + bytesRead, n - bytesRead, bR);
-      if (ret != DEVICE_OK)
-         return ret;
-      bytesRead += bR;
-   }
-
-   return DEVICE_OK;
-}
-
-ArduinoInputMonitorThread::ArduinoInputMonitorThread(CArduinoInput& aInput) :
-   state_(0),
-   aInput_(aInput)
-{
-}
-
-ArduinoInputMonitorThread::~ArduinoInputMonitorThread()
-{
-   Stop();
-   wait();
-}
-
-int ArduinoInputMonitorThread::svc() 
-{
-   while (!stop_)
-   {
-      long state;
-      int ret = aInput_.GetDigitalInput(&state);
-      if (ret != DEVICE_OK)
-      {
-         stop_ = true;
-         return ret;
-      }
-
-      if (state != state_) 
-      {
-         aInput_.ReportStateChange(state);
-         state_ = state;
-      }
-      CDeviceUtils::SleepMs(500);
-   }
-   return DEVICE_OK;
-}
-
-
-void ArduinoInputMonitorThread::Start()
-{
-   stop_ = false;
-   activate();
-}
-
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          Arduino.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Arduino adapter.  Needs accompanying firmware
+// COPYRIGHT:     University of California, San Francisco, 2008
+// LICENSE:       LGPL
+// 
+// AUTHOR:        Nico Stuurman, nico@cmp.ucsf.edu 11/09/2008
+//                automatic device detection by Karl Hoover
+//
+//
+
+#include "Arduino.h"
+#include "ArduinoFilterWheel.h"
+#include "../../MMDevice/ModuleInterface.h"
+#include <sstream>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#ifdef WIN32
+   #define WIN32_LEAN_AND_MEAN
+   #include <windows.h>
+   #define snprintf _snprintf 
+#endif
+
+const char* g_DeviceNameArduinoHub = "Arduino-Hub";
+const char* g_DeviceNameArduinoSwitch = "Arduino-Switch";
+const char* g_DeviceNameArduinoShutter = "Arduino-Shutter";
+const char* g_DeviceNameArduinoDA1 = "Arduino-DAC1";
+const char* g_DeviceNameArduinoDA2 = "Arduino-DAC2";
+const char* g_DeviceNameArduinoInput = "Arduino-Input";
+const char* g_DeviceNameArduinoChannel = "Arduino-Channel";
+const char* g_DeviceNameArduinoFilterWheel = "Arduino-FilterWheel";
+
+
+// Global info about the state of the Arduino.  This should be folded into a class
+const int g_Min_MMVersion = 1;
+const int g_Max_MMVersion = 3;
+// from this version on the board also drives the filter wheel and every
+// command carries a sequence byte that is echoed in its reply
+const int g_Tagged_MMVersion = 3;
+// longest command or reply, including the sequence byte and crc
+const unsigned g_MaxFrame = ArduinoProtocol::MaxFrame;
+// rates the firmware can switch to, the board starts at the first one
+const long g_BaudRates[] = {57600, 115200, 250000, 500000};
+const unsigned g_NumBaudRates = sizeof(g_BaudRates) / sizeof(g_BaudRates[0]);
+// the board drops an unconfirmed rate after this long (baudCheckMs_)
+const long g_BaudCheckMs = 1000;
+// commands in a row that fail before the link moves to a lower rate
+const long g_FailuresToStepDown = 3;
+const unsigned g_LoopbackRounds = 4;
+const char* g_versionProp = "Version";
+const char* g_normalLogicString = "Normal";
+const char* g_invertedLogicString = "Inverted";
+
+const char* g_On = "On";
+const char* g_Off = "Off";
+
+// a preset that moves the wheel takes at most one turn
+const long g_PresetMoveTimeoutMs = 10000;
+
+// static lock
+MMThreadLock CArduinoHub::lock_;
+ArduinoSleepSource* CArduinoHub::sleepSource_ = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+// Exported MMDevice API
+///////////////////////////////////////////////////////////////////////////////
+MODULE_API void InitializeModuleData()
+{
+   RegisterDevice(g_DeviceNameArduinoHub, MM::HubDevice, "Hub (required)");
+   RegisterDevice(g_DeviceNameArduinoSwitch, MM::StateDevice, "Digital out 8-bit");
+   RegisterDevice(g_DeviceNameArduinoShutter, MM::ShutterDevice, "Shutter");
+   RegisterDevice(g_DeviceNameArduinoDA1, MM::SignalIODevice, "DAC channel 1");
+   RegisterDevice(g_DeviceNameArduinoDA2, MM::SignalIODevice, "DAC channel 2");
+   RegisterDevice(g_DeviceNameArduinoInput, MM::GenericDevice, "ADC");
+   RegisterDevice(g_DeviceNameArduinoChannel, MM::StateDevice, "Channel presets (wheel, outputs and DACs in one command)");
+   RegisterDevice(g_DeviceNameArduinoFilterWheel, MM::StateDevice, "Filter Wheel");
+}
+
+MODULE_API MM::Device* CreateDevice(const char* deviceName)
+{
+   if (deviceName == 0)
+      return 0;
+
+   if (strcmp(deviceName, g_DeviceNameArduinoHub) == 0)
+   {
+      return new CArduinoHub;
+   }
+   else if (strcmp(deviceName, g_DeviceNameArduinoSwitch) == 0)
+   {
+      return new CArduinoSwitch;
+   }
+   else if (strcmp(deviceName, g_DeviceNameArduinoShutter) == 0)
+   {
+      return new CArduinoShutter;
+   }
+   else if (strcmp(deviceName, g_DeviceNameArduinoDA1) == 0)
+   {
+      return new CArduinoDA(1); // channel 1
+   }
+   else if (strcmp(deviceName, g_DeviceNameArduinoDA2) == 0)
+   {
+      return new CArduinoDA(2); // channel 2
+   }
+   else if (strcmp(deviceName, g_DeviceNameArduinoInput) == 0)
+   {
+      return new CArduinoInput;
+   }
+   else if (strcmp(deviceName, g_DeviceNameArduinoChannel) == 0)
+   {
+      return new CArduinoChannel;
+   }
+   else if (strcmp(deviceName, g_DeviceNameArduinoFilterWheel) == 0)
+   {
+      return new CArduinoFilterWheel;
+   }
+
+   return 0;
+}
+
+MODULE_API void DeleteDevice(MM::Device* pDevice)
+{
+   delete pDevice;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CArduinoHUb implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+CArduinoHub::CArduinoHub() :
+   initialized_ (false),
+   version_ (0),
+   maxBaud_ (500000),
+   baud_ (57600),
+   switchState_ (0),
+   shutterState_ (0),
+   seq_ (0),
+   stateCacheOn_ (true),
+   skippedWrites_ (0),
+   retries_ (2),
+   retryBudgetMs_ (100),
+   retriedCommands_ (0),
+   failedCommands_ (0),
+   changingBaud_ (false),
+   rttSlots_ (0),
+   adaptiveTimeouts_ (true),
+   timeoutMarginMs_ (10),
+   minTimeoutMs_ (10),
+   maxTimeoutMs_ (2500),
+   dacSyncWindowMs_ (0),
+   flushingDAC_ (false),
+   trafficLogLimitMB_ (100)
+{
+   for (unsigned i = 0; i < NUMDACS; i++)
+   {
+      dacPending_[i] = false;
+      pendingDAC_[i] = 0;
+      dacError_[i] = DEVICE_OK;
+      dacMaxVolts_[i] = 5.0;
+   }
+   portAvailable_ = false;
+   invertedLogic_ = false;
+   timedOutputActive_ = false;
+   InvalidateStateCache();
+   memset(rttSlot_, 0, sizeof(rttSlot_));
+   ResetRoundTrips();
+
+   InitializeDefaultErrorMessages();
+
+   SetErrorText(ERR_PORT_OPEN_FAILED, "Failed opening Arduino USB device");
+   SetErrorText(ERR_BOARD_NOT_FOUND, "Did not find an Arduino board with the correct firmware.  Is the Arduino board connected to this serial port?");
+   SetErrorText(ERR_NO_PORT_SET, "Hub Device not found.  The Arduino Hub device is needed to create this device");
+   std::ostringstream errorText;
+   errorText << "The firmware version on the Arduino is not compatible with this adapter.  Please use firmware version ";
+   errorText <<  g_Min_MMVersion << " to " << g_Max_MMVersion;
+   SetErrorText(ERR_VERSION_MISMATCH, errorText.str().c_str());
+   SetErrorText(ERR_TRAFFIC_LOG, "Could not open the traffic log file");
+
+   CPropertyAction* pAct = new CPropertyAction(this, &CArduinoHub::OnPort);
+   CreateProperty(MM::g_Keyword_Port, "Undefined", MM::String, false, pAct, true);
+
+   pAct = new CPropertyAction(this, &CArduinoHub::OnLogic);
+   CreateProperty("Logic", g_invertedLogicString, MM::String, false, pAct, true);
+
+   AddAllowedValue("Logic", g_invertedLogicString);
+   AddAllowedValue("Logic", g_normalLogicString);
+
+   // firmware version 3 negotiates the fastest rate up to this one
+   pAct = new CPropertyAction(this, &CArduinoHub::OnMaxBaudRate);
+   CreateProperty("Maximum Baud Rate", "500000", MM::Integer, false, pAct, true);
+   for (unsigned i = 0; i < g_NumBaudRates; i++)
+   {
+      std::ostringstream os;
+      os << g_BaudRates[i];
+      AddAllowedValue("Maximum Baud Rate", os.str().c_str());
+   }
+
+   // a file that gets every byte to and from the board, for replay
+   pAct = new CPropertyAction(this, &CArduinoHub::OnTrafficLog);
+   CreateProperty("Traffic Log", "", MM::String, false, pAct, true);
+
+   // a full log moves to <Traffic Log>.1, 0 lets it grow without limit
+   pAct = new CPropertyAction(this, &CArduinoHub::OnTrafficLogLimit);
+   CreateProperty("Traffic Log Limit (MB)", "100", MM::Integer, false, pAct, true);
+   SetPropertyLimits("Traffic Log Limit (MB)", 0, 10000);
+}
+
+CArduinoHub::~CArduinoHub()
+{
+   Shutdown();
+}
+
+void CArduinoHub::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_DeviceNameArduinoHub);
+}
+
+bool CArduinoHub::Busy()
+{
+   return false;
+}
+
+// private and expects caller to:
+// 1. guard the port
+// 2. purge the port
+int CArduinoHub::GetControllerVersion(int& version)
+{
+   int ret = DEVICE_OK;
+   unsigned char command[1];
+   command[0] = ArduinoProtocol::Identify::opcode;
+   version = 0;
+
+   ret = WriteToComPortH((const unsigned char*) command, 1);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   std::string answer;
+   ret = GetSerialAnswer(port_.c_str(), "\r\n", answer);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (trafficLog_.IsOpen())
+   {
+      std::string line = answer + "\r\n";
+      RecordTraffic(ArduinoTrafficRecord::Received, (const unsigned char*) line.c_str(), (unsigned long) line.size());
+   }
+
+   if (answer != "MM-Ard")
+      return ERR_BOARD_NOT_FOUND;
+
+   // Check version number of the Arduino
+   command[0] = ArduinoProtocol::Version::opcode;
+   ret = WriteToComPortH((const unsigned char*) command, 1);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   std::string ans;
+   ret = GetSerialAnswer(port_.c_str(), "\r\n", ans);
+   if (ret != DEVICE_OK) {
+         return ret;
+   }
+   if (trafficLog_.IsOpen())
+   {
+      std::string line = ans + "\r\n";
+      RecordTraffic(ArduinoTrafficRecord::Received, (const unsigned char*) line.c_str(), (unsigned long) line.size());
+   }
+   std::istringstream is(ans);
+   is >> version;
+
+   return ret;
+
+}
+
+// Sends a command and reads its reply.  Every reply starts with the opcode
+// of the command it answers, so bytes left over from earlier commands (late
+// replies, pushed data) are dropped until the opcode shows up.  With
+// firmware version 3 the hub adds a sequence byte after the opcode, which
+// the reply has to echo as well, and a crc of the frame at its end; callers
+// never see either.  Older firmware
+// has no sequence byte, and a late reply to an earlier command with the
+// same opcode would pass for the current one, so the port is purged before
+// an untagged command goes out, as it always was.
+//
+// A tagged command waits for its reply as long as ReplyTimeoutMs() says,
+// at most timeoutMs.  Without a complete reply it is sent again with the
+// same sequence byte, up to retries_ times and for at most retryBudgetMs_
+// on top of the first timeout, each time waiting up to twice as long.  A
+// reply that fails its crc counts as lost.  The board runs a command
+// only once per sequence byte and answers a repeat with the reply it sent
+// before, so a retry is safe whether the command or its reply got lost.
+// Before each retry the hub waits until the board has thrown away what it
+// got of the frame, and purges the port.
+// Caller must hold the lock.
+int CArduinoHub::SendCommand(const unsigned char* command, unsigned len,
+      unsigned char* answer, unsigned answerLen, long timeoutMs)
+{
+   // a DAC write still waiting for its partner goes out first
+   if (!flushingDAC_ && (dacPending_[0] || dacPending_[1]))
+   {
+      int ret = FlushDAC();
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+
+   bool tagged = version_ >= g_Tagged_MMVersion && ArduinoProtocol::isTagged(command[0]);
+   unsigned tagLen = tagged ? 1 : 0;
+   // seq and crc
+   unsigned extraLen = tagged ? ArduinoProtocol::TagBytes - 1 : 0;
+   if (len + extraLen > g_MaxFrame || answerLen + extraLen > g_MaxFrame)
+      return ERR_COMMUNICATION;
+
+   unsigned char request[g_MaxFrame];
+   request[0] = command[0];
+   if (tagged)
+   {
+      seq_ = (unsigned char) (seq_ % 255 + 1);
+      request[1] = seq_;
+   }
+   memcpy(request + 1 + tagLen, command + 1, len - 1);
+   if (tagged)
+      request[len + 1] = ArduinoProtocol::crc8(request, len + 1);
+
+   unsigned char frame[g_MaxFrame];
+   unsigned long replyLen = answerLen + extraLen;
+   long attemptMs = tagged ? ReplyTimeoutMs(request[0], timeoutMs) : timeoutMs;
+   MM::MMTime retryStart;
+   MM::MMTime firstSentAt;
+   if (!tagged)
+      PurgeComPortH();
+   for (long retry = 0; ; retry++)
+   {
+      MM::MMTime sentAt = GetCurrentMMTime();
+      if (retry == 0)
+         firstSentAt = sentAt;
+      int ret = WriteToComPortH(request, len + extraLen);
+      if (ret != DEVICE_OK)
+         return ret;
+
+      ret = ReadReply(request[0], tagged, frame, replyLen, sentAt, attemptMs);
+      if (ret == DEVICE_OK)
+      {
+         // A repeat is answered with the same reply, so after a retry the
+         // reply may be the late one to the first frame.  Timed from the
+         // first send, a board that got slower raises the timeout instead
+         // of being retried every time.
+         if (tagged)
+            AddRoundTrip(request[0], (GetCurrentMMTime() - firstSentAt).getMsec());
+         failedCommands_ = 0;
+         answer[0] = frame[0];
+         memcpy(answer + 1, frame + 1 + tagLen, answerLen - 1);
+         return DEVICE_OK;
+      }
+      if (ret != ERR_COMMUNICATION)
+         return ret;
+
+      if (!tagged || retry >= retries_)
+         break;
+      if (retry == 0)
+         retryStart = GetCurrentMMTime();
+
+      // the board drops a frame that is not complete in time
+      if (attemptMs < (long) ArduinoProtocol::FrameTimeoutMs)
+         SleepMs((long) ArduinoProtocol::FrameTimeoutMs - attemptMs);
+      PurgeComPortH();
+
+      // what is left of the budget, shared by the retries still to come
+      long leftMs = retryBudgetMs_ - (long) (GetCurrentMMTime() - retryStart).getMsec();
+      if (leftMs <= 0)
+         break;
+      // in case the board got slower than its timeout allows for
+      long shareMs = leftMs / (retries_ - retry);
+      attemptMs = shareMs < 2 * attemptMs ? shareMs : 2 * attemptMs;
+      if (attemptMs < 1)
+         attemptMs = 1;
+      if (attemptMs > timeoutMs)
+         attemptMs = timeoutMs;
+      retriedCommands_++;
+
+      std::ostringstream os;
+      os << "Sending command " << (int) request[0] << " again, retry " << retry + 1;
+      LogMessage(os.str().c_str(), true);
+   }
+
+   PurgeComPortH();
+
+   // A link that keeps failing at a fast rate is moved to a slower one.
+   // This command still fails, the next ones go out at the new rate.
+   if (tagged && ++failedCommands_ >= g_FailuresToStepDown && initialized_ &&
+         !changingBaud_ && baud_ != g_BaudRates[0])
+   {
+      failedCommands_ = 0;
+      StepDownBaudRate();
+   }
+   return ERR_COMMUNICATION;
+}
+
+// Reads the reply of the command with this opcode (and seq_), sent at
+// startTime, into frame.  Caller must hold the lock.
+int CArduinoHub::ReadReply(unsigned char opcode, bool tagged, unsigned char* frame,
+      unsigned long replyLen, const MM::MMTime& startTime, long timeoutMs)
+{
+   int ret = DEVICE_OK;
+   unsigned long bytesRead = 0;
+   unsigned long dropped = 0;
+   while ((bytesRead < replyLen) && ( (GetCurrentMMTime() - startTime).getMsec() < timeoutMs))
+   {
+      unsigned long br;
+      ret = ReadFromComPortH(frame + bytesRead, (unsigned) (replyLen - bytesRead), br);
+      if (ret != DEVICE_OK)
+         return ret;
+      bytesRead += br;
+
+      // resynchronize on the opcode (and sequence byte)
+      unsigned long skip = 0;
+      while (skip < bytesRead && (frame[skip] != opcode ||
+            (tagged && skip + 1 < bytesRead && frame[skip + 1] != seq_)))
+         skip++;
+      if (skip > 0)
+      {
+         memmove(frame, frame + skip, bytesRead - skip);
+         bytesRead -= skip;
+         dropped += skip;
+      }
+   }
+
+   if (dropped > 0)
+   {
+      std::ostringstream os;
+      os << "Dropped " << dropped << " stale bytes before reply to command " << (int) opcode;
+      LogMessage(os.str().c_str(), true);
+   }
+
+   if (bytesRead < replyLen)
+      return ERR_COMMUNICATION;
+   // garbled on the way, as good as lost
+   if (tagged && frame[replyLen - 1] != ArduinoProtocol::crc8(frame, (unsigned) replyLen - 1))
+   {
+      std::ostringstream os;
+      os << "Reply to command " << (int) opcode << " failed its crc";
+      LogMessage(os.str().c_str(), true);
+      return ERR_COMMUNICATION;
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoHub::SetPortBaudRate(long baud)
+{
+   // round trips at the old rate say nothing about the new one
+   ResetRoundTrips();
+   std::ostringstream os;
+   os << baud;
+   return GetCoreCallback()->SetDeviceProperty(port_.c_str(), MM::g_Keyword_BaudRate, os.str().c_str());
+}
+
+// Moves the link to the fastest rate up to maxBaud that passes the
+// loopback check.  When a rate fails the board falls back to the safe rate
+// on its own (it never got the confirmation), so the hub waits for that,
+// checks the link at the safe rate and tries the next lower rate.
+// Caller must hold the lock.
+int CArduinoHub::NegotiateBaudRate(long maxBaud)
+{
+   for (unsigned i = g_NumBaudRates - 1; i > 0; i--)
+   {
+      if (g_BaudRates[i] > maxBaud)
+         continue;
+
+      int ret = TryBaudRate(i);
+      if (ret == DEVICE_OK)
+      {
+         baud_ = g_BaudRates[i];
+         std::ostringstream os;
+         os << "Link running at " << baud_ << " baud";
+         LogMessage(os.str().c_str(), false);
+         return DEVICE_OK;
+      }
+
+      std::ostringstream os;
+      os << "Link failed at " << g_BaudRates[i] << " baud, trying a lower rate";
+      LogMessage(os.str().c_str(), false);
+
+      ret = SetPortBaudRate(g_BaudRates[0]);
+      if (ret != DEVICE_OK)
+         return ret;
+      baud_ = g_BaudRates[0];
+      SleepMs(g_BaudCheckMs + 100);
+      PurgeComPortH();
+      ret = VerifyLink();
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+
+   return DEVICE_OK;
+}
+
+// The second longest of the last RTTWINDOW round trips (about the 97th
+// percentile) plus timeoutMarginMs_, once there are RTTMINSAMPLES of them;
+// until then the table's timeout.  Either way between minTimeoutMs_ and
+// maxTimeoutMs_.
+long CArduinoHub::ReplyTimeoutMs(unsigned char opcode, long tableMs)
+{
+   if (!adaptiveTimeouts_)
+      return tableMs;
+
+   long ms = tableMs;
+   unsigned slot = rttSlot_[opcode];
+   if (slot > 0 && roundTrips_[slot - 1].count >= RTTMINSAMPLES)
+      ms = (long) ceil(roundTrips_[slot - 1].highMs) + timeoutMarginMs_;
+   if (ms > maxTimeoutMs_)
+      ms = maxTimeoutMs_;
+   if (ms < minTimeoutMs_)
+      ms = minTimeoutMs_;
+   return ms;
+}
+
+void CArduinoHub::AddRoundTrip(unsigned char opcode, double ms)
+{
+   unsigned slot = rttSlot_[opcode];
+   if (slot == 0)
+   {
+      if (rttSlots_ == ArduinoProtocol::NumCommands)
+         return;
+      slot = rttSlot_[opcode] = (unsigned char) ++rttSlots_;
+   }
+   RoundTrips& r = roundTrips_[slot - 1];
+   float sample = (float) ms;
+   bool evictsHigh = r.count == RTTWINDOW && r.ms[r.next] >= r.highMs;
+   r.ms[r.next] = sample;
+   r.next = (r.next + 1) % RTTWINDOW;
+   if (r.count < RTTWINDOW)
+      r.count++;
+
+   // the two longest change only when one of them leaves the window
+   if (!evictsHigh)
+   {
+      if (sample > r.longestMs)
+      {
+         r.highMs = r.longestMs;
+         r.longestMs = sample;
+      }
+      else if (sample > r.highMs)
+         r.highMs = sample;
+      return;
+   }
+   r.longestMs = 0;
+   r.highMs = 0;
+   for (unsigned i = 0; i < r.count; i++)
+   {
+      if (r.ms[i] > r.longestMs)
+      {
+         r.highMs = r.longestMs;
+         r.longestMs = r.ms[i];
+      }
+      else if (r.ms[i] > r.highMs)
+         r.highMs = r.ms[i];
+   }
+}
+
+void CArduinoHub::ResetRoundTrips()
+{
+   for (unsigned i = 0; i < ArduinoProtocol::NumCommands; i++)
+   {
+      roundTrips_[i].count = 0;
+      roundTrips_[i].next = 0;
+      roundTrips_[i].highMs = 0;
+      roundTrips_[i].longestMs = 0;
+   }
+}
+
+void CArduinoHub::SleepMs(long ms)
+{
+   if (sleepSource_ != 0)
+      sleepSource_->SleepMs(ms);
+   else
+      CDeviceUtils::SleepMs(ms);
+}
+
+// Sends <opcode> <args> and hands back the payload of the reply.
+// Caller must hold the lock.
+int CArduinoHub::Exchange(unsigned char opcode, const unsigned char* args, unsigned nArgs,
+      unsigned char* reply, unsigned nReply, long timeoutMs)
+{
+   if (1 + nArgs > g_MaxFrame || 1 + nReply > g_MaxFrame)
+      return ERR_COMMUNICATION;
+
+   unsigned char command[g_MaxFrame];
+   command[0] = opcode;
+   if (nArgs > 0)
+      memcpy(command + 1, args, nArgs);
+
+   unsigned char answer[g_MaxFrame];
+   int ret = SendCommand(command, 1 + nArgs, answer, 1 + nReply, timeoutMs);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (answer[0] != opcode)
+      return ERR_COMMUNICATION;
+
+   if (nReply > 0)
+      memcpy(reply, answer + 1, nReply);
+   return DEVICE_OK;
+}
+
+// Takes the link back to the safe rate and negotiates again, up to the
+// rate below the one that kept failing.  The board takes the request for
+// the safe rate without a confirmation, so its reply getting lost does not
+// matter; when the board never got the request the link stays where it
+// was.  Caller must hold the lock.
+int CArduinoHub::StepDownBaudRate()
+{
+   unsigned index = 0;
+   while (index < g_NumBaudRates && g_BaudRates[index] != baud_)
+      index++;
+   if (index == 0 || index == g_NumBaudRates)
+      return ERR_COMMUNICATION;
+
+   std::ostringstream os;
+   os << "Commands keep failing at " << baud_ << " baud, stepping down";
+   LogMessage(os.str().c_str(), false);
+
+   changingBaud_ = true;
+   unsigned char args[1] = {0};
+   unsigned char reply[1];
+   Transact<ArduinoProtocol::SetBaud>(args, reply);
+
+   int ret = SetPortBaudRate(g_BaudRates[0]);
+   if (ret == DEVICE_OK)
+   {
+      SleepMs(10);
+      PurgeComPortH();
+      ret = VerifyLink();
+   }
+   if (ret == DEVICE_OK)
+   {
+      baud_ = g_BaudRates[0];
+      ret = NegotiateBaudRate(g_BaudRates[index - 1]);
+   }
+   else
+   {
+      SetPortBaudRate(baud_);
+      PurgeComPortH();
+   }
+   changingBaud_ = false;
+   failedCommands_ = 0;
+   return ret;
+}
+
+// Caller must hold the lock
+int CArduinoHub::TryBaudRate(unsigned index)
+{
+   unsigned char args[1];
+   args[0] = (unsigned char) index;
+   unsigned char reply[1];
+   int ret = Transact<ArduinoProtocol::SetBaud>(args, reply);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (reply[0] != index)
+      return ERR_COMMUNICATION;
+
+   ret = SetPortBaudRate(g_BaudRates[index]);
+   if (ret != DEVICE_OK)
+      return ret;
+   SleepMs(10);
+   PurgeComPortH();
+
+   ret = VerifyLink();
+   if (ret != DEVICE_OK)
+      return ret;
+
+   // keep it
+   ret = Transact<ArduinoProtocol::ConfirmBaud>(args, reply);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (reply[0] != index)
+      return ERR_COMMUNICATION;
+
+   return DEVICE_OK;
+}
+
+// Echoes a few frames with bit patterns that show framing errors.
+// Caller must hold the lock.
+int CArduinoHub::VerifyLink()
+{
+   static const unsigned char pattern[] = {0x00, 0xFF, 0x55, 0xAA, 0x0F, 0xF0, 0x33, 0xCC};
+   const unsigned n = sizeof(pattern);
+
+   for (unsigned round = 0; round < g_LoopbackRounds; round++)
+   {
+      unsigned char args[1 + n];
+      args[0] = (unsigned char) n;
+      for (unsigned i = 0; i < n; i++)
+         args[1 + i] = pattern[(i + round) % n];
+
+      unsigned char reply[1 + n];
+      int ret = Exchange(ArduinoProtocol::Loopback::opcode, args, 1 + n, reply, 1 + n,
+            ArduinoProtocol::Loopback::timeoutMs);
+      if (ret != DEVICE_OK)
+         return ret;
+      if (memcmp(args, reply, 1 + n) != 0)
+         return ERR_COMMUNICATION;
+   }
+
+   return DEVICE_OK;
+}
+
+bool CArduinoHub::SupportsDeviceDetection(void)
+{
+   return true;
+}
+
+MM::DeviceDetectionStatus CArduinoHub::DetectDevice(void)
+{
+   if (initialized_)
+      return MM::CanCommunicate;
+
+   // all conditions must be satisfied...
+   MM::DeviceDetectionStatus result = MM::Misconfigured;
+   char answerTO[MM::MaxStrLength];
+   
+   try
+   {
+      std::string portLowerCase = port_;
+      for( std::string::iterator its = portLowerCase.begin(); its != portLowerCase.end(); ++its)
+      {
+         *its = (char)tolower(*its);
+      }
+      if( 0< portLowerCase.length() &&  0 != portLowerCase.compare("undefined")  && 0 != portLowerCase.compare("unknown") )
+      {
+         result = MM::CanNotCommunicate;
+         // record the default answer time out
+         GetCoreCallback()->GetDeviceProperty(port_.c_str(), "AnswerTimeout", answerTO);
+
+         // device specific default communication parameters
+         // for Arduino Duemilanova
+         GetCoreCallback()->SetDeviceProperty(port_.c_str(), MM::g_Keyword_Handshaking, g_Off);
+         GetCoreCallback()->SetDeviceProperty(port_.c_str(), MM::g_Keyword_BaudRate, "57600" );
+         GetCoreCallback()->SetDeviceProperty(port_.c_str(), MM::g_Keyword_StopBits, "1");
+         // Arduino timed out in GetControllerVersion even if AnswerTimeout  = 300 ms
+         GetCoreCallback()->SetDeviceProperty(port_.c_str(), "AnswerTimeout", "500.0");
+         GetCoreCallback()->SetDeviceProperty(port_.c_str(), "DelayBetweenCharsMs", "0");
+         MM::Device* pS = GetCoreCallback()->GetDevice(this, port_.c_str());
+         pS->Initialize();
+         // The first second or so after opening the serial port, the Arduino is waiting for firmwareupgrades.  Simply sleep 2 seconds.
+         SleepMs(2000);
+         MMThreadGuard myLock(lock_);
+         PurgeComPortH();
+         int v = 0;
+         int ret = GetControllerVersion(v);
+         // later, Initialize will explicitly check the version #
+         if( DEVICE_OK != ret )
+         {
+            LogMessageCode(ret,true);
+         }
+         else
+         {
+            // to succeed must reach here....
+            result = MM::CanCommunicate;
+         }
+         pS->Shutdown();
+         // always restore the AnswerTimeout to the default
+         GetCoreCallback()->SetDeviceProperty(port_.c_str(), "AnswerTimeout", answerTO);
+
+      }
+   }
+   catch(...)
+   {
+      LogMessage("Exception in DetectDevice!",false);
+   }
+
+   return result;
+}
+
+
+int CArduinoHub::Initialize()
+{
+   // Name
+   int ret = CreateProperty(MM::g_Keyword_Name, g_DeviceNameArduinoHub, MM::String, true);
+   if (DEVICE_OK != ret)
+      return ret;
+
+   // The first second or so after opening the serial port, the Arduino is waiting for firmwareupgrades.  Simply sleep 1 second.
+   SleepMs(2000);
+
+   MMThreadGuard myLock(lock_);
+
+   ret = OpenTrafficLog();
+   if (ret != DEVICE_OK)
+      return ret;
+
+   // the board always starts at the safe rate, whatever the port was left at
+   ret = SetPortBaudRate(g_BaudRates[0]);
+   if (ret != DEVICE_OK)
+      return ret;
+   baud_ = g_BaudRates[0];
+
+   // Check that we have a controller:
+   PurgeComPortH();
+   ret = GetControllerVersion(version_);
+   if( DEVICE_OK != ret)
+      return ret;
+
+   if (version_ < g_Min_MMVersion || version_ > g_Max_MMVersion)
+      return ERR_VERSION_MISMATCH;
+
+   if (version_ >= g_Tagged_MMVersion)
+   {
+      ret = NegotiateBaudRate(maxBaud_);
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+
+   CPropertyAction* pAct = new CPropertyAction(this, &CArduinoHub::OnVersion);
+   std::ostringstream sversion;
+   sversion << version_;
+   CreateProperty(g_versionProp, sversion.str().c_str(), MM::Integer, true, pAct);
+
+   // Skip commands that would not change the state of the board
+   pAct = new CPropertyAction(this, &CArduinoHub::OnStateCache);
+   CreateProperty("State Cache", g_On, MM::String, false, pAct);
+   AddAllowedValue("State Cache", g_On);
+   AddAllowedValue("State Cache", g_Off);
+
+   pAct = new CPropertyAction(this, &CArduinoHub::OnSkippedWrites);
+   CreateProperty("Skipped Writes", "0", MM::Integer, true, pAct);
+
+   // commands without a reply are sent again; needs firmware version 3
+   if (version_ >= g_Tagged_MMVersion)
+   {
+      pAct = new CPropertyAction(this, &CArduinoHub::OnRetries);
+      CreateProperty("Retries", "2", MM::Integer, false, pAct);
+      SetPropertyLimits("Retries", 0, 10);
+
+      pAct = new CPropertyAction(this, &CArduinoHub::OnRetryBudget);
+      CreateProperty("Retry Budget (ms)", "100", MM::Integer, false, pAct);
+      SetPropertyLimits("Retry Budget (ms)", 0, 10000);
+
+      pAct = new CPropertyAction(this, &CArduinoHub::OnRetriedCommands);
+      CreateProperty("Retried Commands", "0", MM::Integer, true, pAct);
+
+      // reply timeouts from the round trips seen so far, see ReplyTimeoutMs
+      pAct = new CPropertyAction(this, &CArduinoHub::OnAdaptiveTimeouts);
+      CreateProperty("Adaptive Timeouts", g_On, MM::String, false, pAct);
+      AddAllowedValue("Adaptive Timeouts", g_On);
+      AddAllowedValue("Adaptive Timeouts", g_Off);
+
+      pAct = new CPropertyAction(this, &CArduinoHub::OnTimeoutMargin);
+      CreateProperty("Timeout Margin (ms)", "10", MM::Integer, false, pAct);
+      SetPropertyLimits("Timeout Margin (ms)", 0, 1000);
+
+      pAct = new CPropertyAction(this, &CArduinoHub::OnMinTimeout);
+      CreateProperty("Minimum Timeout (ms)", "10", MM::Integer, false, pAct);
+      SetPropertyLimits("Minimum Timeout (ms)", 1, 10000);
+
+      pAct = new CPropertyAction(this, &CArduinoHub::OnMaxTimeout);
+      CreateProperty("Maximum Timeout (ms)", "2500", MM::Integer, false, pAct);
+      SetPropertyLimits("Maximum Timeout (ms)", 1, 10000);
+   }
+
+   pAct = new CPropertyAction(this, &CArduinoHub::OnBaudRate);
+   CreateProperty("Baud Rate", "57600", MM::Integer, true, pAct);
+
+   // 0 writes each DAC on its own; needs firmware version 3
+   if (version_ >= g_Tagged_MMVersion)
+   {
+      pAct = new CPropertyAction(this, &CArduinoHub::OnDACSyncWindow);
+      CreateProperty("DAC Sync Window (ms)", "0", MM::Integer, false, pAct);
+      SetPropertyLimits("DAC Sync Window (ms)", 0, 1000);
+   }
+
+   // we do not know what the board was doing before we connected
+   InvalidateStateCache();
+
+   ret = UpdateStatus();
+   if (ret != DEVICE_OK)
+      return ret;
+
+   // turn off verbose serial debug messages
+   // GetCoreCallback()->SetDeviceProperty(port_.c_str(), "Verbose", "0");
+
+   initialized_ = true;
+   return DEVICE_OK;
+}
+
+int CArduinoHub::DetectInstalledDevices()
+{
+   if (MM::CanCommunicate == DetectDevice()) 
+   {
+      std::vector<std::string> peripherals; 
+      peripherals.clear();
+      peripherals.push_back(g_DeviceNameArduinoSwitch);
+      peripherals.push_back(g_DeviceNameArduinoShutter);
+      peripherals.push_back(g_DeviceNameArduinoInput);
+      peripherals.push_back(g_DeviceNameArduinoDA1);
+      peripherals.push_back(g_DeviceNameArduinoDA2);
+      peripherals.push_back(g_DeviceNameArduinoChannel);
+      peripherals.push_back(g_DeviceNameArduinoFilterWheel);
+      for (size_t i=0; i < peripherals.size(); i++) 
+      {
+         MM::Device* pDev = ::CreateDevice(peripherals[i].c_str());
+         if (pDev) 
+         {
+            AddInstalledDevice(pDev);
+         }
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+
+
+int CArduinoHub::Shutdown()
+{
+   if (initialized_)
+   {
+      MMThreadGuard myLock(lock_);
+      FlushDAC();
+   }
+   if (initialized_ && baud_ != g_BaudRates[0])
+   {
+      // leave the board where the next Initialize expects it
+      MMThreadGuard myLock(lock_);
+      unsigned char args[1] = {0};
+      unsigned char reply[1];
+      Transact<ArduinoProtocol::SetBaud>(args, reply);
+      SetPortBaudRate(g_BaudRates[0]);
+      baud_ = g_BaudRates[0];
+   }
+   if (trafficLog_.IsOpen())
+   {
+      MMThreadGuard myLock(lock_);
+      trafficLog_.Close();
+   }
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+int CArduinoHub::OnPort(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set(port_.c_str());
+   }
+   else if (pAct == MM::AfterSet)
+   {
+      pProp->Get(port_);
+      portAvailable_ = true;
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoHub::OnVersion(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set((long)version_);
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoHub::OnMaxBaudRate(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set(maxBaud_);
+   }
+   else if (pAct == MM::AfterSet)
+   {
+      pProp->Get(maxBaud_);
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoHub::OnBaudRate(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set(baud_);
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoHub::OnLogic(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      if (invertedLogic_)
+         pProp->Set(g_invertedLogicString);
+      else
+         pProp->Set(g_normalLogicString);
+   } else if (pAct == MM::AfterSet)
+   {
+      std::string logic;
+      pProp->Get(logic);
+      if (logic.compare(g_invertedLogicString)==0)
+         invertedLogic_ = true;
+      else invertedLogic_ = false;
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoHub::OnStateCache(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set(stateCacheOn_ ? g_On : g_Off);
+   }
+   else if (pAct == MM::AfterSet)
+   {
+      std::string state;
+      pProp->Get(state);
+      MMThreadGuard myLock(lock_);
+      stateCacheOn_ = (state == g_On);
+      InvalidateStateCache();
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoHub::OnSkippedWrites(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set(skippedWrites_);
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoHub::OnRetries(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set(retries_);
+   }
+   else if (pAct == MM::AfterSet)
+   {
+      MMThreadGuard myLock(lock_);
+      pProp->Get(retries_);
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoHub::OnRetryBudget(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set(retryBudgetMs_);
+   }
+   else if (pAct == MM::AfterSet)
+   {
+      MMThreadGuard myLock(lock_);
+      pProp->Get(retryBudgetMs_);
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoHub::OnRetriedCommands(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set(retriedCommands_);
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoHub::OnAdaptiveTimeouts(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set(adaptiveTimeouts_ ? g_On : g_Off);
+   }
+   else if (pAct == MM::AfterSet)
+   {
+      std::string state;
+      pProp->Get(state);
+      MMThreadGuard myLock(lock_);
+      adaptiveTimeouts_ = (state == g_On);
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoHub::OnTimeoutMargin(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set(timeoutMarginMs_);
+   }
+   else if (pAct == MM::AfterSet)
+   {
+      MMThreadGuard myLock(lock_);
+      pProp->Get(timeoutMarginMs_);
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoHub::OnMinTimeout(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set(minTimeoutMs_);
+   }
+   else if (pAct == MM::AfterSet)
+   {
+      MMThreadGuard myLock(lock_);
+      pProp->Get(minTimeoutMs_);
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoHub::OnMaxTimeout(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set(maxTimeoutMs_);
+   }
+   else if (pAct == MM::AfterSet)
+   {
+      MMThreadGuard myLock(lock_);
+      pProp->Get(maxTimeoutMs_);
+   }
+   return DEVICE_OK;
+}
+
+bool CArduinoHub::IsPatternCached(unsigned char pattern)
+{
+   if (!stateCacheOn_ || !patternValid_ || cachedPattern_ != pattern)
+   {
+      patternValid_ = false;
+      return false;
+   }
+   skippedWrites_++;
+   return true;
+}
+
+void CArduinoHub::CachePattern(unsigned char pattern)
+{
+   cachedPattern_ = pattern;
+   patternValid_ = true;
+}
+
+bool CArduinoHub::IsDACCached(unsigned channel, unsigned long code)
+{
+   if (channel < 1 || channel > NUMDACS)
+      return false;
+   if (!stateCacheOn_ || !dacValid_[channel - 1] || cachedDAC_[channel - 1] != code)
+   {
+      dacValid_[channel - 1] = false;
+      return false;
+   }
+   skippedWrites_++;
+   return true;
+}
+
+void CArduinoHub::CacheDAC(unsigned channel, unsigned long code)
+{
+   if (channel < 1 || channel > NUMDACS)
+      return;
+   cachedDAC_[channel - 1] = code;
+   dacValid_[channel - 1] = true;
+}
+
+int CArduinoHub::OnDACSyncWindow(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set(dacSyncWindowMs_);
+   }
+   else if (pAct == MM::AfterSet)
+   {
+      MMThreadGuard myLock(lock_);
+      pProp->Get(dacSyncWindowMs_);
+      if (dacSyncWindowMs_ == 0)
+         return FlushDAC();
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoHub::OnTrafficLog(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set(trafficLogPath_.c_str());
+   }
+   else if (pAct == MM::AfterSet)
+   {
+      pProp->Get(trafficLogPath_);
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoHub::OnTrafficLogLimit(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set(trafficLogLimitMB_);
+   }
+   else if (pAct == MM::AfterSet)
+   {
+      pProp->Get(trafficLogLimitMB_);
+   }
+   return DEVICE_OK;
+}
+
+// Starts a new log at trafficLogPath_, or none.  Caller must hold the lock.
+int CArduinoHub::OpenTrafficLog()
+{
+   trafficLog_.Close();
+   if (trafficLogPath_.empty())
+      return DEVICE_OK;
+   uint64_t maxBytes = (uint64_t) trafficLogLimitMB_ * 1024 * 1024;
+   if (!trafficLog_.Open(trafficLogPath_.c_str(), GetCurrentMMTime().getUsec(), maxBytes))
+      return ERR_TRAFFIC_LOG;
+   return DEVICE_OK;
+}
+
+void CArduinoHub::RecordTraffic(ArduinoTrafficRecord::Kind kind, const unsigned char* bytes, unsigned long count)
+{
+   if (!trafficLog_.Record(kind, GetCurrentMMTime().getUsec(), bytes, count))
+   {
+      // a full disk should not fail the commands, so stop recording instead
+      trafficLog_.Close();
+      LogMessage(("Could not write the traffic log " + trafficLogPath_ + ", it is closed").c_str(), false);
+   }
+}
+
+int CArduinoHub::SendDAC(unsigned channel, unsigned long code)
+{
+   unsigned char args[3];
+   args[0] = (unsigned char) (channel - 1);
+   args[1] = (unsigned char) (code / 256L);
+   args[2] = (unsigned char) (code & 255);
+   unsigned char reply[3];
+   int ret = Transact<ArduinoProtocol::SetDac>(args, reply);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   CacheDAC(channel, code);
+   SetTimedOutput(false);
+   return DEVICE_OK;
+}
+
+int CArduinoHub::WriteDAC(unsigned channel, unsigned long code)
+{
+   if (channel < 1 || channel > NUMDACS)
+      return DEVICE_INVALID_INPUT_PARAM;
+
+   // a newer value replaces one that has not gone out yet
+   bool failed = dacError_[channel - 1] != DEVICE_OK;
+   dacPending_[channel - 1] = false;
+   dacError_[channel - 1] = DEVICE_OK;
+
+   // the DAC already holds this value
+   if (IsDACCached(channel, code))
+      return DEVICE_OK;
+
+   if (dacSyncWindowMs_ <= 0 || version_ < g_Tagged_MMVersion)
+      return SendDAC(channel, code);
+
+   bool partnerWaiting = dacPending_[0] || dacPending_[1];
+   if (partnerWaiting && (GetCurrentMMTime() - dacPendingSince_).getMsec() > dacSyncWindowMs_)
+   {
+      int ret = FlushDAC();
+      if (ret != DEVICE_OK)
+         return ret;
+      partnerWaiting = false;
+   }
+
+   pendingDAC_[channel - 1] = code;
+   dacPending_[channel - 1] = true;
+   // after a failed send the caller hears at once whether this one gets through
+   if (!partnerWaiting && !failed)
+   {
+      dacPendingSince_ = GetCurrentMMTime();
+      return DEVICE_OK;
+   }
+   return FlushDAC();
+}
+
+// A write that fails stays pending and keeps its error until it is sent or
+// replaced.
+int CArduinoHub::FlushDAC()
+{
+   if (!dacPending_[0] && !dacPending_[1])
+      return DEVICE_OK;
+
+   // the commands below must not flush again
+   flushingDAC_ = true;
+   int ret;
+   if (dacPending_[0] && dacPending_[1])
+   {
+      unsigned char args[4];
+      args[0] = (unsigned char) (pendingDAC_[0] / 256L);
+      args[1] = (unsigned char) (pendingDAC_[0] & 255);
+      args[2] = (unsigned char) (pendingDAC_[1] / 256L);
+      args[3] = (unsigned char) (pendingDAC_[1] & 255);
+      unsigned char reply[4];
+      ret = Transact<ArduinoProtocol::SetDacs>(args, reply);
+      if (ret == DEVICE_OK)
+      {
+         CacheDAC(1, pendingDAC_[0]);
+         CacheDAC(2, pendingDAC_[1]);
+         SetTimedOutput(false);
+      }
+   }
+   else
+   {
+      unsigned i = dacPending_[0] ? 0 : 1;
+      ret = SendDAC(i + 1, pendingDAC_[i]);
+   }
+   flushingDAC_ = false;
+
+   for (unsigned i = 0; i < NUMDACS; i++)
+   {
+      if (ret == DEVICE_OK)
+         dacPending_[i] = false;
+      if (dacPending_[i])
+         dacError_[i] = ret;
+   }
+   return ret;
+}
+
+// Sends a write whose window has run out; true while this channel's write
+// has not gone out, also after a failed send
+bool CArduinoHub::PollDAC(unsigned channel)
+{
+   if (channel < 1 || channel > NUMDACS || !dacPending_[channel - 1])
+      return false;
+   if ((GetCurrentMMTime() - dacPendingSince_).getMsec() > dacSyncWindowMs_)
+   {
+      bool failed = dacError_[channel - 1] != DEVICE_OK;
+      int ret = FlushDAC();
+      // Busy() polls often, so only the first failure is logged
+      if (ret != DEVICE_OK && !failed)
+      {
+         std::ostringstream os;
+         os << "Could not send the write to DAC " << channel << ", error " << ret << ", it stays pending";
+         LogMessage(os.str().c_str(), false);
+      }
+   }
+   return dacPending_[channel - 1];
+}
+
+void CArduinoHub::SetDACMaxVolts(unsigned channel, double volts)
+{
+   if (channel >= 1 && channel <= NUMDACS && volts > 0)
+      dacMaxVolts_[channel - 1] = volts;
+}
+
+unsigned long CArduinoHub::VoltsToDACCode(unsigned channel, double volts) const
+{
+   if (channel < 1 || channel > NUMDACS)
+      return 0;
+   long value = (long) (volts / dacMaxVolts_[channel - 1] * 4095);
+   if (value < 0)
+      return 0;
+   if (value > 4095)
+      return 4095;
+   return (unsigned long) value;
+}
+
+double CArduinoHub::DACCodeToVolts(unsigned channel, unsigned long code) const
+{
+   if (channel < 1 || channel > NUMDACS)
+      return 0;
+   return code * dacMaxVolts_[channel - 1] / 4095;
+}
+
+// Slot the wheel is at (0 while unknown) and whether it is turning
+int CArduinoHub::ReadWheelStatus(long& pos, bool& moving)
+{
+   MMThreadGuard myLock(lock_);
+
+   unsigned char reply[3];
+   int ret = Query<ArduinoProtocol::WheelStatus>(reply);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   pos = reply[0];
+   moving = reply[1] != 0;
+   if (reply[2] != 0)
+   {
+      // the wheel is somewhere between slots
+      InvalidateStateCache();
+      return ERR_WHEEL_STALLED;
+   }
+   return DEVICE_OK;
+}
+
+// Polls until the wheel has stopped, pos is where
+int CArduinoHub::WaitForWheel(long timeoutMs, long target, long& pos)
+{
+   MM::MMTime startTime = GetCurrentMMTime();
+   for (;;)
+   {
+      bool moving;
+      int ret = ReadWheelStatus(pos, moving);
+      if (ret != DEVICE_OK)
+         return ret;
+      if (!moving)
+         return pos == target ? DEVICE_OK : ERR_WHEEL_POSITION;
+
+      if ((GetCurrentMMTime() - startTime).getMsec() > timeoutMs)
+      {
+         MMThreadGuard myLock(lock_);
+         ret = StopWheel();
+         if (ret != DEVICE_OK)
+            return ret;
+         return ERR_MOVE_TIMEOUT;
+      }
+      SleepMs(20);
+   }
+}
+
+// Stops the wheel wherever it is; it has to be sent to a slot again
+int CArduinoHub::StopWheel()
+{
+   InvalidateStateCache();
+
+   unsigned char args[1] = {0};
+   unsigned char reply[1];
+   int ret = Transact<ArduinoProtocol::WheelMove>(args, reply);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (reply[0] != args[0])
+      return ERR_COMMUNICATION;
+   return DEVICE_OK;
+}
+
+void CArduinoHub::AddPresetListener(ArduinoPresetListener* listener)
+{
+   MMThreadGuard myLock(lock_);
+   presetListeners_.push_back(listener);
+}
+
+void CArduinoHub::RemovePresetListener(ArduinoPresetListener* listener)
+{
+   MMThreadGuard myLock(lock_);
+   for (size_t i = 0; i < presetListeners_.size(); i++)
+   {
+      if (presetListeners_[i] == listener)
+      {
+         presetListeners_.erase(presetListeners_.begin() + i);
+         return;
+      }
+   }
+}
+
+void CArduinoHub::NotifyPresetApplied(long wheel, unsigned pattern, const unsigned long* dacCodes)
+{
+   std::vector<ArduinoPresetListener*> listeners;
+   {
+      MMThreadGuard myLock(lock_);
+      listeners = presetListeners_;
+   }
+   for (size_t i = 0; i < listeners.size(); i++)
+      listeners[i]->PresetApplied(wheel, pattern, dacCodes);
+}
+
+bool CArduinoHub::IsWheelTargetCached(unsigned pos)
+{
+   if (!stateCacheOn_ || !wheelValid_ || cachedWheel_ != pos)
+   {
+      wheelValid_ = false;
+      return false;
+   }
+   skippedWrites_++;
+   return true;
+}
+
+void CArduinoHub::CacheWheelTarget(unsigned pos)
+{
+   cachedWheel_ = pos;
+   wheelValid_ = true;
+}
+
+void CArduinoHub::InvalidateStateCache()
+{
+   wheelValid_ = false;
+   cachedWheel_ = 0;
+   InvalidateOutputCache();
+}
+
+// Call whenever the firmware may change its outputs on its own
+// (sequences, timed output, blanking)
+void CArduinoHub::InvalidateOutputCache()
+{
+   patternValid_ = false;
+   cachedPattern_ = 0;
+   for (unsigned i = 0; i < NUMDACS; i++)
+   {
+      dacValid_[i] = false;
+      cachedDAC_[i] = 0;
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CArduinoSwitch implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+CArduinoSwitch::CArduinoSwitch() : 
+   nrPatternsUsed_(0),
+   currentDelay_(0),
+   sequenceOn_(false),
+   blanking_(false),
+   initialized_(false),
+   numPos_(64), 
+   busy_(false),
+   streamable_(false),
+   streamed_(false),
+   streamPos_(0),
+   streamFree_(0),
+   streamFreeTime_(0.0),
+   streamRate_(0.0),
+   underrunLogged_(false),
+   streamError_(DEVICE_OK),
+   streamThread_(0)
+{
+   InitializeDefaultErrorMessages();
+
+   // add custom error messages
+   SetErrorText(ERR_UNKNOWN_POSITION, "Invalid position (state) specified");
+   SetErrorText(ERR_INITIALIZE_FAILED, "Initialization of the device failed");
+   SetErrorText(ERR_WRITE_FAILED, "Failed to write data to the device");
+   SetErrorText(ERR_CLOSE_FAILED, "Failed closing the device");
+   SetErrorText(ERR_COMMUNICATION, "Error in communication with Arduino board");
+   SetErrorText(ERR_NO_PORT_SET, "Hub Device not found.  The Arduino Hub device is needed to create this device");
+
+   for (unsigned int i=0; i < NUMPATTERNS; i++)
+      pattern_[i] = 0;
+
+   // Description
+   int ret = CreateProperty(MM::g_Keyword_Description, "Arduino digital output driver", MM::String, true);
+   assert(DEVICE_OK == ret);
+
+   // Name
+   ret = CreateProperty(MM::g_Keyword_Name, g_DeviceNameArduinoSwitch, MM::String, true);
+   assert(DEVICE_OK == ret);
+
+   // parent ID display
+   CreateHubIDProperty();
+
+}
+
+CArduinoSwitch::~CArduinoSwitch()
+{
+   Shutdown();
+}
+
+void CArduinoSwitch::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_DeviceNameArduinoSwitch);
+}
+
+
+int CArduinoSwitch::Initialize()
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable()) {
+      return ERR_NO_PORT_SET;
+   }
+   char hubLabel[MM::MaxStrLength];
+   hub->GetLabel(hubLabel);
+   SetParentID(hubLabel); // for backward comp.
+
+   // set property list
+   // -----------------
+   
+   // create positions and labels
+   const int bufSize = 65;
+   char buf[bufSize];
+   for (long i=0; i<numPos_; i++)
+   {
+      snprintf(buf, bufSize, "%d", (unsigned)i);
+      SetPositionLabel(i, buf);
+   }
+
+   // State
+   // -----
+   CPropertyAction* pAct = new CPropertyAction (this, &CArduinoSwitch::OnState);
+   int nRet = CreateProperty(MM::g_Keyword_State, "0", MM::Integer, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   SetPropertyLimits(MM::g_Keyword_State, 0, numPos_ - 1);
+
+   // Label
+   // -----
+   pAct = new CPropertyAction (this, &CStateBase::OnLabel);
+   nRet = CreateProperty(MM::g_Keyword_Label, "", MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   char ver[MM::MaxStrLength] = "0";
+   hub->GetProperty(g_versionProp, ver);
+   streamable_ = atoi(ver) >= g_Tagged_MMVersion;
+   sequence_.reserve(streamable_ ? MAXSTREAMED : NUMPATTERNS);
+
+   pAct = new CPropertyAction(this, &CArduinoSwitch::OnSequence);
+   nRet = CreateProperty("Sequence", g_On, MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue("Sequence", g_On);
+   AddAllowedValue("Sequence", g_Off);
+
+   // Starts "blanking" mode: goal is to synchronize laser light with camera exposure
+   std::string blankMode = "Blanking Mode";
+   pAct = new CPropertyAction(this, &CArduinoSwitch::OnBlanking);
+   nRet = CreateProperty(blankMode.c_str(), "Idle", MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue(blankMode.c_str(), g_On);
+   AddAllowedValue(blankMode.c_str(), g_Off);
+
+   // Blank on TTL high or low
+   pAct = new CPropertyAction(this, &CArduinoSwitch::OnBlankingTriggerDirection);
+   nRet = CreateProperty("Blank On", "Low", MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue("Blank On", "Low");
+   AddAllowedValue("Blank On", "High");
+
+   /*
+   // Starts producing timed digital output patterns 
+   // Parameters that influence the pattern are 'Repeat Timed Pattern', 'Delay', 'State' where the latter two are manipulated with the Get and SetPattern functions
+   std::string timedOutput = "Timed Output Mode";
+   pAct = new CPropertyAction(this, &CArduinoSwitch::OnStartTimedOutput);
+   nRet = CreateProperty(timedOutput.c_str(), "Idle", MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   AddAllowedValue(timedOutput.c_str(), "Stop");
+   AddAllowedValue(timedOutput.c_str(), "Start");
+   AddAllowedValue(timedOutput.c_str(), "Running");
+   AddAllowedValue(timedOutput.c_str(), "Idle");
+
+   // Sets a delay (in ms) to be used in timed output mode
+   // This delay will be transferred to the Arduino using the Get and SetPattern commands
+   pAct = new CPropertyAction(this, &CArduinoSwitch::OnDelay);
+   nRet = CreateProperty("Delay (ms)", "0", MM::Integer, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   SetPropertyLimits("Delay (ms)", 0, 65535);
+
+   // Repeat the timed Pattern this many times:
+   pAct = new CPropertyAction(this, &CArduinoSwitch::OnRepeatTimedPattern);
+   nRet = CreateProperty("Repeat Timed Pattern", "0", MM::Integer, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   SetPropertyLimits("Repeat Timed Pattern", 0, 255);
+   */
+
+   nRet = UpdateStatus();
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   hub->AddPresetListener(this);
+   initialized_ = true;
+
+   return DEVICE_OK;
+}
+
+int CArduinoSwitch::Shutdown()
+{
+   StopStreamThread();
+   if (initialized_)
+   {
+      CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+      if (hub)
+         hub->RemovePresetListener(this);
+   }
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+// a channel preset set the switch state
+void CArduinoSwitch::PresetApplied(long, unsigned pattern, const unsigned long*)
+{
+   std::ostringstream os;
+   os << pattern;
+   OnPropertyChanged(MM::g_Keyword_State, os.str().c_str());
+}
+
+int CArduinoSwitch::WriteToPort(long value)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable()) {
+      return ERR_NO_PORT_SET;
+   }
+
+   MMThreadGuard myLock(hub->GetLock());
+
+   value = 63 & value;
+   if (hub->IsLogicInverted())
+      value = ~value;
+
+   // the board already outputs this pattern
+   if (hub->IsPatternCached((unsigned char) value))
+      return DEVICE_OK;
+
+   unsigned char args[1];
+   args[0] = (unsigned char) value;
+   int ret = hub->Send<ArduinoProtocol::SetPattern>(args);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   hub->CachePattern((unsigned char) value);
+   hub->SetTimedOutput(false);
+
+   return DEVICE_OK;
+}
+
+// Sequence entries are plain decimal numbers.  Parsed by hand: an
+// istringstream per entry allocates and consults the locale, which adds up
+// for long sequences.  Like the stream it replaces, anything after the
+// leading digits is ignored.
+bool CArduinoSwitch::ParsePattern(const std::string& text, unsigned char& value)
+{
+   size_t i = 0;
+   size_t n = text.size();
+   while (i < n && (text[i] == ' ' || text[i] == '\t'))
+      i++;
+   if (i == n || text[i] < '0' || text[i] > '9')
+      return false;
+
+   unsigned v = 0;
+   for (; i < n && text[i] >= '0' && text[i] <= '9'; i++)
+   {
+      v = v * 10 + (text[i] - '0');
+      if (v > 255)
+         return false;
+   }
+   value = (unsigned char) v;
+   return true;
+}
+
+// Splits seq into runs of the same output pattern, at most 255 long.
+// Returns the number of runs, or maxRuns + 1 once they do not fit.
+unsigned CArduinoSwitch::CompressRuns(const unsigned char* seq, unsigned size,
+      unsigned char* pattern, unsigned char* repeat, unsigned maxRuns)
+{
+   unsigned runs = 0;
+   for (unsigned i = 0; i < size; i++)
+   {
+      unsigned char value = 63 & seq[i];
+      if (runs > 0 && pattern[runs - 1] == value && repeat[runs - 1] < 255)
+      {
+         repeat[runs - 1]++;
+         continue;
+      }
+      if (runs == maxRuns)
+         return maxRuns + 1;
+      pattern[runs] = value;
+      repeat[runs] = 1;
+      runs++;
+   }
+   return runs;
+}
+
+// With repeat, entry i holds its pattern for repeat[i] triggers (command 18)
+int CArduinoSwitch::LoadSequence(unsigned size, const unsigned char* seq, const unsigned char* repeat)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+
+   MMThreadGuard myLock(hub->GetLock());
+
+   for (unsigned i=0; i < size; i++)
+   {
+      unsigned char value = seq[i];
+
+      value = 63 & value;
+      if (hub->IsLogicInverted())
+         value = ~value;
+
+      int ret;
+      if (repeat != 0)
+      {
+         unsigned char args[3];
+         args[0] = (unsigned char) i;
+         args[1] = value;
+         args[2] = repeat[i];
+         unsigned char reply[3];
+         ret = hub->Transact<ArduinoProtocol::SequenceRun>(args, reply);
+      }
+      else
+      {
+         unsigned char args[2];
+         args[0] = (unsigned char) i;
+         args[1] = value;
+         unsigned char reply[2];
+         ret = hub->Transact<ArduinoProtocol::SequencePattern>(args, reply);
+      }
+      if (ret != DEVICE_OK)
+         return ret;
+
+   }
+
+   unsigned char args[1];
+   args[0] = (unsigned char) size;
+   unsigned char reply[1];
+   int ret = hub->Transact<ArduinoProtocol::SequenceLength>(args, reply);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   return DEVICE_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Action handlers
+///////////////////////////////////////////////////////////////////////////////
+
+int CArduinoSwitch::OnState(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+
+   if (eAct == MM::BeforeGet)
+   {
+      // a channel preset may have changed it
+      pProp->Set((long) hub->GetSwitchState());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long pos;
+      pProp->Get(pos);
+      hub->SetSwitchState(pos);
+      if (hub->GetShutterState() > 0)
+         return WriteToPort(pos);
+   }
+   else if (eAct == MM::IsSequenceable)                                      
+   {                                                                         
+      if (sequenceOn_)                                                       
+         pProp->SetSequenceable(streamable_ ? MAXSTREAMED : NUMPATTERNS);
+      else                                                                   
+         pProp->SetSequenceable(0);                                          
+   } 
+   else if (eAct == MM::AfterLoadSequence)                                   
+   {                                                                         
+      std::vector<std::string> sequence = pProp->GetSequence();              
+      if (sequence.size() > NUMPATTERNS && !streamable_)
+         return DEVICE_SEQUENCE_TOO_LARGE;                                   
+      if (sequence.size() > (size_t) MAXSTREAMED)
+         return DEVICE_SEQUENCE_TOO_LARGE;
+
+      // stays within the reserved capacity
+      streamed_ = false;
+      sequence_.resize(sequence.size());
+      for (unsigned int i=0; i < sequence.size(); i++)                       
+      {
+         if (!ParsePattern(sequence[i], sequence_[i]))
+            return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+      const unsigned char* seq = sequence_.empty() ? 0 : &sequence_[0];
+
+      // Firmware 3 stores runs of the same pattern in one table entry,
+      // so repetitive sequences fit in the table and need no streaming
+      unsigned char runPattern[NUMPATTERNS];
+      unsigned char runRepeat[NUMPATTERNS];
+      unsigned runs = NUMPATTERNS + 1;
+      if (streamable_)
+         runs = CompressRuns(seq, (unsigned) sequence.size(), runPattern, runRepeat, NUMPATTERNS);
+
+      streamed_ = sequence.size() > NUMPATTERNS && runs > NUMPATTERNS;
+      if (runs < sequence.size() && runs <= NUMPATTERNS)
+      {
+         int ret = LoadSequence(runs, runPattern, runRepeat);
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+      else if (!streamed_)
+      {
+         int ret = LoadSequence((unsigned) sequence.size(), seq);
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+      // a streamed sequence stays in sequence_ and is sent while it plays
+   }                                                                         
+   else if (eAct == MM::StartSequence)
+   { 
+      // the failure of an earlier stream that was never stopped is logged
+      StopStreamThread();
+      streamError_ = DEVICE_OK;
+      if (streamed_)
+         return StartStream();
+
+      MMThreadGuard myLock(hub->GetLock());
+
+      int ret = hub->Send<ArduinoProtocol::StartSequence>();
+      if (ret != DEVICE_OK)
+         return ret;
+      hub->InvalidateOutputCache();
+   }
+   else if (eAct == MM::StopSequence)                                        
+   {
+      StopStreamThread();
+
+      MMThreadGuard myLock(hub->GetLock());
+
+      unsigned char reply[1];
+      int ret = hub->Query<ArduinoProtocol::StopSequence>(reply);
+      if (ret != DEVICE_OK)
+         return ret;
+      hub->InvalidateOutputCache();
+
+      std::ostringstream os;
+      os << "Sequence had " << (int) reply[0] << " transitions";
+      LogMessage(os.str().c_str(), false);
+
+      // the stream thread gave up on a refill, the sequence was cut short
+      ret = streamError_;
+      streamError_ = DEVICE_OK;
+      return ret;
+   }                                                                         
+
+   return DEVICE_OK;
+}
+
+// Empties the board's stream, fills it from the start of the sequence
+// and lets the trigger input play it; the thread keeps it filled.
+int CArduinoSwitch::StartStream()
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+
+   StopStreamThread();
+   {
+      MMThreadGuard myLock(hub->GetLock());
+
+      unsigned char reply[1];
+      int ret = hub->Query<ArduinoProtocol::StreamClear>(reply);
+      if (ret != DEVICE_OK)
+         return ret;
+      streamFree_ = reply[0];
+      streamFreeTime_ = GetCurrentMMTime();
+      streamRate_ = 0.0;
+      streamPos_ = 0;
+      underrunLogged_ = false;
+   }
+
+   int ret = RefillStream();
+   if (ret != DEVICE_OK)
+      return ret;
+
+   {
+      MMThreadGuard myLock(hub->GetLock());
+
+      ret = hub->Send<ArduinoProtocol::StreamStart>();
+      if (ret != DEVICE_OK)
+         return ret;
+      hub->InvalidateOutputCache();
+   }
+
+   streamThread_ = new ArduinoSequenceStreamThread(*this);
+   streamThread_->Start();
+   return DEVICE_OK;
+}
+
+// Sends the next patterns, never more than the board last reported free.
+// While the ring had no room for a chunk at the last reply, the board is
+// only asked again once the triggers should have made room, or after
+// STREAMPOLLMS while their rate is unknown (STREAMIDLEMS once it is).
+int CArduinoSwitch::RefillStream()
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+   if (sequence_.empty())
+      return DEVICE_OK;
+
+   MMThreadGuard myLock(hub->GetLock());
+
+   double sinceMs = (GetCurrentMMTime() - streamFreeTime_).getMsec();
+   long pollMs = streamRate_ > 0.0 ? STREAMIDLEMS : STREAMPOLLMS;
+   if (streamFree_ < STREAMCHUNK && streamFree_ + streamRate_ * sinceMs < STREAMCHUNK &&
+         sinceMs < pollMs)
+      return DEVICE_OK;
+
+   do
+   {
+      unsigned n = streamFree_ < STREAMCHUNK ? streamFree_ : STREAMCHUNK;
+      unsigned char args[1 + STREAMCHUNK];
+      args[0] = (unsigned char) n;
+      for (unsigned i = 0; i < n; i++)
+      {
+         unsigned char value = 63 & sequence_[streamPos_];
+         if (hub->IsLogicInverted())
+            value = ~value;
+         args[1 + i] = value;
+         streamPos_ = (streamPos_ + 1) % sequence_.size();
+      }
+      unsigned char reply[ArduinoProtocol::StreamChunk::reply];
+      int ret = hub->Exchange(ArduinoProtocol::StreamChunk::opcode, args, 1 + n, reply, sizeof(reply),
+            ArduinoProtocol::StreamChunk::timeoutMs);
+      if (ret != DEVICE_OK)
+         return ret;
+
+      // patterns played since the last reply, averaged over about 50 ms
+      MM::MMTime now = GetCurrentMMTime();
+      double elapsedMs = (now - streamFreeTime_).getMsec();
+      long played = (long) reply[0] - ((long) streamFree_ - (long) n);
+      if (elapsedMs > 0 && played >= 0)
+      {
+         double weight = elapsedMs / (elapsedMs + 50.0);
+         streamRate_ += weight * (played / elapsedMs - streamRate_);
+      }
+      streamFree_ = reply[0];
+      streamFreeTime_ = now;
+
+      if (reply[1] && !underrunLogged_)
+      {
+         LogMessage("Sequence stream ran empty, triggers came faster than it could be refilled", false);
+         underrunLogged_ = true;
+      }
+   } while (streamFree_ >= STREAMCHUNK);
+
+   return DEVICE_OK;
+}
+
+// Called by the stream thread when it stops on a failed refill
+void CArduinoSwitch::StreamFailed(int error)
+{
+   std::ostringstream os;
+   os << "Sequence stream stopped, a refill failed with error " << error;
+   LogMessage(os.str().c_str(), false);
+   streamError_ = error;
+}
+
+// Only the stream thread refills while it runs, so no lock is needed
+long CArduinoSwitch::StreamRefillDelayMs()
+{
+   if (streamRate_ <= 0.0)
+      return STREAMPOLLMS;
+
+   double sinceMs = (GetCurrentMMTime() - streamFreeTime_).getMsec();
+   double ms = (STREAMCHUNK - (double) streamFree_) / streamRate_ - sinceMs;
+   if (ms < 1.0)
+      return 1;
+   if (ms > STREAMIDLEMS)
+      return STREAMIDLEMS;
+   return (long) ms;
+}
+
+void CArduinoSwitch::StopStreamThread()
+{
+   if (streamThread_ != 0)
+   {
+      // the destructor stops the thread and waits for it
+      delete streamThread_;
+      streamThread_ = 0;
+   }
+}
+
+int CArduinoSwitch::OnSequence(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      if (sequenceOn_)
+         pProp->Set(g_On);
+      else
+         pProp->Set(g_Off);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string state;
+      pProp->Get(state);
+      if (state == g_On)
+         sequenceOn_ = true;
+      else
+         sequenceOn_ = false;
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoSwitch::OnStartTimedOutput(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+
+   if (eAct == MM::BeforeGet) {
+      if (hub->IsTimedOutputActive())
+         pProp->Set("Running");
+      else
+         pProp->Set("Idle");
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      MMThreadGuard myLock(hub->GetLock());
+
+      std::string prop;
+      pProp->Get(prop);
+
+      if (prop =="Start") {
+         int ret = hub->Send<ArduinoProtocol::StartTimed>();
+         if (ret != DEVICE_OK)
+            return ret;
+         hub->InvalidateOutputCache();
+         hub->SetTimedOutput(true);
+      } else {
+         unsigned char reply[1];
+         int ret = hub->Query<ArduinoProtocol::StopSequence>(reply);
+         if (ret != DEVICE_OK)
+            return ret;
+         hub->InvalidateOutputCache();
+         hub->SetTimedOutput(false);
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+int CArduinoSwitch::OnBlanking(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+
+   if (eAct == MM::BeforeGet) {
+      if (blanking_)
+         pProp->Set(g_On);
+      else
+         pProp->Set(g_Off);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      MMThreadGuard myLock(hub->GetLock());
+
+      std::string prop;
+      pProp->Get(prop);
+
+      if (prop == g_On && !blanking_) {
+         int ret = hub->Send<ArduinoProtocol::BlankingOn>();
+         if (ret != DEVICE_OK)
+            return ret;
+         hub->InvalidateOutputCache();
+         blanking_ = true;
+         hub->SetTimedOutput(false);
+         LogMessage("Switched blanking on", true);
+
+      } else if (prop == g_Off && blanking_){
+         unsigned char reply[1];
+         int ret = hub->Query<ArduinoProtocol::BlankingOff>(reply);
+         if (ret != DEVICE_OK)
+            return ret;
+         hub->InvalidateOutputCache();
+         blanking_ = false;
+         hub->SetTimedOutput(false);
+         LogMessage("Switched blanking off", true);
+      }
+   }
+
+   return DEVICE_OK;
+}
+
+int CArduinoSwitch::OnBlankingTriggerDirection(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+
+   if (eAct == MM::BeforeGet) {
+      // nothing to do, let the caller use cached property
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      MMThreadGuard myLock(hub->GetLock());
+
+      std::string direction;
+      pProp->Get(direction);
+
+      unsigned char args[1];
+      if (direction == "Low") 
+         args[0] = 1;
+      else
+         args[0] = 0;
+
+      int ret = hub->Send<ArduinoProtocol::BlankDirection>(args);
+      if (ret != DEVICE_OK)
+         return ret;
+
+   }
+
+   return DEVICE_OK;
+}
+
+int CArduinoSwitch::OnDelay(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet) {
+      pProp->Set((long int)currentDelay_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long prop;
+      pProp->Get(prop);
+      currentDelay_ = (int) prop;
+   }
+
+   return DEVICE_OK;
+}
+
+int CArduinoSwitch::OnRepeatTimedPattern(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+
+   if (eAct == MM::BeforeGet) {
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      MMThreadGuard myLock(hub->GetLock());
+
+      long prop;
+      pProp->Get(prop);
+
+      unsigned char args[1];
+      args[0] = (unsigned char) prop;
+
+      unsigned char reply[1];
+      int ret = hub->Transact<ArduinoProtocol::TimedRepeat>(args, reply);
+      if (ret != DEVICE_OK)
+         return ret;
+
+      hub->SetTimedOutput(false);
+   }
+
+   return DEVICE_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// CArduinoDA implementation
+// ~~~~~~~~~~~~~~~~~~~~~~
+
+CArduinoDA::CArduinoDA(int channel) :
+      busy_(false), 
+      minV_(0.0), 
+      maxV_(5.0), 
+      volts_(0.0),
+      gatedVolts_(0.0),
+      channel_(channel), 
+      maxChannel_(2),
+      gateOpen_(true),
+      sequenceable_(false),
+      sequenceIntervalUs_(0)
+{
+   InitializeDefaultErrorMessages();
+
+   // add custom error messages
+   SetErrorText(ERR_UNKNOWN_POSITION, "Invalid position (state) specified");
+   SetErrorText(ERR_INITIALIZE_FAILED, "Initialization of the device failed");
+   SetErrorText(ERR_WRITE_FAILED, "Failed to write data to the device");
+   SetErrorText(ERR_CLOSE_FAILED, "Failed closing the device");
+   SetErrorText(ERR_NO_PORT_SET, "Hub Device not found.  The Arduino Hub device is needed to create this device");
+
+   /* Channel property is not needed
+   CPropertyAction* pAct = new CPropertyAction(this, &CArduinoDA::OnChannel);
+   CreateProperty("Channel", channel_ == 1 ? "1" : "2", MM::Integer, false, pAct, true);
+   for (int i=1; i<= 2; i++){
+      std::ostringstream os;
+      os << i;
+      AddAllowedValue("Channel", os.str().c_str());
+   }
+   */
+
+   CPropertyAction* pAct = new CPropertyAction(this, &CArduinoDA::OnMaxVolt);
+   CreateProperty("MaxVolt", "5.0", MM::Float, false, pAct, true);
+
+   name_ = channel_ == 1 ? g_DeviceNameArduinoDA1 : g_DeviceNameArduinoDA2;
+
+   // Description
+   int nRet = CreateProperty(MM::g_Keyword_Description, "Arduino DAC driver", MM::String, true);
+   assert(DEVICE_OK == nRet);
+
+   // Name
+   nRet = CreateProperty(MM::g_Keyword_Name, name_.c_str(), MM::String, true);
+   assert(DEVICE_OK == nRet);
+
+   // parent ID display
+   CreateHubIDProperty();
+}
+
+CArduinoDA::~CArduinoDA()
+{
+   Shutdown();
+}
+
+void CArduinoDA::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, name_.c_str());
+}
+
+
+int CArduinoDA::Initialize()
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable()) {
+      return ERR_NO_PORT_SET;
+   }
+   char hubLabel[MM::MaxStrLength];
+   hub->GetLabel(hubLabel);
+   SetParentID(hubLabel); // for backward comp.
+
+   // set property list
+   // -----------------
+   
+   // State
+   // -----
+   CPropertyAction* pAct = new CPropertyAction (this, &CArduinoDA::OnVolts);
+   int nRet = CreateProperty("Volts", "0.0", MM::Float, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   SetPropertyLimits("Volts", minV_, maxV_);
+
+   // sequences need the waveform table of firmware version 3
+   char ver[MM::MaxStrLength] = "0";
+   hub->GetProperty(g_versionProp, ver);
+   sequenceable_ = atoi(ver) >= g_Tagged_MMVersion;
+   hub->SetDACMaxVolts(channel_, maxV_);
+   if (sequenceable_)
+   {
+      pAct = new CPropertyAction (this, &CArduinoDA::OnSequenceInterval);
+      nRet = CreateProperty("Sequence Interval (us)", "0", MM::Integer, false, pAct);
+      if (nRet != DEVICE_OK)
+         return nRet;
+      SetPropertyLimits("Sequence Interval (us)", 0, 262140);
+   }
+
+   nRet = UpdateStatus();
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   hub->AddPresetListener(this);
+   initialized_ = true;
+
+   return DEVICE_OK;
+}
+
+int CArduinoDA::Shutdown()
+{
+   if (initialized_)
+   {
+      CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+      if (hub)
+         hub->RemovePresetListener(this);
+   }
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+// a channel preset wrote this channel's DAC
+void CArduinoDA::PresetApplied(long, unsigned, const unsigned long* dacCodes)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   volts_ = hub->DACCodeToVolts(channel_, dacCodes[channel_ - 1]);
+   gatedVolts_ = volts_;
+   std::ostringstream os;
+   os << volts_;
+   OnPropertyChanged("Volts", os.str().c_str());
+}
+
+int CArduinoDA::WriteToPort(unsigned long value)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+
+   MMThreadGuard myLock(hub->GetLock());
+
+   return hub->WriteDAC(channel_, value);
+}
+
+// busy while the write waits in the hub for the other channel, or has
+// failed to go out
+bool CArduinoDA::Busy()
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return busy_;
+
+   MMThreadGuard myLock(hub->GetLock());
+   return busy_ || hub->PollDAC(channel_);
+}
+
+
+unsigned long CArduinoDA::VoltsToCode(double volts) const
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   return hub->VoltsToDACCode(channel_, volts - minV_);
+}
+
+int CArduinoDA::WriteSignal(double volts)
+{
+   unsigned long value = VoltsToCode(volts);
+
+   std::ostringstream os;
+    os << "Volts: " << volts << " Max Voltage: " << maxV_ << " digital value: " << value;
+    LogMessage(os.str().c_str(), true);
+
+   return WriteToPort(value);
+}
+
+int CArduinoDA::SetSignal(double volts)
+{
+   volts_ = volts;
+   if (gateOpen_) {
+      gatedVolts_ = volts_;
+      return WriteSignal(volts_);
+   } else {
+      gatedVolts_ = 0;
+   }
+
+   return DEVICE_OK;
+}
+
+int CArduinoDA::SetGateOpen(bool open)
+{
+   if (open) {
+      gateOpen_ = true;
+      gatedVolts_ = volts_;
+      return WriteSignal(volts_);
+   } 
+   gateOpen_ = false;
+   gatedVolts_ = 0;
+   return WriteSignal(0.0);
+
+}
+
+int CArduinoDA::ClearDASequence()
+{
+   sequence_.clear();
+   return DEVICE_OK;
+}
+
+int CArduinoDA::AddToDASequence(double voltage)
+{
+   if (sequence_.size() >= WAVELENGTH)
+      return DEVICE_SEQUENCE_TOO_LARGE;
+   sequence_.push_back(gateOpen_ ? VoltsToCode(voltage) : 0);
+   return DEVICE_OK;
+}
+
+// Uploads the codes into the board's waveform table for this channel
+int CArduinoDA::SendDASequence()
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+   if (!sequenceable_)
+      return DEVICE_UNSUPPORTED_COMMAND;
+
+   MMThreadGuard myLock(hub->GetLock());
+
+   for (unsigned i = 0; i < sequence_.size(); i++)
+   {
+      unsigned char args[4];
+      args[0] = (unsigned char) (channel_ - 1);
+      args[1] = (unsigned char) i;
+      args[2] = (unsigned char) (sequence_[i] / 256L);
+      args[3] = (unsigned char) (sequence_[i] & 255);
+      unsigned char reply[2];
+      int ret = hub->Transact<ArduinoProtocol::WaveCode>(args, reply);
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+
+   unsigned char args[2];
+   args[0] = (unsigned char) (channel_ - 1);
+   args[1] = (unsigned char) sequence_.size();
+   unsigned char reply[2];
+   int ret = hub->Transact<ArduinoProtocol::WaveLength>(args, reply);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   return DEVICE_OK;
+}
+
+int CArduinoDA::StartDASequence()
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+   if (!sequenceable_)
+      return DEVICE_UNSUPPORTED_COMMAND;
+
+   MMThreadGuard myLock(hub->GetLock());
+
+   unsigned long interval = (unsigned long) sequenceIntervalUs_;
+   unsigned char args[6];
+   args[0] = (unsigned char) (channel_ - 1);
+   args[1] = interval > 0 ? 2 : 1;
+   args[2] = (unsigned char) (interval >> 24);
+   args[3] = (unsigned char) (interval >> 16);
+   args[4] = (unsigned char) (interval >> 8);
+   args[5] = (unsigned char) interval;
+   unsigned char reply[1];
+   int ret = hub->Transact<ArduinoProtocol::WaveStart>(args, reply);
+   if (ret != DEVICE_OK)
+      return ret;
+   hub->InvalidateOutputCache();
+
+   return DEVICE_OK;
+}
+
+int CArduinoDA::StopDASequence()
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+   if (!sequenceable_)
+      return DEVICE_UNSUPPORTED_COMMAND;
+
+   MMThreadGuard myLock(hub->GetLock());
+
+   unsigned char args[1];
+   args[0] = (unsigned char) (channel_ - 1);
+   unsigned char reply[2];
+   int ret = hub->Transact<ArduinoProtocol::WaveStop>(args, reply);
+   if (ret != DEVICE_OK)
+      return ret;
+   hub->InvalidateOutputCache();
+
+   std::ostringstream os;
+   os << "Waveform stopped at step " << (int) reply[1];
+   LogMessage(os.str().c_str(), true);
+
+   return DEVICE_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Action handlers
+///////////////////////////////////////////////////////////////////////////////
+
+int CArduinoDA::OnVolts(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      // a channel preset may have changed it
+      pProp->Set(volts_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      double volts;
+      pProp->Get(volts);
+      return SetSignal(volts);
+   }
+   else if (eAct == MM::IsSequenceable)
+   {
+      pProp->SetSequenceable(sequenceable_ ? WAVELENGTH : 0);
+   }
+   else if (eAct == MM::AfterLoadSequence)
+   {
+      std::vector<std::string> sequence = pProp->GetSequence();
+      if (sequence.size() > WAVELENGTH)
+         return DEVICE_SEQUENCE_TOO_LARGE;
+      ClearDASequence();
+      for (unsigned int i = 0; i < sequence.size(); i++)
+         AddToDASequence(atof(sequence[i].c_str()));
+      return SendDASequence();
+   }
+   else if (eAct == MM::StartSequence)
+   {
+      return StartDASequence();
+   }
+   else if (eAct == MM::StopSequence)
+   {
+      return StopDASequence();
+   }
+
+   return DEVICE_OK;
+}
+
+int CArduinoDA::OnSequenceInterval(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(sequenceIntervalUs_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(sequenceIntervalUs_);
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoDA::OnMaxVolt(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(maxV_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(maxV_);
+      if (HasProperty("Volts"))
+      {
+         SetPropertyLimits("Volts", 0.0, maxV_);
+         CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+         if (hub)
+            hub->SetDACMaxVolts(channel_, maxV_);
+      }
+
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoDA::OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set((long int)channel_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long channel;
+      pProp->Get(channel);
+      if (channel >=1 && ( (unsigned) channel <=maxChannel_) )
+         channel_ = channel;
+   }
+   return DEVICE_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CArduinoShutter implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+CArduinoShutter::CArduinoShutter() :
+   fireCount_(1),
+   firePeriodMs_(0.0),
+   initialized_(false),
+   name_(g_DeviceNameArduinoShutter)
+{
+   InitializeDefaultErrorMessages();
+   EnableDelay();
+
+   SetErrorText(ERR_NO_PORT_SET, "Hub Device not found.  The Arduino Hub device is needed to create this device");
+
+   // Name
+   int ret = CreateProperty(MM::g_Keyword_Name, g_DeviceNameArduinoShutter, MM::String, true);
+   assert(DEVICE_OK == ret);
+
+   // Description
+   ret = CreateProperty(MM::g_Keyword_Description, "Arduino shutter driver", MM::String, true);
+   assert(DEVICE_OK == ret);
+
+   // parent ID display
+   CreateHubIDProperty();
+}
+
+CArduinoShutter::~CArduinoShutter()
+{
+   Shutdown();
+}
+
+void CArduinoShutter::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_DeviceNameArduinoShutter);
+}
+
+bool CArduinoShutter::Busy()
+{
+   MM::MMTime now = GetCurrentMMTime();
+   if (now < fireEnd_)
+      return true;
+
+   MM::MMTime interval = now - changedTime_;
+
+   if (interval < (1000.0 * GetDelayMs() ))
+      return true;
+   else
+       return false;
+}
+
+int CArduinoShutter::Initialize()
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable()) {
+      return ERR_NO_PORT_SET;
+   }
+   char hubLabel[MM::MaxStrLength];
+   hub->GetLabel(hubLabel);
+   SetParentID(hubLabel); // for backward comp.
+
+   // set property list
+   // -----------------
+   
+   // OnOff
+   // ------
+   CPropertyAction* pAct = new CPropertyAction (this, &CArduinoShutter::OnOnOff);
+   int ret = CreateProperty("OnOff", "0", MM::Integer, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   // set shutter into the off state
+   //WriteToPort(0);
+
+   std::vector<std::string> vals;
+   vals.push_back("0");
+   vals.push_back("1");
+   ret = SetAllowedValues("OnOff", vals);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   // Fire() sends this many pulses, one every period; the board times them
+   pAct = new CPropertyAction (this, &CArduinoShutter::OnFireCount);
+   ret = CreateProperty("Fire Count", "1", MM::Integer, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   SetPropertyLimits("Fire Count", 1, 65535);
+
+   pAct = new CPropertyAction (this, &CArduinoShutter::OnFirePeriod);
+   ret = CreateProperty("Fire Period (ms)", "0", MM::Float, false, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+   SetPropertyLimits("Fire Period (ms)", 0.0, 60000.0);
+
+   ret = UpdateStatus();
+   if (ret != DEVICE_OK)
+      return ret;
+
+   changedTime_ = GetCurrentMMTime();
+   fireEnd_ = changedTime_;
+   initialized_ = true;
+
+   return DEVICE_OK;
+}
+
+int CArduinoShutter::Shutdown()
+{
+   if (initialized_)
+   {
+      initialized_ = false;
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoShutter::SetOpen(bool open)
+{
+	std::ostringstream os;
+	os << "Request " << open;
+	LogMessage(os.str().c_str(), true);
+
+   if (open)
+      return SetProperty("OnOff", "1");
+   else
+      return SetProperty("OnOff", "0");
+}
+
+int CArduinoShutter::GetOpen(bool& open)
+{
+   char buf[MM::MaxStrLength];
+   int ret = GetProperty("OnOff", buf);
+   if (ret != DEVICE_OK)
+      return ret;
+   long pos = atol(buf);
+   pos > 0 ? open = true : open = false;
+
+   return DEVICE_OK;
+}
+
+// Opens the shutter for deltaT ms, "Fire Count" times when set.  The
+// board times the pulses with a hardware timer (command 13), so their
+// length does not depend on the serial link.  The shutter is closed after.
+int CArduinoShutter::Fire(double deltaT)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+   char ver[MM::MaxStrLength] = "0";
+   hub->GetProperty(g_versionProp, ver);
+   if (atoi(ver) < g_Tagged_MMVersion)
+      return DEVICE_UNSUPPORTED_COMMAND;
+   if (deltaT <= 0.0)
+      return DEVICE_INVALID_INPUT_PARAM;
+
+   MMThreadGuard myLock(hub->GetLock());
+
+   unsigned char open = (unsigned char) (63 & hub->GetSwitchState());
+   unsigned char closed = 0;
+   if (hub->IsLogicInverted())
+   {
+      open = ~open;
+      closed = ~closed;
+   }
+
+   unsigned long width = (unsigned long) (deltaT * 1000.0 + 0.5);
+   unsigned long period = (unsigned long) (firePeriodMs_ * 1000.0 + 0.5);
+   if (period < width)
+      period = width;
+   unsigned int count = (unsigned int) fireCount_;
+
+   unsigned char args[12];
+   args[0] = open;
+   args[1] = closed;
+   args[2] = (unsigned char) (width >> 24);
+   args[3] = (unsigned char) (width >> 16);
+   args[4] = (unsigned char) (width >> 8);
+   args[5] = (unsigned char) width;
+   args[6] = (unsigned char) (count >> 8);
+   args[7] = (unsigned char) count;
+   args[8] = (unsigned char) (period >> 24);
+   args[9] = (unsigned char) (period >> 16);
+   args[10] = (unsigned char) (period >> 8);
+   args[11] = (unsigned char) period;
+   int ret = hub->Send<ArduinoProtocol::Pulses>(args);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   // the board pulses on its own until the burst is over, and closing the
+   // shutter has to reach it to cut the burst short
+   hub->InvalidateOutputCache();
+   hub->SetTimedOutput(false);
+   hub->SetShutterState(0);
+
+   changedTime_ = GetCurrentMMTime();
+   double burstMs = (count - 1) * (period / 1000.0) + deltaT;
+   fireEnd_ = changedTime_ + MM::MMTime::fromMs(burstMs);
+
+   return DEVICE_OK;
+}
+
+int CArduinoShutter::WriteToPort(long value)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+
+   MMThreadGuard myLock(hub->GetLock());
+
+   value = 63 & value;
+   if (hub->IsLogicInverted())
+      value = ~value;
+
+   // the board already outputs this pattern
+   if (hub->IsPatternCached((unsigned char) value))
+      return DEVICE_OK;
+
+   unsigned char args[1];
+   args[0] = (unsigned char) value;
+   int ret = hub->Send<ArduinoProtocol::SetPattern>(args);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   hub->CachePattern((unsigned char) value);
+   hub->SetTimedOutput(false);
+
+   return DEVICE_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Action handlers
+///////////////////////////////////////////////////////////////////////////////
+
+int CArduinoShutter::OnOnOff(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (eAct == MM::BeforeGet)
+   {
+      // use cached state
+      pProp->Set((long)hub->GetShutterState());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long pos;
+      pProp->Get(pos);
+      int ret;
+      if (pos == 0)
+         ret = WriteToPort(0); // turn everything off
+      else
+         ret = WriteToPort(hub->GetSwitchState()); // restore old setting
+      if (ret != DEVICE_OK)
+         return ret;
+      hub->SetShutterState(pos);
+      changedTime_ = GetCurrentMMTime();
+      fireEnd_ = changedTime_;
+   }
+
+   return DEVICE_OK;
+}
+
+int CArduinoShutter::OnFireCount(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(fireCount_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(fireCount_);
+   }
+
+   return DEVICE_OK;
+}
+
+int CArduinoShutter::OnFirePeriod(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(firePeriodMs_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(firePeriodMs_);
+   }
+
+   return DEVICE_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CArduinoChannel implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+CArduinoChannel::CArduinoChannel() :
+   initialized_(false)
+{
+   InitializeDefaultErrorMessages();
+
+   SetErrorText(ERR_UNKNOWN_POSITION, "Invalid position (state) specified");
+   SetErrorText(ERR_COMMUNICATION, "Error in communication with Arduino board");
+   SetErrorText(ERR_NO_PORT_SET, "Hub Device not found.  The Arduino Hub device is needed to create this device");
+   SetErrorText(ERR_VERSION_MISMATCH, "To use channel presets you need firmware version 3 or higher");
+   SetErrorText(ERR_WHEEL_STALLED, "The filter wheel stalled before reaching its position");
+   SetErrorText(ERR_MOVE_TIMEOUT, "The filter wheel did not reach its position within the move timeout");
+   SetErrorText(ERR_WHEEL_POSITION, "The filter wheel came to rest at another position than it was sent to");
+
+   for (unsigned int i=0; i < NUMPRESETS; i++)
+   {
+      wheel_[i] = -1;
+      pattern_[i] = 0;
+      volts_[i][0] = 0.0;
+      volts_[i][1] = 0.0;
+   }
+
+   // Name
+   int ret = CreateProperty(MM::g_Keyword_Name, g_DeviceNameArduinoChannel, MM::String, true);
+   assert(DEVICE_OK == ret);
+
+   // Description
+   ret = CreateProperty(MM::g_Keyword_Description, "Arduino channel presets", MM::String, true);
+   assert(DEVICE_OK == ret);
+
+   // parent ID display
+   CreateHubIDProperty();
+}
+
+CArduinoChannel::~CArduinoChannel()
+{
+   Shutdown();
+}
+
+void CArduinoChannel::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_DeviceNameArduinoChannel);
+}
+
+int CArduinoChannel::Initialize()
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable()) {
+      return ERR_NO_PORT_SET;
+   }
+   char hubLabel[MM::MaxStrLength];
+   hub->GetLabel(hubLabel);
+   SetParentID(hubLabel); // for backward comp.
+
+   char ver[MM::MaxStrLength] = "0";
+   hub->GetProperty(g_versionProp, ver);
+   int version = atoi(ver);
+   if (version < g_Tagged_MMVersion)
+      return ERR_VERSION_MISMATCH;
+
+   // create positions and labels
+   const int bufSize = 65;
+   char buf[bufSize];
+   for (unsigned i=0; i < NUMPRESETS; i++)
+   {
+      snprintf(buf, bufSize, "Channel %d", i);
+      SetPositionLabel(i, buf);
+   }
+
+   // Preset contents.  A wheel position of -1 leaves the wheel where it is.
+   for (long i=0; i < (long) NUMPRESETS; i++)
+   {
+      CPropertyActionEx* pExAct = new CPropertyActionEx(this, &CArduinoChannel::OnPresetWheel, i);
+      std::ostringstream os;
+      os << "Preset " << i << " Wheel";
+      int ret = CreateProperty(os.str().c_str(), "-1", MM::Integer, false, pExAct);
+      if (ret != DEVICE_OK)
+         return ret;
+      SetPropertyLimits(os.str().c_str(), -1, 6);
+
+      pExAct = new CPropertyActionEx(this, &CArduinoChannel::OnPresetPattern, i);
+      os.str("");
+      os << "Preset " << i << " Pattern";
+      ret = CreateProperty(os.str().c_str(), "0", MM::Integer, false, pExAct);
+      if (ret != DEVICE_OK)
+         return ret;
+      SetPropertyLimits(os.str().c_str(), 0, 63);
+
+      // converted with the MaxVolt of the Arduino-DAC devices, which may
+      // initialize after this one; volts beyond it give full scale
+      for (long dac=0; dac < 2; dac++)
+      {
+         pExAct = new CPropertyActionEx(this, &CArduinoChannel::OnPresetVolts, 2 * i + dac);
+         os.str("");
+         os << "Preset " << i << " DAC" << dac + 1 << " Volts";
+         ret = CreateProperty(os.str().c_str(), "0.0", MM::Float, false, pExAct);
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+   }
+
+   // State
+   // -----
+   CPropertyAction* pAct = new CPropertyAction (this, &CArduinoChannel::OnState);
+   int nRet = CreateProperty(MM::g_Keyword_State, "0", MM::Integer, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+   SetPropertyLimits(MM::g_Keyword_State, 0, NUMPRESETS - 1);
+
+   // Label
+   // -----
+   pAct = new CPropertyAction (this, &CStateBase::OnLabel);
+   nRet = CreateProperty(MM::g_Keyword_Label, "", MM::String, false, pAct);
+   if (nRet != DEVICE_OK)
+      return nRet;
+
+   initialized_ = true;
+
+   return DEVICE_OK;
+}
+
+int CArduinoChannel::Shutdown()
+{
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+// Sends the whole preset as one command.  The outputs follow the shutter
+// like CArduinoSwitch does: with the shutter closed only the switch state
+// is remembered and all outputs stay low.  The lock is only held for the
+// command; the wheel is then polled like CArduinoFilterWheel does, and
+// the wheel, switch and DAC devices are told what the preset changed.
+int CArduinoChannel::WriteToPort(long preset)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+
+   unsigned long dac[2];
+   int ret = SendPreset(preset, dac);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   long pos = -1;
+   if (wheel_[preset] >= 0)
+   {
+      ret = hub->WaitForWheel(g_PresetMoveTimeoutMs, wheel_[preset], pos);
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+
+   hub->NotifyPresetApplied(pos, (unsigned) pattern_[preset], dac);
+   return DEVICE_OK;
+}
+
+int CArduinoChannel::SendPreset(long preset, unsigned long* dac)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   MMThreadGuard myLock(hub->GetLock());
+
+   hub->SetSwitchState(pattern_[preset]);
+
+   long value = hub->GetShutterState() > 0 ? pattern_[preset] : 0;
+   value = 63 & value;
+   if (hub->IsLogicInverted())
+      value = ~value;
+
+   for (int i=0; i < 2; i++)
+      dac[i] = hub->VoltsToDACCode(i + 1, volts_[preset][i]);
+
+   unsigned char args[6];
+   args[0] = wheel_[preset] < 0 ? 255 : (unsigned char) wheel_[preset];
+   args[1] = (unsigned char) value;
+   args[2] = (unsigned char) (dac[0] / 256L);
+   args[3] = (unsigned char) (dac[0] & 255);
+   args[4] = (unsigned char) (dac[1] / 256L);
+   args[5] = (unsigned char) (dac[1] & 255);
+
+   unsigned char reply[1];
+   int ret = hub->Transact<ArduinoProtocol::ChannelPreset>(args, reply);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (reply[0] != 0)
+      return ERR_COMMUNICATION;
+
+   hub->CachePattern((unsigned char) value);
+   hub->CacheDAC(1, dac[0]);
+   hub->CacheDAC(2, dac[1]);
+   if (wheel_[preset] >= 0)
+      hub->CacheWheelTarget((unsigned) wheel_[preset]);
+   hub->SetTimedOutput(false);
+
+   return DEVICE_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Action handlers
+///////////////////////////////////////////////////////////////////////////////
+
+int CArduinoChannel::OnState(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      // nothing to do, let the caller use cached property
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long pos;
+      pProp->Get(pos);
+      if (pos < 0 || pos >= (long) NUMPRESETS)
+         return ERR_UNKNOWN_POSITION;
+      return WriteToPort(pos);
+   }
+
+   return DEVICE_OK;
+}
+
+int CArduinoChannel::OnPresetWheel(MM::PropertyBase* pProp, MM::ActionType eAct, long preset)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(wheel_[preset]);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(wheel_[preset]);
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoChannel::OnPresetPattern(MM::PropertyBase* pProp, MM::ActionType eAct, long preset)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(pattern_[preset]);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(pattern_[preset]);
+   }
+   return DEVICE_OK;
+}
+
+// index is 2 * preset + DAC channel (0 or 1)
+int CArduinoChannel::OnPresetVolts(MM::PropertyBase* pProp, MM::ActionType eAct, long index)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(volts_[index / 2][index % 2]);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      double volts;
+      pProp->Get(volts);
+      if (volts < 0)
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      volts_[index / 2][index % 2] = volts;
+   }
+   return DEVICE_OK;
+}
+
+
+/*
+ * Arduino input.  Can either be for all pins (0-6)
+ * or for an individual pin only
+ */
+
+CArduinoInput::CArduinoInput() :
+   mThread_(0),
+   pin_(0),
+   name_(g_DeviceNameArduinoInput)
+{
+   std::string errorText = "To use the Input function you need firmware version 2 or higher";
+   SetErrorText(ERR_VERSION_MISMATCH, errorText.c_str());
+
+   CreateProperty("Pin", "All", MM::String, false, 0, true);
+   AddAllowedValue("Pin", "All");
+   AddAllowedValue("Pin", "0");
+   AddAllowedValue("Pin", "1");
+   AddAllowedValue("Pin", "2");
+   AddAllowedValue("Pin", "3");
+   AddAllowedValue("Pin", "4");
+   AddAllowedValue("Pin", "5");
+
+   CreateProperty("Pull-Up-Resistor", g_On, MM::String, false, 0, true);
+   AddAllowedValue("Pull-Up-Resistor", g_On);
+   AddAllowedValue("Pull-Up-Resistor", g_Off);
+
+   // Name
+   int ret = CreateProperty(MM::g_Keyword_Name, name_.c_str(), MM::String, true);
+   assert(DEVICE_OK == ret);
+
+   // Description
+   ret = CreateProperty(MM::g_Keyword_Description, "Arduino shutter driver", MM::String, true);
+   assert(DEVICE_OK == ret);
+
+   // parent ID display
+   CreateHubIDProperty();
+}
+
+CArduinoInput::~CArduinoInput()
+{
+   Shutdown();
+}
+
+int CArduinoInput::Shutdown()
+{
+   if (initialized_)
+      delete(mThread_);
+   initialized_ = false;
+   return DEVICE_OK;
+}
+
+int CArduinoInput::Initialize()
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable()) {
+      return ERR_NO_PORT_SET;
+   }
+   char hubLabel[MM::MaxStrLength];
+   hub->GetLabel(hubLabel);
+   SetParentID(hubLabel); // for backward comp.
+
+   char ver[MM::MaxStrLength] = "0";
+   hub->GetProperty(g_versionProp, ver);
+   int version = atoi(ver);
+   if (version < 2)
+      return ERR_VERSION_MISMATCH;
+
+   int ret = GetProperty("Pin", pins_);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (strcmp("All", pins_) != 0)
+      pin_ = atoi(pins_); 
+
+   ret = GetProperty("Pull-Up-Resistor", pullUp_);
+   if (ret != DEVICE_OK)
+      return ret;
+ 
+   // Digital Input
+   CPropertyAction* pAct = new CPropertyAction (this, &CArduinoInput::OnDigitalInput);
+   ret = CreateProperty("DigitalInput", "0", MM::Integer, true, pAct);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   int start = 0;
+   int end = 5;
+   if (strcmp("All", pins_) != 0) {
+      start = pin_;
+      end = pin_;
+   }
+
+   for (long i=start; i <=end; i++) 
+   {
+      CPropertyActionEx *pExAct = new CPropertyActionEx(this, &CArduinoInput::OnAnalogInput, i);
+      std::ostringstream os;
+      os << "AnalogInput" << i;
+      ret = CreateProperty(os.str().c_str(), "0.0", MM::Float, true, pExAct);
+      if (ret != DEVICE_OK)
+         return ret;
+      // set pull up resistor state for this pin
+      if (strcmp(g_On, pullUp_) == 0) {
+         SetPullUp(i, 1);
+      } else {
+         SetPullUp(i, 0);
+      }
+
+   }
+
+   mThread_ = new ArduinoInputMonitorThread(*this);
+   mThread_->Start();
+
+   initialized_ = true;
+
+   return DEVICE_OK;
+}
+
+void CArduinoInput::GetName(char* name) const
+{
+  CDeviceUtils::CopyLimitedString(name, name_.c_str());
+}
+
+bool CArduinoInput::Busy()
+{
+   return false;
+}
+
+int CArduinoInput::GetDigitalInput(long* state)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+
+   MMThreadGuard myLock(hub->GetLock());
+
+
+   unsigned char reply[1];
+   int ret = hub->Query<ArduinoProtocol::DigitalInputs>(reply);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   if (strcmp("All", pins_) != 0) {
+      reply[0] = reply[0] >> pin_;
+      reply[0] &= reply[0] & 1;
+   }
+   
+   *state = (long) reply[0];
+
+   return DEVICE_OK;
+}
+
+int CArduinoInput::ReportStateChange(long newState)
+{
+   std::ostringstream os;
+   os << newState;
+   return OnPropertyChanged("DigitalInput", os.str().c_str());
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Action handlers
+///////////////////////////////////////////////////////////////////////////////
+
+int CArduinoInput::OnDigitalInput(MM::PropertyBase*  pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      long state;
+      int ret = GetDigitalInput(&state);
+      if (ret != DEVICE_OK)
+         return ret;
+
+      pProp->Set(state);
+   }
+
+   return DEVICE_OK;
+}
+
+int CArduinoInput::OnAnalogInput(MM::PropertyBase* pProp, MM::ActionType eAct, long  channel )
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+
+   if (eAct == MM::BeforeGet)
+   {
+      MMThreadGuard myLock(hub->GetLock());
+
+      unsigned char args[1];
+      args[0] = (unsigned char) channel;
+
+      unsigned char reply[3];
+      int ret = hub->Transact<ArduinoProtocol::AnalogInput>(args, reply);
+      if (ret != DEVICE_OK)
+         return ret;
+      if (reply[0] != channel)
+         return ERR_COMMUNICATION;
+
+      int tmp = reply[1];
+      tmp = tmp << 8;
+      tmp = tmp | reply[2];
+
+      pProp->Set((long) tmp);
+   }
+   return DEVICE_OK;
+}
+
+int CArduinoInput::SetPullUp(int pin, int state)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable())
+      return ERR_NO_PORT_SET;
+
+   MMThreadGuard myLock(hub->GetLock());
+
+   unsigned char args[2];
+   args[0] = (unsigned char) pin;
+   args[1] = (unsigned char) state;
+
+   unsigned char reply[2];
+   int ret = hub->Transact<ArduinoProtocol::PullUp>(args, reply);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   if (reply[0] != pin)
+      return ERR_COMMUNICATION;
+
+   return DEVICE_OK;
+}
+
+
+ArduinoInputMonitorThread::ArduinoInputMonitorThread(CArduinoInput& aInput) :
+   state_(0),
+   aInput_(aInput)
+{
+}
+
+ArduinoInputMonitorThread::~ArduinoInputMonitorThread()
+{
+   Stop();
+   wait();
+}
+
+int ArduinoInputMonitorThread::svc() 
+{
+   while (!stop_)
+   {
+      // a poll that fails is skipped; the next one may get through
+      long state;
+      int ret = aInput_.GetDigitalInput(&state);
+      if (ret == DEVICE_OK && state != state_)
+      {
+         aInput_.ReportStateChange(state);
+         state_ = state;
+      }
+      CArduinoHub::SleepMs(500);
+   }
+   return DEVICE_OK;
+}
+
+
+void ArduinoInputMonitorThread::Start()
+{
+   stop_ = false;
+   activate();
+}
+
+
+ArduinoSequenceStreamThread::ArduinoSequenceStreamThread(CArduinoSwitch& aSwitch) :
+   aSwitch_(aSwitch),
+   stop_(false)
+{
+}
+
+ArduinoSequenceStreamThread::~ArduinoSequenceStreamThread()
+{
+   Stop();
+   wait();
+}
+
+int ArduinoSequenceStreamThread::svc()
+{
+   while (!stop_)
+   {
+      int ret = aSwitch_.RefillStream();
+      if (ret != DEVICE_OK)
+      {
+         aSwitch_.StreamFailed(ret);
+         stop_ = true;
+         return ret;
+      }
+      CArduinoHub::SleepMs(aSwitch_.StreamRefillDelayMs());
+   }
+   return DEVICE_OK;
+}
+
+void ArduinoSequenceStreamThread::Start()
+{
+   stop_ = false;
+   activate();
+}
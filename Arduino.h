@@ -1,117 +1,606 @@
- //////////////////////////////////////////////////////////////////////////////
-// FILE:          Arduino.h
-// PROJECT:       Micro-Manager
-// SUBSYSTEM:     DeviceAdapters
-//-----------------------------------------------------------------------------
-// DESCRIPTION:   Adapter for Arduino board
-//                Needs accompanying firmware to be installed on the board
-//
-// AUTHOR:        Shirish Goyal, shirish.goyal@gmail.com 09/14/2016
-//
-// COPYRIGHT:     Shirish Goyal, BioCurious, Sunnyvale, 2016
-//
-// LICENSE:       This file is distributed under the BSD license.
-//                License text is included with the source distribution.
-//
-//                This file is distributed in the hope that it will be useful,
-//                but WITHOUT ANY WARRANTY; without even the implied warranty
-//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
-//
-//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
-//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
-//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
-//
-
-#ifndef _Arduino_H_
-#define _Arduino_H_
-
-#include "../../MMDevice/MMDevice.h"
-#include "../../MMDevice/DeviceBase.h"
-#include <string>
-#include <map>
-
-//////////////////////////////////////////////////////////////////////////////
-// Error codes
-//
-#define ERR_UNKNOWN_POSITION 101
-#define ERR_INITIALIZE_FAILED 102
-#define ERR_WRITE_FAILED 103
-#define ERR_CLOSE_FAILED 104
-#define ERR_BOARD_NOT_FOUND 105
-#define ERR_PORT_OPEN_FAILED 106
-#define ERR_COMMUNICATION 107
-#define ERR_NO_PORT_SET 108
-#define ERR_VERSION_MISMATCH 109
-
-class ArduinoInputMonitorThread;
-
-class CArduinoHub : public HubBase<CArduinoHub>  
-{
-public:
-   CArduinoHub();
-   ~CArduinoHub();
-
-   int Initialize();
-   int Shutdown();
-   void GetName(char* pszName) const;
-   bool Busy();
-
-   bool SupportsDeviceDetection(void);
-   MM::DeviceDetectionStatus DetectDevice(void);
-   int DetectInstalledDevices();
-
-   // property handlers
-   int OnPort(MM::PropertyBase* pPropt, MM::ActionType eAct);
-   int OnLogic(MM::PropertyBase* pPropt, MM::ActionType eAct);
-   int OnVersion(MM::PropertyBase* pPropt, MM::ActionType eAct);
-
-   // custom interface for child devices
-   bool IsPortAvailable() {return portAvailable_;}
-   int Purge() {return PurgeComPort(port_.c_str());}
-   int Write(const unsigned char* command, unsigned len) {return WriteToComPort(port_.c_str(), command, len);}
-   int Read(unsigned char* answer, unsigned maxLen, unsigned long& bytesRead)
-   {
-      return ReadFromComPort(port_.c_str(), answer, maxLen, bytesRead);
-   }
-
-   static MMThreadLock& GetLock() {return lock_;}
-
-   void SetFilterWheelState(unsigned state) {filterWheelState_ = state;}
-   unsigned GetFilterWheelState() {return filterWheelState_;}
-
-private:
-   int GetControllerVersion(int&);
-
-   std::string port_;
-   bool initialized_;
-   bool portAvailable_;
-   int version_;
-   static MMThreadLock lock_;
-   unsigned filterWheelState_;
-};
-
-class ArduinoInputMonitorThread : public MMDeviceThreadBase
-{
-   public:
-      ArduinoInputMonitorThread(CArduinoInput& aInput);
-     ~ArduinoInputMonitorThread();
-      int svc();
-      int open (void*) { return 0;}
-      int close(unsigned long) {return 0;}
-
-      void Start();
-      void Stop() {stop_ = true;}
-      ArduinoInputMonitorThread & operator=( const ArduinoInputMonitorThread & ) 
-      {
-         return *this;
-      }
-
-
-   private:
-      long state_;
-      CArduinoInput& aInput_;
-      bool stop_;
-};
-
-
-#endif //_Arduino_H_
+ //////////////////////////////////////////////////////////////////////////////
+// FILE:          Arduino.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Adapter for Arduino board
+//                Needs accompanying firmware to be installed on the board
+//
+// AUTHOR:        Shirish Goyal, shirish.goyal@gmail.com 09/14/2016
+//
+// COPYRIGHT:     Shirish Goyal, BioCurious, Sunnyvale, 2016
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+//
+
+#ifndef _Arduino_H_
+#define _Arduino_H_
+
+#include "../../MMDevice/MMDevice.h"
+#include "../../MMDevice/DeviceBase.h"
+#include "FilterWheelController/ArduinoProtocol.h"
+#include "ArduinoTrafficLog.h"
+#include <string>
+#include <map>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+// Error codes
+//
+#define ERR_UNKNOWN_POSITION 101
+#define ERR_INITIALIZE_FAILED 102
+#define ERR_WRITE_FAILED 103
+#define ERR_CLOSE_FAILED 104
+#define ERR_BOARD_NOT_FOUND 105
+#define ERR_PORT_OPEN_FAILED 106
+#define ERR_COMMUNICATION 107
+#define ERR_NO_PORT_SET 108
+#define ERR_VERSION_MISMATCH 109
+#define ERR_WHEEL_STALLED 110
+#define ERR_MOVE_TIMEOUT 111
+#define ERR_TRAFFIC_LOG 112
+#define ERR_WHEEL_POSITION 113
+
+// shared by the devices of this adapter
+extern const char* g_versionProp;
+extern const int g_Tagged_MMVersion;
+extern const char* g_On;
+extern const char* g_Off;
+
+class ArduinoInputMonitorThread;
+class ArduinoSequenceStreamThread;
+
+// Where the devices and their threads sleep.  Timeouts are measured on the
+// core's clock (GetCurrentMMTime), so a core that runs on simulated time
+// installs a sleep source that waits on the same clock.
+class ArduinoSleepSource
+{
+public:
+   virtual ~ArduinoSleepSource() {}
+   virtual void SleepMs(long ms) = 0;
+};
+
+// Devices that show what the board outputs.  A channel preset changes the
+// wheel, the outputs and both DACs in one command and tells them here, so
+// their properties follow.  Called without the lock held.
+class ArduinoPresetListener
+{
+public:
+   virtual ~ArduinoPresetListener() {}
+   // wheel is the slot the wheel stopped at, -1 when the preset left it
+   virtual void PresetApplied(long wheel, unsigned pattern, const unsigned long* dacCodes) = 0;
+};
+
+class CArduinoHub : public HubBase<CArduinoHub>  
+{
+public:
+   CArduinoHub();
+   ~CArduinoHub();
+
+   int Initialize();
+   int Shutdown();
+   void GetName(char* pszName) const;
+   bool Busy();
+
+   bool SupportsDeviceDetection(void);
+   MM::DeviceDetectionStatus DetectDevice(void);
+   int DetectInstalledDevices();
+
+   // property handlers
+   int OnPort(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnLogic(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnVersion(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnStateCache(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnSkippedWrites(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnMaxBaudRate(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnBaudRate(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnDACSyncWindow(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnTrafficLog(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnTrafficLogLimit(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnRetries(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnRetryBudget(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnRetriedCommands(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnAdaptiveTimeouts(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnTimeoutMargin(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnMinTimeout(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnMaxTimeout(MM::PropertyBase* pPropt, MM::ActionType eAct);
+
+   // custom interface for child devices
+   bool IsPortAvailable() {return portAvailable_;}
+   bool IsLogicInverted() {return invertedLogic_;}
+   bool IsTimedOutputActive() {return timedOutputActive_;}
+   void SetTimedOutput(bool active) {timedOutputActive_ = active;}
+
+   // all traffic goes through these, so the traffic log sees all of it
+   int PurgeComPortH()
+   {
+      if (trafficLog_.IsOpen())
+         RecordTraffic(ArduinoTrafficRecord::Purged, 0, 0);
+      return PurgeComPort(port_.c_str());
+   }
+   int WriteToComPortH(const unsigned char* command, unsigned len)
+   {
+      if (trafficLog_.IsOpen())
+         RecordTraffic(ArduinoTrafficRecord::Sent, command, len);
+      return WriteToComPort(port_.c_str(), command, len);
+   }
+   int ReadFromComPortH(unsigned char* answer, unsigned maxLen, unsigned long& bytesRead)
+   {
+      int ret = ReadFromComPort(port_.c_str(), answer, maxLen, bytesRead);
+      if (ret == DEVICE_OK && bytesRead > 0 && trafficLog_.IsOpen())
+         RecordTraffic(ArduinoTrafficRecord::Received, answer, bytesRead);
+      return ret;
+   }
+   int SendCommand(const unsigned char* command, unsigned len,
+         unsigned char* answer, unsigned answerLen, long timeoutMs);
+   int Exchange(unsigned char opcode, const unsigned char* args, unsigned nArgs,
+         unsigned char* reply, unsigned nReply, long timeoutMs);
+
+   // Typed commands from FilterWheelController/ArduinoProtocol.h.  The
+   // argument and reply arrays are checked against the command table at
+   // compile time; opcode, length and timeout come from the table.
+   // Callers must hold the lock.
+   template <class C>
+   int Send()
+   {
+      static_assert(C::args == 0 && C::reply == 0, "command takes arguments or has a reply");
+      return Exchange(C::opcode, 0, 0, 0, 0, C::timeoutMs);
+   }
+   template <class C, unsigned NA>
+   int Send(const unsigned char (&args)[NA])
+   {
+      static_assert(NA == C::args && C::reply == 0, "arguments do not match the command table");
+      return Exchange(C::opcode, args, NA, 0, 0, C::timeoutMs);
+   }
+   template <class C, unsigned NR>
+   int Query(unsigned char (&reply)[NR])
+   {
+      static_assert(C::args == 0 && NR == C::reply, "reply does not match the command table");
+      return Exchange(C::opcode, 0, 0, reply, NR, C::timeoutMs);
+   }
+   template <class C, unsigned NA, unsigned NR>
+   int Transact(const unsigned char (&args)[NA], unsigned char (&reply)[NR])
+   {
+      static_assert(NA == C::args && NR == C::reply, "arguments or reply do not match the command table");
+      return Exchange(C::opcode, args, NA, reply, NR, C::timeoutMs);
+   }
+   static MMThreadLock& GetLock() {return lock_;}
+   // CDeviceUtils::SleepMs unless another source is set; 0 restores it
+   static void SetSleepSource(ArduinoSleepSource* source) {sleepSource_ = source;}
+   static void SleepMs(long ms);
+   void SetShutterState(unsigned state) {shutterState_ = state;}
+   void SetSwitchState(unsigned state) {switchState_ = state;}
+   unsigned GetShutterState() {return shutterState_;}
+   unsigned GetSwitchState() {return switchState_;}
+
+   // Write-through cache of what was last written to the board.  Callers
+   // must hold the lock.  The Is...Cached functions return true (and count
+   // a skipped write) when sending the value would not change the hardware.
+   // On a miss the entry is dropped until the new value is acknowledged.
+   bool IsPatternCached(unsigned char pattern);
+   void CachePattern(unsigned char pattern);
+   bool IsDACCached(unsigned channel, unsigned long code);
+   void CacheDAC(unsigned channel, unsigned long code);
+   bool IsWheelTargetCached(unsigned pos);
+   void CacheWheelTarget(unsigned pos);
+   void InvalidateOutputCache();
+   void InvalidateStateCache();
+
+   // DAC writes from the two Arduino-DAC devices that come within the sync
+   // window of each other go out as one command (4), so both outputs change
+   // at the same instant.  No timer sends a write whose partner never comes:
+   // it goes out with the next command to the board, or when Busy() on its
+   // DAC is polled after the window.  Callers that need the output to change
+   // must poll Busy() until it is false, as waitForDevice does.  A write
+   // that fails stays pending, so Busy() stays true and the next command
+   // tries it again; the next write to that channel goes out at once and
+   // returns the result.
+   // Callers must hold the lock.
+   int WriteDAC(unsigned channel, unsigned long code);
+   int FlushDAC();
+   bool PollDAC(unsigned channel);
+
+   // Full scale of each DAC, from the MaxVolt of its Arduino-DAC device, so
+   // the channel presets and the DAC devices convert volts the same way.
+   // Volts beyond the scale give the nearest code.
+   void SetDACMaxVolts(unsigned channel, double volts);
+   unsigned long VoltsToDACCode(unsigned channel, double volts) const;
+   double DACCodeToVolts(unsigned channel, unsigned long code) const;
+
+   // Filter wheel status, for the wheel and the channel presets.  These
+   // take the lock themselves, so other devices get through between polls.
+   // A stall returns ERR_WHEEL_STALLED, a move that takes longer than
+   // timeoutMs is stopped and returns ERR_MOVE_TIMEOUT, and a wheel that
+   // comes to rest anywhere but target returns ERR_WHEEL_POSITION.
+   // StopWheel() needs the lock held.
+   int ReadWheelStatus(long& pos, bool& moving);
+   int WaitForWheel(long timeoutMs, long target, long& pos);
+   int StopWheel();
+
+   void AddPresetListener(ArduinoPresetListener* listener);
+   void RemovePresetListener(ArduinoPresetListener* listener);
+   void NotifyPresetApplied(long wheel, unsigned pattern, const unsigned long* dacCodes);
+
+private:
+   static const unsigned int NUMDACS = 2;
+
+   int GetControllerVersion(int&);
+   int ReadReply(unsigned char opcode, bool tagged, unsigned char* frame,
+         unsigned long replyLen, const MM::MMTime& startTime, long timeoutMs);
+   long ReplyTimeoutMs(unsigned char opcode, long tableMs);
+   void AddRoundTrip(unsigned char opcode, double ms);
+   void ResetRoundTrips();
+   int SetPortBaudRate(long baud);
+   int NegotiateBaudRate(long maxBaud);
+   int TryBaudRate(unsigned index);
+   int StepDownBaudRate();
+   int VerifyLink();
+   int SendDAC(unsigned channel, unsigned long code);
+   int OpenTrafficLog();
+   void RecordTraffic(ArduinoTrafficRecord::Kind kind, const unsigned char* bytes, unsigned long count);
+   std::string port_;
+   bool initialized_;
+   bool portAvailable_;
+   bool invertedLogic_;
+   bool timedOutputActive_;
+   int version_;
+   long maxBaud_;
+   long baud_;
+   static MMThreadLock lock_;
+   static ArduinoSleepSource* sleepSource_;
+   unsigned switchState_;
+   unsigned shutterState_;
+   unsigned char seq_;
+
+   bool stateCacheOn_;
+   bool patternValid_;
+   unsigned char cachedPattern_;
+   bool dacValid_[NUMDACS];
+   unsigned long cachedDAC_[NUMDACS];
+   bool wheelValid_;
+   unsigned cachedWheel_;
+   long skippedWrites_;
+   long retries_;
+   long retryBudgetMs_;
+   long retriedCommands_;
+   // commands in a row that failed even with the retries
+   long failedCommands_;
+   bool changingBaud_;
+
+   // Round trips of the last RTTWINDOW replies to each command, for the
+   // reply timeouts.  rttSlot_ maps an opcode to its entry + 1, 0 for none.
+   static const unsigned RTTWINDOW = 32;
+   static const unsigned RTTMINSAMPLES = 8;
+   struct RoundTrips
+   {
+      float ms[RTTWINDOW];
+      unsigned count;
+      unsigned next;
+      // the longest and second longest in ms
+      float longestMs;
+      float highMs;
+   };
+   RoundTrips roundTrips_[ArduinoProtocol::NumCommands];
+   unsigned char rttSlot_[256];
+   unsigned rttSlots_;
+   bool adaptiveTimeouts_;
+   long timeoutMarginMs_;
+   long minTimeoutMs_;
+   long maxTimeoutMs_;
+
+   long dacSyncWindowMs_;
+   bool dacPending_[NUMDACS];
+   unsigned long pendingDAC_[NUMDACS];
+   // error of the last failed send of a pending write
+   int dacError_[NUMDACS];
+   bool flushingDAC_;
+   double dacMaxVolts_[NUMDACS];
+   MM::MMTime dacPendingSince_;
+
+   // "" records nothing
+   std::string trafficLogPath_;
+   long trafficLogLimitMB_;
+   ArduinoTrafficLog trafficLog_;
+
+   std::vector<ArduinoPresetListener*> presetListeners_;
+};
+
+class CArduinoShutter : public CShutterBase<CArduinoShutter>
+{
+public:
+   CArduinoShutter();
+   ~CArduinoShutter();
+  
+   // MMDevice API
+   // ------------
+   int Initialize();
+   int Shutdown();
+  
+   void GetName(char* pszName) const;
+   bool Busy();
+   
+   // Shutter API
+   int SetOpen(bool open = true);
+   int GetOpen(bool& open);
+   int Fire(double deltaT);
+
+   // action interface
+   // ----------------
+   int OnOnOff(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFireCount(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnFirePeriod(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+private:
+   int WriteToPort(long lnValue);
+   MM::MMTime changedTime_;
+   MM::MMTime fireEnd_;
+   long fireCount_;
+   double firePeriodMs_;
+   bool initialized_;
+   std::string name_;
+};
+
+class CArduinoSwitch : public CStateDeviceBase<CArduinoSwitch>, public ArduinoPresetListener
+{
+public:
+   CArduinoSwitch();
+   ~CArduinoSwitch();
+  
+   // MMDevice API
+   // ------------
+   int Initialize();
+   int Shutdown();
+  
+   void GetName(char* pszName) const;
+   bool Busy() {return busy_;}
+   
+   unsigned long GetNumberOfPositions()const {return numPos_;}
+
+   // action interface
+   // ----------------
+   int OnState(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnDelay(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnRepeatTimedPattern(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnStartTimedOutput(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnBlanking(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnBlankingTriggerDirection(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSequence(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+   // tops up the board's stream, called by ArduinoSequenceStreamThread,
+   // which then sleeps until the triggers should have made room.  A failed
+   // refill stops the thread; StreamFailed() logs it and the next
+   // StopSequence returns it.
+   int RefillStream();
+   long StreamRefillDelayMs();
+   void StreamFailed(int error);
+
+   void PresetApplied(long wheel, unsigned pattern, const unsigned long* dacCodes);
+
+private:
+   static const unsigned int NUMPATTERNS = 12;
+   // Longer sequences are streamed (firmware version 3): the board plays
+   // them from a small ring that a thread keeps filled.
+   static const long MAXSTREAMED = 65536;
+   static const unsigned int STREAMCHUNK = ArduinoProtocol::MaxChunk;
+   // longest the stream goes without a refill while the trigger rate is
+   // unknown, and once it is known
+   static const long STREAMPOLLMS = 20;
+   static const long STREAMIDLEMS = 100;
+
+   int WriteToPort(long lnValue);
+   int LoadSequence(unsigned size, const unsigned char* seq, const unsigned char* repeat = 0);
+   static bool ParsePattern(const std::string& text, unsigned char& value);
+   static unsigned CompressRuns(const unsigned char* seq, unsigned size,
+         unsigned char* pattern, unsigned char* repeat, unsigned maxRuns);
+   int StartStream();
+   void StopStreamThread();
+
+   unsigned pattern_[NUMPATTERNS];
+   int nrPatternsUsed_;
+   unsigned currentDelay_;
+   bool sequenceOn_;
+   bool blanking_;
+   bool initialized_;
+   long numPos_;
+   bool busy_;
+
+   bool streamable_;
+   bool streamed_;
+   // the last loaded sequence, reserved once so loading does not allocate
+   std::vector<unsigned char> sequence_;
+   size_t streamPos_;
+   unsigned streamFree_;
+   // when streamFree_ was reported, and the patterns per ms the
+   // triggers have been taking from the ring since the stream started
+   MM::MMTime streamFreeTime_;
+   double streamRate_;
+   bool underrunLogged_;
+   // set by the stream thread, read once it has stopped
+   int streamError_;
+   ArduinoSequenceStreamThread* streamThread_;
+};
+
+class CArduinoDA : public CSignalIOBase<CArduinoDA>, public ArduinoPresetListener
+{
+public:
+   CArduinoDA(int channel);
+   ~CArduinoDA();
+  
+   // MMDevice API
+   // ------------
+   int Initialize();
+   int Shutdown();
+  
+   void GetName(char* pszName) const;
+   bool Busy();
+
+   // DA API
+   int SetGateOpen(bool open);
+   int GetGateOpen(bool& open) {open = gateOpen_; return DEVICE_OK;}
+   int SetSignal(double volts);
+   int GetSignal(double& volts) {volts = volts_; return DEVICE_OK;}
+   int GetLimits(double& minVolts, double& maxVolts) {minVolts = minV_; maxVolts = maxV_; return DEVICE_OK;}
+   
+   // The board plays the sequence from its own table, stepping on each
+   // trigger edge or on its timer ("Sequence Interval (us)" > 0)
+   int IsDASequenceable(bool& isSequenceable) const {isSequenceable = sequenceable_; return DEVICE_OK;}
+   int GetDASequenceMaxLength(long& nrEvents) const {nrEvents = WAVELENGTH; return DEVICE_OK;}
+   int StartDASequence();
+   int StopDASequence();
+   int ClearDASequence();
+   int AddToDASequence(double voltage);
+   int SendDASequence();
+
+   // action interface
+   // ----------------
+   int OnVolts(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnMaxVolt(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnChannel(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnSequenceInterval(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+   void PresetApplied(long wheel, unsigned pattern, const unsigned long* dacCodes);
+
+private:
+   static const unsigned int WAVELENGTH = 64;
+
+   int WriteToPort(unsigned long lnValue);
+   int WriteSignal(double volts);
+   unsigned long VoltsToCode(double volts) const;
+
+   bool initialized_;
+   bool busy_;
+   double minV_;
+   double maxV_;
+   double volts_;
+   double gatedVolts_;
+   unsigned channel_;
+   unsigned maxChannel_;
+   bool gateOpen_;
+   bool sequenceable_;
+   long sequenceIntervalUs_;
+   std::vector<unsigned long> sequence_;
+   std::string name_;
+};
+
+// Applies wheel target, output pattern and both DAC setpoints of a preset
+// in a single command.  The board answers right away; the lock is released
+// while the wheel turns.
+class CArduinoChannel : public CStateDeviceBase<CArduinoChannel>
+{
+public:
+   CArduinoChannel();
+   ~CArduinoChannel();
+  
+   // MMDevice API
+   // ------------
+   int Initialize();
+   int Shutdown();
+  
+   void GetName(char* pszName) const;
+   bool Busy() {return false;}
+   
+   unsigned long GetNumberOfPositions()const {return NUMPRESETS;}
+
+   // action interface
+   // ----------------
+   int OnState(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnPresetWheel(MM::PropertyBase* pProp, MM::ActionType eAct, long preset);
+   int OnPresetPattern(MM::PropertyBase* pProp, MM::ActionType eAct, long preset);
+   int OnPresetVolts(MM::PropertyBase* pProp, MM::ActionType eAct, long index);
+
+private:
+   static const unsigned int NUMPRESETS = 8;
+
+   int WriteToPort(long preset);
+   int SendPreset(long preset, unsigned long* dac);
+
+   long wheel_[NUMPRESETS];
+   long pattern_[NUMPRESETS];
+   double volts_[NUMPRESETS][2];
+   bool initialized_;
+};
+
+class CArduinoInput : public CGenericBase<CArduinoInput>  
+{
+public:
+   CArduinoInput();
+   ~CArduinoInput();
+
+   int Initialize();
+   int Shutdown();
+   void GetName(char* pszName) const;
+   bool Busy();
+
+   int OnDigitalInput(MM::PropertyBase* pPropt, MM::ActionType eAct);
+   int OnAnalogInput(MM::PropertyBase* pProp, MM::ActionType eAct, long channel);
+
+   int GetDigitalInput(long* state);
+   int ReportStateChange(long newState);
+
+private:
+   int SetPullUp(int pin, int state);
+
+   ArduinoInputMonitorThread* mThread_;
+   char pins_[MM::MaxStrLength];
+   char pullUp_[MM::MaxStrLength];
+   int pin_;
+   bool initialized_;
+   std::string name_;
+};
+
+class ArduinoInputMonitorThread : public MMDeviceThreadBase
+{
+   public:
+      ArduinoInputMonitorThread(CArduinoInput& aInput);
+     ~ArduinoInputMonitorThread();
+      int svc();
+      int open (void*) { return 0;}
+      int close(unsigned long) {return 0;}
+
+      void Start();
+      void Stop() {stop_ = true;}
+      ArduinoInputMonitorThread & operator=( const ArduinoInputMonitorThread & ) 
+      {
+         return *this;
+      }
+
+
+   private:
+      long state_;
+      CArduinoInput& aInput_;
+      bool stop_;
+};
+
+class ArduinoSequenceStreamThread : public MMDeviceThreadBase
+{
+   public:
+      ArduinoSequenceStreamThread(CArduinoSwitch& aSwitch);
+     ~ArduinoSequenceStreamThread();
+      int svc();
+      int open (void*) { return 0;}
+      int close(unsigned long) {return 0;}
+
+      void Start();
+      void Stop() {stop_ = true;}
+      ArduinoSequenceStreamThread & operator=( const ArduinoSequenceStreamThread & )
+      {
+         return *this;
+      }
+
+
+   private:
+      CArduinoSwitch& aSwitch_;
+      bool stop_;
+};
+
+
+#endif //_Arduino_H_
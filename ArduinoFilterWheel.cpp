@@ -1,486 +1,607 @@
- //////////////////////////////////////////////////////////////////////////////
-// FILE:          ArduinoFilterWheel.cpp
-// PROJECT:       Micro-Manager
-// SUBSYSTEM:     DeviceAdapters
-//-----------------------------------------------------------------------------
-// DESCRIPTION:   Adapter for Arduino board
-//                Needs accompanying firmware to be installed on the board
-//
-// AUTHOR:        Shirish Goyal, shirish.goyal@gmail.com 09/14/2016
-//
-// COPYRIGHT:     Shirish Goyal, BioCurious, Sunnyvale, 2016
-//
-// LICENSE:       This file is distributed under the BSD license.
-//                License text is included with the source distribution.
-//
-//                This file is distributed in the hope that it will be useful,
-//                but WITHOUT ANY WARRANTY; without even the implied warranty
-//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
-//
-//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
-//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
-//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
-
-#include "ArduinoFilterWheel.h"
-#include "../../MMDevice/ModuleInterface.h"
-#include <sstream>
-#include <cstdio>
-
-#ifdef WIN32
-	#define WIN32_LEAN_AND_MEAN
-	#include <windows.h>
-	#define snprintf _snprintf
-#endif
-
-const char* g_DeviceNameArduinoFilterWheelHub = "ArduinoFilterWheel-Hub";
-const char* g_DeviceNameArduinoFilterWheel = "ArduinoFilterWheel-FilterWheel";
-const char* g_DeviceDescriptionArduinoFilterWheel="Arduino Filter Wheel Driver";
-const char* g_versionProp = "Version";
-
-const int g_Min_MMVersion = 0;
-const int g_Max_MMVersion = 1;
-
-const char* g_On = "On";
-const char* g_Off = "Off";
-
-// static lock
-MMThreadLock CArduinoFilterWheelHub::lock_;
-
-///////////////////////////////////////////////////////////////////////////////
-// Exported MMDevice API
-///////////////////////////////////////////////////////////////////////////////
-MODULE_API void InitializeModuleData() {
-    RegisterDevice(g_DeviceNameArduinoFilterWheelHub, MM::HubDevice, "Hub (required)");
-    RegisterDevice(g_DeviceNameArduinoFilterWheel, MM::StateDevice, "Filter Wheel");
-}
-
-MODULE_API MM::Device *CreateDevice(const char *deviceName) {
-    if (deviceName == 0)
-        return 0;
-
-    if (strcmp(deviceName, g_DeviceNameArduinoFilterWheelHub) == 0) {
-        return new CArduinoFilterWheelHub;
-    } else if (strcmp(deviceName, g_DeviceNameArduinoFilterWheel) == 0) {
-        return new CArduinoFilterWheel;
-    }
-
-    return 0;
-}
-
-MODULE_API void DeleteDevice(MM::Device *pDevice) {
-    delete pDevice;
-}
-///////////////////////////////////////////////////////////////////////////////
-
-CArduinoFilterWheelHub::CArduinoFilterWheelHub() :
-        initialized_(false),
-        filterWheelState_(0) {
-    portAvailable_ = false;
-
-	InitializeDefaultErrorMessages();
-
-    SetErrorText(ERR_PORT_OPEN_FAILED, "Failed opening Arduino USB device");
-    SetErrorText(ERR_BOARD_NOT_FOUND,
-                 "Did not find an Arduino board with the correct firmware.  Is the Arduino board connected to this serial port?");
-    SetErrorText(ERR_NO_PORT_SET, "Hub Device not found.  The Arduino Hub device is needed to create this device");
-
-    std::ostringstream errorText;
-    errorText
-            << "The firmware version on the Arduino is not compatible with this adapter.  Please use firmware version ";
-    errorText << g_Min_MMVersion << " to " << g_Max_MMVersion;
-    SetErrorText(ERR_VERSION_MISMATCH, errorText.str().c_str());
-
-    CPropertyAction *pAct = new CPropertyAction(this, &CArduinoFilterWheelHub::OnPort);
-    CreateProperty(MM::g_Keyword_Port, "Undefined", MM::String, false, pAct, true);
-}
-
-CArduinoFilterWheelHub::~CArduinoFilterWheelHub() {
-    Shutdown();
-}
-
-void CArduinoFilterWheelHub::GetName(char *name) const {
-	CDeviceUtils::CopyLimitedString(name, g_DeviceNameArduinoFilterWheelHub);
-}
-
-bool CArduinoFilterWheelHub::Busy() {
-    return false;
-}
-
-int CArduinoFilterWheelHub::GetControllerVersion(int &version) {
-    int ret = DEVICE_OK;
-    //unsigned char command[1];
-	std::string answer;
-
-    //command[0] = 1;
-    version = 0;
-
-	if(!portAvailable_){
-		return ERR_NO_PORT_SET;
-	}
-
-    //ret = SendSerialCommand(port_.c_str(), (const char *) command, 1);
-    //if (ret != DEVICE_OK)
-    //    return ret;
-
-    ret = SendSerialCommand(port_.c_str(), "V", "\r");
-	if (ret != DEVICE_OK)
-	  return ret;
-
-	ret = GetSerialAnswer(port_.c_str(), "\r", answer);
-	if (ret != DEVICE_OK) {
-	  return ret;
-	}
-
-	LogMessage("Found Board", false);
-	LogMessage(answer, false);
-
-    if (answer != "ArduinoFilterWheel" && answer != "\nArduinoFilterWheel") {
-      return ERR_BOARD_NOT_FOUND;
-    }
-    
-	version = 1; 
-    return ret;
-}
-
-int CArduinoFilterWheelHub::WriteToComPortH(const char* command, size_t len)
-    {
-		int ret = DEVICE_OK;
-	std::string answer;
-
-	ret = SendSerialCommand(port_.c_str(), (const char *)command, "\r");
-	return ret;
-    }
-
-bool CArduinoFilterWheelHub::SupportsDeviceDetection(void) {
-    return true;
-}
-
-MM::DeviceDetectionStatus CArduinoFilterWheelHub::DetectDevice(void) {
-    if (initialized_)
-        return MM::CanCommunicate;
-
-    MM::DeviceDetectionStatus result = MM::Misconfigured;
-    char answerTO[MM::MaxStrLength];
-
-    try {
-        std::string portLowerCase = port_;
-        for (std::string::iterator its = portLowerCase.begin(); its != portLowerCase.end(); ++its) {
-            *its = (char) tolower(*its);
-        }
-        if (0 < portLowerCase.length() && 0 != portLowerCase.compare("undefined") &&
-            0 != portLowerCase.compare("unknown")) {
-            result = MM::CanNotCommunicate;
-
-            // record the default answer time out
-            GetCoreCallback()->GetDeviceProperty(port_.c_str(), "AnswerTimeout", answerTO);
-
-            // device specific default communication parameters
-            // for Arduino Duemilanova
-            GetCoreCallback()->SetDeviceProperty(port_.c_str(), MM::g_Keyword_Handshaking, g_Off);
-            GetCoreCallback()->SetDeviceProperty(port_.c_str(), MM::g_Keyword_BaudRate, "9600");
-            GetCoreCallback()->SetDeviceProperty(port_.c_str(), MM::g_Keyword_StopBits, "1");
-            // Arduino timed out in GetArduinoVersion even if AnswerTimeout  = 300 ms
-            GetCoreCallback()->SetDeviceProperty(port_.c_str(), "AnswerTimeout", "500.0");
-            GetCoreCallback()->SetDeviceProperty(port_.c_str(), "DelayBetweenCharsMs", "0");
-
-            MM::Device *pS = GetCoreCallback()->GetDevice(this, port_.c_str());
-            pS->Initialize();
-
-            // The first second or so after opening the serial port, the Arduino is waiting for firmware upgrades.
-            // Simply sleep 2 seconds.
-            CDeviceUtils::SleepMs(2000);
-
-            MMThreadGuard myLock(lock_);
-            PurgeComPort(port_.c_str());
-
-            int v = 0;
-            int ret = GetControllerVersion(v);
-
-            // later, Initialize will explicitly check the version #
-            if (DEVICE_OK != ret) {
-                LogMessageCode(ret, true);
-            } else {
-                // to succeed must reach here....
-                result = MM::CanCommunicate;
-            }
-            pS->Shutdown();
-            // always restore the AnswerTimeout to the default
-            GetCoreCallback()->SetDeviceProperty(port_.c_str(), "AnswerTimeout", answerTO);
-        }
-    }
-    catch (...) {
-        LogMessage("Exception in Detect Device!", false);
-    }
-
-    return result;
-}
-
-int CArduinoFilterWheelHub::Initialize() {
-    // Name
-   int ret = CreateProperty(MM::g_Keyword_Name, g_DeviceNameArduinoFilterWheelHub, MM::String, true);
-   if (DEVICE_OK != ret)
-      return ret;
-
-   LogMessage("Initializing Filter Wheel", false);
-
-   // The first second or so after opening the serial port, the Arduino is waiting for firmwareupgrades.  Simply sleep 1 second.
-   CDeviceUtils::SleepMs(2000);
-
-   MMThreadGuard myLock(lock_);
-
-   // Check that we have a controller:
-   PurgeComPort(port_.c_str());
-
-   ret = GetControllerVersion(version_);
-   if( DEVICE_OK != ret)
-      return ret;
-
-   if (version_ < g_Min_MMVersion || version_ > g_Max_MMVersion)
-       return ERR_VERSION_MISMATCH;
-
-   CPropertyAction* pAct = new CPropertyAction(this, &CArduinoFilterWheelHub::OnVersion);
-   std::ostringstream sversion;
-   sversion << version_;
-   CreateProperty(g_versionProp, sversion.str().c_str(), MM::Integer, true, pAct);
-   ret = UpdateStatus();
-   if (ret != DEVICE_OK)
-      return ret;
-
-   // turn on verbose serial debug messages
-   GetCoreCallback()->SetDeviceProperty(port_.c_str(), "Verbose", "1");
-
-   initialized_ = true;
-   return DEVICE_OK;
-}
-
-int CArduinoFilterWheelHub::DetectInstalledDevices()
-{
-   if (MM::CanCommunicate == DetectDevice()) 
-   {
-      std::vector<std::string> peripherals; 
-
-      peripherals.clear();
-      peripherals.push_back(g_DeviceNameArduinoFilterWheel);
-
-      for (size_t i=0; i < peripherals.size(); i++) 
-      {
-         MM::Device* pDev = ::CreateDevice(peripherals[i].c_str());
-         if (pDev) 
-         {
-             AddInstalledDevice(pDev);
-         }
-      }
-   }
-
-   return DEVICE_OK;
-}
-
-int CArduinoFilterWheelHub::Shutdown() {
-	LogMessage("Shutdown", false);
-   initialized_ = false;
-   return DEVICE_OK;
-}
-
-int CArduinoFilterWheelHub::OnPort(MM::PropertyBase *pProp, MM::ActionType eAct) {
-	LogMessage("On Port", false);
-
-    if (eAct == MM::BeforeGet) {
-        pProp->Set(port_.c_str());
-    } else if (eAct == MM::AfterSet) {
-        pProp->Get(port_);
-		portAvailable_ = true;
-    }
-
-    return DEVICE_OK;
-}
-
-int CArduinoFilterWheelHub::OnVersion(MM::PropertyBase* pProp, MM::ActionType pAct)
-{
-	LogMessage("On Version", false);
-   if (pAct == MM::BeforeGet)
-   {
-      pProp->Set((long)version_);
-   }
-   return DEVICE_OK;
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// CArduinoFilterWheel implementation
-// ~~~~~~~~~~~~~~~~~~~~~~~~~~~
-
-CArduinoFilterWheel::CArduinoFilterWheel() : 
-	busy_(false),
-	initialized_(false), 
-	name_(g_DeviceNameArduinoFilterWheel),
-	changedTime_(0.0),
-    position_(6),
-	numPos_(7)
-{
-   InitializeDefaultErrorMessages();
-   EnableDelay();
-
-   SetErrorText(ERR_NO_PORT_SET, "Hub Device not found.  The ArduinoFilterWheel Hub device is needed to create this device");
-
-   // Name
-   int ret = CreateProperty(MM::g_Keyword_Name, g_DeviceNameArduinoFilterWheel, MM::String, true);
-   assert(DEVICE_OK == ret);
-
-   // Description
-   ret = CreateProperty(MM::g_Keyword_Description, g_DeviceDescriptionArduinoFilterWheel, MM::String, true);
-   assert(DEVICE_OK == ret);
-
-   // parent ID display
-   CreateHubIDProperty();
-}
-
-CArduinoFilterWheel::~CArduinoFilterWheel() {
-	LogMessage("Destructor", false);
-    Shutdown();
-}
-
-void CArduinoFilterWheel::GetName(char *Name) const {
-    CDeviceUtils::CopyLimitedString(Name, g_DeviceNameArduinoFilterWheel);
-}
-
-bool CArduinoFilterWheel::Busy() {
-	LogMessage("Busy", false);
-	return busy_;
-    //MM::MMTime interval = GetCurrentMMTime() - changedTime_;
-    //MM::MMTime delay(GetDelayMs() * 1000.0);
-    //return (interval < delay);
-}
-
-int CArduinoFilterWheel::Initialize() {
-	LogMessage("Initialize FW", false);
-   CArduinoFilterWheelHub* hub = static_cast<CArduinoFilterWheelHub*>(GetParentHub());
-   if (!hub || !hub->IsPortAvailable()) {
-	  LogMessage("Port failed for Filter Wheel", true);
-      return ERR_NO_PORT_SET;
-   }
-   char hubLabel[MM::MaxStrLength];
-   hub->GetLabel(hubLabel);
-   SetParentID(hubLabel); // for backward comp.
-
-    // set property list
-    // -----------------
-
-    // Set timer for the Busy signal, or we'll get a time-out the first time we check the state of the shutter, for good measure, go back 'delay' time into the past
-    //changedTime_ = GetCurrentMMTime();
-   LogMessage("Set Positions FW", false);
-    // create default positions and labels
-    const int bufSize = 64;
-    char buf[bufSize];
-
-	snprintf(buf, bufSize, "Cy3");
-    SetPositionLabel(1, buf);
-
-	snprintf(buf, bufSize, "TxRed");
-    SetPositionLabel(2, buf);
-
-	snprintf(buf, bufSize, "Cy5");
-    SetPositionLabel(3, buf);
-
-	snprintf(buf, bufSize, "Mirror");
-    SetPositionLabel(4, buf);
-
-	snprintf(buf, bufSize, "Empty");
-    SetPositionLabel(5, buf);
-
-	snprintf(buf, bufSize, "Fitc");
-    SetPositionLabel(6, buf);
-
-	// add Stop Position
-    snprintf(buf, bufSize, "Stop");
-    SetPositionLabel(0, buf);
-
-    // add Home Position   **&*&*&&*&*&*  TODO: HOME  position value *^^*^*^*^^
-    //snprintf(buf, bufSize, "Home");
-    //SetPositionLabel(5, buf);
-
-    //for (unsigned long i = 1; i <= numPos_; i++) {
-    //    snprintf(buf, bufSize, "Filter %d", i);
-    //    SetPositionLabel(i, buf);
-    //}
-
-    // State
-    // -----
-	CPropertyAction *pAct = new CPropertyAction(this, &CArduinoFilterWheel::OnState);
-    int ret = CreateProperty(MM::g_Keyword_State, "State", MM::Integer, false, pAct);
-    if (ret != DEVICE_OK)
-        return ret;
-	SetPropertyLimits(MM::g_Keyword_State, 0, numPos_- 1);
-
-    // Label
-    // -----
-    pAct = new CPropertyAction(this, &CStateBase::OnLabel);
-    ret = CreateProperty(MM::g_Keyword_Label, "", MM::String, false, pAct);
-    if (ret != DEVICE_OK)
-        return ret;
-    
-    ret = UpdateStatus();
-    if (ret != DEVICE_OK)
-        return ret;
-
-    initialized_ = true;
-    return DEVICE_OK;
-}
-
-int CArduinoFilterWheel::Shutdown() {
-    if (initialized_) {
-        initialized_ = false;
-    }
-
-    return DEVICE_OK;
-}
-
-int CArduinoFilterWheel::OnState(MM::PropertyBase *pProp, MM::ActionType eAct) {
-	const int bufSize = 128;
-    char msg[bufSize];
-	long pos;
-
-	CArduinoFilterWheelHub* hub = static_cast<CArduinoFilterWheelHub*>(GetParentHub());
-    if (!hub || !hub->IsPortAvailable())
-      return ERR_NO_PORT_SET;
-
-    if (eAct == MM::BeforeGet) {
-        pProp->Set((long)position_);
-
-        // nothing to do, let the caller to use cached property
-    } else if (eAct == MM::AfterSet) {
-
-        // Set timer for the Busy signal
-        changedTime_ = GetCurrentMMTime();
-
-        pProp->Get(pos);
-
-        //char* deviceName;
-        //GetName(deviceName);
-
-        //if (pos >= numPos_ || pos < 0) {
-		//	LogMessage("Invalid position - reverting",false);
-        //    pProp->Set(pos); // revert
-        //    //return ERR_UNKNOWN_POSITION;
-        //}
-
-		snprintf(msg, bufSize, "Moving to %d", pos);
-        LogMessage(msg,false);
-
-        const int bufSize = 16;
-        char buf[bufSize];
-        snprintf(buf, bufSize, "%d", pos);
-
-        //SendSerialCommand(port_.c_str(), buf, "\r");
-        position_ = pos;
-
-		hub->SetFilterWheelState(pos);
-		if (hub->GetFilterWheelState() >= 0){
-			snprintf(msg, bufSize, "New %d", position_);
-			LogMessage(msg,false);
-			return hub->WriteToComPortH((const char*)buf, bufSize);
-		}
-		
-    }
-
-    return DEVICE_OK;
-}
-
+ //////////////////////////////////////////////////////////////////////////////
+// FILE:          ArduinoFilterWheel.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Adapter for Arduino board
+//                Needs accompanying firmware to be installed on the board
+//
+// AUTHOR:        Shirish Goyal, shirish.goyal@gmail.com 09/14/2016
+//
+// COPYRIGHT:     Shirish Goyal, BioCurious, Sunnyvale, 2016
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ArduinoFilterWheel.h"
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+	#define snprintf _snprintf
+#endif
+
+// registered together with the other devices in Arduino.cpp
+extern const char* g_DeviceNameArduinoFilterWheel;
+const char* g_DeviceDescriptionArduinoFilterWheel="Arduino Filter Wheel Driver";
+
+// a wheel that homes after power-up takes at most one turn
+const long g_HomingTimeoutMs = 10000;
+
+///////////////////////////////////////////////////////////////////////////////
+// CArduinoFilterWheel implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+CArduinoFilterWheel::CArduinoFilterWheel() : 
+	numPos_(7),
+	initialized_(false), 
+	changedTime_(0.0),
+	position_(0),
+	moveTimeoutMs_(5000),
+	moveStarted_(false),
+	moveError_(DEVICE_OK),
+	holdTrigger_(false),
+	programLength_(0),
+	programRepeat_(0),
+	name_(g_DeviceNameArduinoFilterWheel)
+{
+   for (unsigned int i = 0; i < NUMSTEPS; i++)
+   {
+      stepPosition_[i] = 1;
+      stepDwell_[i] = 1000;
+      stepRepeat_[i] = 1;
+   }
+
+   InitializeDefaultErrorMessages();
+   EnableDelay();
+
+   SetErrorText(ERR_COMMUNICATION, "Error in communication with Arduino board");
+   SetErrorText(ERR_NO_PORT_SET, "Hub Device not found.  The Arduino Hub device is needed to create this device");
+   SetErrorText(ERR_VERSION_MISMATCH, "To use the filter wheel you need firmware version 3 or higher");
+   SetErrorText(ERR_WHEEL_STALLED, "The filter wheel stalled before reaching its position");
+   SetErrorText(ERR_MOVE_TIMEOUT, "The filter wheel did not reach its position within the move timeout");
+   SetErrorText(ERR_WHEEL_POSITION, "The filter wheel came to rest at another position than it was sent to");
+
+   // Name
+   int ret = CreateProperty(MM::g_Keyword_Name, g_DeviceNameArduinoFilterWheel, MM::String, true);
+   assert(DEVICE_OK == ret);
+
+   // Description
+   ret = CreateProperty(MM::g_Keyword_Description, g_DeviceDescriptionArduinoFilterWheel, MM::String, true);
+   assert(DEVICE_OK == ret);
+
+   // parent ID display
+   CreateHubIDProperty();
+}
+
+CArduinoFilterWheel::~CArduinoFilterWheel() {
+    Shutdown();
+}
+
+void CArduinoFilterWheel::GetName(char *Name) const {
+    CDeviceUtils::CopyLimitedString(Name, g_DeviceNameArduinoFilterWheel);
+}
+
+// Asks the board whether the wheel is still turning.  A move started from
+// the State property is checked here when the wheel stops: a stall, a
+// move that outlasts moveTimeoutMs_ (the wheel is then stopped) or a
+// wheel that comes to rest in the wrong slot is logged, kept in
+// moveError_ and returned by the next get of State.
+bool CArduinoFilterWheel::Busy() {
+	long pos = position_;
+	bool moving = false;
+	int ret = ReadPosition(pos, moving);
+	if (!moveStarted_) {
+		if (ret != DEVICE_OK)
+			LogMessage("Could not read the filter wheel status", true);
+		return ret == DEVICE_OK && moving;
+	}
+
+	if (ret == DEVICE_OK && moving) {
+		if ((GetCurrentMMTime() - changedTime_).getMsec() <= moveTimeoutMs_)
+			return true;
+
+		CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+		MMThreadGuard myLock(hub->GetLock());
+		ret = hub->StopWheel();
+		if (ret == DEVICE_OK)
+			ret = ERR_MOVE_TIMEOUT;
+	} else if (ret == DEVICE_OK && pos != position_) {
+		ret = ERR_WHEEL_POSITION;
+	}
+
+	moveStarted_ = false;
+	moveError_ = ret;
+	if (ret != DEVICE_OK) {
+		CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+		if (hub) {
+			MMThreadGuard myLock(hub->GetLock());
+			hub->InvalidateStateCache();
+		}
+		std::ostringstream os;
+		os << "Move to " << position_ << " failed with error " << ret << ", the wheel is at " << pos;
+		LogMessage(os.str().c_str(), false);
+		position_ = pos;
+	}
+	return false;
+}
+
+// Slot the wheel is at (0 while unknown) and whether it is turning.
+// Returns ERR_WHEEL_STALLED when the board gave up on the last move.
+int CArduinoFilterWheel::ReadPosition(long& pos, bool& moving)
+{
+	CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+	if (!hub || !hub->IsPortAvailable())
+		return ERR_NO_PORT_SET;
+
+	return hub->ReadWheelStatus(pos, moving);
+}
+
+// a channel preset moved the wheel
+void CArduinoFilterWheel::PresetApplied(long wheel, unsigned, const unsigned long*)
+{
+	if (wheel < 0)
+		return;
+	position_ = wheel;
+	moveStarted_ = false;
+	std::ostringstream os;
+	os << position_;
+	OnPropertyChanged(MM::g_Keyword_State, os.str().c_str());
+}
+
+int CArduinoFilterWheel::Initialize() {
+   CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+   if (!hub || !hub->IsPortAvailable()) {
+      return ERR_NO_PORT_SET;
+   }
+   char hubLabel[MM::MaxStrLength];
+   hub->GetLabel(hubLabel);
+   SetParentID(hubLabel); // for backward comp.
+
+   char ver[MM::MaxStrLength] = "0";
+   hub->GetProperty(g_versionProp, ver);
+   int version = atoi(ver);
+   if (version < g_Tagged_MMVersion)
+      return ERR_VERSION_MISMATCH;
+
+   // The board restores its position from EEPROM after a reset and only
+   // homes when it cannot; either way, take the position from the board.
+   bool moving = true;
+   MM::MMTime startTime = GetCurrentMMTime();
+   while (moving)
+   {
+      int ret = ReadPosition(position_, moving);
+      // a stall is cleared by the next move, it does not stop us here
+      if (ret == ERR_WHEEL_STALLED)
+         ret = DEVICE_OK;
+      if (ret != DEVICE_OK)
+         return ret;
+      if (moving && (GetCurrentMMTime() - startTime).getMsec() > g_HomingTimeoutMs)
+         break;
+      if (moving)
+         CArduinoHub::SleepMs(50);
+   }
+
+   // the wheel is there already, no need to send it
+   if (!moving && position_ > 0)
+   {
+      MMThreadGuard myLock(hub->GetLock());
+      hub->CacheWheelTarget((unsigned) position_);
+   }
+
+    // set property list
+    // -----------------
+
+    // create default positions and labels
+    const int bufSize = 64;
+    char buf[bufSize];
+
+    snprintf(buf, bufSize, "Cy3");
+    SetPositionLabel(1, buf);
+
+    snprintf(buf, bufSize, "TxRed");
+    SetPositionLabel(2, buf);
+
+    snprintf(buf, bufSize, "Cy5");
+    SetPositionLabel(3, buf);
+
+    snprintf(buf, bufSize, "Mirror");
+    SetPositionLabel(4, buf);
+
+    snprintf(buf, bufSize, "Empty");
+    SetPositionLabel(5, buf);
+
+    snprintf(buf, bufSize, "Fitc");
+    SetPositionLabel(6, buf);
+
+    // add Stop Position
+    snprintf(buf, bufSize, "Stop");
+    SetPositionLabel(0, buf);
+
+    // State
+    // -----
+    CPropertyAction *pAct = new CPropertyAction(this, &CArduinoFilterWheel::OnState);
+    std::ostringstream state;
+    state << position_;
+    int ret = CreateProperty(MM::g_Keyword_State, state.str().c_str(), MM::Integer, false, pAct);
+    if (ret != DEVICE_OK)
+        return ret;
+    SetPropertyLimits(MM::g_Keyword_State, 0, numPos_- 1);
+
+    // Label
+    // -----
+    pAct = new CPropertyAction(this, &CStateBase::OnLabel);
+    ret = CreateProperty(MM::g_Keyword_Label, "", MM::String, false, pAct);
+    if (ret != DEVICE_OK)
+        return ret;
+
+    // Longest a move may take before it is failed and the wheel stopped
+    pAct = new CPropertyAction(this, &CArduinoFilterWheel::OnMoveTimeout);
+    ret = CreateProperty("Move Timeout (ms)", "5000", MM::Integer, false, pAct);
+    if (ret != DEVICE_OK)
+        return ret;
+    SetPropertyLimits("Move Timeout (ms)", 100, 60000);
+
+    // The board drives a "wheel ready" TTL and can keep camera triggers
+    // back until the wheel has settled, so no round trip is needed
+    pAct = new CPropertyAction(this, &CArduinoFilterWheel::OnHoldTrigger);
+    ret = CreateProperty("Hold Camera Trigger", g_Off, MM::String, false, pAct);
+    if (ret != DEVICE_OK)
+        return ret;
+    AddAllowedValue("Hold Camera Trigger", g_On);
+    AddAllowedValue("Hold Camera Trigger", g_Off);
+
+    // Filter program: the board cycles through the steps on its own timer.
+    // Works like the timed output of Arduino-Switch: set up the steps,
+    // then set "Program Mode" to Start.
+    for (unsigned int i = 0; i < NUMSTEPS; i++)
+    {
+        std::ostringstream prefix;
+        prefix << "Program Step " << i << " ";
+
+        CPropertyActionEx* pActEx = new CPropertyActionEx(this, &CArduinoFilterWheel::OnStepPosition, i);
+        std::string name = prefix.str() + "Position";
+        ret = CreateProperty(name.c_str(), "1", MM::Integer, false, pActEx);
+        if (ret != DEVICE_OK)
+            return ret;
+        SetPropertyLimits(name.c_str(), 1, numPos_ - 1);
+
+        pActEx = new CPropertyActionEx(this, &CArduinoFilterWheel::OnStepDwell, i);
+        name = prefix.str() + "Dwell (ms)";
+        ret = CreateProperty(name.c_str(), "1000", MM::Integer, false, pActEx);
+        if (ret != DEVICE_OK)
+            return ret;
+        SetPropertyLimits(name.c_str(), 0, 65535);
+
+        pActEx = new CPropertyActionEx(this, &CArduinoFilterWheel::OnStepRepeat, i);
+        name = prefix.str() + "Repeat";
+        ret = CreateProperty(name.c_str(), "1", MM::Integer, false, pActEx);
+        if (ret != DEVICE_OK)
+            return ret;
+        SetPropertyLimits(name.c_str(), 1, 255);
+    }
+
+    pAct = new CPropertyAction(this, &CArduinoFilterWheel::OnProgramLength);
+    ret = CreateProperty("Program Length", "0", MM::Integer, false, pAct);
+    if (ret != DEVICE_OK)
+        return ret;
+    SetPropertyLimits("Program Length", 0, NUMSTEPS);
+
+    // Run the program this many times, 0 runs until stopped
+    pAct = new CPropertyAction(this, &CArduinoFilterWheel::OnRepeatProgram);
+    ret = CreateProperty("Repeat Program", "0", MM::Integer, false, pAct);
+    if (ret != DEVICE_OK)
+        return ret;
+    SetPropertyLimits("Repeat Program", 0, 255);
+
+    pAct = new CPropertyAction(this, &CArduinoFilterWheel::OnProgramMode);
+    ret = CreateProperty("Program Mode", "Idle", MM::String, false, pAct);
+    if (ret != DEVICE_OK)
+        return ret;
+    AddAllowedValue("Program Mode", "Stop");
+    AddAllowedValue("Program Mode", "Start");
+    AddAllowedValue("Program Mode", "Running");
+    AddAllowedValue("Program Mode", "Idle");
+
+    pAct = new CPropertyAction(this, &CArduinoFilterWheel::OnProgramProgress);
+    ret = CreateProperty("Program Progress", "", MM::String, true, pAct);
+    if (ret != DEVICE_OK)
+        return ret;
+    
+    ret = UpdateStatus();
+    if (ret != DEVICE_OK)
+        return ret;
+
+    hub->AddPresetListener(this);
+    initialized_ = true;
+    return DEVICE_OK;
+}
+
+int CArduinoFilterWheel::Shutdown() {
+    if (initialized_) {
+        CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+        if (hub)
+            hub->RemovePresetListener(this);
+        initialized_ = false;
+    }
+
+    return DEVICE_OK;
+}
+
+// Starts the move (position 0 stops the wheel).  The board acknowledges
+// right away; Busy() tells when the wheel has arrived.
+int CArduinoFilterWheel::WriteToPort(long pos)
+{
+	CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+	if (!hub || !hub->IsPortAvailable())
+		return ERR_NO_PORT_SET;
+
+	MMThreadGuard myLock(hub->GetLock());
+
+	// the wheel was already sent there
+	if (hub->IsWheelTargetCached((unsigned) pos))
+		return DEVICE_OK;
+
+	unsigned char args[1];
+	args[0] = (unsigned char) pos;
+	unsigned char reply[1];
+	int ret = hub->Transact<ArduinoProtocol::WheelMove>(args, reply);
+	if (ret != DEVICE_OK)
+		return ret;
+	if (reply[0] != args[0])
+		return ERR_COMMUNICATION;
+
+	hub->CacheWheelTarget((unsigned) pos);
+	return DEVICE_OK;
+}
+
+int CArduinoFilterWheel::OnState(MM::PropertyBase *pProp, MM::ActionType eAct) {
+    if (eAct == MM::BeforeGet) {
+        pProp->Set((long)position_);
+
+        // the last move went wrong, see Busy(); reported once
+        if (moveError_ != DEVICE_OK) {
+            int ret = moveError_;
+            moveError_ = DEVICE_OK;
+            return ret;
+        }
+    } else if (eAct == MM::AfterSet) {
+        // a new move replaces a failed one, which Busy() has logged
+        moveError_ = DEVICE_OK;
+
+        long pos;
+        pProp->Get(pos);
+
+        // Set timer for the Busy signal
+        changedTime_ = GetCurrentMMTime();
+
+        std::ostringstream os;
+        os << "Moving to " << pos;
+        LogMessage(os.str().c_str(), true);
+
+        int ret = WriteToPort(pos);
+        if (ret != DEVICE_OK)
+            return ret;
+        position_ = pos;
+
+        // a stopped wheel has nowhere to go; Busy() sees the move through
+        moveStarted_ = pos > 0;
+    }
+
+    return DEVICE_OK;
+}
+
+// Sends the steps and the program length.  Caller must hold the lock.
+int CArduinoFilterWheel::LoadProgram()
+{
+	CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+
+	for (long i = 0; i < programLength_; i++)
+	{
+		unsigned char args[5];
+		args[0] = (unsigned char) i;
+		args[1] = (unsigned char) stepPosition_[i];
+		args[2] = (unsigned char) (stepDwell_[i] / 256L);
+		args[3] = (unsigned char) (stepDwell_[i] & 255);
+		args[4] = (unsigned char) stepRepeat_[i];
+		unsigned char reply[1];
+		int ret = hub->Transact<ArduinoProtocol::ProgramStep>(args, reply);
+		if (ret != DEVICE_OK)
+			return ret;
+		if (reply[0] != i)
+			return ERR_COMMUNICATION;
+	}
+
+	unsigned char args[1];
+	args[0] = (unsigned char) programLength_;
+	unsigned char reply[1];
+	int ret = hub->Transact<ArduinoProtocol::ProgramLength>(args, reply);
+	if (ret != DEVICE_OK)
+		return ret;
+
+	return DEVICE_OK;
+}
+
+int CArduinoFilterWheel::ReadProgramStatus(bool& running, long& step, long& dwells, long& cycle)
+{
+	CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+	if (!hub || !hub->IsPortAvailable())
+		return ERR_NO_PORT_SET;
+
+	MMThreadGuard myLock(hub->GetLock());
+
+	unsigned char reply[4];
+	int ret = hub->Query<ArduinoProtocol::ProgramStatus>(reply);
+	if (ret != DEVICE_OK)
+		return ret;
+
+	running = reply[0] != 0;
+	step = reply[1];
+	dwells = reply[2];
+	cycle = reply[3];
+	return DEVICE_OK;
+}
+
+int CArduinoFilterWheel::OnProgramMode(MM::PropertyBase *pProp, MM::ActionType eAct) {
+    if (eAct == MM::BeforeGet) {
+        bool running;
+        long step, dwells, cycle;
+        int ret = ReadProgramStatus(running, step, dwells, cycle);
+        if (ret != DEVICE_OK)
+            return ret;
+        pProp->Set(running ? "Running" : "Idle");
+    } else if (eAct == MM::AfterSet) {
+        CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+        if (!hub || !hub->IsPortAvailable())
+            return ERR_NO_PORT_SET;
+
+        std::string mode;
+        pProp->Get(mode);
+
+        MMThreadGuard myLock(hub->GetLock());
+
+        if (mode == "Start") {
+            int ret = LoadProgram();
+            if (ret != DEVICE_OK)
+                return ret;
+
+            unsigned char args[1];
+            args[0] = (unsigned char) programRepeat_;
+            ret = hub->Send<ArduinoProtocol::ProgramStart>(args);
+            if (ret != DEVICE_OK)
+                return ret;
+
+            // the board moves the wheel on its own from now on
+            hub->InvalidateStateCache();
+        } else if (mode == "Stop") {
+            unsigned char reply[2];
+            int ret = hub->Query<ArduinoProtocol::ProgramStop>(reply);
+            if (ret != DEVICE_OK)
+                return ret;
+
+            std::ostringstream os;
+            os << "Program stopped at step " << (int) reply[0] << " in cycle " << (int) reply[1];
+            LogMessage(os.str().c_str(), false);
+        }
+    }
+
+    return DEVICE_OK;
+}
+
+int CArduinoFilterWheel::OnProgramProgress(MM::PropertyBase *pProp, MM::ActionType eAct) {
+    if (eAct == MM::BeforeGet) {
+        bool running;
+        long step, dwells, cycle;
+        int ret = ReadProgramStatus(running, step, dwells, cycle);
+        if (ret != DEVICE_OK)
+            return ret;
+
+        std::ostringstream os;
+        if (running)
+            os << "Step " << step << ", dwell " << dwells + 1 << " of " << stepRepeat_[step % NUMSTEPS] << ", cycle " << cycle + 1;
+        else
+            os << "Idle";
+        pProp->Set(os.str().c_str());
+    }
+
+    return DEVICE_OK;
+}
+
+int CArduinoFilterWheel::OnProgramLength(MM::PropertyBase *pProp, MM::ActionType eAct) {
+    if (eAct == MM::BeforeGet) {
+        pProp->Set(programLength_);
+    } else if (eAct == MM::AfterSet) {
+        pProp->Get(programLength_);
+    }
+
+    return DEVICE_OK;
+}
+
+int CArduinoFilterWheel::OnRepeatProgram(MM::PropertyBase *pProp, MM::ActionType eAct) {
+    if (eAct == MM::BeforeGet) {
+        pProp->Set(programRepeat_);
+    } else if (eAct == MM::AfterSet) {
+        pProp->Get(programRepeat_);
+    }
+
+    return DEVICE_OK;
+}
+
+int CArduinoFilterWheel::OnStepPosition(MM::PropertyBase *pProp, MM::ActionType eAct, long step) {
+    if (eAct == MM::BeforeGet) {
+        pProp->Set(stepPosition_[step]);
+    } else if (eAct == MM::AfterSet) {
+        pProp->Get(stepPosition_[step]);
+    }
+
+    return DEVICE_OK;
+}
+
+int CArduinoFilterWheel::OnStepDwell(MM::PropertyBase *pProp, MM::ActionType eAct, long step) {
+    if (eAct == MM::BeforeGet) {
+        pProp->Set(stepDwell_[step]);
+    } else if (eAct == MM::AfterSet) {
+        pProp->Get(stepDwell_[step]);
+    }
+
+    return DEVICE_OK;
+}
+
+int CArduinoFilterWheel::OnStepRepeat(MM::PropertyBase *pProp, MM::ActionType eAct, long step) {
+    if (eAct == MM::BeforeGet) {
+        pProp->Set(stepRepeat_[step]);
+    } else if (eAct == MM::AfterSet) {
+        pProp->Get(stepRepeat_[step]);
+    }
+
+    return DEVICE_OK;
+}
+
+int CArduinoFilterWheel::OnHoldTrigger(MM::PropertyBase *pProp, MM::ActionType eAct) {
+    if (eAct == MM::BeforeGet) {
+        pProp->Set(holdTrigger_ ? g_On : g_Off);
+    } else if (eAct == MM::AfterSet) {
+        CArduinoHub* hub = static_cast<CArduinoHub*>(GetParentHub());
+        if (!hub || !hub->IsPortAvailable())
+            return ERR_NO_PORT_SET;
+
+        std::string state;
+        pProp->Get(state);
+
+        MMThreadGuard myLock(hub->GetLock());
+
+        unsigned char args[1];
+        args[0] = state == g_On ? 1 : 0;
+        unsigned char reply[1];
+        int ret = hub->Transact<ArduinoProtocol::HoldTrigger>(args, reply);
+        if (ret != DEVICE_OK)
+            return ret;
+        if (reply[0] != args[0])
+            return ERR_COMMUNICATION;
+
+        holdTrigger_ = args[0] != 0;
+    }
+
+    return DEVICE_OK;
+}
+
+int CArduinoFilterWheel::OnMoveTimeout(MM::PropertyBase *pProp, MM::ActionType eAct) {
+    if (eAct == MM::BeforeGet) {
+        pProp->Set(moveTimeoutMs_);
+    } else if (eAct == MM::AfterSet) {
+        pProp->Get(moveTimeoutMs_);
+    }
+
+    return DEVICE_OK;
+}
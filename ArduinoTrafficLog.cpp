@@ -0,0 +1,128 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          ArduinoTrafficLog.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Adapter for Arduino board
+//                Recording of the hub's serial traffic
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#include "ArduinoTrafficLog.h"
+#include <cstring>
+
+// records are buffered, the hub does not wait for the disk
+const size_t g_TrafficLogBuffer = 64 * 1024;
+const uint64_t g_TrafficLogFlushUs = 1000000;
+
+ArduinoTrafficLog::ArduinoTrafficLog() :
+   file_(0),
+   startUs_(0),
+   maxBytes_(0),
+   size_(0),
+   flushedUs_(0)
+{
+}
+
+ArduinoTrafficLog::~ArduinoTrafficLog()
+{
+   Close();
+}
+
+bool ArduinoTrafficLog::Open(const char* path, double startUs, uint64_t maxBytes)
+{
+   Close();
+   path_ = path;
+   startUs_ = startUs;
+   maxBytes_ = maxBytes;
+   // room for the header and at least one record
+   if (maxBytes_ != 0 && maxBytes_ < 2 * sizeof(ArduinoTrafficRecord))
+      maxBytes_ = 2 * sizeof(ArduinoTrafficRecord);
+   flushedUs_ = 0;
+   return StartFile();
+}
+
+bool ArduinoTrafficLog::StartFile()
+{
+   file_ = fopen(path_.c_str(), "wb");
+   if (file_ == 0)
+      return false;
+   setvbuf(file_, 0, _IOFBF, g_TrafficLogBuffer);
+
+   ArduinoTrafficHeader header;
+   memset(&header, 0, sizeof(header));
+   strcpy(header.magic, g_TrafficLogMagic);
+   header.version = g_TrafficLogVersion;
+   header.recordSize = sizeof(ArduinoTrafficRecord);
+   if (fwrite(&header, sizeof(header), 1, file_) != 1)
+   {
+      Close();
+      return false;
+   }
+   size_ = sizeof(header);
+   return true;
+}
+
+// Caller has an open file
+bool ArduinoTrafficLog::Rotate()
+{
+   bool ok = fclose(file_) == 0;
+   file_ = 0;
+   std::string old = path_ + ".1";
+   remove(old.c_str());
+   if (rename(path_.c_str(), old.c_str()) != 0)
+      ok = false;
+   return StartFile() && ok;
+}
+
+void ArduinoTrafficLog::Close()
+{
+   if (file_ != 0)
+   {
+      fclose(file_);
+      file_ = 0;
+   }
+}
+
+bool ArduinoTrafficLog::Record(ArduinoTrafficRecord::Kind kind, double timeUs,
+      const unsigned char* bytes, unsigned long count)
+{
+   if (file_ == 0)
+      return false;
+
+   ArduinoTrafficRecord r;
+   r.timeUs = timeUs > startUs_ ? (uint64_t) (timeUs - startUs_) : 0;
+   r.kind = (uint8_t) kind;
+   unsigned long done = 0;
+   do
+   {
+      if (maxBytes_ != 0 && size_ + sizeof(r) > maxBytes_ && !Rotate())
+         return false;
+      unsigned long n = count - done < sizeof(r.bytes) ? count - done : sizeof(r.bytes);
+      r.count = (uint8_t) n;
+      memset(r.bytes, 0, sizeof(r.bytes));
+      if (n > 0)
+         memcpy(r.bytes, bytes + done, n);
+      if (fwrite(&r, sizeof(r), 1, file_) != 1)
+         return false;
+      size_ += sizeof(r);
+      done += n;
+   } while (done < count);
+
+   if (r.timeUs - flushedUs_ >= g_TrafficLogFlushUs || r.timeUs < flushedUs_)
+   {
+      flushedUs_ = r.timeUs;
+      if (fflush(file_) != 0)
+         return false;
+   }
+   return true;
+}
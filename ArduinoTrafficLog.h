@@ -0,0 +1,95 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          ArduinoTrafficLog.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Adapter for Arduino board
+//                Recording of the hub's serial traffic
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+//                This file is distributed in the hope that it will be useful,
+//                but WITHOUT ANY WARRANTY; without even the implied warranty
+//                of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//                IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+//                CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+//                INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES.
+
+#ifndef _ArduinoTrafficLog_H_
+#define _ArduinoTrafficLog_H_
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+
+// A traffic log is a header and then records, both 16 bytes and in the
+// byte order of the machine that wrote them, so a reader can map the file
+// and index the records.  A record holds up to six bytes that went one way
+// at one time; a longer write or read takes several records with the same
+// time.  Times are microseconds on the core's clock since the log was
+// opened.  The host tools replay these logs (host/sim/ReplayLink.h).
+struct ArduinoTrafficHeader
+{
+   char magic[8];          // "ARDTRAF", zero terminated
+   uint32_t version;
+   uint32_t recordSize;
+};
+
+struct ArduinoTrafficRecord
+{
+   enum Kind
+   {
+      Sent = 0,            // written to the port
+      Received = 1,        // read from the port
+      Purged = 2           // the port was purged, no bytes
+   };
+
+   uint64_t timeUs;
+   uint8_t kind;
+   uint8_t count;
+   uint8_t bytes[6];
+};
+
+static_assert(sizeof(ArduinoTrafficHeader) == 16, "traffic log header is 16 bytes");
+static_assert(sizeof(ArduinoTrafficRecord) == 16, "traffic log records are 16 bytes");
+
+const char* const g_TrafficLogMagic = "ARDTRAF";
+const uint32_t g_TrafficLogVersion = 1;
+
+// The log is flushed once a second of log time, so a crash loses little of
+// it.  A log that reaches maxBytes is renamed to path.1, replacing the one
+// before, and a new log with the same start time goes on at path; the two
+// together hold at most twice maxBytes.  maxBytes 0 means no limit.
+class ArduinoTrafficLog
+{
+public:
+   ArduinoTrafficLog();
+   ~ArduinoTrafficLog();
+
+   // startUs is the time on the core's clock that becomes 0 in the log
+   bool Open(const char* path, double startUs, uint64_t maxBytes = 0);
+   void Close();
+   bool IsOpen() const {return file_ != 0;}
+
+   // false if the log could not be written; the caller should close it
+   bool Record(ArduinoTrafficRecord::Kind kind, double timeUs,
+         const unsigned char* bytes, unsigned long count);
+
+private:
+   ArduinoTrafficLog(const ArduinoTrafficLog&);
+   ArduinoTrafficLog& operator=(const ArduinoTrafficLog&);
+
+   bool StartFile();
+   bool Rotate();
+
+   FILE* file_;
+   std::string path_;
+   double startUs_;
+   uint64_t maxBytes_;
+   uint64_t size_;
+   uint64_t flushedUs_;
+};
+
+#endif // _ArduinoTrafficLog_H_
@@ -0,0 +1,188 @@
+// Commands of the filter wheel and I/O controller
+//
+// Shared by the firmware (FilterWheelController.ino) and the Micro-Manager
+// adapter (Arduino.cpp, ArduinoFilterWheel.cpp), so both sides agree on
+// every frame.  A command is <opcode> <seq> <arguments> <crc> and its reply
+// is <opcode> <seq> <payload> <crc>; the table below lists the number of
+// argument and payload bytes between <seq> and <crc>, and how long the
+// adapter waits for the reply.  See FilterWheelController.ino for what each
+// one does.  <crc> is crc8() of the bytes before it; a frame that does not
+// match is dropped by the board, and the adapter sends a command again when
+// the reply does not match.
+//
+// Identify (30) and Version (31) are single bytes without a sequence byte,
+// answered with a text line.  Loopback (33) and StreamChunk (15) carry a
+// count as their first argument; their sizes are the maximum.
+//
+// The sizes are enums and compile time constants, usable as array sizes.
+// The per-opcode lookups are switch statements, which the compilers turn
+// into a jump table or a few compares; crc8() takes two lookups in a
+// 16 byte table per byte.  Nothing here needs more than C++03, so the
+// Visual C++ 2010 tools of the adapter's project build it too.
+
+#ifndef _ArduinoProtocol_H_
+#define _ArduinoProtocol_H_
+
+namespace ArduinoProtocol {
+
+typedef unsigned char byte_t;
+
+// longest variable part of Loopback and StreamChunk
+const byte_t MaxChunk = 8;
+
+// The board drops a command that is not complete this long after its
+// first byte, so after a lost byte the next command starts afresh.  Frames
+// are written in one go and take a few milliseconds at 57600 baud.
+const unsigned FrameTimeoutMs = 20;
+
+// After a byte that is no opcode or a frame that fails its crc, the board
+// drops everything until the line has been quiet this long, so it does not
+// take the rest of a garbled frame for a command.  The adapter waits at
+// least FrameTimeoutMs after sending a frame before it sends it again.
+const unsigned FrameGapMs = 5;
+
+//        name              opcode  args          reply        timeout (ms)
+#define ARDUINO_PROTOCOL_COMMANDS(X) \
+   X(SetPattern,            1,      1,            0,           250) \
+   X(SetDac,                3,      3,            3,           2500) \
+   X(SetDacs,               4,      4,            4,           2500) \
+   X(SequencePattern,       5,      2,            2,           250) \
+   X(SequenceLength,        6,      1,            1,           250) \
+   X(SkipTriggers,          7,      1,            1,           250) \
+   X(StartSequence,         8,      0,            0,           250) \
+   X(StopSequence,          9,      0,            1,           250) \
+   X(TimedDelay,            10,     3,            1,           250) \
+   X(TimedRepeat,           11,     1,            1,           250) \
+   X(StartTimed,            12,     0,            0,           250) \
+   X(Pulses,                13,     12,           0,           250) \
+   X(StreamChunk,           15,     1 + MaxChunk, 2,           250) \
+   X(StreamClear,           16,     0,            1,           250) \
+   X(StreamStart,           17,     0,            0,           250) \
+   X(SequenceRun,           18,     3,            3,           250) \
+   X(BlankingOn,            20,     0,            0,           250) \
+   X(BlankingOff,           21,     0,            1,           250) \
+   X(BlankDirection,        22,     1,            0,           250) \
+   X(Identify,              30,     0,            0,           500) \
+   X(Version,               31,     0,            0,           500) \
+   X(SetBaud,               32,     1,            1,           250) \
+   X(Loopback,              33,     1 + MaxChunk, 1 + MaxChunk, 250) \
+   X(ConfirmBaud,           34,     1,            1,           250) \
+   X(DigitalInputs,         40,     0,            1,           500) \
+   X(AnalogInput,           41,     1,            3,           500) \
+   X(PullUp,                42,     2,            2,           500) \
+   X(ChannelPreset,         50,     6,            1,           250) \
+   X(WheelMove,             60,     1,            1,           250) \
+   X(WheelStatus,           61,     0,            3,           250) \
+   X(HoldTrigger,           62,     1,            1,           250) \
+   X(ProgramStep,           70,     5,            1,           250) \
+   X(ProgramLength,         71,     1,            1,           250) \
+   X(ProgramStart,          72,     1,            0,           250) \
+   X(ProgramStop,           73,     0,            2,           250) \
+   X(ProgramStatus,         74,     0,            4,           250) \
+   X(WaveCode,              80,     4,            2,           250) \
+   X(WaveLength,            81,     2,            2,           250) \
+   X(WaveStart,             82,     6,            1,           250) \
+   X(WaveStop,              83,     1,            2,           250)
+
+// One type per command, for the typed send functions of the adapter
+#define ARDUINO_PROTOCOL_STRUCT(name, op, a, r, t) \
+   struct name { enum { opcode = op, args = a, reply = r, timeoutMs = t }; };
+ARDUINO_PROTOCOL_COMMANDS(ARDUINO_PROTOCOL_STRUCT)
+#undef ARDUINO_PROTOCOL_STRUCT
+
+const byte_t NotACommand = 0xFF;
+
+#define ARDUINO_PROTOCOL_ARGS(name, op, a, r, t) case op: return (byte_t) (a);
+#define ARDUINO_PROTOCOL_REPLY(name, op, a, r, t) case op: return (byte_t) (r);
+#define ARDUINO_PROTOCOL_TIMEOUT(name, op, a, r, t) case op: return (long) (t);
+#define ARDUINO_PROTOCOL_COUNT(name, op, a, r, t) + 1
+
+// argument bytes after <opcode> <seq>, NotACommand for unknown opcodes
+inline byte_t argBytes(byte_t opcode)
+{
+   switch (opcode)
+   {
+   ARDUINO_PROTOCOL_COMMANDS(ARDUINO_PROTOCOL_ARGS)
+   default: return NotACommand;
+   }
+}
+
+// payload bytes after <opcode> <seq>
+inline byte_t replyBytes(byte_t opcode)
+{
+   switch (opcode)
+   {
+   ARDUINO_PROTOCOL_COMMANDS(ARDUINO_PROTOCOL_REPLY)
+   default: return NotACommand;
+   }
+}
+
+// how long the adapter waits for the reply, 0 for unknown opcodes
+inline long timeoutMs(byte_t opcode)
+{
+   switch (opcode)
+   {
+   ARDUINO_PROTOCOL_COMMANDS(ARDUINO_PROTOCOL_TIMEOUT)
+   default: return 0;
+   }
+}
+
+inline bool isCommand(byte_t opcode)
+{
+   return argBytes(opcode) != NotACommand;
+}
+
+// every command except Identify and Version carries a sequence byte
+inline bool isTagged(byte_t opcode)
+{
+   return opcode != Identify::opcode && opcode != Version::opcode;
+}
+
+// the first argument counts the bytes that follow
+inline bool isVariable(byte_t opcode)
+{
+   return opcode == Loopback::opcode || opcode == StreamChunk::opcode;
+}
+
+// CRC-8 with polynomial 0x07, no reflection, initial value 0.  It catches
+// every error within eight consecutive bits, so every garbled byte.  The
+// table holds the remainder of each high nibble, so a byte takes two steps.
+const byte_t Crc8Nibbles[16] = {
+   0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15,
+   0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D
+};
+
+inline byte_t crc8(const byte_t* data, unsigned n, byte_t crc = 0)
+{
+   for (unsigned i = 0; i < n; i++)
+   {
+      crc ^= data[i];
+      crc = (byte_t) (crc << 4) ^ Crc8Nibbles[crc >> 4];
+      crc = (byte_t) (crc << 4) ^ Crc8Nibbles[crc >> 4];
+   }
+   return crc;
+}
+
+// bytes of a tagged frame around its arguments or payload: opcode, seq, crc
+const unsigned TagBytes = 3;
+
+const unsigned NumCommands = 0 ARDUINO_PROTOCOL_COMMANDS(ARDUINO_PROTOCOL_COUNT);
+
+// longest frame in either direction, opcode, seq and crc included: the
+// size of a union with a member of each frame's size
+namespace detail {
+#define ARDUINO_PROTOCOL_SIZE(name, op, a, r, t) \
+   byte_t name##Command[TagBytes + (a)]; byte_t name##Reply[TagBytes + (r)];
+union Frames { ARDUINO_PROTOCOL_COMMANDS(ARDUINO_PROTOCOL_SIZE) };
+#undef ARDUINO_PROTOCOL_SIZE
+}
+const unsigned MaxFrame = sizeof(detail::Frames);
+
+#undef ARDUINO_PROTOCOL_ARGS
+#undef ARDUINO_PROTOCOL_REPLY
+#undef ARDUINO_PROTOCOL_TIMEOUT
+#undef ARDUINO_PROTOCOL_COUNT
+
+} // namespace ArduinoProtocol
+
+#endif // _ArduinoProtocol_H_
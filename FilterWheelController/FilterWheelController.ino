@@ -1,55 +1,1504 @@
+// Filter Wheel and I/O Controller
+// Version 3
+// BioCurious Fluorescent Microscope
+//
+// One board drives the filter wheel and the Micro-Manager Arduino devices
+// (digital outputs, shutter, two DACs, inputs), so the adapter only needs a
+// single hub and a single serial link.
+//
+// Hardware: Arduino Mega 2560 with the Adafruit Motor Shield (v1)
+//   wheel motor       motor 4 on the shield
+//   opto sensor       A0, one pulse per filter slot
+//   hall sensor       A1, one pulse per turn, between slots 5 and 6
+//   digital outputs   pins 22-27 (PORTA bits 0-5)
+//   trigger input     pin 2
+//   wheel ready       pin 28, high while the wheel sits at its target
+//   camera trigger    in on pin 19 (INT2), out to the camera on pin 29
+//   inputs            A8-A13 (PORTK bits 0-5)
+//   DAC               MCP4822 on SPI, chip select pin 53, LDAC pin 49
+//
+// Protocol, binary.  The board starts at 57600 baud after every reset; the
+// adapter may then move it to a faster rate (command 32), test the link
+// with loopbacks (command 33) and has to confirm the rate (command 34)
+// within baudCheckMs_, otherwise the board drops back to 57600.
+// 30 (identify) and 31 (version) are single bytes answered with a text
+// line, so the adapter can find out what it is talking to.  Every other command is <opcode> <seq> <arguments> <crc> and its
+// reply is <opcode> <seq> <payload> <crc>, which lets the adapter match replies to
+// commands.  A command whose crc does not match is dropped.  A command that
+// repeats the last one, seq included, is not run again; the board sends the
+// reply it sent before, so the adapter can retry when a command or its reply
+// got lost or garbled.  The table leaves out <seq> and <crc>.
+//
+//    1 pattern                   digital outputs           -> 1
+//    3 channel hi lo             DAC, 12 bits              -> 3 channel hi lo
+//    4 hi0 lo0 hi1 lo1           both DACs, latched        -> 4 hi0 lo0 hi1 lo1
+//                                together
+//    5 index pattern             store sequence pattern    -> 5 index pattern
+//   18 index pattern repeat      store a run: the pattern  -> 18 index pattern repeat
+//                                stays for repeat triggers
+//    6 count                     sequence length           -> 6 count
+//    7 count                     triggers to skip          -> 7 count
+//    8                           start triggered sequence  -> 8
+//    9                           stop sequence/timed       -> 9 transitions
+//   10 index hi lo               timed output delay (ms)   -> 10 index
+//   11 count                     repeat timed output       -> 11 count
+//   12                           start timed output        -> 12
+//   13 open closed w3 w2 w1 w0 nhi nlo p3 p2 p1 p0
+//                                shutter pulses            -> 13
+//                                (n pulses of w us with the open pattern,
+//                                 one every p us, closed pattern between
+//                                 and after; timed by Timer1, 1, 8, 12 and
+//                                 50 cut a burst short)
+//   15 n p1 ... pn               append to streamed        -> 15 free underrun
+//                                sequence, n <= 8
+//   16                           empty the stream          -> 16 free
+//   17                           play the stream, one      -> 17
+//                                pattern per trigger (9 stops it)
+//   20                           blanking on               -> 20
+//   21                           blanking off              -> 21 0
+//   22 mode                      blank on high (0)/low (1) -> 22
+//   32 rate                      switch baud rate          -> 32 rate
+//                                (answered at the old rate, see bauds_)
+//   33 n byte1 ... byten         loopback, n <= 8          -> 33 n byte1 ... byten
+//   34 rate                      keep the new baud rate    -> 34 rate
+//   40                           digital inputs            -> 40 bits
+//   41 pin                       analog input              -> 41 pin hi lo
+//   42 pin state                 input pull-up             -> 42 pin state
+//   50 wheel pattern d1hi d1lo d2hi d2lo
+//                                apply a channel preset    -> 50 status
+//                                (answered right away, status 0; the wheel
+//                                 then turns like after 60, wheel 255 leaves
+//                                 it where it is)
+//   60 position                  move wheel, 0 stops       -> 60 position
+//   61                           wheel status              -> 61 position moving fault
+//                                (fault 0 none, 1 stalled; cleared by the
+//                                 next move)
+//   62 mode                      hold camera triggers      -> 62 mode
+//                                until the wheel is ready (1) or pass
+//                                them straight through (0)
+//   80 channel index hi lo       store DAC waveform code   -> 80 channel index
+//   81 channel count             waveform length           -> 81 channel count
+//   82 channel mode i3 i2 i1 i0  play waveform             -> 82 channel
+//                                (mode 1 steps on each rising trigger edge,
+//                                 mode 2 every i us on Timer5; loops over
+//                                 the table, 3 and 50 stop it)
+//   83 channel                   stop waveform             -> 83 channel step
+//   70 index position hi lo repeat
+//                                store program step        -> 70 index
+//                                (dwell hi lo in ms, the step is held for
+//                                 repeat dwells, 0 counts as 1)
+//   71 count                     program length            -> 71 count
+//   72 repeat                    run program, 0 = forever  -> 72
+//   73                           stop program              -> 73 step cycle
+//   74                           program status            -> 74 running step dwells cycle
+//                                (60 and 50 stop a running program)
 
+#include <AFMotor.h>              // Invoke library for controlling the motor shield.
+#include <SPI.h>
+#include <EEPROM.h>
+#include "ArduinoProtocol.h"      // opcodes and frame sizes, shared with the adapter
 
-unsigned int version_ = 1;
+unsigned int version_ = 3;
 
+// pin assignments
+const int inPin_ = 2;
+const int dacCsPin_ = 53;
+const int dacLdacPin_ = 49;
+const int readyPin_ = 28;
+const int cameraOutPin_ = 29;
+const int cameraInPin_ = 19;   // INT2
 
-void setup() {
-    // Higher speeds do not appear to be reliable
-    Serial.begin(57600);
+// a command that is not complete after this long is thrown away
+const unsigned long timeOut_ = ArduinoProtocol::FrameTimeoutMs;
+// after a garbled frame, bytes are thrown away until the line pauses
+const unsigned long frameGap_ = ArduinoProtocol::FrameGapMs;
+
+// baud rates selectable with command 32, index 0 is the rate after reset
+const long bauds_[] = {57600, 115200, 250000, 500000};
+const byte NUMBAUDS = sizeof(bauds_) / sizeof(bauds_[0]);
+const byte MAXLOOPBACK = ArduinoProtocol::MaxChunk;
+const unsigned long baudCheckMs_ = 1000;
+byte currentBaud_ = 0;
+bool baudCheckPending_ = false;
+unsigned long baudChangeTime_;
+const byte NOBAUD = 255;
+byte pendingBaud_ = NOBAUD;
+
+// Commands are collected in rx_ without blocking; replies go through the
+// tx_ ring and are handed to the UART only as fast as it takes them, so a
+// command never holds up wheel tracking.  The adapter waits for each
+// reply, which keeps tx_ far from full.
+const byte MAXFRAME = ArduinoProtocol::MaxFrame;
+byte rx_[MAXFRAME];
+byte rxCount_ = 0;
+unsigned long rxStart_;
+bool rxDiscard_ = false;
+unsigned long rxLast_;
+const byte TXSIZE = 64;           // power of two
+byte tx_[TXSIZE];
+byte txHead_ = 0;
+byte txTail_ = 0;
+// the last tagged command and its reply, for repeats
+byte lastRx_[MAXFRAME];
+byte lastRxCount_ = 0;
+byte lastReply_[MAXFRAME];
+byte lastReplyCount_ = 0;
+
+// digital outputs
+const int SEQUENCELENGTH = 12;
+byte currentPattern_ = 0;
+byte triggerPattern_[SEQUENCELENGTH];
+byte triggerRepeat_[SEQUENCELENGTH];      // triggers per entry, 0 counts as 1
+byte runCount_ = 0;
+unsigned int triggerDelay_[SEQUENCELENGTH];
+int patternLength_ = 0;
+byte repeatPattern_ = 0;
+volatile int triggerNr_;          // total # of triggers in this run (0-based)
+volatile int sequenceNr_;         // # of trigger sequences in this run
+int skipTriggers_ = 0;            // # of triggers to skip before starting to generate patterns
+byte currentDelayPattern_ = 0;
+unsigned long delayStart_;
+bool triggerMode_ = false;
+bool timedOutput_ = false;
+bool blanking_ = false;
+bool blankOnHigh_ = false;
+int lastTrigger_ = LOW;
+
+// Streamed sequences: a triggered sequence longer than triggerPattern_
+// arrives in chunks (command 15) while it plays.  stream_ is a ring that
+// the trigger input drains; every chunk is answered with the free space,
+// so the adapter never sends more than fits.
+const byte STREAMSIZE = 64;       // power of two
+const byte STREAMCHUNK = ArduinoProtocol::MaxChunk;
+byte stream_[STREAMSIZE];
+byte streamHead_ = 0;
+byte streamTail_ = 0;
+bool streaming_ = false;
+bool streamUnderrun_ = false;
+
+// Shutter pulses run off Timer1 compare matches in 0.5 us ticks, so their
+// length does not depend on how long a pass of loop() takes.  On the Mega
+// the shield would drive motor 2 from Timer1 (OC1A, pin 11); only motor 4
+// is connected, so Timer1 is free.  OCR1A is moved on by each phase, in
+// chunks when a phase is longer than the 16 bit timer.
+const unsigned long TICKS_PER_US = 2;
+const unsigned long MIN_PULSE_US = 20;     // compare match interrupt latency
+const unsigned long MAX_PULSE_US = 0x7FFFFFFF / TICKS_PER_US;
+volatile bool pulseActive_ = false;
+volatile bool pulseOn_;
+volatile unsigned int pulsesLeft_;
+volatile unsigned long pulseTicksLeft_;
+unsigned long pulseWidth_;        // ticks
+unsigned long pulseGap_;          // ticks
+byte pulseOpen_;
+byte pulseClosed_;
+
+// DAC waveforms: a table of codes per channel that is stepped through on
+// each rising trigger edge or on Timer5 compare matches (4 us ticks,
+// channel 0 on OCR5A, channel 1 on OCR5B).  Timer3 is not touched: the
+// shield drives motor 4, the wheel, with PWM on OC3A (pin 5) and sets its
+// speed in OCR3A.  The shield does not use Timer5.
+const int WAVELENGTH = 64;
+const unsigned long WAVE_TICK_US = 4;
+const unsigned long MIN_WAVE_US = 100;           // time for the SPI write
+const unsigned long MAX_WAVE_US = 0xFFFF * WAVE_TICK_US;
+const byte WAVE_OFF = 0;
+const byte WAVE_TRIGGER = 1;
+const byte WAVE_TIMER = 2;
+struct Waveform {
+  unsigned int code[WAVELENGTH];
+  byte length;
+  volatile byte mode;
+  volatile byte step;
+  unsigned int interval;          // ticks
+};
+Waveform wave_[2];
+
+// filter wheel
+AF_DCMotor motor(4);             // Select motor 4
+
+int lastOpto, currentOpto, delta;
+int lastHall, currentHall, deltaHall;
+int NONE = -100;
+int monitor = NONE;
+int direction = 1;
+int MAX = 6;
+int SPEED = 200;
+
+// Position in half slots: slot k is 2 * (k - 1), the odd values lie
+// between two slots.  The hall sensor sits between slots 5 and 6, so it
+// sets INDEX; from there the next opto pulse is half a slot away, every
+// other one a full slot.  Until the hall sensor has been seen the
+// position is UNKNOWN and opto pulses are ignored.
+const int HALFSLOTS = 2 * 6;
+const int INDEX = 9;
+const int UNKNOWN = -1;
+int halfSlot = UNKNOWN;
+
+// Stall detection: while the motor runs, an opto edge has to come within
+// a few slot periods.  slotPeriod starts from the speed setting and then
+// follows the measured time between edges.
+const unsigned long SLOT_MS_FULL_SPEED = 100;   // ms per slot at speed 255
+const unsigned long SPINUP_MS = 300;            // extra time for the first edge
+const int STALL_PERIODS = 4;
+const byte FAULT_NONE = 0;
+const byte FAULT_STALLED = 1;
+unsigned long slotPeriod = SLOT_MS_FULL_SPEED * 255 / SPEED;
+unsigned long lastEdge;
+bool firstEdge = true;
+byte fault = FAULT_NONE;
+
+// Camera trigger gate.  The camera trigger input interrupts on both
+// edges and, while the gate is open, the interrupt copies it to the
+// output, so the camera sees the trigger without waiting for loop().  The
+// gate is always open with holdTriggers_ off; with it on only while the
+// wheel is ready.  A rising edge that comes while the gate is closed is
+// held together with how long the input stayed high.  Once the wheel has
+// settled the output goes high for that long, or follows the input when
+// it is still high.
+bool holdTriggers_ = false;
+volatile bool gateOpen_ = true;
+volatile bool triggerHeld_ = false;
+volatile unsigned long heldRiseUs_;
+volatile unsigned long heldWidthUs_;   // 0 while the held input is high
+bool heldPulseOn_ = false;
+unsigned long heldPulseStart_;
+unsigned long heldPulseUs_;
+
+// Filter program: the board steps through the wheel positions on its
+// own, holding each for its dwell time once the wheel has arrived, in the
+// way timed output steps through output patterns.
+struct ProgramStep {
+  byte slot;
+  unsigned int dwell;
+  byte repeat;
+};
+const int MAXSTEPS = 16;
+ProgramStep program_[MAXSTEPS];
+byte programLength_ = 0;
+byte programRepeat_ = 0;
+bool programRunning_ = false;
+bool dwelling_ = false;
+byte programStep_ = 0;
+byte stepDwells_ = 0;
+byte programCycle_ = 0;
+unsigned long dwellStart_;
+
+// Last slot the wheel stopped at, with the hall sensor reading there.
+// After a reset the wheel is only homed when that record is missing or the
+// hall sensor disagrees with it.  Every stop at another slot writes a new
+// record, so the records go round a ring of cells to spread the wear over
+// EEPROM_RECORDS times as many write cycles.  A record is a sequence
+// byte and a data byte; the newest record is the last one before the
+// sequence breaks.  The data byte is RECORD_VALID | hall << 4 | halfSlot,
+// or RECORD_NONE once the position is lost.
+const int EEPROM_RING_ADDR = 0;
+const int EEPROM_RECORDS = 64;
+const byte RECORD_VALID = 0xA0;
+const byte RECORD_MASK = 0xE0;
+const byte RECORD_NONE = 0;
+int record_ = -1;
+
+int toDigital(int val){
+  if (val > 512) {
+    return 1;
+  }
+  else {
+    return 0;
+  }
 }
 
-void loop() {
-  if (Serial.available() > 0) {
-     int inByte = Serial.read();
+int getOpto() {
+  int val = analogRead(A0);
+  return toDigital(val);
+}
+
+int getHall() {
+  int val = analogRead(A1);
+  //Serial.println(val);
+  return toDigital(val);
+}
+
+void startMotor() {
+  lastEdge = millis();
+  firstEdge = true;
+  fault = FAULT_NONE;
+}
+
+void backward() {
+  startMotor();
+  motor.run(BACKWARD);
+  direction = -1;
+  //Serial.println(" backwards");
+}
+
+void forward() {
+  startMotor();
+  motor.run(FORWARD);
+  direction = 1;
+  //Serial.println(" forwards");
+}
+
+void stop() {
+  motor.run(RELEASE);
+  direction = 1;
+  //Serial.println("stop");
+  monitor = -100;
+  savePosition();
+}
+
+// newest record in the ring
+int findRecord() {
+  int i = 0;
+  while (i + 1 < EEPROM_RECORDS &&
+         EEPROM.read(EEPROM_RING_ADDR + 2 * (i + 1)) == (byte) (EEPROM.read(EEPROM_RING_ADDR + 2 * i) + 1)) {
+    i++;
+  }
+  return i;
+}
+
+// The data goes in before its sequence byte, so a reset in between leaves
+// the last record the newest.
+void writeRecord(byte data) {
+  if (record_ < 0) {
+    record_ = findRecord();
+  }
+  int addr = EEPROM_RING_ADDR + 2 * record_;
+  if (EEPROM.read(addr + 1) == data) {
+    return;
+  }
+  byte seq = EEPROM.read(addr) + 1;
+  record_ = (record_ + 1) % EEPROM_RECORDS;
+  addr = EEPROM_RING_ADDR + 2 * record_;
+  EEPROM.update(addr + 1, data);
+  EEPROM.update(addr, seq);
+}
+
+void savePosition() {
+  if (halfSlot == UNKNOWN || halfSlot % 2 != 0) {
+    return;
+  }
+  writeRecord(RECORD_VALID | getHall() << 4 | halfSlot);
+}
+
+// true when the saved position can be trusted
+bool restorePosition() {
+  record_ = findRecord();
+  byte data = EEPROM.read(EEPROM_RING_ADDR + 2 * record_ + 1);
+  if ((data & RECORD_MASK) != RECORD_VALID) {
+    return false;
+  }
+  int saved = data & 0x0F;
+  if (saved >= HALFSLOTS || saved % 2 != 0) {
+    return false;
+  }
+  if (((data >> 4) & 1) != getHall()) {
+    return false;
+  }
+  halfSlot = saved;
+  return true;
+}
+
+// slot the wheel is at, or just past when between slots, 0 while unknown
+int currentSlot() {
+  if (halfSlot == UNKNOWN) {
+    return 0;
+  }
+  return halfSlot / 2 + 1;
+}
+
+void rotate(int currPos, int pos) {
+  int distance = currPos < pos ? (6 - pos + currPos) : (currPos - pos);
+  //Serial.print(currPos);
+  //Serial.print("=>");
+  //Serial.print(pos);
+
+  if (distance < 3) {
+    backward();
+  } else {
+    forward();
+  }
+}
+
+bool isPosition(int pos) {
+  return halfSlot != UNKNOWN && halfSlot == 2 * (pos - 1);
+}
+
+bool isHallFired() {
+  return currentHall == 0 && lastHall == 1;
+}
+
+bool isOptoFired() {
+  return currentOpto == 0 && lastOpto == 1;
+}
+
+bool shouldStop() {
+  return monitor != NONE && isPosition(monitor);
+}
+
+// No edge for too long: the wheel is stuck or an edge was missed, so the
+// position can no longer be trusted, not now and not after a reset.
+void checkStall() {
+  if (monitor == NONE) {
+    return;
+  }
+  unsigned long limit = STALL_PERIODS * slotPeriod + (firstEdge ? SPINUP_MS : 0);
+  if (millis() - lastEdge <= limit) {
+    return;
+  }
+  motor.run(RELEASE);
+  direction = 1;
+  monitor = NONE;
+  halfSlot = UNKNOWN;
+  writeRecord(RECORD_NONE);
+  fault = FAULT_STALLED;
+}
+
+// Starts a move, or stops the wheel for position 0.
+// Returns true when the wheel has to turn.
+bool moveWheel(int pos) {
+  if (pos == 0) {
+    stop();
+    return false;
+  }
+  if (pos < 1 || pos > MAX || isPosition(pos)) {
+    return false;
+  }
+  rotate(currentSlot(), pos);
+  monitor = pos;
+  return true;
+}
+
+void startStep() {
+  dwelling_ = false;
+  moveWheel(program_[programStep_].slot);
+}
+
+void runProgram() {
+  if (!programRunning_) {
+    return;
+  }
+  if (fault != FAULT_NONE) {
+    programRunning_ = false;
+    return;
+  }
+  if (!dwelling_) {
+    // dwell starts once the wheel is there
+    if (monitor == NONE) {
+      dwelling_ = true;
+      dwellStart_ = millis();
+    }
+    return;
+  }
+  if (millis() - dwellStart_ < program_[programStep_].dwell) {
+    return;
+  }
+
+  stepDwells_++;
+  if (stepDwells_ < program_[programStep_].repeat) {
+    dwellStart_ = millis();
+    return;
+  }
+  stepDwells_ = 0;
+  programStep_++;
+  if (programStep_ >= programLength_) {
+    programStep_ = 0;
+    programCycle_++;
+    if (programRepeat_ > 0 && programCycle_ >= programRepeat_) {
+      programRunning_ = false;
+      return;
+    }
+  }
+  startStep();
+}
+
+// at its target, the position known and nothing wrong
+bool wheelReady() {
+  return monitor == NONE && fault == FAULT_NONE && halfSlot != UNKNOWN && halfSlot % 2 == 0;
+}
+
+ISR(INT2_vect) {
+  int in = digitalRead(cameraInPin_);
+  if (gateOpen_) {
+    digitalWrite(cameraOutPin_, in);
+  } else if (in == HIGH) {
+    if (!triggerHeld_) {
+      triggerHeld_ = true;
+      heldRiseUs_ = micros();
+      heldWidthUs_ = 0;
+    }
+  } else if (triggerHeld_ && heldWidthUs_ == 0) {
+    unsigned long width = micros() - heldRiseUs_;
+    heldWidthUs_ = width > 0 ? width : 1;
+  }
+}
+
+// Opens and closes the gate, and plays a held trigger back
+void runTriggerGate() {
+  bool ready = wheelReady();
+  digitalWrite(readyPin_, ready ? HIGH : LOW);
+
+  if (heldPulseOn_) {
+    if (micros() - heldPulseStart_ < heldPulseUs_) {
+      return;
+    }
+    digitalWrite(cameraOutPin_, LOW);
+    heldPulseOn_ = false;
+  }
+
+  bool open = !holdTriggers_ || ready;
+  if (open == gateOpen_) {
+    return;
+  }
+  byte sreg = SREG;
+  cli();
+  if (!open) {
+    gateOpen_ = false;
+    digitalWrite(cameraOutPin_, LOW);
+  } else if (triggerHeld_ && heldWidthUs_ > 0) {
+    // the gate opens when the pulse is over
+    triggerHeld_ = false;
+    heldPulseOn_ = true;
+    heldPulseStart_ = micros();
+    heldPulseUs_ = heldWidthUs_;
+    digitalWrite(cameraOutPin_, HIGH);
+  } else {
+    triggerHeld_ = false;
+    gateOpen_ = true;
+    digitalWrite(cameraOutPin_, digitalRead(cameraInPin_));
+  }
+  SREG = sreg;
+}
+
+// Where the sensor edges of one pass take the wheel, turning in dir
+int trackEdges(int from, bool hallFired, bool optoFired, int dir) {
+  int to = hallFired ? INDEX : from;
+  if (optoFired && to != UNKNOWN) {
+    int step = (to % 2) ? dir : 2 * dir;
+    to = (to + step + HALFSLOTS) % HALFSLOTS;
+  }
+  return to;
+}
+
+void trackWheel() {
+  currentOpto = getOpto();
+  currentHall = getHall();
+
+  if (isHallFired())
+  {
+    halfSlot = INDEX;
+  }
+
+  if (isOptoFired())
+  {
+    unsigned long now = millis();
+    if (!firstEdge) {
+      // half slots around the index count double
+      unsigned long gap = now - lastEdge;
+      slotPeriod += ((long) gap - (long) slotPeriod) / 4;
+    }
+    lastEdge = now;
+    firstEdge = false;
+  }
+
+  halfSlot = trackEdges(halfSlot, isHallFired(), isOptoFired(), direction);
+
+  lastOpto = currentOpto;
+  lastHall = currentHall;
+}
+
+void send(byte b) {
+  byte next = (txHead_ + 1) & (TXSIZE - 1);
+  if (next == txTail_) {
+    return;
+  }
+  tx_[txHead_] = b;
+  txHead_ = next;
+}
+
+void send(const byte* data, byte n) {
+  for (byte i = 0; i < n; i++) {
+    send(data[i]);
+  }
+}
+
+void sendLine(const char* text) {
+  while (*text) {
+    send(*text++);
+  }
+  send('\r');
+  send('\n');
+}
+
+void reply(byte opcode, byte seq) {
+  send(opcode);
+  send(seq);
+}
+
+// moves queued bytes into the UART buffer, never waits
+void transmit() {
+  while (txTail_ != txHead_ && Serial.availableForWrite() > 0) {
+    Serial.write(tx_[txTail_]);
+    txTail_ = (txTail_ + 1) & (TXSIZE - 1);
+  }
+}
+
+bool transmitDone() {
+  return txTail_ == txHead_ && Serial.availableForWrite() >= SERIAL_TX_BUFFER_SIZE - 1;
+}
+
+// Bytes in the complete command that starts rx_, 0 for unknown opcodes.
+// For the loopback and stream chunks the length is only known once their
+// count byte is in.
+byte frameLength() {
+  byte opcode = rx_[0];
+  if (!ArduinoProtocol::isCommand(opcode)) {
+    return 0;
+  }
+  if (!ArduinoProtocol::isTagged(opcode)) {
+    return 1;
+  }
+  if (ArduinoProtocol::isVariable(opcode)) {
+    if (rxCount_ < 3) {
+      return 3;
+    }
+    return rx_[2] <= ArduinoProtocol::MaxChunk ? ArduinoProtocol::TagBytes + 1 + rx_[2] : 0;
+  }
+  return ArduinoProtocol::TagBytes + ArduinoProtocol::argBytes(opcode);
+}
+
+// Collects what has arrived.  Runs at most one command per pass of loop()
+// so the wheel is looked at between commands.
+void receive() {
+  if (rxCount_ > 0 && millis() - rxStart_ > timeOut_) {
+    rxCount_ = 0;
+  }
+
+  while (Serial.available() > 0) {
+    byte b = Serial.read();
+    if (rxDiscard_ && millis() - rxLast_ <= frameGap_) {
+      rxLast_ = millis();
+      continue;
+    }
+    rxDiscard_ = false;
+    if (rxCount_ == 0) {
+      rxStart_ = millis();
+    }
+    rx_[rxCount_++] = b;
+
+    byte length = frameLength();
+    if (length == 0) {
+      // not a command: the rest of a garbled frame, up to the pause
+      // before the adapter sends it again
+      discardFrame();
+    } else if (rxCount_ == length) {
+      if (length > 1 && rx_[length - 1] != ArduinoProtocol::crc8(rx_, length - 1)) {
+        // garbled on the way, the adapter sends it again
+        discardFrame();
+      } else if (isRepeat()) {
+        send(lastReply_, lastReplyCount_);
+      } else {
+        runCommand();
+      }
+      rxCount_ = 0;
+      return;
+    }
+  }
+}
+
+void discardFrame() {
+  rxCount_ = 0;
+  rxDiscard_ = true;
+  rxLast_ = millis();
+}
 
-     switch (inByte) {
-        // Gives identification of the device
-       case 1:
-         Serial.println("Arduino-FW");
-         break;
+bool isRepeat() {
+  if (rxCount_ != lastRxCount_) {
+    return false;
+  }
+  for (byte i = 0; i < rxCount_; i++) {
+    if (rx_[i] != lastRx_[i]) {
+      return false;
+    }
+  }
+  return true;
+}
 
-       // Returns version string
-       case 2:
-         Serial.println(version_);
-         break;
+// Runs the command in rx_, closes its reply with the crc and keeps what it
+// sent back
+void runCommand() {
+  byte head = txHead_;
+  handleCommand();
 
-       // Set position
-       case 3:
-          if (waitForSerial(timeOut_)) {
+  lastRxCount_ = 0;
+  if (!ArduinoProtocol::isTagged(rx_[0]) || txHead_ == head) {
+    return;
+  }
+  byte crc = 0;
+  for (byte i = head; i != txHead_; i = (i + 1) & (TXSIZE - 1)) {
+    crc = ArduinoProtocol::crc8(&tx_[i], 1, crc);
+  }
+  send(crc);
 
-            // get position
-            currentPattern_ = Serial.read();
+  byte n = (txHead_ - head) & (TXSIZE - 1);
+  if (n > MAXFRAME) {
+    return;
+  }
+  for (byte i = 0; i < n; i++) {
+    lastReply_[i] = tx_[(head + i) & (TXSIZE - 1)];
+  }
+  lastReplyCount_ = n;
+  for (byte i = 0; i < rxCount_; i++) {
+    lastRx_[i] = rx_[i];
+  }
+  lastRxCount_ = rxCount_;
+}
 
-            // todo: set filter wheel position
+void writeOutputs(byte pattern) {
+  PORTA = (PORTA & 0xC0) | (pattern & 0x3F);
+}
 
+// the pulse interrupt writes PORTA as well
+void setOutputs(byte pattern) {
+  byte sreg = SREG;
+  cli();
+  writeOutputs(pattern);
+  SREG = sreg;
+}
 
+// moves the compare match on by the next part of the current phase
+void nextPulseChunk() {
+  unsigned long chunk = pulseTicksLeft_ > 0xFFFF ? 0x8000 : pulseTicksLeft_;
+  pulseTicksLeft_ -= chunk;
+  OCR1A += (unsigned int) chunk;
+}
 
-          }
-          break;
+unsigned long pulseTicks(unsigned long us) {
+  if (us < MIN_PULSE_US) {
+    us = MIN_PULSE_US;
+  }
+  if (us > MAX_PULSE_US) {
+    us = MAX_PULSE_US;
+  }
+  return us * TICKS_PER_US;
+}
 
-     }
+byte streamFree() {
+  return (streamTail_ - streamHead_ - 1) & (STREAMSIZE - 1);
+}
+
+void clearStream() {
+  streaming_ = false;
+  streamHead_ = 0;
+  streamTail_ = 0;
+  streamUnderrun_ = false;
+}
+
+void startPulses(byte open, byte closed, unsigned long width, unsigned int count, unsigned long period) {
+  pulseOpen_ = open;
+  pulseClosed_ = closed;
+  pulseWidth_ = pulseTicks(width);
+  pulseGap_ = period > width ? pulseTicks(period - width) : pulseTicks(0);
+  currentPattern_ = closed;
+
+  byte sreg = SREG;
+  cli();
+  pulsesLeft_ = count > 0 ? count : 1;
+  pulseOn_ = true;
+  pulseTicksLeft_ = pulseWidth_;
+  writeOutputs(open);
+  OCR1A = TCNT1;
+  nextPulseChunk();
+  TIFR1 = _BV(OCF1A);
+  TIMSK1 |= _BV(OCIE1A);
+  pulseActive_ = true;
+  SREG = sreg;
+}
+
+// ends a burst early, outputs closed
+void stopPulses() {
+  byte sreg = SREG;
+  cli();
+  if (pulseActive_) {
+    TIMSK1 &= ~_BV(OCIE1A);
+    pulseActive_ = false;
+    writeOutputs(pulseClosed_);
+  }
+  SREG = sreg;
+}
+
+ISR(TIMER1_COMPA_vect) {
+  if (pulseTicksLeft_ > 0) {
+    nextPulseChunk();
+    return;
+  }
+  if (pulseOn_) {
+    writeOutputs(pulseClosed_);
+    pulseOn_ = false;
+    if (--pulsesLeft_ == 0) {
+      TIMSK1 &= ~_BV(OCIE1A);
+      pulseActive_ = false;
+      return;
+    }
+    pulseTicksLeft_ = pulseGap_;
+  } else {
+    writeOutputs(pulseOpen_);
+    pulseOn_ = true;
+    pulseTicksLeft_ = pulseWidth_;
   }
+  nextPulseChunk();
+}
+
+// MCP4822: bit 15 selects the channel, gain 2x (0-4.095 V), output on.
+// The value sits in the input register until LDAC is pulsed, which moves
+// both channels to their outputs at once.
+void loadDac(byte channel, unsigned int value) {
+  unsigned int word = (channel ? 0x8000 : 0) | 0x1000 | (value & 0x0FFF);
+  digitalWrite(dacCsPin_, LOW);
+  SPI.transfer(word >> 8);
+  SPI.transfer(word & 0xFF);
+  digitalWrite(dacCsPin_, HIGH);
+}
 
+void latchDacs() {
+  digitalWrite(dacLdacPin_, LOW);
+  digitalWrite(dacLdacPin_, HIGH);
 }
 
- 
-bool waitForSerial(unsigned long timeOut)
-{
-    unsigned long startTime = millis();
+void writeDac(byte channel, unsigned int value) {
+  loadDac(channel, value);
+  latchDacs();
+}
 
-    while (Serial.available() == 0 && (millis() - startTime < timeOut) ) {}
+// both channels change at the same instant
+void setDacs(unsigned int value0, unsigned int value1) {
+  byte sreg = SREG;
+  cli();
+  loadDac(0, value0);
+  loadDac(1, value1);
+  latchDacs();
+  SREG = sreg;
+}
 
-    return Serial.available() > 0;
+// the waveform interrupts use the SPI bus as well
+void setDac(byte channel, unsigned int value) {
+  byte sreg = SREG;
+  cli();
+  writeDac(channel, value);
+  SREG = sreg;
 }
 
+// outputs the current code of a waveform and moves on to the next one
+void stepWave(byte channel) {
+  Waveform& w = wave_[channel];
+  writeDac(channel, w.code[w.step]);
+  w.step = w.step + 1 < w.length ? w.step + 1 : 0;
+}
 
+void stopWave(byte channel) {
+  byte sreg = SREG;
+  cli();
+  TIMSK5 &= ~(channel ? _BV(OCIE5B) : _BV(OCIE5A));
+  wave_[channel].mode = WAVE_OFF;
+  SREG = sreg;
+}
+
+void startWave(byte channel, byte mode, unsigned long interval) {
+  stopWave(channel);
+  Waveform& w = wave_[channel];
+  if (w.length == 0 || (mode != WAVE_TRIGGER && mode != WAVE_TIMER)) {
+    return;
+  }
+  w.step = 0;
+  if (mode == WAVE_TRIGGER) {
+    w.mode = mode;
+    return;
+  }
+
+  if (interval < MIN_WAVE_US) {
+    interval = MIN_WAVE_US;
+  }
+  if (interval > MAX_WAVE_US) {
+    interval = MAX_WAVE_US;
+  }
+  w.interval = interval / WAVE_TICK_US;
+
+  byte sreg = SREG;
+  cli();
+  stepWave(channel);
+  if (channel) {
+    OCR5B = TCNT5 + w.interval;
+    TIFR5 = _BV(OCF5B);
+    TIMSK5 |= _BV(OCIE5B);
+  } else {
+    OCR5A = TCNT5 + w.interval;
+    TIFR5 = _BV(OCF5A);
+    TIMSK5 |= _BV(OCIE5A);
+  }
+  w.mode = mode;
+  SREG = sreg;
+}
+
+// waveforms that step on the trigger input
+void triggerWaves() {
+  for (byte channel = 0; channel < 2; channel++) {
+    if (wave_[channel].mode == WAVE_TRIGGER) {
+      byte sreg = SREG;
+      cli();
+      stepWave(channel);
+      SREG = sreg;
+    }
+  }
+}
+
+ISR(TIMER5_COMPA_vect) {
+  OCR5A += wave_[0].interval;
+  stepWave(0);
+}
+
+ISR(TIMER5_COMPB_vect) {
+  OCR5B += wave_[1].interval;
+  stepWave(1);
+}
+
+// takes effect once the reply to command 32 has gone out
+void requestBaud(byte index) {
+  pendingBaud_ = index;
+}
+
+void setBaud(byte index) {
+  currentBaud_ = index;
+  Serial.end();
+  Serial.begin(bauds_[index]);
+  while (Serial.available() > 0) {
+    Serial.read();
+  }
+  rxCount_ = 0;
+}
+
+void setup() {
+  // Only the safe rate here, faster rates are negotiated by the adapter
+  Serial.begin(bauds_[0]);
+
+  DDRA |= 0x3F;
+  setOutputs(0);
+
+  // Timer1 free running at 2 MHz for the shutter pulses
+  TCCR1A = 0;
+  TCCR1B = _BV(CS11);
+  TIMSK1 = 0;
+
+  // Timer5 free running at 250 kHz for the DAC waveforms; Timer3 is the
+  // wheel motor's PWM
+  TCCR5A = 0;
+  TCCR5B = _BV(CS51) | _BV(CS50);
+  TIMSK5 = 0;
+  pinMode(inPin_, INPUT);
+  pinMode(readyPin_, OUTPUT);
+  digitalWrite(readyPin_, LOW);
+  pinMode(cameraOutPin_, OUTPUT);
+  digitalWrite(cameraOutPin_, LOW);
+  pinMode(cameraInPin_, INPUT);
+  // INT2 on any change of the camera trigger input
+  EICRA = (EICRA & ~(_BV(ISC21) | _BV(ISC20))) | _BV(ISC20);
+  EIFR = _BV(INTF2);
+  EIMSK |= _BV(INT2);
+
+  pinMode(dacCsPin_, OUTPUT);
+  pinMode(dacLdacPin_, OUTPUT);
+  digitalWrite(dacCsPin_, HIGH);
+  digitalWrite(dacLdacPin_, HIGH);
+  SPI.begin();
+  setDacs(0, 0);
+
+  // turn on motor
+  motor.setSpeed(SPEED);
+  motor.run(RELEASE);
+
+  lastOpto = getOpto();
+  lastHall = getHall();
+
+  // home only when the saved position does not fit
+  if (!restorePosition()) {
+    monitor = 6;
+    forward();
+  }
+}
+
+//Main Loop
+void loop() {
+  if (shouldStop()) {
+    stop();
+  }
+  checkStall();
+
+  // new rate was not confirmed, go back to where the adapter can find us
+  if (baudCheckPending_ && millis() - baudChangeTime_ > baudCheckMs_) {
+    baudCheckPending_ = false;
+    requestBaud(0);
+  }
+  if (pendingBaud_ != NOBAUD && transmitDone()) {
+    setBaud(pendingBaud_);
+    pendingBaud_ = NOBAUD;
+  }
+
+  trackWheel();
+  runOutputs();
+  runProgram();
+  runTriggerGate();
+
+  receive();
+  transmit();
+}
+
+// triggered sequences, timed output and blanking
+void runOutputs() {
+  int trigger = digitalRead(inPin_);
+
+  if (trigger == HIGH && lastTrigger_ == LOW) {
+    triggerWaves();
+  }
+
+  if (triggerMode_) {
+    if (trigger == HIGH && lastTrigger_ == LOW) {
+      if (skipTriggers_ > 0 && triggerNr_ < skipTriggers_) {
+        triggerNr_++;
+      } else if (patternLength_ > 0) {
+        currentPattern_ = triggerPattern_[sequenceNr_];
+        if (++runCount_ >= triggerRepeat_[sequenceNr_]) {
+          runCount_ = 0;
+          sequenceNr_ = (sequenceNr_ + 1) % patternLength_;
+        }
+        triggerNr_++;
+        if (!blanking_) {
+          setOutputs(currentPattern_);
+        }
+      }
+    }
+  } else if (streaming_) {
+    if (trigger == HIGH && lastTrigger_ == LOW) {
+      if (skipTriggers_ > 0 && triggerNr_ < skipTriggers_) {
+        triggerNr_++;
+      } else if (streamTail_ != streamHead_) {
+        currentPattern_ = stream_[streamTail_];
+        streamTail_ = (streamTail_ + 1) & (STREAMSIZE - 1);
+        triggerNr_++;
+        if (!blanking_) {
+          setOutputs(currentPattern_);
+        }
+      } else {
+        // the adapter fell behind, keep the last pattern
+        streamUnderrun_ = true;
+      }
+    }
+  } else if (timedOutput_) {
+    if (millis() - delayStart_ >= triggerDelay_[currentDelayPattern_]) {
+      currentDelayPattern_++;
+      if (currentDelayPattern_ >= patternLength_) {
+        currentDelayPattern_ = 0;
+        if (repeatPattern_ > 0 && ++sequenceNr_ >= repeatPattern_) {
+          timedOutput_ = false;
+          setOutputs(0);
+          return;
+        }
+      }
+      setOutputs(triggerPattern_[currentDelayPattern_]);
+      delayStart_ = millis();
+    }
+  }
+
+  if (blanking_ && !pulseActive_) {
+    bool blank = (trigger == HIGH) == blankOnHigh_;
+    setOutputs(blank ? 0 : currentPattern_);
+  }
+
+  lastTrigger_ = trigger;
+}
+
+// Executes the complete command in rx_
+void handleCommand() {
+  byte opcode = rx_[0];
+
+  // identification and version carry no sequence byte
+  if (opcode == 30) {
+    sendLine("MM-Ard");
+    return;
+  }
+  if (opcode == 31) {
+    char buf[8];
+    utoa(version_, buf, 10);
+    sendLine(buf);
+    return;
+  }
+
+  byte seq = rx_[1];
+  const byte* args = rx_ + 2;
+
+  switch (opcode) {
+    // Set digital output
+    case 1:
+      stopPulses();
+      currentPattern_ = args[0];
+      triggerMode_ = false;
+      timedOutput_ = false;
+      streaming_ = false;
+      if (!blanking_) {
+        setOutputs(currentPattern_);
+      }
+      reply(1, seq);
+      break;
+
+    // Set DAC
+    case 3:
+      if (args[0] < 2) {
+        stopWave(args[0]);
+      }
+      setDac(args[0], ((unsigned int) args[1] << 8) | args[2]);
+      reply(3, seq);
+      send(args, 3);
+      break;
+
+    // Set both DACs together
+    case 4:
+      stopWave(0);
+      stopWave(1);
+      setDacs(((unsigned int) args[0] << 8) | args[1], ((unsigned int) args[2] << 8) | args[3]);
+      reply(4, seq);
+      send(args, 4);
+      break;
+
+    // Set pattern at given position of the sequence
+    case 5:
+      if (args[0] < SEQUENCELENGTH) {
+        triggerPattern_[args[0]] = args[1];
+        triggerRepeat_[args[0]] = 1;
+      }
+      reply(5, seq);
+      send(args, 2);
+      break;
+
+    // Set a run of the sequence
+    case 18:
+      if (args[0] < SEQUENCELENGTH) {
+        triggerPattern_[args[0]] = args[1];
+        triggerRepeat_[args[0]] = args[2];
+      }
+      reply(18, seq);
+      send(args, 3);
+      break;
+
+    // Number of patterns in the sequence
+    case 6:
+      patternLength_ = args[0] < SEQUENCELENGTH ? args[0] : SEQUENCELENGTH;
+      reply(6, seq);
+      send(args[0]);
+      break;
+
+    // Skip this many triggers before starting the sequence
+    case 7:
+      skipTriggers_ = args[0];
+      reply(7, seq);
+      send(args[0]);
+      break;
+
+    // Start trigger mode
+    case 8:
+      stopPulses();
+      triggerNr_ = 0;
+      sequenceNr_ = 0;
+      runCount_ = 0;
+      timedOutput_ = false;
+      streaming_ = false;
+      triggerMode_ = true;
+      reply(8, seq);
+      break;
+
+    // Stop trigger mode and timed output, report the transitions
+    case 9:
+      triggerMode_ = false;
+      timedOutput_ = false;
+      streaming_ = false;
+      reply(9, seq);
+      send((byte) (triggerNr_ > skipTriggers_ ? triggerNr_ - skipTriggers_ : 0));
+      break;
+
+    // Delay for a pattern of the timed output
+    case 10:
+      if (args[0] < SEQUENCELENGTH) {
+        triggerDelay_[args[0]] = ((unsigned int) args[1] << 8) | args[2];
+      }
+      reply(10, seq);
+      send(args[0]);
+      break;
+
+    // Repeat the timed output this many times, 0 runs until stopped
+    case 11:
+      repeatPattern_ = args[0];
+      reply(11, seq);
+      send(args[0]);
+      break;
+
+    // Start timed output
+    case 12:
+      if (patternLength_ > 0) {
+        stopPulses();
+        triggerMode_ = false;
+        streaming_ = false;
+        sequenceNr_ = 0;
+        currentDelayPattern_ = 0;
+        setOutputs(triggerPattern_[0]);
+        delayStart_ = millis();
+        timedOutput_ = true;
+      }
+      reply(12, seq);
+      break;
+
+    // Shutter pulses, answered as soon as the first one has started
+    case 13:
+      stopPulses();
+      triggerMode_ = false;
+      timedOutput_ = false;
+      streaming_ = false;
+      startPulses(args[0], args[1],
+                  ((unsigned long) args[2] << 24) | ((unsigned long) args[3] << 16) | ((unsigned long) args[4] << 8) | args[5],
+                  ((unsigned int) args[6] << 8) | args[7],
+                  ((unsigned long) args[8] << 24) | ((unsigned long) args[9] << 16) | ((unsigned long) args[10] << 8) | args[11]);
+      reply(13, seq);
+      break;
+
+    // Append patterns to the streamed sequence
+    case 15:
+      for (byte i = 0; i < args[0] && streamFree() > 0; i++) {
+        stream_[streamHead_] = args[1 + i];
+        streamHead_ = (streamHead_ + 1) & (STREAMSIZE - 1);
+      }
+      reply(15, seq);
+      send(streamFree());
+      send((byte) (streamUnderrun_ ? 1 : 0));
+      break;
+
+    // Empty the stream
+    case 16:
+      clearStream();
+      reply(16, seq);
+      send(streamFree());
+      break;
+
+    // Play the stream on the trigger input
+    case 17:
+      stopPulses();
+      triggerNr_ = 0;
+      triggerMode_ = false;
+      timedOutput_ = false;
+      streamUnderrun_ = false;
+      streaming_ = true;
+      reply(17, seq);
+      break;
+
+    // Blanking on: outputs follow the trigger input
+    case 20:
+      blanking_ = true;
+      reply(20, seq);
+      break;
+
+    // Blanking off
+    case 21:
+      blanking_ = false;
+      setOutputs(currentPattern_);
+      reply(21, seq);
+      send((byte) 0);
+      break;
+
+    // Blank on trigger high (0) or low (1)
+    case 22:
+      blankOnHigh_ = args[0] == 0;
+      reply(22, seq);
+      break;
+
+    // Switch the baud rate, the reply still goes out at the old rate
+    case 32:
+      if (args[0] < NUMBAUDS) {
+        reply(32, seq);
+        send(args[0]);
+        requestBaud(args[0]);
+        baudCheckPending_ = args[0] != 0;
+        baudChangeTime_ = millis();
+      }
+      break;
+
+    // Loopback, lets the adapter test the link
+    case 33:
+      reply(33, seq);
+      send(args, 1 + args[0]);
+      break;
+
+    // Keep the baud rate set by command 32
+    case 34:
+      if (args[0] == currentBaud_) {
+        baudCheckPending_ = false;
+        reply(34, seq);
+        send(args[0]);
+      }
+      break;
+
+    // Digital inputs
+    case 40:
+      reply(40, seq);
+      send(PINK & 0x3F);
+      break;
+
+    // Analog input
+    case 41:
+      {
+        int val = args[0] < 6 ? analogRead(A8 + args[0]) : 0;
+        reply(41, seq);
+        send(args[0]);
+        send(highByte(val));
+        send(lowByte(val));
+      }
+      break;
+
+    // Input pull-up
+    case 42:
+      if (args[0] < 6) {
+        pinMode(A8 + args[0], args[1] ? INPUT_PULLUP : INPUT);
+      }
+      reply(42, seq);
+      send(args, 2);
+      break;
+
+    // Channel preset: wheel, outputs and both DACs
+    case 50:
+      programRunning_ = false;
+      stopPulses();
+      currentPattern_ = args[1];
+      triggerMode_ = false;
+      timedOutput_ = false;
+      streaming_ = false;
+      if (!blanking_) {
+        setOutputs(currentPattern_);
+      }
+      stopWave(0);
+      stopWave(1);
+      setDacs(((unsigned int) args[2] << 8) | args[3], ((unsigned int) args[4] << 8) | args[5]);
+      if (args[0] != 255) {
+        moveWheel(args[0]);
+      }
+      reply(50, seq);
+      send((byte) 0);
+      break;
+
+    // Move the filter wheel
+    case 60:
+      programRunning_ = false;
+      moveWheel(args[0]);
+      reply(60, seq);
+      send(args[0]);
+      break;
+
+    // Filter wheel slot (0 while unknown or between slots) and whether it is moving
+    case 61:
+      reply(61, seq);
+      send((byte) (halfSlot != UNKNOWN && halfSlot % 2 == 0 ? currentSlot() : 0));
+      send((byte) (monitor != NONE ? 1 : 0));
+      send(fault);
+      break;
+
+    // Hold camera triggers while the wheel is not ready
+    case 62:
+      holdTriggers_ = args[0] != 0;
+      triggerHeld_ = false;
+      reply(62, seq);
+      send(args[0]);
+      break;
+
+    // Store a waveform code
+    case 80:
+      if (args[0] < 2 && args[1] < WAVELENGTH) {
+        wave_[args[0]].code[args[1]] = (((unsigned int) args[2] << 8) | args[3]) & 0x0FFF;
+      }
+      reply(80, seq);
+      send(args, 2);
+      break;
+
+    // Number of codes in the waveform
+    case 81:
+      if (args[0] < 2) {
+        stopWave(args[0]);
+        wave_[args[0]].length = args[1] < WAVELENGTH ? args[1] : WAVELENGTH;
+      }
+      reply(81, seq);
+      send(args, 2);
+      break;
+
+    // Play the waveform on trigger edges or on the timer
+    case 82:
+      if (args[0] < 2) {
+        startWave(args[0], args[1],
+                  ((unsigned long) args[2] << 24) | ((unsigned long) args[3] << 16) | ((unsigned long) args[4] << 8) | args[5]);
+      }
+      reply(82, seq);
+      send(args[0]);
+      break;
+
+    // Stop the waveform, the DAC keeps its last code
+    case 83:
+      reply(83, seq);
+      send(args[0]);
+      if (args[0] < 2) {
+        stopWave(args[0]);
+        send(wave_[args[0]].step);
+      } else {
+        send((byte) 0);
+      }
+      break;
+
+    // Store a program step
+    case 70:
+      if (args[0] < MAXSTEPS) {
+        program_[args[0]].slot = args[1];
+        program_[args[0]].dwell = ((unsigned int) args[2] << 8) | args[3];
+        program_[args[0]].repeat = args[4] > 0 ? args[4] : 1;
+      }
+      reply(70, seq);
+      send(args[0]);
+      break;
+
+    // Number of steps in the program
+    case 71:
+      programLength_ = args[0] < MAXSTEPS ? args[0] : MAXSTEPS;
+      reply(71, seq);
+      send(args[0]);
+      break;
+
+    // Run the program
+    case 72:
+      programRepeat_ = args[0];
+      programStep_ = 0;
+      stepDwells_ = 0;
+      programCycle_ = 0;
+      programRunning_ = programLength_ > 0;
+      if (programRunning_) {
+        startStep();
+      }
+      reply(72, seq);
+      break;
+
+    // Stop the program, the wheel finishes its current move
+    case 73:
+      programRunning_ = false;
+      reply(73, seq);
+      send(programStep_);
+      send(programCycle_);
+      break;
+
+    // Program progress
+    case 74:
+      reply(74, seq);
+      send((byte) (programRunning_ ? 1 : 0));
+      send(programStep_);
+      send(stepDwells_);
+      send(programCycle_);
+      break;
+  }
+}
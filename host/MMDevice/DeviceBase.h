@@ -0,0 +1,231 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceBase.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   MMDevice stand-in: property store and device base classes
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+
+#ifndef _STUB_DEVICEBASE_H_
+#define _STUB_DEVICEBASE_H_
+#include "MMDevice.h"
+#include "DeviceThreads.h"
+#include "DeviceUtils.h"
+#include <map>
+#include <vector>
+#include <string>
+#include <cstdio>
+
+namespace stub {
+class Property : public MM::PropertyBase {
+public:
+   Property(const std::string& n, MM::PropertyType t, bool ro, MM::ActionFunctor* a, bool pre)
+      : name_(n), type_(t), readOnly_(ro), act_(a), pre_(pre), hasLimits_(false), lo_(0), hi_(0), seqMax_(0) {}
+   ~Property() { delete act_; }
+   bool Set(double v) { std::ostringstream os; os << v; value_ = os.str(); return true; }
+   bool Set(long v) { std::ostringstream os; os << v; value_ = os.str(); return true; }
+   bool Set(const char* v) { value_ = v; return true; }
+   bool Get(double& v) const { v = atof(value_.c_str()); return true; }
+   bool Get(long& v) const { v = atol(value_.c_str()); return true; }
+   bool Get(std::string& v) const { v = value_; return true; }
+   bool SetSequenceable(long n) { seqMax_ = n; return true; }
+   long GetSequenceMaxSize() const { return seqMax_; }
+   std::vector<std::string> GetSequence() const { return sequence_; }
+   std::string GetName() const { return name_; }
+   std::string name_, value_;
+   MM::PropertyType type_;
+   bool readOnly_;
+   MM::ActionFunctor* act_;
+   bool pre_, hasLimits_;
+   double lo_, hi_;
+   long seqMax_;
+   std::vector<std::string> allowed_;
+   std::vector<std::string> sequence_;
+};
+}
+
+template <class T, class U>
+class CDeviceBase : public T {
+public:
+   typedef MM::Action<U> CPropertyAction;
+   typedef MM::ActionEx<U> CPropertyActionEx;
+
+   CDeviceBase() : callback_(0), delayMs_(0), usesDelay_(false) {}
+   virtual ~CDeviceBase() { for (auto& p : props_) delete p.second; }
+
+   void GetLabel(char* name) const { CDeviceUtils::CopyLimitedString(name, label_.c_str()); }
+   void SetLabel(const char* label) { label_ = label; }
+   void SetCallback(MM::Core* cbk) { callback_ = cbk; }
+   void SetParentID(const char* p) { parentID_ = p; }
+   void GetParentID(char* p) const { CDeviceUtils::CopyLimitedString(p, parentID_.c_str()); }
+
+   int GetProperty(const char* name, char* value) const {
+      auto it = props_.find(name);
+      if (it == props_.end()) return DEVICE_INVALID_PROPERTY;
+      stub::Property* p = it->second;
+      if (p->act_) { int r = p->act_->Execute(p, MM::BeforeGet); if (r != DEVICE_OK) return r; }
+      CDeviceUtils::CopyLimitedString(value, p->value_.c_str());
+      return DEVICE_OK;
+   }
+   int GetProperty(const char* name, double& v) { char b[MM::MaxStrLength]; int r = GetProperty(name, b); v = atof(b); return r; }
+   int GetProperty(const char* name, long& v) { char b[MM::MaxStrLength]; int r = GetProperty(name, b); v = atol(b); return r; }
+   int SetProperty(const char* name, const char* value) {
+      auto it = props_.find(name);
+      if (it == props_.end()) return DEVICE_INVALID_PROPERTY;
+      stub::Property* p = it->second;
+      if (!p->allowed_.empty()) {
+         bool ok = false;
+         for (auto& a : p->allowed_) if (a == value) ok = true;
+         if (!ok) return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+      p->value_ = value;
+      if (p->act_) return p->act_->Execute(p, MM::AfterSet);
+      return DEVICE_OK;
+   }
+   bool HasProperty(const char* name) const { return props_.count(name) != 0; }
+
+   int IsPropertySequenceable(const char* name, bool& isSequenceable) const {
+      long n;
+      int r = GetPropertySequenceMaxLength(name, n);
+      isSequenceable = n > 0;
+      return r;
+   }
+   int GetPropertySequenceMaxLength(const char* name, long& n) const {
+      n = 0;
+      auto it = props_.find(name);
+      if (it == props_.end()) return DEVICE_INVALID_PROPERTY;
+      stub::Property* p = it->second;
+      p->seqMax_ = 0;
+      if (p->act_) { int r = p->act_->Execute(p, MM::IsSequenceable); if (r != DEVICE_OK) return r; }
+      n = p->seqMax_;
+      return DEVICE_OK;
+   }
+   int StartPropertySequence(const char* name) { return ExecuteSequenceAction(name, MM::StartSequence); }
+   int StopPropertySequence(const char* name) { return ExecuteSequenceAction(name, MM::StopSequence); }
+   int ClearPropertySequence(const char* name) {
+      auto it = props_.find(name);
+      if (it == props_.end()) return DEVICE_INVALID_PROPERTY;
+      it->second->sequence_.clear();
+      return DEVICE_OK;
+   }
+   int AddToPropertySequence(const char* name, const char* value) {
+      auto it = props_.find(name);
+      if (it == props_.end()) return DEVICE_INVALID_PROPERTY;
+      it->second->sequence_.push_back(value);
+      return DEVICE_OK;
+   }
+   int SendPropertySequence(const char* name) { return ExecuteSequenceAction(name, MM::AfterLoadSequence); }
+   int CreateProperty(const char* name, const char* value, MM::PropertyType t, bool ro, MM::ActionFunctor* act = 0, bool pre = false) {
+      if (props_.count(name)) { delete act; return DEVICE_ERR; }
+      stub::Property* p = new stub::Property(name, t, ro, act, pre);
+      p->value_ = value;
+      props_[name] = p;
+      return DEVICE_OK;
+   }
+   int CreateIntegerProperty(const char* name, long v, bool ro, MM::ActionFunctor* act = 0, bool pre = false) { std::ostringstream os; os << v; return CreateProperty(name, os.str().c_str(), MM::Integer, ro, act, pre); }
+   int CreateFloatProperty(const char* name, double v, bool ro, MM::ActionFunctor* act = 0, bool pre = false) { std::ostringstream os; os << v; return CreateProperty(name, os.str().c_str(), MM::Float, ro, act, pre); }
+   int CreateStringProperty(const char* name, const char* v, bool ro, MM::ActionFunctor* act = 0, bool pre = false) { return CreateProperty(name, v, MM::String, ro, act, pre); }
+   int SetAllowedValues(const char* name, std::vector<std::string>& values) { auto it = props_.find(name); if (it == props_.end()) return DEVICE_INVALID_PROPERTY; it->second->allowed_ = values; return DEVICE_OK; }
+   int AddAllowedValue(const char* name, const char* value) { auto it = props_.find(name); if (it == props_.end()) return DEVICE_INVALID_PROPERTY; it->second->allowed_.push_back(value); return DEVICE_OK; }
+   int AddAllowedValue(const char* name, const char* value, long) { return AddAllowedValue(name, value); }
+   int SetPropertyLimits(const char* name, double lo, double hi) { auto it = props_.find(name); if (it == props_.end()) return DEVICE_INVALID_PROPERTY; it->second->hasLimits_ = true; it->second->lo_ = lo; it->second->hi_ = hi; return DEVICE_OK; }
+   int UpdateStatus() { for (auto& p : props_) if (p.second->act_) { int r = p.second->act_->Execute(p.second, MM::BeforeGet); if (r != DEVICE_OK) return r; } return DEVICE_OK; }
+   int UpdateProperty(const char* name) { char b[MM::MaxStrLength]; return GetProperty(name, b); }
+   int OnPropertyChanged(const char* name, const char* value) { if (callback_) return callback_->OnPropertyChanged(this, name, value); return DEVICE_OK; }
+   int OnPropertiesChanged() { return DEVICE_OK; }
+
+   void SetErrorText(int code, const char* text) { errors_[code] = text; }
+   void InitializeDefaultErrorMessages() {}
+   int LogMessage(const char* msg, bool debugOnly = false) const { if (callback_) return callback_->LogMessage(this, msg, debugOnly); return DEVICE_OK; }
+   int LogMessage(const std::string& msg, bool debugOnly = false) const { return LogMessage(msg.c_str(), debugOnly); }
+   int LogMessageCode(const int code, bool debugOnly = false) const { std::ostringstream os; os << "Error " << code; return LogMessage(os.str(), debugOnly); }
+   MM::MMTime GetCurrentMMTime() { if (callback_) return callback_->GetCurrentMMTime(); return MM::MMTime(0.0); }
+   void EnableDelay(bool state = true) { usesDelay_ = state; }
+   double GetDelayMs() const { return delayMs_; }
+   void SetDelayMs(double d) { delayMs_ = d; }
+   MM::Core* GetCoreCallback() const { return callback_; }
+
+   int WriteToComPort(const char* port, const unsigned char* buf, unsigned len) { return callback_ ? callback_->WriteToSerial(this, port, buf, len) : DEVICE_ERR; }
+   int ReadFromComPort(const char* port, unsigned char* buf, unsigned maxLen, unsigned long& read) { read = 0; return callback_ ? callback_->ReadFromSerial(this, port, buf, maxLen, read) : DEVICE_ERR; }
+   int PurgeComPort(const char* port) { return callback_ ? callback_->PurgeSerial(this, port) : DEVICE_ERR; }
+   int SendSerialCommand(const char* port, const char* cmd, const char* term) { return callback_ ? callback_->SetSerialCommand(this, port, cmd, term) : DEVICE_ERR; }
+   int GetSerialAnswer(const char* port, const char* term, std::string& ans) {
+      if (!callback_) return DEVICE_ERR;
+      char buf[MM::MaxStrLength];
+      int r = callback_->GetSerialAnswer(this, port, MM::MaxStrLength, buf, term);
+      if (r != DEVICE_OK) return r;
+      ans = buf;
+      return DEVICE_OK;
+   }
+   MM::Hub* GetParentHub() const { return callback_ ? callback_->GetParentHub(this) : 0; }
+   void CreateHubIDProperty() {}
+
+protected:
+   MM::Core* callback_;
+private:
+   int ExecuteSequenceAction(const char* name, MM::ActionType eAct) {
+      auto it = props_.find(name);
+      if (it == props_.end()) return DEVICE_INVALID_PROPERTY;
+      stub::Property* p = it->second;
+      if (p->seqMax_ == 0 || !p->act_) return DEVICE_UNSUPPORTED_COMMAND;
+      return p->act_->Execute(p, eAct);
+   }
+
+   std::map<std::string, stub::Property*> props_;
+   std::map<int, std::string> errors_;
+   std::string label_, parentID_;
+   double delayMs_;
+   bool usesDelay_;
+};
+
+template <class U>
+class HubBase : public CDeviceBase<MM::Hub, U> {
+public:
+   int DetectInstalledDevices() { return DEVICE_OK; }
+   void AddInstalledDevice(MM::Device* d) { installed_.push_back(d); }
+   void ClearInstalledDevices() { installed_.clear(); }
+   unsigned GetNumberOfInstalledDevices() const { return (unsigned)installed_.size(); }
+   MM::Device* GetInstalledDevice(int i) { return installed_[i]; }
+private:
+   std::vector<MM::Device*> installed_;
+};
+
+template <class U>
+class CGenericBase : public CDeviceBase<MM::Generic, U> {};
+template <class U>
+class CShutterBase : public CDeviceBase<MM::Shutter, U> {};
+template <class U>
+class CSignalIOBase : public CDeviceBase<MM::SignalIO, U> {
+public:
+   virtual int GetDASequenceMaxLength(long& n) const { n = 0; return DEVICE_UNSUPPORTED_COMMAND; }
+   virtual int StartDASequence() { return DEVICE_UNSUPPORTED_COMMAND; }
+   virtual int StopDASequence() { return DEVICE_UNSUPPORTED_COMMAND; }
+   virtual int ClearDASequence() { return DEVICE_UNSUPPORTED_COMMAND; }
+   virtual int AddToDASequence(double) { return DEVICE_UNSUPPORTED_COMMAND; }
+   virtual int SendDASequence() { return DEVICE_UNSUPPORTED_COMMAND; }
+};
+template <class U>
+class CStateDeviceBase : public CDeviceBase<MM::State, U> {
+public:
+   typedef CStateDeviceBase CStateBase;
+   int SetPositionLabel(long pos, const char* label) { labels_[pos] = label; return DEVICE_OK; }
+   int OnLabel(MM::PropertyBase* pProp, MM::ActionType eAct) {
+      if (eAct == MM::BeforeGet) {
+         char b[MM::MaxStrLength];
+         this->GetProperty(MM::g_Keyword_State, b);
+         pProp->Set(labels_[atol(b)].c_str());
+      } else if (eAct == MM::AfterSet) {
+         std::string l; pProp->Get(l);
+         for (auto& e : labels_) if (e.second == l) { std::ostringstream os; os << e.first; return this->SetProperty(MM::g_Keyword_State, os.str().c_str()); }
+         return DEVICE_ERR;
+      }
+      return DEVICE_OK;
+   }
+private:
+   std::map<long, std::string> labels_;
+};
+
+#endif // _STUB_DEVICEBASE_H_
@@ -0,0 +1,40 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceThreads.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   MMDevice stand-in: locks and device threads on std::thread
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+
+#ifndef _STUB_DEVICETHREADS_H_
+#define _STUB_DEVICETHREADS_H_
+#include <mutex>
+#include <thread>
+class MMThreadLock {
+public:
+   void Lock() { m_.lock(); }
+   void Unlock() { m_.unlock(); }
+private:
+   std::recursive_mutex m_;
+};
+class MMThreadGuard {
+public:
+   MMThreadGuard(MMThreadLock& l) : l_(l) { l_.Lock(); }
+   ~MMThreadGuard() { l_.Unlock(); }
+private:
+   MMThreadLock& l_;
+};
+class MMDeviceThreadBase {
+public:
+   virtual ~MMDeviceThreadBase() { if (t_.joinable()) t_.join(); }
+   virtual int svc() = 0;
+   int activate() { t_ = std::thread([this] { svc(); }); return 0; }
+   void wait() { if (t_.joinable()) t_.join(); }
+private:
+   std::thread t_;
+};
+
+#endif // _STUB_DEVICETHREADS_H_
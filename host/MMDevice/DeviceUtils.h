@@ -0,0 +1,25 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          DeviceUtils.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   MMDevice stand-in: string and sleep helpers
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+
+#ifndef _STUB_DEVICEUTILS_H_
+#define _STUB_DEVICEUTILS_H_
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include "MMDevice.h"
+class CDeviceUtils {
+public:
+   static bool CopyLimitedString(char* target, const char* source) { strncpy(target, source, MM::MaxStrLength - 1); target[MM::MaxStrLength - 1] = 0; return true; }
+   static void SleepMs(long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+   static void NapMicros(unsigned long us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+};
+
+#endif // _STUB_DEVICEUTILS_H_
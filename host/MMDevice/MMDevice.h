@@ -0,0 +1,192 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          MMDevice.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Stand-in for the part of the MMDevice API that the Arduino
+//                adapter uses, so the adapter builds and runs on a host
+//                without a Micro-Manager checkout (see host/CMakeLists.txt).
+//                Only what the adapter and the host tools use is here.
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+
+#ifndef _STUB_MMDEVICE_H_
+#define _STUB_MMDEVICE_H_
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <cstdlib>
+#include <cassert>
+#include <sstream>
+#include <chrono>
+
+#define DEVICE_OK 0
+#define DEVICE_ERR 1
+#define DEVICE_INVALID_PROPERTY 2
+#define DEVICE_INVALID_INPUT_PARAM 21
+#define DEVICE_INVALID_PROPERTY_VALUE 3
+#define DEVICE_UNSUPPORTED_COMMAND 11
+#define DEVICE_SERIAL_TIMEOUT 17
+#define DEVICE_SEQUENCE_TOO_LARGE 39
+#define DEVICE_NOT_YET_IMPLEMENTED 45
+
+namespace MM {
+const int MaxStrLength = 1024;
+const char* const g_Keyword_Name = "Name";
+const char* const g_Keyword_Description = "Description";
+const char* const g_Keyword_Port = "Port";
+const char* const g_Keyword_State = "State";
+const char* const g_Keyword_Label = "Label";
+const char* const g_Keyword_BaudRate = "BaudRate";
+const char* const g_Keyword_Handshaking = "Handshaking";
+const char* const g_Keyword_StopBits = "StopBits";
+
+enum PropertyType { Undef, String, Float, Integer };
+enum ActionType { NoAction, BeforeGet, AfterSet, IsSequenceable, AfterLoadSequence, StartSequence, StopSequence };
+enum DeviceType { UnknownType, AnyType, CameraDevice, ShutterDevice, StateDevice, StageDevice, XYStageDevice, SerialDevice, GenericDevice, AutoFocusDevice, CoreDevice, ImageProcessorDevice, SignalIODevice, MagnifierDevice, SLMDevice, HubDevice, GalvoDevice };
+enum DeviceDetectionStatus { Unimplemented = -2, Misconfigured = -1, CanNotCommunicate = 0, CanCommunicate = 1 };
+
+class MMTime {
+public:
+   MMTime(double uSecTotal = 0.0) : us_((long long)uSecTotal) {}
+   MMTime(long sec, long uSec) : us_((long long)sec * 1000000 + uSec) {}
+   static MMTime fromMs(double ms) { return MMTime(ms * 1000.0); }
+   MMTime operator+(const MMTime& o) const { MMTime t; t.us_ = us_ + o.us_; return t; }
+   MMTime operator-(const MMTime& o) const { MMTime t; t.us_ = us_ - o.us_; return t; }
+   bool operator<(const MMTime& o) const { return us_ < o.us_; }
+   bool operator>(const MMTime& o) const { return us_ > o.us_; }
+   bool operator==(const MMTime& o) const { return us_ == o.us_; }
+   double getMsec() const { return us_ / 1000.0; }
+   double getUsec() const { return (double)us_; }
+private:
+   long long us_;
+};
+
+class PropertyBase {
+public:
+   virtual ~PropertyBase() {}
+   virtual bool Set(double val) = 0;
+   virtual bool Set(long val) = 0;
+   virtual bool Set(const char* val) = 0;
+   virtual bool Get(double& val) const = 0;
+   virtual bool Get(long& val) const = 0;
+   virtual bool Get(std::string& val) const = 0;
+   virtual bool SetSequenceable(long sequenceSize) = 0;
+   virtual long GetSequenceMaxSize() const = 0;
+   virtual std::vector<std::string> GetSequence() const = 0;
+   virtual std::string GetName() const = 0;
+};
+
+class ActionFunctor {
+public:
+   virtual ~ActionFunctor() {}
+   virtual int Execute(PropertyBase* pProp, ActionType eAct) = 0;
+};
+
+template <class T>
+class Action : public ActionFunctor {
+   typedef int (T::*Fn)(PropertyBase*, ActionType);
+public:
+   Action(T* obj, Fn fn) : obj_(obj), fn_(fn) {}
+   int Execute(PropertyBase* pProp, ActionType eAct) { return (obj_->*fn_)(pProp, eAct); }
+private:
+   T* obj_; Fn fn_;
+};
+
+template <class T>
+class ActionEx : public ActionFunctor {
+   typedef int (T::*Fn)(PropertyBase*, ActionType, long);
+public:
+   ActionEx(T* obj, Fn fn, long data) : obj_(obj), fn_(fn), data_(data) {}
+   int Execute(PropertyBase* pProp, ActionType eAct) { return (obj_->*fn_)(pProp, eAct, data_); }
+private:
+   T* obj_; Fn fn_; long data_;
+};
+
+class Core;
+class Hub;
+
+class Device {
+public:
+   virtual ~Device() {}
+   virtual int Initialize() = 0;
+   virtual int Shutdown() = 0;
+   virtual void GetName(char* name) const = 0;
+   virtual bool Busy() = 0;
+   virtual void GetLabel(char* name) const = 0;
+   virtual void SetLabel(const char* label) = 0;
+   virtual int SetProperty(const char* name, const char* value) = 0;
+   virtual int GetProperty(const char* name, char* value) const = 0;
+   virtual bool HasProperty(const char* name) const = 0;
+   virtual void SetCallback(Core* cbk) = 0;
+   virtual DeviceType GetType() const = 0;
+   virtual void SetParentID(const char* parentId) = 0;
+   virtual void GetParentID(char* parentID) const = 0;
+
+   // property sequences, as MMCore drives them
+   virtual int IsPropertySequenceable(const char* name, bool& isSequenceable) const = 0;
+   virtual int GetPropertySequenceMaxLength(const char* propertyName, long& nrEvents) const = 0;
+   virtual int StartPropertySequence(const char* propertyName) = 0;
+   virtual int StopPropertySequence(const char* propertyName) = 0;
+   virtual int ClearPropertySequence(const char* propertyName) = 0;
+   virtual int AddToPropertySequence(const char* propertyName, const char* value) = 0;
+   virtual int SendPropertySequence(const char* propertyName) = 0;
+};
+
+class Generic : public Device { public: DeviceType GetType() const { return GenericDevice; } };
+class Shutter : public Device {
+public:
+   DeviceType GetType() const { return ShutterDevice; }
+   virtual int SetOpen(bool open = true) = 0;
+   virtual int GetOpen(bool& open) = 0;
+   virtual int Fire(double deltaT) = 0;
+};
+class State : public Device {
+public:
+   DeviceType GetType() const { return StateDevice; }
+   virtual unsigned long GetNumberOfPositions() const = 0;
+};
+class SignalIO : public Device {
+public:
+   DeviceType GetType() const { return SignalIODevice; }
+   virtual int SetGateOpen(bool open = true) = 0;
+   virtual int GetGateOpen(bool& open) = 0;
+   virtual int SetSignal(double volts) = 0;
+   virtual int GetSignal(double& volts) = 0;
+   virtual int GetLimits(double& minVolts, double& maxVolts) = 0;
+   virtual int IsDASequenceable(bool& isSequenceable) const = 0;
+   virtual int GetDASequenceMaxLength(long& nrEvents) const = 0;
+   virtual int StartDASequence() = 0;
+   virtual int StopDASequence() = 0;
+   virtual int ClearDASequence() = 0;
+   virtual int AddToDASequence(double voltage) = 0;
+   virtual int SendDASequence() = 0;
+};
+class Hub : public Device {
+public:
+   DeviceType GetType() const { return HubDevice; }
+   virtual int DetectInstalledDevices() = 0;
+};
+
+class Core {
+public:
+   virtual ~Core() {}
+   virtual int LogMessage(const Device* caller, const char* msg, bool debugOnly) const = 0;
+   virtual Device* GetDevice(const Device* caller, const char* label) = 0;
+   virtual int GetDeviceProperty(const char* deviceName, const char* propName, char* value) = 0;
+   virtual int SetDeviceProperty(const char* deviceName, const char* propName, const char* value) = 0;
+   virtual int SetSerialCommand(const Device* caller, const char* portName, const char* command, const char* term) = 0;
+   virtual int GetSerialAnswer(const Device* caller, const char* portName, unsigned long ansLength, char* answer, const char* term) = 0;
+   virtual int WriteToSerial(const Device* caller, const char* port, const unsigned char* buf, unsigned long length) = 0;
+   virtual int ReadFromSerial(const Device* caller, const char* port, unsigned char* buf, unsigned long length, unsigned long& read) = 0;
+   virtual int PurgeSerial(const Device* caller, const char* portName) = 0;
+   virtual MMTime GetCurrentMMTime() = 0;
+   virtual int OnPropertyChanged(const Device* caller, const char* propName, const char* propValue) = 0;
+   virtual Hub* GetParentHub(const Device* caller) const = 0;
+};
+} // namespace MM
+
+#endif // _STUB_MMDEVICE_H_
@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ModuleInterface.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   MMDevice stand-in: device registry of the module
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+
+#include "ModuleInterface.h"
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct DeviceInfo
+{
+   std::string name;
+   MM::DeviceType type;
+   std::string description;
+};
+
+std::vector<DeviceInfo>& Registry()
+{
+   static std::vector<DeviceInfo> devices;
+   return devices;
+}
+
+const DeviceInfo* Find(const char* deviceName)
+{
+   for (size_t i = 0; i < Registry().size(); i++)
+      if (Registry()[i].name == deviceName)
+         return &Registry()[i];
+   return 0;
+}
+
+bool CopyName(const std::string& source, char* target, unsigned bufLen)
+{
+   if (source.size() >= bufLen)
+      return false;
+   strcpy(target, source.c_str());
+   return true;
+}
+
+} // namespace
+
+void RegisterDevice(const char* deviceName, MM::DeviceType deviceType, const char* description)
+{
+   if (deviceName == 0 || Find(deviceName) != 0)
+      return;
+   DeviceInfo info;
+   info.name = deviceName;
+   info.type = deviceType;
+   info.description = description ? description : "";
+   Registry().push_back(info);
+}
+
+MODULE_API unsigned GetNumberOfDevices()
+{
+   if (Registry().empty())
+      InitializeModuleData();
+   return (unsigned) Registry().size();
+}
+
+MODULE_API bool GetDeviceName(unsigned deviceIndex, char* name, unsigned bufLen)
+{
+   if (deviceIndex >= GetNumberOfDevices())
+      return false;
+   return CopyName(Registry()[deviceIndex].name, name, bufLen);
+}
+
+MODULE_API bool GetDeviceDescription(const char* deviceName, char* name, unsigned bufLen)
+{
+   GetNumberOfDevices();
+   const DeviceInfo* info = Find(deviceName);
+   return info != 0 && CopyName(info->description, name, bufLen);
+}
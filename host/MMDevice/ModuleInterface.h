@@ -0,0 +1,26 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ModuleInterface.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   MMDevice stand-in: module entry points and device registry
+//
+// LICENSE:       This file is distributed under the BSD license.
+//                License text is included with the source distribution.
+//
+
+#ifndef _STUB_MODULEINTERFACE_H_
+#define _STUB_MODULEINTERFACE_H_
+#include "MMDevice.h"
+#define MODULE_API extern "C"
+MODULE_API void InitializeModuleData();
+MODULE_API MM::Device* CreateDevice(const char* name);
+MODULE_API void DeleteDevice(MM::Device* pDevice);
+MODULE_API unsigned GetNumberOfDevices();
+MODULE_API bool GetDeviceName(unsigned deviceIndex, char* name, unsigned bufLen);
+MODULE_API bool GetDeviceDescription(const char* deviceName, char* name, unsigned bufLen);
+
+// called from InitializeModuleData()
+void RegisterDevice(const char* deviceName, MM::DeviceType deviceType, const char* description);
+
+#endif // _STUB_MODULEINTERFACE_H_
@@ -0,0 +1,422 @@
+// A multi-channel acquisition, end to end
+//
+// Drives the adapter's devices through what a multi-dimensional
+// acquisition asks of them, against the emulated board with a link that
+// has USB latency and byte times, and a wheel that takes its time:
+//
+//   software  for every frame and channel: move the filter wheel, set the
+//             DAC, select the switch pattern, open the shutter, expose,
+//             close the shutter.  Each step waits until the device is no
+//             longer busy, polling every millisecond.
+//   sequence  the channels' patterns as a switch sequence that camera
+//             triggers step through, one per exposure, with the shutter
+//             open.  Longer than the board's table, so it is streamed.
+//
+// Prints frames per second for both and where the time of a software
+// frame goes.  --save writes the results to a file, --baseline compares
+// them with such a file.  With --virtual-time everything runs on the
+// board's virtual clock: the numbers are what the modelled hardware
+// takes, the same on every run, and long runs finish quickly.  --record
+// has the hub write a traffic log, for arduino_replay_bench.
+//
+// usage: arduino_acquisition_bench [--frames n] [--sequence-frames n]
+//           [--channels n] [--exposure-ms t] [--latency-us t]
+//           [--slot-ms t] [--virtual-time] [--save file] [--baseline file]
+//           [--record file]
+
+#include "BenchResults.h"
+#include "../sim/ArduinoRig.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const double g_BusyTimeoutMs = 10000;
+// while the bench watches the board's outputs
+const double g_PollUs = 10;
+
+struct Options
+{
+   Options() :
+      frames(10), sequenceFrames(100), channels(3),
+      exposureMs(10), latencyUs(1000), slotMs(100), virtualTime(false)
+   {}
+
+   long frames;
+   long sequenceFrames;
+   long channels;
+   double exposureMs;
+   double latencyUs;
+   double slotMs;
+   bool virtualTime;
+   std::string save;
+   std::string baseline;
+   std::string record;
+};
+
+struct StepStats
+{
+   StepStats() : count(0), totalMs(0), minMs(0), maxMs(0) {}
+
+   void Add(double ms)
+   {
+      if (count == 0 || ms < minMs)
+         minMs = ms;
+      if (ms > maxMs)
+         maxMs = ms;
+      totalMs += ms;
+      count++;
+   }
+
+   long count;
+   double totalMs;
+   double minMs;
+   double maxMs;
+};
+
+// on the board's clock, which is the core's
+double NowMs()
+{
+   return ArduinoBoard::Instance().GetTimeUs() / 1000;
+}
+
+double MsSince(double startMs)
+{
+   return NowMs() - startMs;
+}
+
+int WaitForDevice(MM::Device* device)
+{
+   double start = NowMs();
+   while (device->Busy())
+   {
+      if (MsSince(start) > g_BusyTimeoutMs)
+         return DEVICE_ERR;
+      ArduinoBoard::Instance().Wait(1000);
+   }
+   return DEVICE_OK;
+}
+
+int SetAndWait(MM::Device* device, const char* property, const std::string& value)
+{
+   int ret = device->SetProperty(property, value.c_str());
+   if (ret != DEVICE_OK)
+      return ret;
+   return WaitForDevice(device);
+}
+
+std::string ToString(double value)
+{
+   std::ostringstream os;
+   os << value;
+   return os.str();
+}
+
+unsigned char ChannelPattern(long channel)
+{
+   return (unsigned char) (1 << (channel % 6));
+}
+
+double ChannelVolts(long channel)
+{
+   return 0.5 + 0.5 * (channel % 8);
+}
+
+class Acquisition
+{
+public:
+   Acquisition(ArduinoRig& rig, const Options& options) :
+      rig_(rig),
+      options_(options),
+      wheel_(rig.GetDevice("Arduino-FilterWheel")),
+      dac_(rig.GetDevice("Arduino-DAC1")),
+      switch_(rig.GetDevice("Arduino-Switch")),
+      shutter_(rig.GetDevice("Arduino-Shutter")),
+      mismatches_(0)
+   {}
+
+   int RunSoftware(BenchResults& results);
+   int RunSequence(BenchResults& results);
+
+   // software-timed frames that did not find the devices as they were set
+   long GetMismatches() const {return mismatches_;}
+
+private:
+   int Step(const char* name, MM::Device* device, const char* property, const std::string& value);
+   void Check(bool ok, const char* what, long frame, long channel);
+
+   ArduinoRig& rig_;
+   const Options& options_;
+   MM::Device* wheel_;
+   MM::Device* dac_;
+   MM::Device* switch_;
+   MM::Device* shutter_;
+   std::vector<std::string> stepNames_;
+   std::map<std::string, StepStats> steps_;
+   long mismatches_;
+};
+
+int Acquisition::Step(const char* name, MM::Device* device, const char* property, const std::string& value)
+{
+   if (steps_.count(name) == 0)
+      stepNames_.push_back(name);
+   double start = NowMs();
+   int ret = SetAndWait(device, property, value);
+   steps_[name].Add(MsSince(start));
+   if (ret != DEVICE_OK)
+      fprintf(stderr, "%s failed with %d\n", name, ret);
+   return ret;
+}
+
+void Acquisition::Check(bool ok, const char* what, long frame, long channel)
+{
+   if (ok)
+      return;
+   if (mismatches_++ < 10)
+      fprintf(stderr, "frame %ld, channel %ld: %s is not what was set\n", frame, channel, what);
+}
+
+int Acquisition::RunSoftware(BenchResults& results)
+{
+   ArduinoBoard& board = rig_.GetBoard();
+   double start = NowMs();
+   for (long frame = 0; frame < options_.frames; frame++)
+   {
+      for (long channel = 0; channel < options_.channels; channel++)
+      {
+         // State is the slot, 0 stops the wheel
+         long slot = channel % 6 + 1;
+         int ret = Step("wheel", wheel_, MM::g_Keyword_State, ToString((double) slot));
+         if (ret == DEVICE_OK)
+            ret = Step("dac", dac_, "Volts", ToString(ChannelVolts(channel)));
+         if (ret == DEVICE_OK)
+            ret = Step("switch", switch_, MM::g_Keyword_State, ToString(ChannelPattern(channel)));
+         if (ret == DEVICE_OK)
+            ret = Step("shutter open", shutter_, "OnOff", "1");
+         if (ret != DEVICE_OK)
+            return ret;
+
+         Check((long) std::floor(board.GetWheelPosition() + 0.5) == slot, "wheel position", frame, channel);
+         Check(board.GetOutputs() == ChannelPattern(channel), "output pattern", frame, channel);
+         Check(std::fabs(board.GetDacCode(0) - ChannelVolts(channel) / 5.0 * 4095) <= 1, "DAC code", frame, channel);
+
+         if (steps_.count("exposure") == 0)
+            stepNames_.push_back("exposure");
+         double exposure = NowMs();
+         board.Wait(options_.exposureMs * 1000);
+         steps_["exposure"].Add(MsSince(exposure));
+
+         ret = Step("shutter close", shutter_, "OnOff", "0");
+         if (ret != DEVICE_OK)
+            return ret;
+      }
+   }
+   double totalMs = MsSince(start);
+   double fps = options_.frames * 1000.0 / totalMs;
+
+   printf("\nsoftware timed: %ld frames of %ld channels, %.2f frames/s\n",
+         options_.frames, options_.channels, fps);
+   printf("%-16s %10s %10s %10s %10s\n", "step", "mean ms", "min ms", "max ms", "% of frame");
+   results.Set("software_fps", fps);
+   for (size_t i = 0; i < stepNames_.size(); i++)
+   {
+      const StepStats& s = steps_[stepNames_[i]];
+      double mean = s.totalMs / s.count;
+      printf("%-16s %10.3f %10.3f %10.3f %10.1f\n", stepNames_[i].c_str(), mean, s.minMs, s.maxMs,
+            100.0 * s.totalMs / totalMs);
+      std::string key = "step_" + stepNames_[i] + "_ms";
+      for (size_t j = 0; j < key.size(); j++)
+         if (key[j] == ' ')
+            key[j] = '_';
+      results.Set(key, mean);
+   }
+   return DEVICE_OK;
+}
+
+// The camera fires once per exposure, as it would in a burst.  A pattern
+// that is not on the outputs by the middle of the exposure is late; late
+// patterns mean the stream was not refilled in time.
+int Acquisition::RunSequence(BenchResults& results)
+{
+   ArduinoBoard& board = rig_.GetBoard();
+   long length = options_.sequenceFrames * options_.channels;
+
+   int ret = switch_->SetProperty("Sequence", "On");
+   if (ret != DEVICE_OK)
+      return ret;
+   long maxLength = 0;
+   ret = switch_->GetPropertySequenceMaxLength(MM::g_Keyword_State, maxLength);
+   if (ret != DEVICE_OK)
+      return ret;
+   if (length > maxLength)
+   {
+      fprintf(stderr, "the switch takes sequences of up to %ld patterns\n", maxLength);
+      return DEVICE_SEQUENCE_TOO_LARGE;
+   }
+
+   switch_->ClearPropertySequence(MM::g_Keyword_State);
+   for (long i = 0; i < length; i++)
+      switch_->AddToPropertySequence(MM::g_Keyword_State, ToString(ChannelPattern(i % options_.channels)).c_str());
+
+   ret = SetAndWait(shutter_, "OnOff", "1");
+   if (ret != DEVICE_OK)
+      return ret;
+   double load = NowMs();
+   ret = switch_->SendPropertySequence(MM::g_Keyword_State);
+   if (ret == DEVICE_OK)
+      ret = switch_->StartPropertySequence(MM::g_Keyword_State);
+   if (ret != DEVICE_OK)
+      return ret;
+   double startMs = MsSince(load);
+
+   double period = options_.exposureMs;
+   long late = 0;
+   double start = NowMs();
+   for (long i = 0; i < length; i++)
+   {
+      double next = start + i * period;
+      if (NowMs() < next)
+         board.Wait((next - NowMs()) * 1000);
+      unsigned char expected = ChannelPattern(i % options_.channels);
+      board.SetTriggerInput(true);
+      double trigger = NowMs();
+      while (board.GetOutputs() != expected && MsSince(trigger) < period / 2)
+         board.Wait(g_PollUs);
+      if (board.GetOutputs() != expected)
+         late++;
+
+      // the sketch acts on edges, it has to see the trigger go low
+      board.SetTriggerInput(false);
+      unsigned long loops = board.GetLoopCount();
+      while (board.GetLoopCount() < loops + 2)
+         board.Wait(g_PollUs);
+   }
+   double totalMs = MsSince(start);
+
+   ret = switch_->StopPropertySequence(MM::g_Keyword_State);
+   if (ret == DEVICE_OK)
+      ret = SetAndWait(shutter_, "OnOff", "0");
+   if (ret != DEVICE_OK)
+      return ret;
+
+   double fps = options_.sequenceFrames * 1000.0 / totalMs;
+   printf("\nsequence: %ld triggers, started in %.3f ms, %.2f frames/s, %ld patterns late\n",
+         length, startMs, fps, late);
+   results.Set("sequence_fps", fps);
+   results.Set("sequence_start_ms", startMs);
+   results.Set("sequence_late", (double) late);
+   return DEVICE_OK;
+}
+
+bool ParseOptions(int argc, char** argv, Options& options)
+{
+   for (int i = 1; i < argc; i++)
+   {
+      std::string arg = argv[i];
+      if (arg == "--virtual-time")
+      {
+         options.virtualTime = true;
+         continue;
+      }
+      if (i + 1 >= argc)
+         return false;
+      const char* value = argv[++i];
+      if (arg == "--frames")
+         options.frames = atol(value);
+      else if (arg == "--sequence-frames")
+         options.sequenceFrames = atol(value);
+      else if (arg == "--channels")
+         options.channels = atol(value);
+      else if (arg == "--exposure-ms")
+         options.exposureMs = atof(value);
+      else if (arg == "--latency-us")
+         options.latencyUs = atof(value);
+      else if (arg == "--slot-ms")
+         options.slotMs = atof(value);
+      else if (arg == "--save")
+         options.save = value;
+      else if (arg == "--baseline")
+         options.baseline = value;
+      else if (arg == "--record")
+         options.record = value;
+      else
+         return false;
+   }
+   return options.frames > 0 && options.sequenceFrames > 0 &&
+         options.channels > 0 && options.channels <= 6 &&
+         options.exposureMs >= 0 && options.latencyUs >= 0 && options.slotMs > 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+   Options options;
+   if (!ParseOptions(argc, argv, options))
+   {
+      fprintf(stderr, "usage: %s [--frames n] [--sequence-frames n] [--channels 1-6]\n"
+            "          [--exposure-ms t] [--latency-us t] [--slot-ms t] [--virtual-time]\n"
+            "          [--save file] [--baseline file] [--record file]\n", argv[0]);
+      return 2;
+   }
+
+   ArduinoBoard::Config config;
+   config.serialLatencyUs = options.latencyUs;
+   config.slotMsFullSpeed = options.slotMs;
+   config.homed = true;
+
+   ArduinoRig rig;
+   if (options.virtualTime)
+      rig.GetBoard().UseVirtualTime();
+   rig.GetCore().SetLogging(true);
+   rig.SetPreInitProperty("Arduino-Hub", "Logic", "Normal");
+   if (!options.record.empty())
+      rig.SetPreInitProperty("Arduino-Hub", "Traffic Log", options.record.c_str());
+   int ret = rig.Load(config);
+   if (ret != DEVICE_OK)
+   {
+      fprintf(stderr, "loading the adapter failed with %d\n", ret);
+      return 1;
+   }
+
+   char baud[MM::MaxStrLength];
+   rig.GetHub()->GetProperty("Baud Rate", baud);
+   printf("link at %s baud, %.0f us latency; wheel %.0f ms per slot at full speed\n",
+         baud, options.latencyUs, options.slotMs);
+   printf("hub initialized in %.0f ms%s\n", rig.GetHubInitializeMs(),
+         options.virtualTime ? ", all times virtual" : "");
+
+   BenchResults results;
+   Acquisition acquisition(rig, options);
+   ret = acquisition.RunSoftware(results);
+   if (ret == DEVICE_OK)
+      ret = acquisition.RunSequence(results);
+   if (ret != DEVICE_OK)
+   {
+      fprintf(stderr, "acquisition failed with %d\n", ret);
+      return 1;
+   }
+   if (acquisition.GetMismatches() > 0)
+      printf("\n%ld software-timed channels did not find the devices as set\n", acquisition.GetMismatches());
+
+   if (!options.baseline.empty())
+   {
+      BenchResults baseline;
+      if (!baseline.Load(options.baseline))
+         fprintf(stderr, "cannot read baseline %s\n", options.baseline.c_str());
+      else
+         results.Compare(baseline);
+   }
+   if (!options.save.empty() && !results.Save(options.save))
+   {
+      fprintf(stderr, "cannot write %s\n", options.save.c_str());
+      return 1;
+   }
+   return 0;
+}
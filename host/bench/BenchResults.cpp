@@ -0,0 +1,46 @@
+// Named results of a benchmark run, see BenchResults.h
+
+#include "BenchResults.h"
+#include <cstdio>
+#include <fstream>
+
+void BenchResults::Set(const std::string& name, double value)
+{
+   if (values_.count(name) == 0)
+      names_.push_back(name);
+   values_[name] = value;
+}
+
+bool BenchResults::Save(const std::string& path) const
+{
+   std::ofstream out(path.c_str());
+   for (size_t i = 0; i < names_.size(); i++)
+      out << names_[i] << " " << values_.find(names_[i])->second << "\n";
+   return out.good();
+}
+
+bool BenchResults::Load(const std::string& path)
+{
+   std::ifstream in(path.c_str());
+   if (!in)
+      return false;
+   std::string name;
+   double value;
+   while (in >> name >> value)
+      Set(name, value);
+   return true;
+}
+
+void BenchResults::Compare(const BenchResults& baseline) const
+{
+   printf("\n%-32s %12s %12s %8s\n", "compared with baseline", "now", "baseline", "change");
+   for (size_t i = 0; i < names_.size(); i++)
+   {
+      std::map<std::string, double>::const_iterator b = baseline.values_.find(names_[i]);
+      if (b == baseline.values_.end())
+         continue;
+      double now = values_.find(names_[i])->second;
+      double change = b->second != 0 ? 100.0 * (now - b->second) / b->second : 0;
+      printf("%-32s %12.3f %12.3f %+7.1f%%\n", names_[i].c_str(), now, b->second, change);
+   }
+}
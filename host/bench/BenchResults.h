@@ -0,0 +1,28 @@
+// Named results of a benchmark run
+//
+// Kept in the order they were set.  Saved as one "name value" line each,
+// so a run can be compared with an earlier one: Compare() prints both
+// values and the change in percent for every name the two have in common.
+
+#ifndef _BenchResults_H_
+#define _BenchResults_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+class BenchResults
+{
+public:
+   void Set(const std::string& name, double value);
+
+   bool Save(const std::string& path) const;
+   bool Load(const std::string& path);
+   void Compare(const BenchResults& baseline) const;
+
+private:
+   std::vector<std::string> names_;
+   std::map<std::string, double> values_;
+};
+
+#endif // _BenchResults_H_
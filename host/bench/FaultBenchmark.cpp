@@ -0,0 +1,355 @@
+// Throughput over a line that gets bytes wrong
+//
+// Loads the adapter against the emulated board through FaultyLink and
+// runs the commands the devices send most (switch patterns, DAC
+// setpoints, input reads) twice: over a clean line, then with bytes
+// dropped, corrupted, duplicated and delayed at the given rates in both
+// directions.  The hub retries what gets no reply within its retry budget.
+// Last, the line goes dead and the bench times how long the hub takes to
+// give up on a command.
+//
+// Prints operations per second for both runs, the operations that failed,
+// those that succeeded with a wrong result (every frame carries a crc, so
+// there should be none; the bench fails if there are), the hub's retries,
+// the slowest operation, and the time to a failure on the dead line.  --save writes the results to a file,
+// --baseline compares them with such a file.  --record has the hub write a
+// traffic log, to see what the line did to each command.
+//
+// usage: arduino_fault_bench [--ops n] [--drop p] [--corrupt p]
+//           [--duplicate p] [--delay p] [--delay-us t] [--retries n]
+//           [--budget-ms t] [--fixed-timeouts] [--latency-us t] [--seed n]
+//           [--virtual-time]
+//           [--save file] [--baseline file] [--record file]
+
+#include "BenchResults.h"
+#include "../sim/ArduinoRig.h"
+#include "../sim/FaultyLink.h"
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+namespace {
+
+// the board's inputs during the run
+const unsigned char g_Inputs = 0x2A;
+
+struct Options
+{
+   Options() :
+      ops(2000), delayUs(2000), retries(2), budgetMs(100),
+      latencyUs(1000), seed(1), fixedTimeouts(false), virtualTime(false)
+   {
+      faults.drop = 0.0005;
+      faults.corrupt = 0.0005;
+      faults.duplicate = 0.0005;
+      faults.delay = 0.0005;
+   }
+
+   long ops;
+   FaultyLink::Faults faults;
+   double delayUs;
+   long retries;
+   long budgetMs;
+   double latencyUs;
+   unsigned seed;
+   bool fixedTimeouts;
+   bool virtualTime;
+   std::string save;
+   std::string baseline;
+   std::string record;
+};
+
+struct RunStats
+{
+   RunStats() : ops(0), failed(0), wrong(0), ms(0), maxOpMs(0) {}
+
+   long ops;
+   long failed;
+   long wrong;
+   double ms;
+   double maxOpMs;
+};
+
+class Workload
+{
+public:
+   Workload(ArduinoRig& rig) :
+      rig_(rig),
+      switch_(rig.GetDevice("Arduino-Switch")),
+      dac_(rig.GetDevice("Arduino-DAC1")),
+      input_(rig.GetDevice("Arduino-Input"))
+   {}
+
+   int Prepare();
+   void Run(long ops, RunStats& stats);
+   int Step(long i, bool& wrong);
+
+private:
+
+   ArduinoRig& rig_;
+   MM::Device* switch_;
+   MM::Device* dac_;
+   MM::Device* input_;
+   std::string inputs_;
+};
+
+int Workload::Prepare()
+{
+   // the switch only drives the outputs while the shutter is open
+   int ret = rig_.GetDevice("Arduino-Shutter")->SetProperty("OnOff", "1");
+   if (ret != DEVICE_OK)
+      return ret;
+   rig_.GetBoard().SetDigitalInputs(g_Inputs);
+
+   // what the input device makes of them, over the clean line
+   char value[MM::MaxStrLength];
+   ret = input_->GetProperty("DigitalInput", value);
+   if (ret != DEVICE_OK)
+      return ret;
+   inputs_ = value;
+   return DEVICE_OK;
+}
+
+int Workload::Step(long i, bool& wrong)
+{
+   wrong = false;
+   char value[MM::MaxStrLength];
+   switch (i % 3)
+   {
+   case 0:
+   {
+      unsigned pattern = i % 2 ? 5 : 10;
+      std::ostringstream os;
+      os << pattern;
+      int ret = switch_->SetProperty("State", os.str().c_str());
+      if (ret != DEVICE_OK)
+         return ret;
+      wrong = rig_.GetBoard().GetOutputs() != pattern;
+      return DEVICE_OK;
+   }
+   case 1:
+      return dac_->SetProperty("Volts", i % 2 ? "1.25" : "2.5");
+   default:
+   {
+      int ret = input_->GetProperty("DigitalInput", value);
+      if (ret != DEVICE_OK)
+         return ret;
+      wrong = inputs_ != value;
+      return DEVICE_OK;
+   }
+   }
+}
+
+void Workload::Run(long ops, RunStats& stats)
+{
+   ArduinoBoard& board = rig_.GetBoard();
+   double start = board.GetTimeUs();
+   for (long i = 0; i < ops; i++)
+   {
+      double before = board.GetTimeUs();
+      bool wrong;
+      int ret = Step(i, wrong);
+      double opMs = (board.GetTimeUs() - before) / 1000;
+      if (opMs > stats.maxOpMs)
+         stats.maxOpMs = opMs;
+      stats.ops++;
+      if (ret != DEVICE_OK)
+         stats.failed++;
+      else if (wrong)
+         stats.wrong++;
+   }
+   stats.ms = (board.GetTimeUs() - start) / 1000;
+}
+
+// Puts the core's link back when the bench ends, so the hub still reaches
+// the board while the rig unloads it, after the faulty link is gone
+class RestoreLink
+{
+public:
+   RestoreLink(SimulatedCore& core) : core_(core), link_(core.GetLink()) {}
+   ~RestoreLink() {core_.SetLink(link_);}
+
+private:
+   SimulatedCore& core_;
+   SerialLink* link_;
+};
+
+void Print(const char* name, const RunStats& s)
+{
+   printf("%-8s %8ld ops %10.1f ops/s %6ld failed %6ld wrong %10.2f ms slowest\n",
+         name, s.ops, s.ops * 1000 / s.ms, s.failed, s.wrong, s.maxOpMs);
+}
+
+bool ParseOptions(int argc, char** argv, Options& options)
+{
+   for (int i = 1; i < argc; i++)
+   {
+      std::string arg = argv[i];
+      if (arg == "--virtual-time")
+      {
+         options.virtualTime = true;
+         continue;
+      }
+      if (arg == "--fixed-timeouts")
+      {
+         options.fixedTimeouts = true;
+         continue;
+      }
+      if (i + 1 >= argc)
+         return false;
+      const char* value = argv[++i];
+      if (arg == "--ops")
+         options.ops = atol(value);
+      else if (arg == "--drop")
+         options.faults.drop = atof(value);
+      else if (arg == "--corrupt")
+         options.faults.corrupt = atof(value);
+      else if (arg == "--duplicate")
+         options.faults.duplicate = atof(value);
+      else if (arg == "--delay")
+         options.faults.delay = atof(value);
+      else if (arg == "--delay-us")
+         options.delayUs = atof(value);
+      else if (arg == "--retries")
+         options.retries = atol(value);
+      else if (arg == "--budget-ms")
+         options.budgetMs = atol(value);
+      else if (arg == "--latency-us")
+         options.latencyUs = atof(value);
+      else if (arg == "--seed")
+         options.seed = (unsigned) atol(value);
+      else if (arg == "--save")
+         options.save = value;
+      else if (arg == "--baseline")
+         options.baseline = value;
+      else if (arg == "--record")
+         options.record = value;
+      else
+         return false;
+   }
+   options.faults.delayUs = options.delayUs;
+   return options.ops > 0 && options.retries >= 0 && options.budgetMs >= 0 &&
+         options.delayUs >= 0 && options.latencyUs >= 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+   Options options;
+   if (!ParseOptions(argc, argv, options))
+   {
+      fprintf(stderr, "usage: %s [--ops n] [--drop p] [--corrupt p] [--duplicate p]\n"
+            "          [--delay p] [--delay-us t] [--retries n] [--budget-ms t]\n"
+            "          [--fixed-timeouts] [--latency-us t] [--seed n] [--virtual-time]\n"
+            "          [--save file] [--baseline file] [--record file]\n", argv[0]);
+      return 2;
+   }
+
+   ArduinoBoard::Config config;
+   config.serialLatencyUs = options.latencyUs;
+   config.homed = true;
+
+   ArduinoRig rig;
+   if (options.virtualTime)
+      rig.GetBoard().UseVirtualTime();
+   rig.GetCore().SetLogging(true);
+   rig.SetPreInitProperty("Arduino-Hub", "Logic", "Normal");
+   if (!options.record.empty())
+      rig.SetPreInitProperty("Arduino-Hub", "Traffic Log", options.record.c_str());
+   FaultyLink line(*rig.GetCore().GetLink(), options.seed);
+   RestoreLink restore(rig.GetCore());
+   rig.GetCore().SetLink(&line);
+   int ret = rig.Load(config);
+   if (ret == DEVICE_OK)
+   {
+      std::ostringstream retries, budget;
+      retries << options.retries;
+      budget << options.budgetMs;
+      ret = rig.GetHub()->SetProperty("Retries", retries.str().c_str());
+      if (ret == DEVICE_OK)
+         ret = rig.GetHub()->SetProperty("Retry Budget (ms)", budget.str().c_str());
+      if (ret == DEVICE_OK && options.fixedTimeouts)
+         ret = rig.GetHub()->SetProperty("Adaptive Timeouts", "Off");
+   }
+   if (ret != DEVICE_OK)
+   {
+      fprintf(stderr, "loading the adapter failed with %d\n", ret);
+      return 1;
+   }
+
+   Workload workload(rig);
+   ret = workload.Prepare();
+   if (ret != DEVICE_OK)
+   {
+      fprintf(stderr, "setting up the devices failed with %d\n", ret);
+      return 1;
+   }
+
+   printf("per byte, each way: drop %g, corrupt %g, duplicate %g, delay %g by %.0f us\n",
+         options.faults.drop, options.faults.corrupt, options.faults.duplicate,
+         options.faults.delay, options.delayUs);
+   printf("%ld retries within %ld ms, %s timeouts, %.0f us latency%s\n\n", options.retries,
+         options.budgetMs, options.fixedTimeouts ? "fixed" : "adaptive", options.latencyUs,
+         options.virtualTime ? ", all times virtual" : "");
+
+   RunStats clean;
+   workload.Run(options.ops, clean);
+   Print("clean", clean);
+
+   line.SetFaults(options.faults, options.faults);
+   RunStats faulty;
+   workload.Run(options.ops, faulty);
+   Print("faulty", faulty);
+
+   // an input read, as the monitor thread does
+   FaultyLink::Faults dead;
+   dead.drop = 1;
+   line.SetFaults(dead, dead);
+   double before = rig.GetBoard().GetTimeUs();
+   bool wrong;
+   ret = workload.Step(2, wrong);
+   double deadMs = (rig.GetBoard().GetTimeUs() - before) / 1000;
+   line.SetFaults(FaultyLink::Faults(), FaultyLink::Faults());
+   printf("dead line: %s after %.1f ms\n", ret != DEVICE_OK ? "failed" : "succeeded (?)", deadMs);
+
+   char retried[MM::MaxStrLength];
+   rig.GetHub()->GetProperty("Retried Commands", retried);
+   const FaultyLink::Counts& out = line.GetCounts(true);
+   const FaultyLink::Counts& in = line.GetCounts(false);
+   printf("\n%lu bytes out, %lu in: %lu dropped, %lu corrupted, %lu duplicated, %lu delayed\n",
+         out.bytes, in.bytes, out.dropped + in.dropped, out.corrupted + in.corrupted,
+         out.duplicated + in.duplicated, out.delayed + in.delayed);
+   printf("the hub retried %s commands; faulty throughput %.1f%% of clean\n",
+         retried, 100.0 * (faulty.ops / faulty.ms) / (clean.ops / clean.ms));
+
+   BenchResults results;
+   results.Set("clean_ops_per_s", clean.ops * 1000 / clean.ms);
+   results.Set("faulty_ops_per_s", faulty.ops * 1000 / faulty.ms);
+   results.Set("faulty_failed", (double) faulty.failed);
+   results.Set("faulty_wrong", (double) faulty.wrong);
+   results.Set("faulty_slowest_ms", faulty.maxOpMs);
+   results.Set("retried", atof(retried));
+   results.Set("dead_line_ms", deadMs);
+
+   if (!options.baseline.empty())
+   {
+      BenchResults baseline;
+      if (!baseline.Load(options.baseline))
+         fprintf(stderr, "cannot read baseline %s\n", options.baseline.c_str());
+      else
+         results.Compare(baseline);
+   }
+   if (!options.save.empty() && !results.Save(options.save))
+   {
+      fprintf(stderr, "cannot write %s\n", options.save.c_str());
+      return 1;
+   }
+   if (clean.wrong > 0 || faulty.wrong > 0)
+   {
+      fprintf(stderr, "%ld operations succeeded with a wrong result\n", clean.wrong + faulty.wrong);
+      return 1;
+   }
+   return 0;
+}
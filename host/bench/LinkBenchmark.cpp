@@ -0,0 +1,101 @@
+// Round trips over the simulated link
+//
+// Loads the adapter against the emulated board and times the commands the
+// devices send most: switch patterns, DAC setpoints and input reads.  Each
+// one alternates between two values so the hub's state cache does not
+// skip it.
+//
+// usage: arduino_link_bench [iterations]
+
+#include "../sim/ArduinoRig.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Operation
+{
+   const char* name;
+   const char* device;
+   const char* property;
+   const char* values[2];     // 0: read the property
+};
+
+const Operation g_Operations[] = {
+   {"switch pattern", "Arduino-Switch", "State", {"5", "10"}},
+   {"DAC setpoint", "Arduino-DAC1", "Volts", {"1.25", "2.5"}},
+   {"digital inputs", "Arduino-Input", "DigitalInput", {0, 0}},
+};
+
+int Time(ArduinoRig& rig, const Operation& op, long iterations)
+{
+   MM::Device* device = rig.GetDevice(op.device);
+   if (device == 0)
+   {
+      fprintf(stderr, "%s is not loaded\n", op.device);
+      return DEVICE_ERR;
+   }
+
+   char value[MM::MaxStrLength];
+   Clock::time_point start = Clock::now();
+   for (long i = 0; i < iterations; i++)
+   {
+      int ret = op.values[0] != 0 ?
+            device->SetProperty(op.property, op.values[i % 2]) :
+            device->GetProperty(op.property, value);
+      if (ret != DEVICE_OK)
+      {
+         fprintf(stderr, "%s failed with %d after %ld round trips\n", op.name, ret, i);
+         return ret;
+      }
+   }
+   double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+   printf("%-16s %10.1f us/op %10.0f op/s\n", op.name, us / iterations, iterations * 1e6 / us);
+   return DEVICE_OK;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+   long iterations = argc > 1 ? atol(argv[1]) : 2000;
+   if (iterations <= 0)
+   {
+      fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+      return 2;
+   }
+
+   ArduinoRig rig;
+   rig.GetCore().SetLogging(true);
+   ArduinoBoard::Config config;
+   config.homed = true;
+   int ret = rig.Load(config);
+   if (ret != DEVICE_OK)
+   {
+      fprintf(stderr, "loading the adapter failed with %d\n", ret);
+      return 1;
+   }
+
+   // the switch only drives the outputs while the shutter is open
+   ret = rig.GetDevice("Arduino-Shutter")->SetProperty("OnOff", "1");
+   if (ret != DEVICE_OK)
+   {
+      fprintf(stderr, "opening the shutter failed with %d\n", ret);
+      return 1;
+   }
+
+   char baud[MM::MaxStrLength];
+   rig.GetHub()->GetProperty("Baud Rate", baud);
+   printf("hub initialized in %.0f ms, link at %s baud\n", rig.GetHubInitializeMs(), baud);
+
+   for (unsigned i = 0; i < sizeof(g_Operations) / sizeof(g_Operations[0]); i++)
+   {
+      if (Time(rig, g_Operations[i], iterations) != DEVICE_OK)
+         return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,340 @@
+// The hub's primitives, one at a time
+//
+// Loads the adapter against LoopbackLink, which answers every command
+// before the write returns, and times what every command goes through:
+// writing a frame, reading the reply (in one read, a byte per read, after
+// stale bytes), taking the hub's lock with and without other threads
+// after it, turning a property sequence into patterns, and reading the
+// clock the way the reply loops do.
+//
+// Prints ns/op and heap allocations/op.  --save writes the results to a
+// file, --baseline compares them with such a file.
+//
+// usage: arduino_primitives_bench [--iterations n] [--save file]
+//           [--baseline file]
+
+#include "BenchResults.h"
+#include "../sim/ArduinoRig.h"
+#include "../sim/LoopbackLink.h"
+#include "Arduino.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::atomic<unsigned long> g_Allocations(0);
+
+} // namespace
+
+// every allocation of the process, the adapter's included
+void* operator new(std::size_t size)
+{
+   g_Allocations++;
+   void* p = malloc(size > 0 ? size : 1);
+   if (p == 0)
+      throw std::bad_alloc();
+   return p;
+}
+
+void operator delete(void* p) noexcept
+{
+   free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+   free(p);
+}
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const unsigned g_SequenceLength = 4096;
+
+struct Measurement
+{
+   double ns;
+   double allocations;
+};
+
+// Runs op iterations times, with op returning DEVICE_OK.  perOp scales
+// the results when one call does several operations.
+template <class Op>
+int Measure(long iterations, Op op, Measurement& m, long perOp = 1)
+{
+   // once untimed, so first-use allocations do not count
+   int ret = op();
+   if (ret != DEVICE_OK)
+      return ret;
+
+   unsigned long allocations = g_Allocations;
+   Clock::time_point start = Clock::now();
+   for (long i = 0; i < iterations; i++)
+   {
+      ret = op();
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+   double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+   m.ns = ns / iterations / perOp;
+   m.allocations = (double) (g_Allocations - allocations) / iterations / perOp;
+   return DEVICE_OK;
+}
+
+class Bench
+{
+public:
+   Bench(ArduinoRig& rig, LoopbackLink& link, long iterations, BenchResults& results) :
+      rig_(rig),
+      link_(link),
+      iterations_(iterations),
+      results_(results),
+      hub_(static_cast<CArduinoHub*>(rig.GetHub())),
+      failed_(false)
+   {}
+
+   void Run();
+   bool Failed() const {return failed_;}
+
+private:
+   template <class Op>
+   void Report(const char* name, const char* key, Op op, long iterations, long perOp = 1);
+
+   void Write();
+   void Exchange();
+   void Lock();
+   void Sequence();
+   void Clock();
+
+   ArduinoRig& rig_;
+   LoopbackLink& link_;
+   long iterations_;
+   BenchResults& results_;
+   CArduinoHub* hub_;
+   bool failed_;
+};
+
+template <class Op>
+void Bench::Report(const char* name, const char* key, Op op, long iterations, long perOp)
+{
+   if (failed_)
+      return;
+   Measurement m;
+   int ret = Measure(iterations, op, m, perOp);
+   if (ret != DEVICE_OK)
+   {
+      fprintf(stderr, "%s failed with %d\n", name, ret);
+      failed_ = true;
+      return;
+   }
+   printf("%-36s %10.1f ns/op %8.2f allocs/op\n", name, m.ns, m.allocations);
+   results_.Set(std::string(key) + "_ns", m.ns);
+   results_.Set(std::string(key) + "_allocs", m.allocations);
+}
+
+void Bench::Run()
+{
+   Write();
+   Exchange();
+   Lock();
+   Sequence();
+   Clock();
+}
+
+void Bench::Write()
+{
+   CArduinoHub* hub = hub_;
+   unsigned char frame[] = {ArduinoProtocol::SetPattern::opcode, 1, 5, 0};
+   frame[3] = ArduinoProtocol::crc8(frame, 3);
+   link_.SetAnswering(false);
+   Report("WriteToComPortH, 4 bytes", "write", [hub, &frame]() {
+      return hub->WriteToComPortH(frame, sizeof(frame));
+   }, iterations_);
+   link_.SetAnswering(true);
+}
+
+// the reply loop of SendCommand, through the typed commands the devices use
+void Bench::Exchange()
+{
+   CArduinoHub* hub = hub_;
+   auto query = [hub]() {
+      MMThreadGuard myLock(hub->GetLock());
+      unsigned char reply[1];
+      return hub->Query<ArduinoProtocol::DigitalInputs>(reply);
+   };
+   auto transact = [hub]() {
+      MMThreadGuard myLock(hub->GetLock());
+      const unsigned char args[3] = {0, 0x08, 0x00};
+      unsigned char reply[3];
+      return hub->Transact<ArduinoProtocol::SetDac>(args, reply);
+   };
+
+   Report("Query<DigitalInputs>", "query", query, iterations_);
+   Report("Transact<SetDac>", "transact", transact, iterations_);
+
+   link_.SetReadChunk(1);
+   Report("Transact<SetDac>, a byte per read", "transact_bytewise", transact, iterations_);
+   link_.SetReadChunk(0);
+
+   link_.SetStaleBytes(4);
+   Report("Transact<SetDac>, 4 stale bytes", "transact_stale", transact, iterations_);
+   link_.SetStaleBytes(0);
+}
+
+// The device threads (input monitor, sequence stream) take the same lock
+// as the devices.  The others take it in a loop of their own.
+void Bench::Lock()
+{
+   MMThreadLock& lock = CArduinoHub::GetLock();
+   auto acquire = [&lock]() {
+      MMThreadGuard myLock(lock);
+      return DEVICE_OK;
+   };
+   Report("MMThreadGuard, uncontended", "lock", acquire, iterations_);
+
+   const unsigned contenders[] = {1, 3};
+   for (unsigned c = 0; c < sizeof(contenders) / sizeof(contenders[0]); c++)
+   {
+      std::atomic<bool> stop(false);
+      std::vector<std::thread> threads;
+      for (unsigned i = 0; i < contenders[c]; i++)
+      {
+         threads.push_back(std::thread([&lock, &stop]() {
+            while (!stop)
+            {
+               MMThreadGuard myLock(lock);
+            }
+         }));
+      }
+
+      std::ostringstream name, key;
+      name << "MMThreadGuard, " << contenders[c] << " other thread" << (contenders[c] > 1 ? "s" : "");
+      key << "lock_contended_" << contenders[c];
+      Report(name.str().c_str(), key.str().c_str(), acquire, iterations_);
+
+      stop = true;
+      for (size_t i = 0; i < threads.size(); i++)
+         threads[i].join();
+   }
+}
+
+// Parsing and run-length coding in AfterLoadSequence, per entry.  The
+// streamed sequence is kept for the stream and does not touch the port;
+// the repetitive one is coded into runs and uploaded.
+void Bench::Sequence()
+{
+   MM::Device* sw = rig_.GetDevice("Arduino-Switch");
+   if (failed_ || sw->SetProperty("Sequence", "On") != DEVICE_OK)
+   {
+      fprintf(stderr, "cannot turn on switch sequences\n");
+      failed_ = true;
+      return;
+   }
+
+   long iterations = iterations_ / 1000 > 0 ? iterations_ / 1000 : 1;
+   const char* const kinds[] = {"streamed", "runs"};
+   for (unsigned k = 0; k < 2; k++)
+   {
+      long maxLength = 0;
+      sw->GetPropertySequenceMaxLength(MM::g_Keyword_State, maxLength);
+      sw->ClearPropertySequence(MM::g_Keyword_State);
+      for (unsigned i = 0; i < g_SequenceLength; i++)
+      {
+         // 1, 2, 3, ... or 12 runs of the same pattern
+         unsigned pattern = k == 0 ? 1 + i % 63 : 1 + i * 12 / g_SequenceLength;
+         std::ostringstream os;
+         os << pattern;
+         sw->AddToPropertySequence(MM::g_Keyword_State, os.str().c_str());
+      }
+
+      std::ostringstream name, key;
+      name << "sequence of " << g_SequenceLength << ", " << kinds[k] << ", per entry";
+      key << "sequence_" << kinds[k];
+      Report(name.str().c_str(), key.str().c_str(), [sw]() {
+         return sw->SendPropertySequence(MM::g_Keyword_State);
+      }, iterations, g_SequenceLength);
+   }
+}
+
+// what the reply loops do on every pass
+void Bench::Clock()
+{
+   MM::Core* core = &rig_.GetCore();
+   Report("GetCurrentMMTime", "mmtime", [core]() {
+      volatile double us = core->GetCurrentMMTime().getUsec();
+      (void) us;
+      return DEVICE_OK;
+   }, iterations_);
+
+   MM::MMTime start = core->GetCurrentMMTime();
+   Report("timeout check", "timeout_check", [core, start]() {
+      volatile bool expired = (core->GetCurrentMMTime() - start).getMsec() >= 1e9;
+      (void) expired;
+      return DEVICE_OK;
+   }, iterations_);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+   long iterations = 100000;
+   std::string save, baseline;
+   for (int i = 1; i + 1 < argc; i += 2)
+   {
+      std::string arg = argv[i];
+      if (arg == "--iterations")
+         iterations = atol(argv[i + 1]);
+      else if (arg == "--save")
+         save = argv[i + 1];
+      else if (arg == "--baseline")
+         baseline = argv[i + 1];
+      else
+         iterations = 0;
+   }
+   if (iterations <= 0 || argc % 2 == 0)
+   {
+      fprintf(stderr, "usage: %s [--iterations n] [--save file] [--baseline file]\n", argv[0]);
+      return 2;
+   }
+
+   LoopbackLink link;
+   ArduinoRig rig;
+   rig.GetCore().SetLink(&link);
+   rig.GetCore().SetLogging(true);
+   int ret = rig.LoadDevices();
+   if (ret != DEVICE_OK)
+   {
+      fprintf(stderr, "loading the adapter failed with %d\n", ret);
+      return 1;
+   }
+
+   BenchResults results;
+   Bench bench(rig, link, iterations, results);
+   bench.Run();
+   if (bench.Failed())
+      return 1;
+
+   if (!baseline.empty())
+   {
+      BenchResults before;
+      if (!before.Load(baseline))
+         fprintf(stderr, "cannot read baseline %s\n", baseline.c_str());
+      else
+         results.Compare(before);
+   }
+   if (!save.empty() && !results.Save(save))
+   {
+      fprintf(stderr, "cannot write %s\n", save.c_str());
+      return 1;
+   }
+   return 0;
+}
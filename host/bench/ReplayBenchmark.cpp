@@ -0,0 +1,232 @@
+// A recorded session, played back through the hub
+//
+// Loads the hub against ReplayLink with a traffic log the hub wrote (the
+// "Traffic Log" property, or arduino_acquisition_bench --record), so its
+// initialization is answered from the log.  Then sends every command that
+// follows in the log at its recorded time, times the time scale, and
+// times each round trip against the recorded one.
+//
+// Prints, per command, the recorded and replayed round trips and the
+// commands that failed; and how far the replay fell behind the log and how
+// often the hub's traffic left the recorded order.  --save writes the
+// results to a file, --baseline compares them with such a file.  With
+// --virtual-time the replay runs on the board's virtual clock.
+//
+// usage: arduino_replay_bench [--scale s] [--virtual-time] [--save file]
+//           [--baseline file] log
+
+#include "BenchResults.h"
+#include "../sim/ArduinoRig.h"
+#include "../sim/ReplayLink.h"
+#include "Arduino.h"
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+
+namespace {
+
+struct Options
+{
+   Options() : scale(1.0), virtualTime(false) {}
+
+   double scale;
+   bool virtualTime;
+   std::string save;
+   std::string baseline;
+   std::string log;
+};
+
+struct CommandStats
+{
+   CommandStats() : count(0), failures(0), recordedUs(0), replayedUs(0) {}
+
+   long count;
+   long failures;
+   double recordedUs;
+   double replayedUs;
+};
+
+bool ParseOptions(int argc, char** argv, Options& options)
+{
+   for (int i = 1; i < argc; i++)
+   {
+      std::string arg = argv[i];
+      if (arg == "--virtual-time")
+      {
+         options.virtualTime = true;
+         continue;
+      }
+      if (arg.compare(0, 2, "--") != 0)
+      {
+         if (!options.log.empty())
+            return false;
+         options.log = arg;
+         continue;
+      }
+      if (i + 1 >= argc)
+         return false;
+      const char* value = argv[++i];
+      if (arg == "--scale")
+         options.scale = atof(value);
+      else if (arg == "--save")
+         options.save = value;
+      else if (arg == "--baseline")
+         options.baseline = value;
+      else
+         return false;
+   }
+   return !options.log.empty() && options.scale > 0;
+}
+
+// Sends what e sent, as the device that sent it would have.  The hub adds
+// its own sequence byte and crc, so the recorded ones are left out.
+int Resend(CArduinoHub* hub, const ReplayLink::Exchange& e, unsigned tagLen)
+{
+   unsigned char opcode = e.sent[0];
+   if (e.sent.size() < 1 + 2 * tagLen)
+      return ERR_COMMUNICATION;
+   const unsigned char* args = &e.sent[0] + 1 + tagLen;
+   unsigned nArgs = (unsigned) (e.sent.size() - 1 - 2 * tagLen);
+   unsigned nReply = opcode == ArduinoProtocol::Loopback::opcode ? nArgs : ArduinoProtocol::replyBytes(opcode);
+
+   unsigned char reply[ArduinoProtocol::MaxFrame];
+   MMThreadGuard myLock(hub->GetLock());
+   return hub->Exchange(opcode, args, nArgs, reply, nReply, ArduinoProtocol::timeoutMs(opcode));
+}
+
+int Replay(ArduinoRig& rig, const ReplayLink& link, const Options& options, BenchResults& results)
+{
+   CArduinoHub* hub = static_cast<CArduinoHub*>(rig.GetHub());
+   char version[MM::MaxStrLength];
+   hub->GetProperty(g_versionProp, version);
+   unsigned tagLen = atoi(version) >= 3 ? 1 : 0;
+
+   const std::vector<ReplayLink::Exchange>& exchanges = link.GetExchanges();
+   size_t first = link.GetPosition();
+   if (first >= exchanges.size())
+   {
+      printf("nothing in the log after the hub's initialization\n");
+      return DEVICE_OK;
+   }
+
+   ArduinoBoard& board = rig.GetBoard();
+   std::map<unsigned, CommandStats> stats;
+   double startUs = board.GetTimeUs();
+   double maxBehindUs = 0;
+   long sent = 0;
+   long failures = 0;
+   for (size_t i = first; i < exchanges.size(); i++)
+   {
+      const ReplayLink::Exchange& e = exchanges[i];
+      if (e.sent.empty() || !ArduinoProtocol::isCommand(e.sent[0]) ||
+            !ArduinoProtocol::isTagged(e.sent[0]))
+         continue;
+
+      double dueUs = startUs + options.scale * (e.timeUs - exchanges[first].timeUs);
+      double nowUs = board.GetTimeUs();
+      if (dueUs > nowUs)
+         board.Wait(dueUs - nowUs);
+      else if (nowUs - dueUs > maxBehindUs)
+         maxBehindUs = nowUs - dueUs;
+
+      double before = board.GetTimeUs();
+      int ret = Resend(hub, e, tagLen);
+      double rttUs = board.GetTimeUs() - before;
+
+      CommandStats& s = stats[e.sent[0]];
+      s.count++;
+      sent++;
+      if (ret != DEVICE_OK)
+      {
+         s.failures++;
+         failures++;
+         continue;
+      }
+      // the hub has the reply when its last byte is in
+      s.recordedUs += e.received.empty() ? 0 : e.received.back().delayUs;
+      s.replayedUs += rttUs;
+   }
+   double totalMs = (board.GetTimeUs() - startUs) / 1000;
+   double recordedMs = (exchanges.back().timeUs - exchanges[first].timeUs) / 1000;
+
+   printf("\n%-8s %8s %14s %14s %8s\n", "opcode", "count", "recorded us", "replayed us", "failed");
+   for (std::map<unsigned, CommandStats>::const_iterator it = stats.begin(); it != stats.end(); ++it)
+   {
+      const CommandStats& s = it->second;
+      long ok = s.count - s.failures;
+      printf("%-8u %8ld %14.1f %14.1f %8ld\n", it->first, s.count,
+            ok > 0 ? s.recordedUs / ok : 0, ok > 0 ? s.replayedUs / ok : 0, s.failures);
+
+      char key[64];
+      snprintf(key, sizeof(key), "rtt_us_%u", it->first);
+      results.Set(key, ok > 0 ? s.replayedUs / ok : 0);
+   }
+   printf("\n%ld commands in %.1f ms, recorded in %.1f ms at scale %g\n",
+         sent, totalMs, recordedMs, options.scale);
+   printf("%ld failed, at most %.3f ms behind the log, %lu divergences\n",
+         failures, maxBehindUs / 1000, link.GetDivergences());
+
+   results.Set("replay_ms", totalMs);
+   results.Set("failures", (double) failures);
+   results.Set("divergences", (double) link.GetDivergences());
+   results.Set("max_behind_ms", maxBehindUs / 1000);
+   return DEVICE_OK;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+   Options options;
+   if (!ParseOptions(argc, argv, options))
+   {
+      fprintf(stderr, "usage: %s [--scale s] [--virtual-time] [--save file]\n"
+            "          [--baseline file] log\n", argv[0]);
+      return 2;
+   }
+
+   ReplayLink link;
+   std::string error;
+   if (!link.Load(options.log, error))
+   {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+   }
+   link.SetTimeScale(options.scale);
+
+   ArduinoRig rig;
+   if (options.virtualTime)
+      rig.GetBoard().UseVirtualTime();
+   rig.GetCore().SetLink(&link);
+   rig.GetCore().SetLogging(true);
+   int ret = rig.LoadHub();
+   if (ret != DEVICE_OK)
+   {
+      fprintf(stderr, "loading the hub failed with %d\n", ret);
+      return 1;
+   }
+   printf("%lu exchanges in %s, the hub's initialization took %lu of them in %.0f ms\n",
+         (unsigned long) link.GetExchanges().size(), options.log.c_str(),
+         (unsigned long) link.GetPosition(), rig.GetHubInitializeMs());
+
+   BenchResults results;
+   ret = Replay(rig, link, options, results);
+   if (ret != DEVICE_OK)
+      return 1;
+
+   if (!options.baseline.empty())
+   {
+      BenchResults baseline;
+      if (!baseline.Load(options.baseline))
+         fprintf(stderr, "cannot read baseline %s\n", options.baseline.c_str());
+      else
+         results.Compare(baseline);
+   }
+   if (!options.save.empty() && !results.Save(options.save))
+   {
+      fprintf(stderr, "cannot write %s\n", options.save.c_str());
+      return 1;
+   }
+   return 0;
+}
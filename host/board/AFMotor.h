@@ -0,0 +1,24 @@
+// Adafruit Motor Shield (v1) library for FilterWheelController.ino on the
+// host, see Arduino.h.  Only the DC motor that turns the wheel.
+
+#ifndef _HOST_AFMOTOR_H_
+#define _HOST_AFMOTOR_H_
+
+#include "Arduino.h"
+
+#define FORWARD 1
+#define BACKWARD 2
+#define BRAKE 3
+#define RELEASE 4
+
+class AF_DCMotor
+{
+public:
+   AF_DCMotor(uint8_t motorNumber);
+   void setSpeed(uint8_t speed);
+   void run(uint8_t command);
+private:
+   uint8_t motorNumber_;
+};
+
+#endif // _HOST_AFMOTOR_H_
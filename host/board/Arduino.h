@@ -0,0 +1,95 @@
+// Arduino core for FilterWheelController.ino on the host
+//
+// Just the part of the Arduino Mega core that the sketch uses.  Pins,
+// registers, the UART, SPI, EEPROM and the motor shield all end up in
+// ArduinoBoard.cpp, which models the hardware behind them.  Only the
+// sketch and the board model include this; everything else talks to the
+// board through ArduinoBoard.h.
+
+#ifndef _HOST_ARDUINO_H_
+#define _HOST_ARDUINO_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+// Mega 2560 analog pins
+#define A0 54
+#define A1 55
+#define A8 62
+
+#define SERIAL_TX_BUFFER_SIZE 64
+
+#define highByte(w) ((uint8_t) ((w) >> 8))
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define _BV(b) (1 << (b))
+
+// AVR registers the sketch touches directly
+extern volatile uint8_t PORTA, DDRA, PINK, PORTK, DDRK;
+extern volatile uint8_t SREG;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint16_t OCR1A, TCNT1;
+extern volatile uint8_t TCCR3A, TCCR3B;
+extern volatile uint16_t OCR3A;
+extern volatile uint8_t TCCR5A, TCCR5B, TIMSK5, TIFR5;
+extern volatile uint16_t OCR5A, OCR5B, TCNT5;
+extern volatile uint8_t EICRA, EIMSK, EIFR;
+
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define CS30 0
+#define CS31 1
+#define CS32 2
+#define CS50 0
+#define CS51 1
+#define CS52 2
+#define WGM30 0
+#define COM3A1 7
+#define OCIE1A 1
+#define OCF1A 1
+#define OCIE5A 1
+#define OCIE5B 2
+#define OCF5A 1
+#define OCF5B 2
+#define ISC20 4
+#define ISC21 5
+#define INT2 2
+#define INTF2 2
+
+// Interrupts only run between two passes of loop(), so there is nothing
+// to lock out.
+inline void cli() {}
+inline void sei() {}
+#define ISR(vector) void vector()
+
+unsigned long millis();
+unsigned long micros();
+int analogRead(uint8_t pin);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+void pinMode(uint8_t pin, uint8_t mode);
+char* utoa(unsigned value, char* buf, int radix);
+
+class HardwareSerial
+{
+public:
+   void begin(unsigned long baud);
+   void end();
+   int available();
+   int read();
+   int availableForWrite();
+   size_t write(uint8_t b);
+   void flush();
+};
+extern HardwareSerial Serial;
+
+#endif // _HOST_ARDUINO_H_
@@ -0,0 +1,882 @@
+// Hardware behind the host Arduino core, see ArduinoBoard.h
+
+#include "ArduinoBoard.h"
+#include "Arduino.h"
+#include "AFMotor.h"
+#include "SPI.h"
+#include "EEPROM.h"
+#include "Firmware.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+volatile uint8_t PORTA, DDRA, PINK, PORTK, DDRK;
+volatile uint8_t SREG;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t OCR1A, TCNT1;
+volatile uint8_t TCCR3A, TCCR3B;
+volatile uint16_t OCR3A;
+volatile uint8_t TCCR5A, TCCR5B, TIMSK5, TIFR5;
+volatile uint16_t OCR5A, OCR5B, TCNT5;
+volatile uint8_t EICRA, EIMSK, EIFR;
+
+HardwareSerial Serial;
+SPIClass SPI;
+EEPROMClass EEPROM;
+
+namespace {
+
+// wiring, see the top of FilterWheelController.ino
+const uint8_t TRIGGER_PIN = 2;
+const uint8_t READY_PIN = 28;
+const uint8_t CAMERA_OUT_PIN = 29;
+const uint8_t CAMERA_IN_PIN = 19;
+const uint8_t DAC_LDAC_PIN = 49;
+const uint8_t DAC_CS_PIN = 53;
+const uint8_t OPTO_PIN = A0;
+const uint8_t HALL_PIN = A1;
+const uint8_t WHEEL_MOTOR = 4;
+const unsigned NUM_ANALOG = 6;
+
+const double CPU_MHZ = 16.0;
+
+// The wheel turns in half slots: slot k sits at 2 * (k - 1), the opto
+// sensor goes dark around every slot and the hall sensor between slots 5
+// and 6.  A pass of loop() never moves the wheel by more than a quarter of
+// a dark window, so the sketch sees every edge even when its thread does
+// not get the processor for a while; the wheel then turns slower.
+const double HALFSLOTS = 12.0;
+const double HALL_HALFSLOT = 9.0;
+const double DARK_WIDTH = 0.2;
+const double MAX_STEP = DARK_WIDTH / 4;
+const int DARK = 0;
+const int LIGHT = 1023;
+
+const int EEPROM_SIZE = 4096;
+
+// start bit, 8 data bits, stop bit
+const double BITS_PER_BYTE = 10.0;
+
+// how long Wait() gives an awake thread, in real time, to get back to
+// Idle(); a thread that ends while awake may leave it waiting that long
+const std::chrono::milliseconds AWAKE_TURN(20);
+
+typedef std::chrono::steady_clock Clock;
+
+struct Board
+{
+   Board() :
+      running(false), poweredUp(false), start(Clock::now()), loops(0),
+      virtualTime(false), virtualUs(0), awake(0),
+      lastServiceUs(0), timer1Carry(0), timer5Carry(0), cameraInSeen(false),
+      hostTxDoneUs(0), boardTxDoneUs(0), baud(0),
+      halfSlot(0), motorDirection(0), position(1), turning(false),
+      trigger(false), cameraIn(false), ready(false), cameraOut(false), inputs(0), outputs(0),
+      csLow(false), spiWord(0), spiBytes(0)
+   {
+      for (unsigned i = 0; i < NUM_ANALOG; i++)
+         analog[i] = 0;
+      for (unsigned i = 0; i < 2; i++)
+      {
+         dacInput[i] = 0;
+         dacOutput[i] = 0;
+      }
+      memset(eeprom, 0xFF, sizeof(eeprom));
+      memset(eepromWrites, 0, sizeof(eepromWrites));
+      mostEepromWrites = 0;
+   }
+
+   ~Board()
+   {
+      running = false;
+      if (thread.joinable())
+         thread.join();
+   }
+
+   ArduinoBoard::Config config;
+   std::thread thread;
+   std::atomic<bool> running;
+   bool poweredUp;
+   Clock::time_point start;
+   std::atomic<unsigned long> loops;
+
+   // virtual time, moved on under timeLock; while it moves the sketch runs
+   // in the thread that moves it
+   bool virtualTime;
+   std::atomic<double> virtualUs;
+   std::mutex timeLock;
+   std::condition_variable timeMoved;
+
+   // Threads in Idle() and the time they wait for.  Once the clock has
+   // passed it, the next Wait() makes the sleeper due and gives its thread
+   // a turn: it counts as awake until it idles again or ends, and Wait()
+   // goes on after that.  Step() wakes no one, as its caller may hold a
+   // lock the sleeper needs.
+   struct Sleeper
+   {
+      double untilUs;
+      bool due;
+   };
+   std::vector<Sleeper*> sleepers;
+   int awake;
+
+   // timers and the external interrupt, board thread only
+   double lastServiceUs;
+   double timer1Carry;
+   double timer5Carry;
+   bool cameraInSeen;
+
+   // UART, under serialLock.  Every byte on the link carries the rate it
+   // was sent at and the time it gets to the other end: one byte time
+   // after the previous one, plus the latency of the USB bridge.  baud is
+   // 0 while the UART is off.
+   struct WireByte
+   {
+      unsigned char c;
+      long baud;
+      double arrivalUs;
+   };
+   std::mutex serialLock;
+   std::deque<WireByte> toBoard;
+   std::deque<WireByte> toHost;
+   double hostTxDoneUs;
+   double boardTxDoneUs;
+   long baud;
+
+   // wheel, board thread only, published in position and turning.  The
+   // speed is the PWM duty on OC3A, see AF_DCMotor.
+   double halfSlot;
+   int motorDirection;
+   std::atomic<double> position;
+   std::atomic<bool> turning;
+
+   // pins
+   std::atomic<bool> trigger;
+   std::atomic<bool> cameraIn;
+   std::atomic<bool> ready;
+   std::atomic<bool> cameraOut;
+   std::atomic<unsigned char> inputs;
+   std::atomic<unsigned char> outputs;
+   std::atomic<int> analog[NUM_ANALOG];
+
+   // DAC: the SPI word being shifted in, the input registers and what
+   // LDAC moved to the outputs
+   bool csLow;
+   unsigned spiWord;
+   unsigned spiBytes;
+   unsigned dacInput[2];
+   std::atomic<unsigned> dacOutput[2];
+
+   // write cycles per cell, and the most any cell has taken
+   uint8_t eeprom[EEPROM_SIZE];
+   unsigned long eepromWrites[EEPROM_SIZE];
+   std::atomic<unsigned long> mostEepromWrites;
+};
+
+Board& TheBoard()
+{
+   static Board board;
+   return board;
+}
+
+double NowUs()
+{
+   Board& b = TheBoard();
+   if (b.virtualTime)
+      return b.virtualUs;
+   return std::chrono::duration<double, std::micro>(Clock::now() - b.start).count();
+}
+
+double ByteUs(long baud)
+{
+   return BITS_PER_BYTE * 1e6 / baud;
+}
+
+bool IsDark(double halfSlot, double center)
+{
+   double d = std::fabs(halfSlot - center);
+   if (d > HALFSLOTS / 2)
+      d = HALFSLOTS - d;
+   return d < DARK_WIDTH / 2;
+}
+
+// The motor only gets power while Timer3 drives its PWM on OC3A
+uint8_t MotorSpeed()
+{
+   return (TCCR3A & _BV(COM3A1)) && (TCCR3B & 7) ? (uint8_t) OCR3A : 0;
+}
+
+void MoveWheel(double elapsedUs)
+{
+   Board& b = TheBoard();
+   uint8_t speed = MotorSpeed();
+   if (b.motorDirection != 0 && speed > 0)
+   {
+      double slotMs = b.config.slotMsFullSpeed * 255.0 / speed;
+      double step = 2.0 * elapsedUs / (1000.0 * slotMs);
+      if (step > MAX_STEP)
+         step = MAX_STEP;
+      b.halfSlot = std::fmod(b.halfSlot + b.motorDirection * step + HALFSLOTS, HALFSLOTS);
+   }
+   b.position = b.halfSlot / 2 + 1;
+   b.turning = b.motorDirection != 0 && speed > 0;
+}
+
+unsigned Prescaler(uint8_t tccrb)
+{
+   static const unsigned prescalers[] = {0, 1, 8, 64, 256, 1024, 0, 0};
+   return prescalers[tccrb & 7];
+}
+
+struct Compare
+{
+   volatile uint16_t* ocr;
+   volatile uint8_t* timsk;
+   uint8_t enable;
+   void (*isr)();
+};
+
+// Counts the timer on and runs the compare match interrupts it passes, in
+// the order they come.  An OCR equal to the count has just matched.
+void RunTimer(volatile uint16_t& tcnt, double& carry, uint8_t tccrb, double elapsedUs,
+      const Compare* compares, unsigned n)
+{
+   unsigned prescaler = Prescaler(tccrb);
+   if (prescaler == 0)
+      return;
+   carry += elapsedUs * CPU_MHZ / prescaler;
+   unsigned long ticks = (unsigned long) carry;
+   carry -= ticks;
+
+   while (ticks > 0)
+   {
+      unsigned long next = ticks + 1;
+      const Compare* match = 0;
+      for (unsigned i = 0; i < n; i++)
+      {
+         if (!(*compares[i].timsk & _BV(compares[i].enable)))
+            continue;
+         unsigned long d = (uint16_t) (*compares[i].ocr - tcnt);
+         if (d == 0)
+            d = 0x10000;
+         if (d < next)
+         {
+            next = d;
+            match = &compares[i];
+         }
+      }
+      if (match == 0)
+      {
+         tcnt = (uint16_t) (tcnt + ticks);
+         return;
+      }
+      tcnt = (uint16_t) (tcnt + next);
+      ticks -= next;
+      match->isr();
+   }
+}
+
+// the hardware between two passes of loop()
+void Service()
+{
+   Board& b = TheBoard();
+   double now = NowUs();
+   double elapsed = now - b.lastServiceUs;
+   b.lastServiceUs = now;
+
+   MoveWheel(elapsed);
+
+   static const Compare timer1[] = {
+      {&OCR1A, &TIMSK1, OCIE1A, FirmwareTimer1CompA},
+   };
+   static const Compare timer5[] = {
+      {&OCR5A, &TIMSK5, OCIE5A, FirmwareTimer5CompA},
+      {&OCR5B, &TIMSK5, OCIE5B, FirmwareTimer5CompB},
+   };
+   RunTimer(TCNT1, b.timer1Carry, TCCR1B, elapsed, timer1, 1);
+   RunTimer(TCNT5, b.timer5Carry, TCCR5B, elapsed, timer5, 2);
+
+   // INT2 on the camera trigger input, any change (ISC2 01) only
+   bool cameraIn = b.cameraIn;
+   if (cameraIn != b.cameraInSeen)
+   {
+      b.cameraInSeen = cameraIn;
+      if ((EIMSK & _BV(INT2)) && (EICRA & (_BV(ISC21) | _BV(ISC20))) == _BV(ISC20))
+         FirmwareInt2();
+   }
+
+   PINK = b.inputs;
+}
+
+void Pass()
+{
+   Board& b = TheBoard();
+   Service();
+   FirmwareLoop();
+   b.outputs = PORTA & 0x3F;
+   b.loops++;
+}
+
+void Run()
+{
+   Board& b = TheBoard();
+   b.lastServiceUs = NowUs();
+   FirmwareSetup();
+   while (b.running)
+   {
+      Pass();
+      std::this_thread::yield();
+   }
+}
+
+// Is this thread awake after Idle()?  Gives up its turn when the thread
+// ends.
+struct AwakeThread
+{
+   AwakeThread() : on(false) {}
+
+   ~AwakeThread()
+   {
+      if (!on)
+         return;
+      Board& b = TheBoard();
+      std::lock_guard<std::mutex> guard(b.timeLock);
+      b.awake--;
+      b.timeMoved.notify_all();
+   }
+
+   bool on;
+};
+
+thread_local AwakeThread t_Awake;
+
+// Caller holds timeLock
+void WakeSleepers()
+{
+   Board& b = TheBoard();
+   for (size_t i = 0; i < b.sleepers.size(); i++)
+   {
+      Board::Sleeper* s = b.sleepers[i];
+      if (!s->due && s->untilUs <= b.virtualUs)
+      {
+         s->due = true;
+         b.awake++;
+         b.timeMoved.notify_all();
+      }
+   }
+}
+
+// Caller holds timeLock
+double NextDueUs(double untilUs)
+{
+   Board& b = TheBoard();
+   for (size_t i = 0; i < b.sleepers.size(); i++)
+   {
+      if (!b.sleepers[i]->due && b.sleepers[i]->untilUs < untilUs)
+         untilUs = b.sleepers[i]->untilUs;
+   }
+   return untilUs;
+}
+
+// Moves virtual time on to untilUs, a pass of loop() at a time.  Caller
+// holds timeLock.
+void Advance(double untilUs)
+{
+   Board& b = TheBoard();
+   while (b.virtualUs < untilUs)
+   {
+      if (b.running)
+         Pass();
+      double next = b.virtualUs + b.config.loopUs;
+      b.virtualUs = next < untilUs ? next : untilUs;
+   }
+}
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// Arduino core
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned long millis()
+{
+   return (unsigned long) (NowUs() / 1000);
+}
+
+unsigned long micros()
+{
+   return (unsigned long) NowUs();
+}
+
+int analogRead(uint8_t pin)
+{
+   Board& b = TheBoard();
+   if (pin == OPTO_PIN)
+      return IsDark(b.halfSlot, 2 * std::floor(b.halfSlot / 2 + 0.5)) ? DARK : LIGHT;
+   if (pin == HALL_PIN)
+      return IsDark(b.halfSlot, HALL_HALFSLOT) ? DARK : LIGHT;
+   if (pin >= A8 && pin < A8 + NUM_ANALOG)
+      return b.analog[pin - A8];
+   return 0;
+}
+
+int digitalRead(uint8_t pin)
+{
+   Board& b = TheBoard();
+   if (pin == TRIGGER_PIN)
+      return b.trigger ? HIGH : LOW;
+   if (pin == CAMERA_IN_PIN)
+      return b.cameraIn ? HIGH : LOW;
+   return LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+   Board& b = TheBoard();
+   switch (pin)
+   {
+      case READY_PIN:
+         b.ready = value == HIGH;
+         break;
+      case CAMERA_OUT_PIN:
+         b.cameraOut = value == HIGH;
+         break;
+      case DAC_CS_PIN:
+         // MCP4822: bit 15 channel, bit 12 output on, 12 bits of code
+         if (value == LOW)
+         {
+            b.csLow = true;
+            b.spiWord = 0;
+            b.spiBytes = 0;
+         }
+         else if (b.csLow)
+         {
+            b.csLow = false;
+            if (b.spiBytes == 2 && (b.spiWord & 0x1000))
+               b.dacInput[b.spiWord >> 15] = b.spiWord & 0x0FFF;
+         }
+         break;
+      case DAC_LDAC_PIN:
+         if (value == LOW)
+         {
+            b.dacOutput[0] = b.dacInput[0];
+            b.dacOutput[1] = b.dacInput[1];
+         }
+         break;
+   }
+}
+
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+char* utoa(unsigned value, char* buf, int radix)
+{
+   char digits[8 * sizeof(unsigned) + 1];
+   int n = 0;
+   do
+   {
+      unsigned d = value % radix;
+      digits[n++] = (char) (d < 10 ? '0' + d : 'a' + d - 10);
+      value /= radix;
+   } while (value > 0);
+   for (int i = 0; i < n; i++)
+      buf[i] = digits[n - 1 - i];
+   buf[n] = 0;
+   return buf;
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+   Board& b = TheBoard();
+   std::lock_guard<std::mutex> guard(b.serialLock);
+   b.baud = (long) baud;
+}
+
+void HardwareSerial::end()
+{
+   Board& b = TheBoard();
+   std::lock_guard<std::mutex> guard(b.serialLock);
+   b.baud = 0;
+   b.toBoard.clear();
+}
+
+int HardwareSerial::available()
+{
+   Board& b = TheBoard();
+   std::lock_guard<std::mutex> guard(b.serialLock);
+   double now = NowUs();
+   int n = 0;
+   for (std::deque<Board::WireByte>::const_iterator it = b.toBoard.begin();
+         it != b.toBoard.end() && it->arrivalUs <= now; ++it)
+      n++;
+   return n;
+}
+
+int HardwareSerial::read()
+{
+   Board& b = TheBoard();
+   std::lock_guard<std::mutex> guard(b.serialLock);
+   if (b.toBoard.empty() || b.toBoard.front().arrivalUs > NowUs())
+      return -1;
+   int c = b.toBoard.front().c;
+   b.toBoard.pop_front();
+   return c;
+}
+
+// room in the transmit buffer: bytes that have not left the UART yet
+// take up space
+int HardwareSerial::availableForWrite()
+{
+   Board& b = TheBoard();
+   std::lock_guard<std::mutex> guard(b.serialLock);
+   double sentBy = NowUs() + b.config.serialLatencyUs;
+   int pending = 0;
+   for (std::deque<Board::WireByte>::const_reverse_iterator it = b.toHost.rbegin();
+         it != b.toHost.rend() && it->arrivalUs > sentBy; ++it)
+      pending++;
+   return pending < SERIAL_TX_BUFFER_SIZE - 1 ? SERIAL_TX_BUFFER_SIZE - 1 - pending : 0;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+   Board& b = TheBoard();
+   std::lock_guard<std::mutex> guard(b.serialLock);
+   if (b.baud == 0)
+      return 0;
+   double now = NowUs();
+   b.boardTxDoneUs = (b.boardTxDoneUs > now ? b.boardTxDoneUs : now) + ByteUs(b.baud);
+   Board::WireByte w = {c, b.baud, b.boardTxDoneUs + b.config.serialLatencyUs};
+   b.toHost.push_back(w);
+   return 1;
+}
+
+void HardwareSerial::flush()
+{
+}
+
+void SPIClass::begin()
+{
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+   Board& b = TheBoard();
+   if (b.csLow)
+   {
+      b.spiWord = ((b.spiWord << 8) | data) & 0xFFFF;
+      b.spiBytes++;
+   }
+   return 0;
+}
+
+uint8_t EEPROMClass::read(int address)
+{
+   return address >= 0 && address < EEPROM_SIZE ? TheBoard().eeprom[address] : 0xFF;
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+   if (address < 0 || address >= EEPROM_SIZE)
+      return;
+   Board& b = TheBoard();
+   b.eeprom[address] = value;
+   if (++b.eepromWrites[address] > b.mostEepromWrites)
+      b.mostEepromWrites = b.eepromWrites[address];
+}
+
+// like the library, only writes a byte that changes
+void EEPROMClass::update(int address, uint8_t value)
+{
+   if (read(address) != value)
+      write(address, value);
+}
+
+// On the Mega the library runs motor 4 off Timer3: fast PWM on OC3A
+// (pin 5) at about 1 kHz, the speed is the duty cycle in OCR3A
+AF_DCMotor::AF_DCMotor(uint8_t motorNumber) :
+   motorNumber_(motorNumber)
+{
+   if (motorNumber_ == WHEEL_MOTOR)
+   {
+      TCCR3A |= _BV(COM3A1) | _BV(WGM30);
+      TCCR3B = (TCCR3B & 0xF8) | _BV(CS31) | _BV(CS30);
+      OCR3A = 0;
+   }
+}
+
+void AF_DCMotor::setSpeed(uint8_t speed)
+{
+   if (motorNumber_ == WHEEL_MOTOR)
+      OCR3A = speed;
+}
+
+void AF_DCMotor::run(uint8_t command)
+{
+   if (motorNumber_ != WHEEL_MOTOR)
+      return;
+   Board& b = TheBoard();
+   if (command == FORWARD)
+      b.motorDirection = 1;
+   else if (command == BACKWARD)
+      b.motorDirection = -1;
+   else
+      b.motorDirection = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ArduinoBoard
+///////////////////////////////////////////////////////////////////////////////
+
+ArduinoBoard::Config::Config() :
+   serialLatencyUs(0),
+   slotMsFullSpeed(100.0),
+   startSlot(1),
+   homed(false),
+   loopUs(50.0)
+{
+}
+
+ArduinoBoard& ArduinoBoard::Instance()
+{
+   static ArduinoBoard instance;
+   return instance;
+}
+
+void ArduinoBoard::PowerUp(const Config& config)
+{
+   Board& b = TheBoard();
+   if (b.poweredUp)
+      return;
+   b.poweredUp = true;
+
+   b.config = config;
+   int slot = config.startSlot >= 1 && config.startSlot <= 6 ? config.startSlot : 1;
+   b.halfSlot = 2.0 * (slot - 1);
+   b.position = slot;
+   if (config.homed)
+      FirmwareStorePosition(slot, analogRead(HALL_PIN) > 512 ? 1 : 0);
+
+   if (b.virtualTime)
+   {
+      std::lock_guard<std::mutex> guard(b.timeLock);
+      b.lastServiceUs = NowUs();
+      FirmwareSetup();
+      b.running = true;
+      return;
+   }
+   b.running = true;
+   b.thread = std::thread(Run);
+}
+
+void ArduinoBoard::PowerDown()
+{
+   Board& b = TheBoard();
+   std::lock_guard<std::mutex> guard(b.timeLock);
+   b.running = false;
+   if (b.thread.joinable())
+      b.thread.join();
+}
+
+void ArduinoBoard::UseVirtualTime()
+{
+   Board& b = TheBoard();
+   if (b.poweredUp)
+      return;
+   b.virtualUs = NowUs();
+   b.virtualTime = true;
+}
+
+bool ArduinoBoard::IsVirtualTime() const
+{
+   return TheBoard().virtualTime;
+}
+
+double ArduinoBoard::GetTimeUs() const
+{
+   return NowUs();
+}
+
+void ArduinoBoard::Wait(double us)
+{
+   Board& b = TheBoard();
+   if (!b.virtualTime)
+   {
+      std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(us));
+      return;
+   }
+   std::unique_lock<std::mutex> lock(b.timeLock);
+   double until = b.virtualUs + us;
+   do
+   {
+      Advance(NextDueUs(until));
+      if (t_Awake.on)
+         continue;
+      WakeSleepers();
+      if (b.awake > 0)
+         b.timeMoved.wait_for(lock, AWAKE_TURN, [&b]() {return b.awake == 0;});
+   } while (b.virtualUs < until);
+}
+
+void ArduinoBoard::Step()
+{
+   Board& b = TheBoard();
+   if (!b.virtualTime)
+   {
+      std::this_thread::yield();
+      return;
+   }
+   std::lock_guard<std::mutex> guard(b.timeLock);
+   Advance(b.virtualUs + b.config.loopUs);
+}
+
+void ArduinoBoard::Idle(double us)
+{
+   Board& b = TheBoard();
+   std::chrono::duration<double, std::micro> realTime(us);
+   if (!b.virtualTime)
+   {
+      std::this_thread::sleep_for(realTime);
+      return;
+   }
+   std::unique_lock<std::mutex> lock(b.timeLock);
+   if (t_Awake.on)
+   {
+      t_Awake.on = false;
+      b.awake--;
+      b.timeMoved.notify_all();
+   }
+
+   Board::Sleeper sleeper = {b.virtualUs + us, false};
+   b.sleepers.push_back(&sleeper);
+   b.timeMoved.wait_for(lock, realTime, [&sleeper]() {return sleeper.due;});
+   for (size_t i = 0; i < b.sleepers.size(); i++)
+   {
+      if (b.sleepers[i] == &sleeper)
+      {
+         b.sleepers.erase(b.sleepers.begin() + i);
+         break;
+      }
+   }
+   t_Awake.on = sleeper.due;
+}
+
+bool ArduinoBoard::IsPoweredUp() const
+{
+   return TheBoard().running;
+}
+
+void ArduinoBoard::HostWrite(const unsigned char* buf, unsigned long len, long baud)
+{
+   Board& b = TheBoard();
+   std::lock_guard<std::mutex> guard(b.serialLock);
+   if (b.baud != baud)
+      return;
+   double start = NowUs() + b.config.serialLatencyUs;
+   double t = b.hostTxDoneUs > start ? b.hostTxDoneUs : start;
+   for (unsigned long i = 0; i < len; i++)
+   {
+      t += ByteUs(baud);
+      Board::WireByte w = {buf[i], baud, t};
+      b.toBoard.push_back(w);
+   }
+   b.hostTxDoneUs = t;
+}
+
+unsigned long ArduinoBoard::HostRead(unsigned char* buf, unsigned long maxLen, long baud)
+{
+   Board& b = TheBoard();
+   std::lock_guard<std::mutex> guard(b.serialLock);
+   double now = NowUs();
+   unsigned long n = 0;
+   while (n < maxLen && !b.toHost.empty() && b.toHost.front().arrivalUs <= now)
+   {
+      if (b.toHost.front().baud == baud)
+         buf[n++] = b.toHost.front().c;
+      b.toHost.pop_front();
+   }
+   return n;
+}
+
+void ArduinoBoard::HostPurge()
+{
+   Board& b = TheBoard();
+   std::lock_guard<std::mutex> guard(b.serialLock);
+   double now = NowUs();
+   while (!b.toHost.empty() && b.toHost.front().arrivalUs <= now)
+      b.toHost.pop_front();
+}
+
+long ArduinoBoard::GetBaudRate() const
+{
+   Board& b = TheBoard();
+   std::lock_guard<std::mutex> guard(b.serialLock);
+   return b.baud;
+}
+
+void ArduinoBoard::SetTriggerInput(bool high)
+{
+   TheBoard().trigger = high;
+}
+
+void ArduinoBoard::SetCameraInput(bool high)
+{
+   TheBoard().cameraIn = high;
+}
+
+void ArduinoBoard::SetDigitalInputs(unsigned char bits)
+{
+   TheBoard().inputs = bits;
+}
+
+void ArduinoBoard::SetAnalogInput(unsigned channel, int value)
+{
+   if (channel < NUM_ANALOG)
+      TheBoard().analog[channel] = value;
+}
+
+unsigned char ArduinoBoard::GetOutputs() const
+{
+   return TheBoard().outputs;
+}
+
+unsigned ArduinoBoard::GetDacCode(unsigned channel) const
+{
+   return channel < 2 ? TheBoard().dacOutput[channel].load() : 0;
+}
+
+bool ArduinoBoard::GetReadyOutput() const
+{
+   return TheBoard().ready;
+}
+
+bool ArduinoBoard::GetCameraOutput() const
+{
+   return TheBoard().cameraOut;
+}
+
+double ArduinoBoard::GetWheelPosition() const
+{
+   return TheBoard().position;
+}
+
+bool ArduinoBoard::IsWheelTurning() const
+{
+   return TheBoard().turning;
+}
+
+unsigned long ArduinoBoard::GetMostEepromWrites() const
+{
+   return TheBoard().mostEepromWrites;
+}
+
+unsigned long ArduinoBoard::GetLoopCount() const
+{
+   return TheBoard().loops;
+}
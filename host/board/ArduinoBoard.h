@@ -0,0 +1,106 @@
+// FilterWheelController.ino running on the host
+//
+// The sketch is built against the Arduino core in this directory and runs
+// setup() and then loop() on a thread of its own, as it would on the Mega.
+// ArduinoBoard models what is wired to the board: the UART, the wheel
+// motor with its opto and hall sensors, the MCP4822 DAC, the digital
+// outputs and inputs, the Timer1/Timer5 compare matches and the wheel
+// motor's PWM on Timer3.  Interrupt handlers run between two passes of
+// loop().
+//
+// The sketch keeps its state in globals, so there is one board per
+// process and it is powered up once.
+//
+// The board keeps the time for everything that talks to it.  It runs on
+// real time, or after UseVirtualTime() on a clock that moves only in
+// Wait() and Step().  Those run the sketch in the calling thread, one pass
+// of loop() per Config::loopUs, for the time they let pass; the board
+// stands still in between.  Moves and timeouts then take no longer than
+// the passes they need.  Threads that wait in Idle() run when the clock
+// gets to them, so a run gives the same times every time, up to where
+// such a thread first got in after it was started.
+
+#ifndef _ArduinoBoard_H_
+#define _ArduinoBoard_H_
+
+class ArduinoBoard
+{
+public:
+   struct Config
+   {
+      Config();
+
+      // one way, on top of the byte times at the link's rate; a USB
+      // bridge adds about a millisecond
+      double serialLatencyUs;
+      // time from one slot to the next with the motor at full speed; the
+      // sketch runs it at 200 of 255
+      double slotMsFullSpeed;
+      // where the wheel sits at power-up, 1..6
+      int startSlot;
+      // the EEPROM holds startSlot, so the wheel does not home at power-up
+      bool homed;
+      // virtual time one pass of loop() takes
+      double loopUs;
+   };
+
+   static ArduinoBoard& Instance();
+
+   void PowerUp(const Config& config = Config());
+   void PowerDown();
+   bool IsPoweredUp() const;
+
+   // before anything else; there is no way back to real time
+   void UseVirtualTime();
+   bool IsVirtualTime() const;
+   // microseconds since the process started
+   double GetTimeUs() const;
+   // Lets the time pass.  In virtual time, threads in Idle() whose time
+   // comes get to run first.
+   void Wait(double us);
+   // Lets the board get on: a yield in real time, a pass of loop() in
+   // virtual time.  Does not wait for other threads, so it can be called
+   // with locks held.
+   void Step();
+   // Waits for someone else to move the clock on by us, in real time at
+   // most us.  For threads that should not drive virtual time themselves.
+   void Idle(double us);
+
+   // The serial link, seen from the computer.  Bytes take their time on
+   // the wire at the given rate plus the link latency.  Bytes sent at
+   // another rate than the board's UART runs at are lost, and so are bytes
+   // the board sent while the computer listened at another rate.  A purge
+   // drops what has arrived, not what is still on its way.
+   void HostWrite(const unsigned char* buf, unsigned long len, long baud);
+   unsigned long HostRead(unsigned char* buf, unsigned long maxLen, long baud);
+   void HostPurge();
+   long GetBaudRate() const;
+
+   // inputs of the board
+   void SetTriggerInput(bool high);
+   void SetCameraInput(bool high);
+   void SetDigitalInputs(unsigned char bits);
+   void SetAnalogInput(unsigned channel, int value);
+
+   // outputs of the board
+   unsigned char GetOutputs() const;
+   unsigned GetDacCode(unsigned channel) const;
+   bool GetReadyOutput() const;
+   bool GetCameraOutput() const;
+
+   // the wheel, position in slots from 1.0 up to (not including) 7.0
+   double GetWheelPosition() const;
+   bool IsWheelTurning() const;
+   // write cycles the most worn EEPROM cell has taken since power-up
+   unsigned long GetMostEepromWrites() const;
+
+   // passes through loop() since power-up
+   unsigned long GetLoopCount() const;
+
+private:
+   ArduinoBoard() {}
+   ArduinoBoard(const ArduinoBoard&);
+   ArduinoBoard& operator=(const ArduinoBoard&);
+};
+
+#endif // _ArduinoBoard_H_
@@ -0,0 +1,17 @@
+// EEPROM library for FilterWheelController.ino on the host, see Arduino.h
+
+#ifndef _HOST_EEPROM_H_
+#define _HOST_EEPROM_H_
+
+#include "Arduino.h"
+
+class EEPROMClass
+{
+public:
+   uint8_t read(int address);
+   void write(int address, uint8_t value);
+   void update(int address, uint8_t value);
+};
+extern EEPROMClass EEPROM;
+
+#endif // _HOST_EEPROM_H_
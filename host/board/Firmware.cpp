@@ -0,0 +1,60 @@
+// FilterWheelController.ino, built for the host
+//
+// The sketch goes into namespace Firmware, so that its globals (motor,
+// stop(), send() and the like) stay out of the way of everything else.
+// Its includes come first, outside the namespace, which turns the ones in
+// the sketch into no-ops.  SketchPrototypes.h is generated from the sketch
+// by CMake: like the Arduino IDE, it declares every function up front, so
+// the sketch may call functions that are defined further down.
+
+#include "Arduino.h"
+#include "AFMotor.h"
+#include "SPI.h"
+#include "EEPROM.h"
+#include "ArduinoProtocol.h"
+#include "Firmware.h"
+
+namespace Firmware {
+#include "SketchPrototypes.h"
+#include "FilterWheelController.ino"
+}
+
+void FirmwareSetup()
+{
+   Firmware::setup();
+}
+
+void FirmwareLoop()
+{
+   Firmware::loop();
+}
+
+void FirmwareStorePosition(int slot, int hall)
+{
+   Firmware::writeRecord(Firmware::RECORD_VALID | hall << 4 | 2 * (slot - 1));
+}
+
+int FirmwareTrackEdges(int halfSlot, bool hallFired, bool optoFired, int direction)
+{
+   return Firmware::trackEdges(halfSlot, hallFired, optoFired, direction);
+}
+
+void FirmwareTimer1CompA()
+{
+   Firmware::TIMER1_COMPA_vect();
+}
+
+void FirmwareTimer5CompA()
+{
+   Firmware::TIMER5_COMPA_vect();
+}
+
+void FirmwareTimer5CompB()
+{
+   Firmware::TIMER5_COMPB_vect();
+}
+
+void FirmwareInt2()
+{
+   Firmware::INT2_vect();
+}
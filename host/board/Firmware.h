@@ -0,0 +1,22 @@
+// Entry points of the sketch for ArduinoBoard.cpp, see Firmware.cpp
+
+#ifndef _Firmware_H_
+#define _Firmware_H_
+
+void FirmwareSetup();
+void FirmwareLoop();
+
+// writes what the sketch saves when the wheel stops at slot
+void FirmwareStorePosition(int slot, int hall);
+
+// the sketch's wheel tracking: the half slot (-1 while unknown) the
+// sensor edges of one pass take the wheel to, turning in direction
+int FirmwareTrackEdges(int halfSlot, bool hallFired, bool optoFired, int direction);
+
+// interrupt vectors
+void FirmwareTimer1CompA();
+void FirmwareTimer5CompA();
+void FirmwareTimer5CompB();
+void FirmwareInt2();
+
+#endif // _Firmware_H_
@@ -0,0 +1,16 @@
+// SPI library for FilterWheelController.ino on the host, see Arduino.h
+
+#ifndef _HOST_SPI_H_
+#define _HOST_SPI_H_
+
+#include "Arduino.h"
+
+class SPIClass
+{
+public:
+   void begin();
+   uint8_t transfer(uint8_t data);
+};
+extern SPIClass SPI;
+
+#endif // _HOST_SPI_H_
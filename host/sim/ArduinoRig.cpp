@@ -0,0 +1,157 @@
+// Every device of the adapter, loaded against the emulated board
+
+#include "ArduinoRig.h"
+#include "ModuleInterface.h"
+#include "Arduino.h"
+#include <cstring>
+#include <thread>
+
+namespace {
+
+// hub first, then the peripherals in the order DetectInstalledDevices()
+// lists them
+const char* const g_DeviceNames[] = {
+   "Arduino-Hub",
+   "Arduino-Switch",
+   "Arduino-Shutter",
+   "Arduino-Input",
+   "Arduino-DAC1",
+   "Arduino-DAC2",
+   "Arduino-Channel",
+   "Arduino-FilterWheel",
+};
+const unsigned g_NumDevices = sizeof(g_DeviceNames) / sizeof(g_DeviceNames[0]);
+
+// The thread that loads the adapter moves the board's clock on when it
+// sleeps.  The adapter's own threads (input monitor, sequence stream)
+// wait for it instead, so in virtual time they do not rush ahead of it.
+class RigSleep : public ArduinoSleepSource
+{
+public:
+   void SetDriver(std::thread::id driver) {driver_ = driver;}
+
+   void SleepMs(long ms)
+   {
+      if (std::this_thread::get_id() == driver_)
+         ArduinoBoard::Instance().Wait(ms * 1000.0);
+      else
+         ArduinoBoard::Instance().Idle(ms * 1000.0);
+   }
+
+private:
+   std::thread::id driver_;
+};
+
+RigSleep g_Sleep;
+
+} // namespace
+
+ArduinoRig::ArduinoRig() :
+   hubInitializeMs_(0)
+{
+}
+
+ArduinoRig::~ArduinoRig()
+{
+   Unload();
+}
+
+void ArduinoRig::SetPreInitProperty(const char* device, const char* name, const char* value)
+{
+   PreInitProperty p;
+   p.device = device;
+   p.name = name;
+   p.value = value;
+   preInit_.push_back(p);
+}
+
+int ArduinoRig::Load(const ArduinoBoard::Config& config)
+{
+   GetBoard().PowerUp(config);
+   return LoadDevices();
+}
+
+int ArduinoRig::LoadDevices()
+{
+   int ret = LoadHub();
+   if (ret != DEVICE_OK)
+      return ret;
+
+   for (unsigned i = 1; i < g_NumDevices; i++)
+   {
+      int ret = LoadDevice(g_DeviceNames[i]);
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+   return DEVICE_OK;
+}
+
+int ArduinoRig::LoadHub()
+{
+   g_Sleep.SetDriver(std::this_thread::get_id());
+   CArduinoHub::SetSleepSource(&g_Sleep);
+   return LoadDevice(g_DeviceNames[0]);
+}
+
+int ArduinoRig::LoadDevice(const char* name)
+{
+   MM::Device* device = ::CreateDevice(name);
+   if (device == 0)
+      return DEVICE_ERR;
+   devices_.push_back(device);
+   core_.AddDevice(name, device);
+
+   bool isHub = device->GetType() == MM::HubDevice;
+   if (isHub)
+   {
+      int ret = device->SetProperty(MM::g_Keyword_Port, SimulatedCore::PortName);
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+   for (size_t i = 0; i < preInit_.size(); i++)
+   {
+      if (preInit_[i].device != name)
+         continue;
+      int ret = device->SetProperty(preInit_[i].name.c_str(), preInit_[i].value.c_str());
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+
+   MM::MMTime start = core_.GetCurrentMMTime();
+   int ret = device->Initialize();
+   if (ret != DEVICE_OK)
+      return ret;
+
+   if (isHub)
+   {
+      hubInitializeMs_ = (core_.GetCurrentMMTime() - start).getMsec();
+      core_.SetHub(static_cast<MM::Hub*>(device));
+   }
+   return DEVICE_OK;
+}
+
+void ArduinoRig::Unload()
+{
+   while (!devices_.empty())
+   {
+      MM::Device* device = devices_.back();
+      devices_.pop_back();
+      device->Shutdown();
+      char label[MM::MaxStrLength];
+      device->GetLabel(label);
+      core_.RemoveDevice(label);
+      ::DeleteDevice(device);
+   }
+   core_.SetHub(0);
+   CArduinoHub::SetSleepSource(0);
+}
+
+MM::Device* ArduinoRig::GetDevice(const char* name)
+{
+   return core_.GetDevice(0, name);
+}
+
+MM::Hub* ArduinoRig::GetHub()
+{
+   return core_.GetParentHub(0);
+}
@@ -0,0 +1,58 @@
+// Every device of the adapter, loaded against the emulated board
+//
+// Load() powers up the board, creates the hub and its peripherals through
+// the module interface, labels them with their device names and
+// initializes them, as Micro-Manager does for a configuration that uses
+// the whole adapter.  The adapter sleeps on the board's clock, see
+// ArduinoBoard::UseVirtualTime().
+
+#ifndef _ArduinoRig_H_
+#define _ArduinoRig_H_
+
+#include "SimulatedCore.h"
+#include "../board/ArduinoBoard.h"
+#include <string>
+#include <vector>
+
+class ArduinoRig
+{
+public:
+   ArduinoRig();
+   ~ArduinoRig();
+
+   // set on the device after it is created, before it is initialized
+   void SetPreInitProperty(const char* device, const char* name, const char* value);
+
+   int Load(const ArduinoBoard::Config& config = ArduinoBoard::Config());
+   // leaves the board off, for a core whose port leads to another link
+   int LoadDevices();
+   // the hub alone, for tools that send it commands of their own
+   int LoadHub();
+   void Unload();
+
+   // by device name, "Arduino-Switch" and so on; 0 before Load()
+   MM::Device* GetDevice(const char* name);
+   MM::Hub* GetHub();
+   SimulatedCore& GetCore() {return core_;}
+   ArduinoBoard& GetBoard() {return ArduinoBoard::Instance();}
+
+   // how long the hub took to initialize, link negotiation included
+   double GetHubInitializeMs() const {return hubInitializeMs_;}
+
+private:
+   int LoadDevice(const char* name);
+
+   struct PreInitProperty
+   {
+      std::string device;
+      std::string name;
+      std::string value;
+   };
+
+   SimulatedCore core_;
+   std::vector<PreInitProperty> preInit_;
+   std::vector<MM::Device*> devices_;
+   double hubInitializeMs_;
+};
+
+#endif // _ArduinoRig_H_
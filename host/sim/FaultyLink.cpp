@@ -0,0 +1,117 @@
+// A serial link that gets bytes wrong, see FaultyLink.h
+
+#include "FaultyLink.h"
+#include "../board/ArduinoBoard.h"
+
+namespace {
+
+const unsigned long g_ReadSize = 256;
+
+} // namespace
+
+FaultyLink::FaultyLink(SerialLink& link, unsigned seed) :
+   link_(link),
+   baud_(0),
+   buffer_(g_ReadSize),
+   random_(seed),
+   uniform_(0.0, 1.0)
+{
+}
+
+void FaultyLink::SetFaults(const Faults& toBoard, const Faults& fromBoard)
+{
+   toBoard_.faults = toBoard;
+   fromBoard_.faults = fromBoard;
+}
+
+bool FaultyLink::Chance(double p)
+{
+   return p > 0 && uniform_(random_) < p;
+}
+
+void FaultyLink::Queue(Line& line, unsigned char byte, double dueUs)
+{
+   if (line.pos == line.queue.size())
+   {
+      line.queue.clear();
+      line.pos = 0;
+   }
+   if (dueUs < line.lastDueUs)
+      dueUs = line.lastDueUs;
+   line.lastDueUs = dueUs;
+   Pending p = {dueUs, byte};
+   line.queue.push_back(p);
+}
+
+void FaultyLink::Pass(Line& line, const unsigned char* buf, unsigned long len, double nowUs)
+{
+   const Faults& f = line.faults;
+   for (unsigned long i = 0; i < len; i++)
+   {
+      line.counts.bytes++;
+      if (Chance(f.drop))
+      {
+         line.counts.dropped++;
+         continue;
+      }
+      unsigned char byte = buf[i];
+      if (Chance(f.corrupt))
+      {
+         byte ^= (unsigned char) (1 << (random_() % 8));
+         line.counts.corrupted++;
+      }
+      double dueUs = nowUs;
+      if (Chance(f.delay))
+      {
+         dueUs += f.delayUs;
+         line.counts.delayed++;
+      }
+      Queue(line, byte, dueUs);
+      if (Chance(f.duplicate))
+      {
+         Queue(line, byte, dueUs);
+         line.counts.duplicated++;
+      }
+   }
+}
+
+void FaultyLink::Write(const unsigned char* buf, unsigned long len, long baud)
+{
+   baud_ = baud;
+   double nowUs = ArduinoBoard::Instance().GetTimeUs();
+   Pass(toBoard_, buf, len, nowUs);
+
+   // what is due goes on in one write
+   buffer_.clear();
+   while (toBoard_.pos < toBoard_.queue.size() && toBoard_.queue[toBoard_.pos].dueUs <= nowUs)
+      buffer_.push_back(toBoard_.queue[toBoard_.pos++].byte);
+   if (!buffer_.empty())
+      link_.Write(&buffer_[0], (unsigned long) buffer_.size(), baud);
+   buffer_.resize(g_ReadSize);
+}
+
+unsigned long FaultyLink::Read(unsigned char* buf, unsigned long maxLen, long baud)
+{
+   double nowUs = ArduinoBoard::Instance().GetTimeUs();
+   // delayed bytes to the board go on as soon as they are due
+   if (toBoard_.pos < toBoard_.queue.size())
+      Write(0, 0, baud_);
+
+   unsigned long n = link_.Read(&buffer_[0], g_ReadSize, baud);
+   Pass(fromBoard_, &buffer_[0], n, nowUs);
+
+   unsigned long read = 0;
+   while (read < maxLen && fromBoard_.pos < fromBoard_.queue.size() &&
+         fromBoard_.queue[fromBoard_.pos].dueUs <= nowUs)
+      buf[read++] = fromBoard_.queue[fromBoard_.pos++].byte;
+   return read;
+}
+
+// what has arrived, not what is still on its way
+void FaultyLink::Purge()
+{
+   link_.Purge();
+   double nowUs = ArduinoBoard::Instance().GetTimeUs();
+   while (fromBoard_.pos < fromBoard_.queue.size() && fromBoard_.queue[fromBoard_.pos].dueUs <= nowUs)
+      fromBoard_.pos++;
+}
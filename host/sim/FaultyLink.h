@@ -0,0 +1,86 @@
+// A serial link that gets bytes wrong
+//
+// FaultyLink sits between the core's port and another link (the board,
+// usually) and, byte by byte, drops, corrupts (one bit flipped),
+// duplicates or delays what goes through, in either direction, at the
+// rates set for it.  A delayed byte holds up the bytes behind it, as on a
+// real line.  The faults come from a seeded generator, so a run with the
+// same seed and the same traffic meets the same faults.
+
+#ifndef _FaultyLink_H_
+#define _FaultyLink_H_
+
+#include "SerialLink.h"
+#include <cstddef>
+#include <random>
+#include <vector>
+
+class FaultyLink : public SerialLink
+{
+public:
+   // chances per byte, 0 to 1
+   struct Faults
+   {
+      Faults() : drop(0), corrupt(0), duplicate(0), delay(0), delayUs(0) {}
+
+      double drop;
+      double corrupt;
+      double duplicate;
+      double delay;
+      double delayUs;
+   };
+
+   struct Counts
+   {
+      Counts() : bytes(0), dropped(0), corrupted(0), duplicated(0), delayed(0) {}
+
+      unsigned long bytes;
+      unsigned long dropped;
+      unsigned long corrupted;
+      unsigned long duplicated;
+      unsigned long delayed;
+   };
+
+   FaultyLink(SerialLink& link, unsigned seed = 1);
+
+   void SetFaults(const Faults& toBoard, const Faults& fromBoard);
+   const Counts& GetCounts(bool toBoard) const {return toBoard ? toBoard_.counts : fromBoard_.counts;}
+
+   void Write(const unsigned char* buf, unsigned long len, long baud);
+   unsigned long Read(unsigned char* buf, unsigned long maxLen, long baud);
+   void Purge();
+
+private:
+   struct Pending
+   {
+      double dueUs;
+      unsigned char byte;
+   };
+
+   // one direction of the line
+   struct Line
+   {
+      Line() : lastDueUs(0), pos(0) {}
+
+      Faults faults;
+      Counts counts;
+      double lastDueUs;
+      // bytes on their way, queue[pos..]
+      std::vector<Pending> queue;
+      size_t pos;
+   };
+
+   void Pass(Line& line, const unsigned char* buf, unsigned long len, double nowUs);
+   void Queue(Line& line, unsigned char byte, double dueUs);
+   bool Chance(double p);
+
+   SerialLink& link_;
+   Line toBoard_;
+   Line fromBoard_;
+   long baud_;
+   std::vector<unsigned char> buffer_;
+   std::mt19937 random_;
+   std::uniform_real_distribution<double> uniform_;
+};
+
+#endif // _FaultyLink_H_
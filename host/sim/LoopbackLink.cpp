@@ -0,0 +1,104 @@
+// A board that answers every command at once, see LoopbackLink.h
+
+#include "LoopbackLink.h"
+#include "../../FilterWheelController/ArduinoProtocol.h"
+#include <cstring>
+
+LoopbackLink::LoopbackLink() :
+   txPos_(0),
+   answering_(true),
+   readChunk_(0),
+   staleBytes_(0)
+{
+   rx_.reserve(ArduinoProtocol::MaxFrame);
+}
+
+void LoopbackLink::Write(const unsigned char* buf, unsigned long len, long)
+{
+   for (unsigned long i = 0; i < len; i++)
+   {
+      rx_.push_back(buf[i]);
+      unsigned length = FrameLength();
+      if (length == 0)
+         rx_.clear();
+      else if (rx_.size() == length)
+      {
+         if (answering_)
+            Answer(length);
+         rx_.clear();
+      }
+   }
+}
+
+unsigned long LoopbackLink::Read(unsigned char* buf, unsigned long maxLen, long)
+{
+   unsigned long queued = (unsigned long) (tx_.size() - txPos_);
+   unsigned long n = queued < maxLen ? queued : maxLen;
+   if (readChunk_ > 0 && n > readChunk_)
+      n = readChunk_;
+   if (n > 0)
+      memcpy(buf, &tx_[txPos_], n);
+   txPos_ += n;
+   if (txPos_ == tx_.size())
+      Purge();
+   return n;
+}
+
+void LoopbackLink::Purge()
+{
+   tx_.clear();
+   txPos_ = 0;
+}
+
+// as frameLength() in the firmware
+unsigned LoopbackLink::FrameLength() const
+{
+   unsigned char opcode = rx_[0];
+   if (!ArduinoProtocol::isCommand(opcode))
+      return 0;
+   if (!ArduinoProtocol::isTagged(opcode))
+      return 1;
+   if (ArduinoProtocol::isVariable(opcode))
+   {
+      if (rx_.size() < 3)
+         return 3;
+      return rx_[2] <= ArduinoProtocol::MaxChunk ? ArduinoProtocol::TagBytes + 1 + rx_[2] : 0;
+   }
+   return ArduinoProtocol::TagBytes + ArduinoProtocol::argBytes(opcode);
+}
+
+void LoopbackLink::Answer(unsigned length)
+{
+   unsigned char opcode = rx_[0];
+   if (opcode == ArduinoProtocol::Identify::opcode)
+   {
+      SendLine("MM-Ard");
+      return;
+   }
+   if (opcode == ArduinoProtocol::Version::opcode)
+   {
+      SendLine("3");
+      return;
+   }
+
+   for (unsigned i = 0; i < staleBytes_; i++)
+      tx_.push_back(ArduinoProtocol::NotACommand);
+
+   // <opcode> <seq>, then the arguments for as long as the reply is, <crc>
+   unsigned args = length - ArduinoProtocol::TagBytes;
+   size_t start = tx_.size();
+   tx_.push_back(opcode);
+   tx_.push_back(rx_[1]);
+   unsigned payload = opcode == ArduinoProtocol::Loopback::opcode ?
+         args : ArduinoProtocol::replyBytes(opcode);
+   for (unsigned i = 0; i < payload; i++)
+      tx_.push_back(i < args ? rx_[2 + i] : 0);
+   tx_.push_back(ArduinoProtocol::crc8(&tx_[start], (unsigned) (tx_.size() - start)));
+}
+
+void LoopbackLink::SendLine(const char* line)
+{
+   tx_.insert(tx_.end(), line, line + strlen(line));
+   tx_.push_back('\r');
+   tx_.push_back('\n');
+}
@@ -0,0 +1,48 @@
+// A board that answers every command at once
+//
+// LoopbackLink parses the frames written to it with the command table of
+// FilterWheelController/ArduinoProtocol.h and queues a reply of the right
+// length before Write() returns, so the hub's round trips cost only the
+// adapter's own code.  Replies echo the arguments and are padded with
+// zeros; Loopback echoes its frame, Identify and Version answer with the
+// lines firmware version 3 sends.  Nothing runs on a thread of its own.
+
+#ifndef _LoopbackLink_H_
+#define _LoopbackLink_H_
+
+#include "SerialLink.h"
+#include <cstddef>
+#include <vector>
+
+class LoopbackLink : public SerialLink
+{
+public:
+   LoopbackLink();
+
+   void Write(const unsigned char* buf, unsigned long len, long baud);
+   unsigned long Read(unsigned char* buf, unsigned long maxLen, long baud);
+   void Purge();
+
+   // off: frames are taken in and not answered
+   void SetAnswering(bool on) {answering_ = on;}
+   // at most this many bytes per Read(), 0 for all that are queued
+   void SetReadChunk(unsigned long bytes) {readChunk_ = bytes;}
+   // bytes that are not a reply, sent ahead of every reply
+   void SetStaleBytes(unsigned count) {staleBytes_ = count;}
+
+private:
+   unsigned FrameLength() const;
+   void Answer(unsigned length);
+   void SendLine(const char* line);
+
+   std::vector<unsigned char> rx_;
+   // replies not read yet are tx_[txPos_..]; the buffers keep their
+   // capacity, so a round trip allocates nothing
+   std::vector<unsigned char> tx_;
+   size_t txPos_;
+   bool answering_;
+   unsigned long readChunk_;
+   unsigned staleBytes_;
+};
+
+#endif // _LoopbackLink_H_
@@ -0,0 +1,171 @@
+// A board that answers the way a recorded one did, see ReplayLink.h
+
+#include "ReplayLink.h"
+#include "../board/ArduinoBoard.h"
+#include "../../ArduinoTrafficLog.h"
+#include "../../FilterWheelController/ArduinoProtocol.h"
+#include <cstdio>
+#include <cstring>
+
+ReplayLink::ReplayLink() :
+   position_(0),
+   divergences_(0),
+   scale_(1.0),
+   pendingPos_(0)
+{
+}
+
+bool ReplayLink::Load(const std::string& path, std::string& error)
+{
+   exchanges_.clear();
+   position_ = 0;
+   divergences_ = 0;
+
+   FILE* file = fopen(path.c_str(), "rb");
+   if (file == 0)
+   {
+      error = "cannot open " + path;
+      return false;
+   }
+   ArduinoTrafficHeader header;
+   if (fread(&header, sizeof(header), 1, file) != 1 ||
+         strncmp(header.magic, g_TrafficLogMagic, sizeof(header.magic)) != 0)
+   {
+      fclose(file);
+      error = path + " is not a traffic log";
+      return false;
+   }
+   if (header.version != g_TrafficLogVersion || header.recordSize != sizeof(ArduinoTrafficRecord))
+   {
+      fclose(file);
+      error = path + " is a traffic log of another version";
+      return false;
+   }
+
+   // A write of more than six bytes takes several records with the same
+   // time, all but the last of them full.
+   bool writeOpen = false;
+   ArduinoTrafficRecord r;
+   while (fread(&r, sizeof(r), 1, file) == 1)
+   {
+      if (r.count > sizeof(r.bytes))
+         continue;
+      if (r.kind == ArduinoTrafficRecord::Sent)
+      {
+         if (!writeOpen || exchanges_.back().timeUs != (double) r.timeUs)
+         {
+            exchanges_.push_back(Exchange());
+            exchanges_.back().timeUs = (double) r.timeUs;
+         }
+         Exchange& e = exchanges_.back();
+         e.sent.insert(e.sent.end(), r.bytes, r.bytes + r.count);
+         writeOpen = r.count == sizeof(r.bytes);
+      }
+      else
+      {
+         writeOpen = false;
+         // reads before the first write, and purges, only tell when the
+         // hub did them; the replay does them when the hub does
+         if (r.kind != ArduinoTrafficRecord::Received || exchanges_.empty())
+            continue;
+         Exchange& e = exchanges_.back();
+         double delayUs = (double) r.timeUs - e.timeUs;
+         if (e.received.empty() || e.received.back().delayUs != delayUs)
+         {
+            e.received.push_back(Chunk());
+            e.received.back().delayUs = delayUs;
+         }
+         Chunk& c = e.received.back();
+         c.bytes.insert(c.bytes.end(), r.bytes, r.bytes + r.count);
+      }
+   }
+   fclose(file);
+   return true;
+}
+
+void ReplayLink::Write(const unsigned char* buf, unsigned long len, long)
+{
+   if (len == 0)
+      return;
+
+   size_t end = position_ + ReplayWindow < exchanges_.size() ? position_ + ReplayWindow : exchanges_.size();
+   size_t match = position_;
+   while (match < end && (exchanges_[match].sent.empty() || exchanges_[match].sent[0] != buf[0]))
+      match++;
+   if (match == end)
+   {
+      divergences_++;
+      return;
+   }
+   divergences_ += (unsigned long) (match - position_);
+   position_ = match + 1;
+
+   const Exchange& e = exchanges_[match];
+   bool tagged = ArduinoProtocol::isTagged(buf[0]) && len > 1 && e.sent.size() > 1;
+   unsigned char recordedSeq = tagged ? e.sent[1] : 0;
+
+   if (pendingPos_ == pending_.size())
+   {
+      pending_.clear();
+      pendingPos_ = 0;
+   }
+   double now = ArduinoBoard::Instance().GetTimeUs();
+   size_t first = pending_.size();
+   std::vector<unsigned char> recorded;
+   bool afterOpcode = false;
+   for (size_t i = 0; i < e.received.size(); i++)
+   {
+      const Chunk& c = e.received[i];
+      for (size_t j = 0; j < c.bytes.size(); j++)
+      {
+         Pending p;
+         p.dueUs = now + scale_ * c.delayUs;
+         p.byte = c.bytes[j];
+         // the reply echoes the sequence byte right after the opcode
+         if (tagged && afterOpcode && p.byte == recordedSeq)
+            p.byte = buf[1];
+         afterOpcode = c.bytes[j] == buf[0];
+         pending_.push_back(p);
+         recorded.push_back(c.bytes[j]);
+      }
+   }
+   if (!tagged || !ArduinoProtocol::isCommand(buf[0]) || buf[1] == recordedSeq)
+      return;
+
+   // the crc at the end of a reply covers the sequence byte, so a reply
+   // that was intact when recorded gets the crc of its new sequence byte
+   unsigned payload = buf[0] != ArduinoProtocol::Loopback::opcode ?
+         ArduinoProtocol::replyBytes(buf[0]) :
+         (len > ArduinoProtocol::TagBytes ? (unsigned) len - ArduinoProtocol::TagBytes : 0);
+   unsigned frameLen = ArduinoProtocol::TagBytes + payload;
+   if (frameLen > ArduinoProtocol::MaxFrame)
+      return;
+   for (size_t k = 0; k + frameLen <= recorded.size(); k++)
+   {
+      const unsigned char* frame = &recorded[k];
+      if (frame[0] != buf[0] || frame[1] != recordedSeq ||
+            frame[frameLen - 1] != ArduinoProtocol::crc8(frame, frameLen - 1))
+         continue;
+      unsigned char replayed[ArduinoProtocol::MaxFrame];
+      for (unsigned i = 0; i < frameLen - 1; i++)
+         replayed[i] = pending_[first + k + i].byte;
+      pending_[first + k + frameLen - 1].byte = ArduinoProtocol::crc8(replayed, frameLen - 1);
+   }
+}
+
+unsigned long ReplayLink::Read(unsigned char* buf, unsigned long maxLen, long)
+{
+   double now = ArduinoBoard::Instance().GetTimeUs();
+   unsigned long n = 0;
+   while (n < maxLen && pendingPos_ < pending_.size() && pending_[pendingPos_].dueUs <= now)
+      buf[n++] = pending_[pendingPos_++].byte;
+   return n;
+}
+
+// what has arrived, not what is still on its way
+void ReplayLink::Purge()
+{
+   double now = ArduinoBoard::Instance().GetTimeUs();
+   while (pendingPos_ < pending_.size() && pending_[pendingPos_].dueUs <= now)
+      pendingPos_++;
+}
@@ -0,0 +1,74 @@
+// A board that answers the way a recorded one did
+//
+// ReplayLink reads a traffic log written by the hub ("Traffic Log"
+// property, ArduinoTrafficLog.h) and splits it into exchanges: what the
+// hub wrote in one call, and what it read back until it wrote again.  Each
+// frame the hub writes is matched with the next recorded exchange of the
+// same opcode; exchanges it skips over count as divergences.  The
+// recorded reply then arrives after the recorded delay, times the time
+// scale, with the recorded sequence byte changed to the one the hub sent.
+// Frames that match nothing in the next ReplayWindow exchanges get no
+// answer.  Times are on the board's clock, so a replay runs in virtual
+// time as well.
+
+#ifndef _ReplayLink_H_
+#define _ReplayLink_H_
+
+#include "SerialLink.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class ReplayLink : public SerialLink
+{
+public:
+   struct Chunk
+   {
+      // since the write
+      double delayUs;
+      std::vector<unsigned char> bytes;
+   };
+
+   struct Exchange
+   {
+      // since the log was opened
+      double timeUs;
+      std::vector<unsigned char> sent;
+      std::vector<Chunk> received;
+   };
+
+   static const size_t ReplayWindow = 32;
+
+   ReplayLink();
+
+   // false, with a reason, when the file is not a traffic log
+   bool Load(const std::string& path, std::string& error);
+   // 2 plays back at half speed, 0.5 at twice the speed
+   void SetTimeScale(double scale) {scale_ = scale;}
+
+   void Write(const unsigned char* buf, unsigned long len, long baud);
+   unsigned long Read(unsigned char* buf, unsigned long maxLen, long baud);
+   void Purge();
+
+   const std::vector<Exchange>& GetExchanges() const {return exchanges_;}
+   // the next exchange a write is matched with
+   size_t GetPosition() const {return position_;}
+   unsigned long GetDivergences() const {return divergences_;}
+
+private:
+   struct Pending
+   {
+      double dueUs;
+      unsigned char byte;
+   };
+
+   std::vector<Exchange> exchanges_;
+   size_t position_;
+   unsigned long divergences_;
+   double scale_;
+   // replies on their way, in the order they arrive
+   std::vector<Pending> pending_;
+   size_t pendingPos_;
+};
+
+#endif // _ReplayLink_H_
@@ -0,0 +1,20 @@
+// The other end of SimulatedCore's serial port
+//
+// By default the port leads to the emulated board.  A SerialLink set on
+// the core takes its place, for benchmarks that leave the board out.
+
+#ifndef _SerialLink_H_
+#define _SerialLink_H_
+
+class SerialLink
+{
+public:
+   virtual ~SerialLink() {}
+
+   // baud is the rate the computer end of the port runs at
+   virtual void Write(const unsigned char* buf, unsigned long len, long baud) = 0;
+   virtual unsigned long Read(unsigned char* buf, unsigned long maxLen, long baud) = 0;
+   virtual void Purge() = 0;
+};
+
+#endif // _SerialLink_H_
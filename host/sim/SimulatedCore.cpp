@@ -0,0 +1,218 @@
+// MMCore stand-in for the adapter on the host, see SimulatedCore.h
+
+#include "SimulatedCore.h"
+#include "../board/ArduinoBoard.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+const char* const SimulatedCore::PortName = "SimulatedPort";
+
+namespace {
+
+class BoardLink : public SerialLink
+{
+public:
+   void Write(const unsigned char* buf, unsigned long len, long baud)
+   {
+      ArduinoBoard::Instance().HostWrite(buf, len, baud);
+   }
+   unsigned long Read(unsigned char* buf, unsigned long maxLen, long baud)
+   {
+      return ArduinoBoard::Instance().HostRead(buf, maxLen, baud);
+   }
+   void Purge()
+   {
+      ArduinoBoard::Instance().HostPurge();
+   }
+};
+
+BoardLink g_BoardLink;
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// SimulatedPort
+///////////////////////////////////////////////////////////////////////////////
+
+SimulatedPort::SimulatedPort()
+{
+   SetLabel(SimulatedCore::PortName);
+   CreateProperty(MM::g_Keyword_BaudRate, "9600", MM::Integer, false);
+   CreateProperty(MM::g_Keyword_Handshaking, "Off", MM::String, false);
+   CreateProperty(MM::g_Keyword_StopBits, "1", MM::String, false);
+   CreateProperty("AnswerTimeout", "500.0", MM::Float, false);
+   CreateProperty("DelayBetweenCharsMs", "0", MM::Float, false);
+   CreateProperty("Verbose", "1", MM::Integer, false);
+}
+
+void SimulatedPort::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, SimulatedCore::PortName);
+}
+
+long SimulatedPort::GetBaudRate() const
+{
+   char value[MM::MaxStrLength];
+   GetProperty(MM::g_Keyword_BaudRate, value);
+   return atol(value);
+}
+
+double SimulatedPort::GetAnswerTimeoutMs() const
+{
+   char value[MM::MaxStrLength];
+   GetProperty("AnswerTimeout", value);
+   return atof(value);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// SimulatedCore
+///////////////////////////////////////////////////////////////////////////////
+
+SimulatedCore::SimulatedCore() :
+   link_(&g_BoardLink),
+   hub_(0),
+   logging_(false),
+   verbose_(false)
+{
+   port_.SetCallback(this);
+}
+
+void SimulatedCore::AddDevice(const char* label, MM::Device* device)
+{
+   device->SetLabel(label);
+   device->SetCallback(this);
+   devices_[label] = device;
+}
+
+void SimulatedCore::SetLink(SerialLink* link)
+{
+   link_ = link != 0 ? link : &g_BoardLink;
+}
+
+void SimulatedCore::RemoveDevice(const char* label)
+{
+   devices_.erase(label);
+}
+
+bool SimulatedCore::IsPort(const char* portName) const
+{
+   return portName != 0 && strcmp(portName, PortName) == 0;
+}
+
+int SimulatedCore::LogMessage(const MM::Device* caller, const char* msg, bool debugOnly) const
+{
+   if (!logging_ || (debugOnly && !verbose_))
+      return DEVICE_OK;
+   char label[MM::MaxStrLength] = "";
+   if (caller != 0)
+      caller->GetLabel(label);
+   fprintf(stderr, "%s: %s\n", label, msg);
+   return DEVICE_OK;
+}
+
+MM::Device* SimulatedCore::GetDevice(const MM::Device*, const char* label)
+{
+   if (IsPort(label))
+      return &port_;
+   std::map<std::string, MM::Device*>::iterator it = devices_.find(label);
+   return it == devices_.end() ? 0 : it->second;
+}
+
+int SimulatedCore::GetDeviceProperty(const char* deviceName, const char* propName, char* value)
+{
+   MM::Device* device = GetDevice(0, deviceName);
+   if (device == 0)
+      return DEVICE_ERR;
+   return device->GetProperty(propName, value);
+}
+
+int SimulatedCore::SetDeviceProperty(const char* deviceName, const char* propName, const char* value)
+{
+   MM::Device* device = GetDevice(0, deviceName);
+   if (device == 0)
+      return DEVICE_ERR;
+   return device->SetProperty(propName, value);
+}
+
+int SimulatedCore::SetSerialCommand(const MM::Device* caller, const char* portName, const char* command, const char* term)
+{
+   std::string line = std::string(command) + term;
+   return WriteToSerial(caller, portName, (const unsigned char*) line.c_str(), (unsigned long) line.size());
+}
+
+// collects bytes up to the terminator, which is dropped, for as long as
+// the port's AnswerTimeout
+int SimulatedCore::GetSerialAnswer(const MM::Device*, const char* portName, unsigned long ansLength, char* answer, const char* term)
+{
+   if (!IsPort(portName))
+      return DEVICE_ERR;
+
+   std::string line;
+   size_t termLen = strlen(term);
+   MM::MMTime start = GetCurrentMMTime();
+   while ((GetCurrentMMTime() - start).getMsec() < port_.GetAnswerTimeoutMs())
+   {
+      unsigned char c;
+      if (link_->Read(&c, 1, port_.GetBaudRate()) == 0)
+      {
+         ArduinoBoard::Instance().Step();
+         continue;
+      }
+      line += (char) c;
+      if (line.size() >= termLen && line.compare(line.size() - termLen, termLen, term) == 0)
+      {
+         line.resize(line.size() - termLen);
+         if (line.size() + 1 > ansLength)
+            return DEVICE_ERR;
+         strcpy(answer, line.c_str());
+         return DEVICE_OK;
+      }
+   }
+   return DEVICE_SERIAL_TIMEOUT;
+}
+
+int SimulatedCore::WriteToSerial(const MM::Device*, const char* port, const unsigned char* buf, unsigned long length)
+{
+   if (!IsPort(port))
+      return DEVICE_ERR;
+   link_->Write(buf, length, port_.GetBaudRate());
+   return DEVICE_OK;
+}
+
+int SimulatedCore::ReadFromSerial(const MM::Device*, const char* port, unsigned char* buf, unsigned long length, unsigned long& read)
+{
+   if (!IsPort(port))
+      return DEVICE_ERR;
+   read = link_->Read(buf, length, port_.GetBaudRate());
+   // A real port goes through the kernel; here an empty read lets the
+   // board run, which matters when both share one processor, and in
+   // virtual time is what moves the clock while the hub waits for a reply
+   if (read == 0)
+      ArduinoBoard::Instance().Step();
+   return DEVICE_OK;
+}
+
+int SimulatedCore::PurgeSerial(const MM::Device*, const char* portName)
+{
+   if (!IsPort(portName))
+      return DEVICE_ERR;
+   link_->Purge();
+   return DEVICE_OK;
+}
+
+// the board's clock, virtual or not
+MM::MMTime SimulatedCore::GetCurrentMMTime()
+{
+   return MM::MMTime(ArduinoBoard::Instance().GetTimeUs());
+}
+
+int SimulatedCore::OnPropertyChanged(const MM::Device*, const char*, const char*)
+{
+   return DEVICE_OK;
+}
+
+MM::Hub* SimulatedCore::GetParentHub(const MM::Device*) const
+{
+   return hub_;
+}
@@ -0,0 +1,78 @@
+// MMCore stand-in for the adapter on the host
+//
+// SimulatedCore is the callback the adapter's devices talk to: it knows
+// them by label, hands out the parent hub and serves one serial port,
+// SimulatedCore::PortName, whose other end is the emulated board
+// (host/board/ArduinoBoard.h).  The port keeps the properties the hub
+// sets on it; its BaudRate is the rate the computer end of the link runs
+// at, its AnswerTimeout bounds GetSerialAnswer.  SetLink() puts another
+// SerialLink at the far end of the port.  The core's clock is the board's,
+// so it is virtual when the board's is.
+
+#ifndef _SimulatedCore_H_
+#define _SimulatedCore_H_
+
+#include "MMDevice.h"
+#include "DeviceBase.h"
+#include "SerialLink.h"
+#include <map>
+#include <string>
+
+class SimulatedPort : public CGenericBase<SimulatedPort>
+{
+public:
+   SimulatedPort();
+
+   int Initialize() {return DEVICE_OK;}
+   int Shutdown() {return DEVICE_OK;}
+   void GetName(char* name) const;
+   bool Busy() {return false;}
+
+   long GetBaudRate() const;
+   double GetAnswerTimeoutMs() const;
+};
+
+class SimulatedCore : public MM::Core
+{
+public:
+   static const char* const PortName;
+
+   SimulatedCore();
+
+   // Gives the device its label and this core as callback.  The core does
+   // not own the device.
+   void AddDevice(const char* label, MM::Device* device);
+   void RemoveDevice(const char* label);
+   void SetHub(MM::Hub* hub) {hub_ = hub;}
+   // device log messages go to stderr, debug messages only when verbose
+   void SetLogging(bool on, bool verbose = false) {logging_ = on; verbose_ = verbose;}
+   // the port leads to link from now on, to the board again for 0; the
+   // core does not own the link
+   void SetLink(SerialLink* link);
+   SerialLink* GetLink() const {return link_;}
+
+   int LogMessage(const MM::Device* caller, const char* msg, bool debugOnly) const;
+   MM::Device* GetDevice(const MM::Device* caller, const char* label);
+   int GetDeviceProperty(const char* deviceName, const char* propName, char* value);
+   int SetDeviceProperty(const char* deviceName, const char* propName, const char* value);
+   int SetSerialCommand(const MM::Device* caller, const char* portName, const char* command, const char* term);
+   int GetSerialAnswer(const MM::Device* caller, const char* portName, unsigned long ansLength, char* answer, const char* term);
+   int WriteToSerial(const MM::Device* caller, const char* port, const unsigned char* buf, unsigned long length);
+   int ReadFromSerial(const MM::Device* caller, const char* port, unsigned char* buf, unsigned long length, unsigned long& read);
+   int PurgeSerial(const MM::Device* caller, const char* portName);
+   MM::MMTime GetCurrentMMTime();
+   int OnPropertyChanged(const MM::Device* caller, const char* propName, const char* propValue);
+   MM::Hub* GetParentHub(const MM::Device* caller) const;
+
+private:
+   bool IsPort(const char* portName) const;
+
+   SimulatedPort port_;
+   SerialLink* link_;
+   std::map<std::string, MM::Device*> devices_;
+   MM::Hub* hub_;
+   bool logging_;
+   bool verbose_;
+};
+
+#endif // _SimulatedCore_H_
@@ -0,0 +1,1131 @@
+// Checks of the adapter against the emulated board
+//
+// Each case loads the adapter in virtual time against the firmware on the
+// emulated board and checks what ends up on the board's outputs, the
+// wheel and the wire.  The board is powered up once per process, so every
+// case runs in a process of its own; ctest runs them one by one.
+//
+// usage: arduino_adapter_test case
+//        arduino_adapter_test --list
+
+#include "../sim/ArduinoRig.h"
+#include "Arduino.h"
+#include "ArduinoTrafficLog.h"
+#include "../sim/FaultyLink.h"
+#include "../sim/ReplayLink.h"
+#include "../board/Firmware.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const double g_BusyTimeoutMs = 10000;
+const double g_PollUs = 200;
+
+long g_Failures = 0;
+
+void Check(bool ok, const char* what, long detail = -1)
+{
+   if (ok)
+      return;
+   g_Failures++;
+   if (detail >= 0)
+      fprintf(stderr, "FAILED: %s (%ld)\n", what, detail);
+   else
+      fprintf(stderr, "FAILED: %s\n", what);
+}
+
+// how far the wheel is from a slot, either way round the six slots
+double SlotOffset(double position, long slot)
+{
+   double off = std::fabs(position - slot);
+   return off < 3 ? off : 6 - off;
+}
+
+long FileSize(const std::string& path)
+{
+   FILE* f = fopen(path.c_str(), "rb");
+   if (f == 0)
+      return -1;
+   fseek(f, 0, SEEK_END);
+   long size = ftell(f);
+   fclose(f);
+   return size;
+}
+
+std::string ToString(long value)
+{
+   std::ostringstream os;
+   os << value;
+   return os.str();
+}
+
+double NowMs()
+{
+   return ArduinoBoard::Instance().GetTimeUs() / 1000;
+}
+
+std::string GetValue(MM::Device* device, const char* property)
+{
+   char value[MM::MaxStrLength] = "";
+   device->GetProperty(property, value);
+   return value;
+}
+
+int WaitForDevice(MM::Device* device)
+{
+   double start = NowMs();
+   while (device->Busy())
+   {
+      if (NowMs() - start > g_BusyTimeoutMs)
+         return DEVICE_ERR;
+      ArduinoBoard::Instance().Wait(1000);
+   }
+   return DEVICE_OK;
+}
+
+// Virtual time only waits for threads that sleep on it.  Gives a thread
+// the adapter just started real time to get to its first sleep, or the
+// clock runs ahead without it.
+void SettleThreads()
+{
+   std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+// The port's far end: passes everything on to the board, counts the frames
+// written per opcode and drops the reply to the next frame of an opcode,
+// or everything the board sends while the port runs faster than a rate.
+class ProbeLink : public SerialLink
+{
+public:
+   ProbeLink(SerialLink& link) : link_(link), dropOpcode_(-1), dropBytes_(0), maxBaud_(0)
+   {
+      memset(written_, 0, sizeof(written_));
+   }
+
+   void Write(const unsigned char* buf, unsigned long len, long baud)
+   {
+      if (len > 0)
+      {
+         written_[buf[0]]++;
+         if (buf[0] == dropOpcode_)
+         {
+            dropBytes_ = ArduinoProtocol::TagBytes + ArduinoProtocol::replyBytes(buf[0]);
+            dropOpcode_ = -1;
+         }
+      }
+      link_.Write(buf, len, baud);
+   }
+
+   unsigned long Read(unsigned char* buf, unsigned long maxLen, long baud)
+   {
+      unsigned long n = link_.Read(buf, maxLen, baud);
+      if (maxBaud_ > 0 && baud > maxBaud_)
+         return 0;
+      unsigned long skip = n < dropBytes_ ? n : dropBytes_;
+      dropBytes_ -= skip;
+      memmove(buf, buf + skip, n - skip);
+      return n - skip;
+   }
+
+   void Purge() {link_.Purge();}
+
+   void DropNextReply(unsigned char opcode) {dropOpcode_ = opcode;}
+   void BreakAbove(long baud) {maxBaud_ = baud;}
+   unsigned long Written(unsigned char opcode) const {return written_[opcode];}
+   unsigned long Written() const
+   {
+      unsigned long frames = 0;
+      for (unsigned i = 0; i < 256; i++)
+         frames += written_[i];
+      return frames;
+   }
+
+private:
+   SerialLink& link_;
+   unsigned long written_[256];
+   int dropOpcode_;
+   unsigned long dropBytes_;
+   long maxBaud_;
+};
+
+// Loads every device with ProbeLink in front of the board, outputs driven
+// with the shutter open
+class TestRig
+{
+public:
+   TestRig() : probe_(*rig_.GetCore().GetLink()) {}
+   ~TestRig() {rig_.Unload();}
+
+   int Load(const char* trafficLog = 0)
+   {
+      rig_.GetBoard().UseVirtualTime();
+      rig_.GetCore().SetLink(&probe_);
+      rig_.SetPreInitProperty("Arduino-Hub", "Logic", "Normal");
+      if (trafficLog != 0)
+         rig_.SetPreInitProperty("Arduino-Hub", "Traffic Log", trafficLog);
+
+      ArduinoBoard::Config config;
+      config.homed = true;
+      int ret = rig_.Load(config);
+      if (ret != DEVICE_OK)
+         return ret;
+      return rig_.GetDevice("Arduino-Shutter")->SetProperty("OnOff", "1");
+   }
+
+   MM::Device* Device(const char* name) {return rig_.GetDevice(name);}
+   CArduinoHub* Hub() {return static_cast<CArduinoHub*>(rig_.GetHub());}
+   ArduinoBoard& Board() {return rig_.GetBoard();}
+   ProbeLink& Probe() {return probe_;}
+   ArduinoRig& Rig() {return rig_;}
+
+private:
+   ArduinoRig rig_;
+   ProbeLink probe_;
+};
+
+void WaitForLoops(ArduinoBoard& board, unsigned long passes)
+{
+   unsigned long loops = board.GetLoopCount();
+   while (board.GetLoopCount() < loops + passes)
+      board.Wait(g_PollUs);
+}
+
+// Plays the switch's sequence, one trigger per pattern, and counts the
+// patterns that were not on the outputs by the middle of the period
+long PlaySequence(TestRig& rig, const std::vector<unsigned char>& patterns, double periodMs)
+{
+   MM::Device* sw = rig.Device("Arduino-Switch");
+   ArduinoBoard& board = rig.Board();
+   long maxLength = 0;
+   sw->GetPropertySequenceMaxLength(MM::g_Keyword_State, maxLength);
+   if (maxLength < (long) patterns.size())
+   {
+      fprintf(stderr, "the switch takes sequences of up to %ld patterns\n", maxLength);
+      return (long) patterns.size();
+   }
+   sw->ClearPropertySequence(MM::g_Keyword_State);
+   for (size_t i = 0; i < patterns.size(); i++)
+      sw->AddToPropertySequence(MM::g_Keyword_State, ToString(patterns[i]).c_str());
+   int ret = sw->SendPropertySequence(MM::g_Keyword_State);
+   if (ret == DEVICE_OK)
+      ret = sw->StartPropertySequence(MM::g_Keyword_State);
+   if (ret != DEVICE_OK)
+   {
+      fprintf(stderr, "starting the sequence failed with %d\n", ret);
+      return (long) patterns.size();
+   }
+
+   SettleThreads();
+
+   long wrong = 0;
+   double start = NowMs();
+   for (size_t i = 0; i < patterns.size(); i++)
+   {
+      double next = start + i * periodMs;
+      if (NowMs() < next)
+         board.Wait((next - NowMs()) * 1000);
+      // a run keeps the pattern, so wait for the sketch to see the edge
+      board.SetTriggerInput(true);
+      double trigger = NowMs();
+      WaitForLoops(board, 2);
+      while (board.GetOutputs() != patterns[i] && NowMs() - trigger < periodMs / 2)
+         board.Wait(g_PollUs);
+      if (board.GetOutputs() != patterns[i])
+         wrong++;
+
+      // the sketch acts on edges, it has to see the trigger go low
+      board.SetTriggerInput(false);
+      WaitForLoops(board, 2);
+   }
+   sw->StopPropertySequence(MM::g_Keyword_State);
+   return wrong;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Cases
+///////////////////////////////////////////////////////////////////////////////
+
+// The wheel gets to every slot, forward and backward, and says where it is
+void TestWheel()
+{
+   TestRig rig;
+   Check(rig.Load() == DEVICE_OK, "load");
+   MM::Device* wheel = rig.Device("Arduino-FilterWheel");
+
+   const long slots[] = {2, 3, 4, 5, 6, 1, 6, 3, 1};
+   for (size_t i = 0; i < sizeof(slots) / sizeof(slots[0]); i++)
+   {
+      long slot = slots[i];
+      Check(wheel->SetProperty(MM::g_Keyword_State, ToString(slot).c_str()) == DEVICE_OK, "move", slot);
+      Check(WaitForDevice(wheel) == DEVICE_OK, "wheel stops", slot);
+      Check(!rig.Board().IsWheelTurning(), "wheel at rest", slot);
+      // position 6.9 is next to slot 1
+      double off = std::fabs(rig.Board().GetWheelPosition() - slot);
+      Check(off < 0.25 || off > 5.75, "wheel position", slot);
+      Check(GetValue(wheel, MM::g_Keyword_State) == ToString(slot), "State", slot);
+   }
+}
+
+// A lost reply is retried with the same sequence byte, and the board
+// answers the repeat without running the command again: a stream chunk
+// sent twice would take twice the room in the ring.
+void TestRetry()
+{
+   TestRig rig;
+   Check(rig.Load() == DEVICE_OK, "load");
+   CArduinoHub* hub = rig.Hub();
+
+   MMThreadGuard myLock(hub->GetLock());
+   unsigned char cleared[1];
+   Check(hub->Query<ArduinoProtocol::StreamClear>(cleared) == DEVICE_OK, "stream clear");
+
+   unsigned char args[1 + ArduinoProtocol::MaxChunk];
+   args[0] = ArduinoProtocol::MaxChunk;
+   for (unsigned i = 0; i < ArduinoProtocol::MaxChunk; i++)
+      args[1 + i] = (unsigned char) (i + 1);
+   unsigned char reply[2];
+   unsigned long sent = rig.Probe().Written(ArduinoProtocol::StreamChunk::opcode);
+   rig.Probe().DropNextReply(ArduinoProtocol::StreamChunk::opcode);
+   Check(hub->Transact<ArduinoProtocol::StreamChunk>(args, reply) == DEVICE_OK, "chunk after a lost reply");
+   Check(rig.Probe().Written(ArduinoProtocol::StreamChunk::opcode) == sent + 2, "chunk sent twice");
+   Check(reply[0] == cleared[0] - ArduinoProtocol::MaxChunk, "chunk stored once", reply[0]);
+   Check(GetValue(hub, "Retried Commands") == "1", "retry counted");
+
+   // the next command is not taken for a repeat
+   Check(hub->Transact<ArduinoProtocol::StreamChunk>(args, reply) == DEVICE_OK, "next chunk");
+   Check(reply[0] == cleared[0] - 2 * ArduinoProtocol::MaxChunk, "next chunk stored", reply[0]);
+}
+
+// A sequence longer than the board's table is streamed; the thread keeps
+// the ring filled so every pattern is there on its trigger
+void TestStream()
+{
+   TestRig rig;
+   Check(rig.Load() == DEVICE_OK, "load");
+   MM::Device* sw = rig.Device("Arduino-Switch");
+   Check(sw->SetProperty("Sequence", "On") == DEVICE_OK, "sequence on");
+
+   std::vector<unsigned char> patterns;
+   for (unsigned i = 0; i < 300; i++)
+      patterns.push_back((unsigned char) (1 + (i * 7) % 63));
+   unsigned long before = rig.Probe().Written(ArduinoProtocol::StreamChunk::opcode);
+   Check(PlaySequence(rig, patterns, 5) == 0, "streamed patterns late or wrong");
+   unsigned long chunks = rig.Probe().Written(ArduinoProtocol::StreamChunk::opcode) - before;
+   Check(chunks >= patterns.size() / ArduinoProtocol::MaxChunk, "sequence streamed", chunks);
+   // paced by the triggers: no polling of a full ring every few ms
+   Check(chunks <= 3 * patterns.size() / ArduinoProtocol::MaxChunk, "refills paced", chunks);
+
+   // a refill that fails ends the stream and fails the stop, once
+   Check(rig.Hub()->SetProperty("Retries", "0") == DEVICE_OK, "no retries");
+   sw->ClearPropertySequence(MM::g_Keyword_State);
+   for (size_t i = 0; i < patterns.size(); i++)
+      sw->AddToPropertySequence(MM::g_Keyword_State, ToString(patterns[i]).c_str());
+   Check(sw->SendPropertySequence(MM::g_Keyword_State) == DEVICE_OK, "load again");
+   Check(sw->StartPropertySequence(MM::g_Keyword_State) == DEVICE_OK, "start again");
+   SettleThreads();
+   before = rig.Probe().Written(ArduinoProtocol::StreamChunk::opcode);
+   rig.Probe().DropNextReply(ArduinoProtocol::StreamChunk::opcode);
+   rig.Board().Wait(200000);
+   Check(rig.Probe().Written(ArduinoProtocol::StreamChunk::opcode) == before + 1, "no refills after the error",
+         (long) (rig.Probe().Written(ArduinoProtocol::StreamChunk::opcode) - before));
+   Check(sw->StopPropertySequence(MM::g_Keyword_State) == ERR_COMMUNICATION, "refill error returned");
+   Check(sw->StartPropertySequence(MM::g_Keyword_State) == DEVICE_OK, "start after the error");
+   Check(sw->StopPropertySequence(MM::g_Keyword_State) == DEVICE_OK, "error returned once");
+}
+
+// A long sequence of a few runs goes into the table as runs and plays
+// without streaming
+void TestRunLength()
+{
+   TestRig rig;
+   Check(rig.Load() == DEVICE_OK, "load");
+   MM::Device* sw = rig.Device("Arduino-Switch");
+   Check(sw->SetProperty("Sequence", "On") == DEVICE_OK, "sequence on");
+
+   const unsigned char runs[] = {5, 10, 5, 63};
+   const unsigned lengths[] = {20, 1, 40, 3};
+   std::vector<unsigned char> patterns;
+   for (unsigned r = 0; r < 4; r++)
+      patterns.insert(patterns.end(), lengths[r], runs[r]);
+
+   Check(PlaySequence(rig, patterns, 5) == 0, "run-length patterns late or wrong");
+   Check(rig.Probe().Written(ArduinoProtocol::SequenceRun::opcode) == 4, "one table entry per run",
+         (long) rig.Probe().Written(ArduinoProtocol::SequenceRun::opcode));
+   Check(rig.Probe().Written(ArduinoProtocol::StreamChunk::opcode) == 0, "nothing streamed");
+
+   // a run longer than a repeat count takes more than one entry
+   patterns.assign(300, 21);
+   patterns.insert(patterns.end(), 2, 42);
+   unsigned long entries = rig.Probe().Written(ArduinoProtocol::SequenceRun::opcode);
+   Check(PlaySequence(rig, patterns, 2) == 0, "long run late or wrong");
+   entries = rig.Probe().Written(ArduinoProtocol::SequenceRun::opcode) - entries;
+   Check(entries == 3, "a run split at 255", (long) entries);
+   Check(rig.Probe().Written(ArduinoProtocol::StreamChunk::opcode) == 0, "long run not streamed");
+
+   // more runs than table entries are streamed
+   patterns.clear();
+   for (unsigned r = 0; r < 13; r++)
+      patterns.insert(patterns.end(), 2, (unsigned char) (1 + r));
+   entries = rig.Probe().Written(ArduinoProtocol::SequenceRun::opcode);
+   Check(PlaySequence(rig, patterns, 5) == 0, "streamed runs late or wrong");
+   Check(rig.Probe().Written(ArduinoProtocol::SequenceRun::opcode) == entries, "no table entries");
+   Check(rig.Probe().Written(ArduinoProtocol::StreamChunk::opcode) > 0, "13 runs streamed");
+}
+
+// What the hub logs reads back as the frames it sent and got
+void TestTrafficLog()
+{
+   std::string path = "arduino_adapter_test_traffic.log";
+   const unsigned char patterns[] = {5, 10, 21, 42};
+   {
+      TestRig rig;
+      Check(rig.Load(path.c_str()) == DEVICE_OK, "load");
+      MM::Device* sw = rig.Device("Arduino-Switch");
+      for (unsigned i = 0; i < 4; i++)
+         Check(sw->SetProperty(MM::g_Keyword_State, ToString(patterns[i]).c_str()) == DEVICE_OK, "set", i);
+   }
+
+   ReplayLink replay;
+   std::string error;
+   Check(replay.Load(path, error), error.c_str());
+   const std::vector<ReplayLink::Exchange>& exchanges = replay.GetExchanges();
+   unsigned found = 0;
+   for (size_t i = 0; i < exchanges.size() && found < 4; i++)
+   {
+      const ReplayLink::Exchange& e = exchanges[i];
+      if (e.sent.size() != 4 || e.sent[0] != ArduinoProtocol::SetPattern::opcode || e.sent[2] != patterns[found])
+         continue;
+      std::vector<unsigned char> received;
+      for (size_t c = 0; c < e.received.size(); c++)
+         received.insert(received.end(), e.received[c].bytes.begin(), e.received[c].bytes.end());
+      Check(received.size() >= 2 && received[0] == e.sent[0] && received[1] == e.sent[1], "reply logged", found);
+      found++;
+   }
+   Check(found == 4, "pattern commands logged", found);
+   remove(path.c_str());
+
+   // a second of log time goes to the disk without a close
+   const unsigned char bytes[6] = {1, 2, 3, 4, 5, 6};
+   {
+      ArduinoTrafficLog log;
+      Check(log.Open(path.c_str(), 0), "open");
+      Check(log.Record(ArduinoTrafficRecord::Sent, 0, bytes, 6), "record");
+      Check(log.Record(ArduinoTrafficRecord::Sent, 2000000, bytes, 6), "record");
+      Check(FileSize(path) == 3 * sizeof(ArduinoTrafficRecord), "flushed", FileSize(path));
+   }
+   remove(path.c_str());
+
+   // a full log moves aside and both parts replay
+   std::string older = path + ".1";
+   const long maxBytes = 1024;
+   {
+      ArduinoTrafficLog log;
+      Check(log.Open(path.c_str(), 0, maxBytes), "open capped");
+      for (unsigned i = 0; i < 1000; i++)
+         Check(log.Record(ArduinoTrafficRecord::Sent, i * 1000.0, bytes, 6), "capped record", i);
+   }
+   Check(FileSize(path) > 0 && FileSize(path) <= maxBytes, "log capped", FileSize(path));
+   Check(FileSize(older) == maxBytes, "older log capped", FileSize(older));
+   ReplayLink newer, previous;
+   Check(newer.Load(path, error), error.c_str());
+   Check(previous.Load(older, error), error.c_str());
+   remove(path.c_str());
+   remove(older.c_str());
+
+   // a failed write is reported, not dropped
+   {
+      ArduinoTrafficLog log;
+      Check(log.Open("/dev/full", 0), "open /dev/full");
+      bool failed = false;
+      for (unsigned i = 0; i < 100000 && !failed; i++)
+         failed = !log.Record(ArduinoTrafficRecord::Sent, i * 1000.0, bytes, 6);
+      Check(failed, "write error reported");
+   }
+   {
+      TestRig rig;
+      Check(rig.Load("/dev/full") == DEVICE_OK, "load with a full disk");
+      MM::Device* sw = rig.Device("Arduino-Switch");
+      for (unsigned i = 0; i < 4; i++)
+         Check(sw->SetProperty(MM::g_Keyword_State, ToString(patterns[i]).c_str()) == DEVICE_OK, "set with a full disk", i);
+   }
+}
+
+// Closing the shutter during a burst reaches the board and ends the burst
+void TestShutterBurst()
+{
+   TestRig rig;
+   Check(rig.Load() == DEVICE_OK, "load");
+   ArduinoBoard& board = rig.Board();
+   MM::Device* shutter = rig.Device("Arduino-Shutter");
+   Check(rig.Device("Arduino-Switch")->SetProperty(MM::g_Keyword_State, "5") == DEVICE_OK, "switch");
+   Check(shutter->SetProperty("OnOff", "0") == DEVICE_OK, "close");
+   Check(shutter->SetProperty("Fire Count", "100") == DEVICE_OK, "fire count");
+   Check(shutter->SetProperty("Fire Period (ms)", "10") == DEVICE_OK, "fire period");
+
+   Check(static_cast<MM::Shutter*>(shutter)->Fire(5) == DEVICE_OK, "fire");
+   board.Wait(20000);
+   unsigned long patterns = rig.Probe().Written(ArduinoProtocol::SetPattern::opcode);
+   Check(shutter->SetProperty("OnOff", "0") == DEVICE_OK, "close during the burst");
+   Check(rig.Probe().Written(ArduinoProtocol::SetPattern::opcode) == patterns + 1, "close sent");
+
+   bool pulsed = false;
+   for (unsigned i = 0; i < 100; i++)
+   {
+      board.Wait(1000);
+      pulsed = pulsed || board.GetOutputs() != 0;
+   }
+   Check(!pulsed, "burst ended");
+}
+
+// A DAC waveform on its timer runs while the wheel turns, and neither
+// gets in the way of the other
+void TestWaveWheel()
+{
+   TestRig rig;
+   Check(rig.Load() == DEVICE_OK, "load");
+   ArduinoBoard& board = rig.Board();
+   MM::Device* dac = rig.Device("Arduino-DAC1");
+   MM::Device* wheel = rig.Device("Arduino-FilterWheel");
+
+   long maxLength = 0;
+   dac->GetPropertySequenceMaxLength("Volts", maxLength);
+   Check(maxLength >= 2, "DAC sequenceable");
+   Check(dac->SetProperty("Sequence Interval (us)", "1000") == DEVICE_OK, "interval");
+   dac->ClearPropertySequence("Volts");
+   dac->AddToPropertySequence("Volts", "1.0");
+   dac->AddToPropertySequence("Volts", "4.0");
+   Check(dac->SendPropertySequence("Volts") == DEVICE_OK, "load waveform");
+   Check(dac->StartPropertySequence("Volts") == DEVICE_OK, "start waveform");
+
+   // setting the state does not wait for the wheel, the waveform is
+   // sampled while it turns
+   Check(wheel->SetProperty(MM::g_Keyword_State, "4") == DEVICE_OK, "move");
+   Check(board.IsWheelTurning(), "wheel turning");
+   unsigned low = 0, high = 0;
+   double start = NowMs();
+   while (wheel->Busy() && NowMs() - start < g_BusyTimeoutMs)
+   {
+      board.Wait(250);
+      if (board.GetDacCode(0) < 2048)
+         low++;
+      else
+         high++;
+   }
+   Check(low > 10 && high > 10, "waveform steps during the move");
+   Check(!board.IsWheelTurning(), "wheel stops");
+   double off = std::fabs(board.GetWheelPosition() - 4);
+   Check(off < 0.25, "wheel position");
+   Check(GetValue(wheel, MM::g_Keyword_State) == "4", "State");
+
+   low = high = 0;
+   for (unsigned i = 0; i < 80; i++)
+   {
+      board.Wait(250);
+      if (board.GetDacCode(0) < 2048)
+         low++;
+      else
+         high++;
+   }
+   Check(low > 0 && high > 0, "waveform steps");
+   dac->StopPropertySequence("Volts");
+}
+
+// A move that outlasts the move timeout is stopped by Busy() and fails
+// the next access to State; the wheel can then be sent on again
+void TestWheelTimeout()
+{
+   TestRig rig;
+   Check(rig.Load() == DEVICE_OK, "load");
+   ArduinoBoard& board = rig.Board();
+   MM::Device* wheel = rig.Device("Arduino-FilterWheel");
+
+   Check(wheel->SetProperty(MM::g_Keyword_State, "1") == DEVICE_OK, "move to 1");
+   Check(WaitForDevice(wheel) == DEVICE_OK, "wheel at 1");
+   Check(GetValue(wheel, MM::g_Keyword_State) == "1", "State 1");
+
+   Check(wheel->SetProperty("Move Timeout (ms)", "100") == DEVICE_OK, "timeout");
+   Check(wheel->SetProperty(MM::g_Keyword_State, "4") == DEVICE_OK, "move to 4");
+   Check(wheel->Busy(), "busy while turning");
+   Check(WaitForDevice(wheel) == DEVICE_OK, "wheel stopped");
+   board.Wait(50000);
+   Check(!board.IsWheelTurning(), "wheel at rest");
+   Check(std::fabs(board.GetWheelPosition() - 4) > 0.25, "wheel short of 4");
+
+   char value[MM::MaxStrLength] = "";
+   Check(wheel->GetProperty(MM::g_Keyword_State, value) == ERR_MOVE_TIMEOUT, "timeout reported");
+   Check(GetValue(wheel, MM::g_Keyword_State) != "4", "State not 4");
+
+   Check(wheel->SetProperty("Move Timeout (ms)", "5000") == DEVICE_OK, "timeout");
+   Check(wheel->SetProperty(MM::g_Keyword_State, "4") == DEVICE_OK, "move to 4 again");
+   Check(WaitForDevice(wheel) == DEVICE_OK, "wheel stops");
+   Check(std::fabs(board.GetWheelPosition() - 4) < 0.25, "wheel at 4");
+   Check(GetValue(wheel, MM::g_Keyword_State) == "4", "State 4");
+
+   // a move after a failed one goes out without the error being read
+   Check(wheel->SetProperty("Move Timeout (ms)", "100") == DEVICE_OK, "timeout");
+   Check(wheel->SetProperty(MM::g_Keyword_State, "1") == DEVICE_OK, "move to 1");
+   Check(WaitForDevice(wheel) == DEVICE_OK, "wheel stopped");
+   board.Wait(50000);
+   Check(SlotOffset(board.GetWheelPosition(), 1) > 0.25, "wheel short of 1");
+   Check(wheel->SetProperty("Move Timeout (ms)", "5000") == DEVICE_OK, "timeout");
+   Check(wheel->SetProperty(MM::g_Keyword_State, "1") == DEVICE_OK, "move to 1 without a read");
+   Check(WaitForDevice(wheel) == DEVICE_OK, "wheel stops");
+   Check(SlotOffset(board.GetWheelPosition(), 1) < 0.25, "wheel at 1");
+   Check(wheel->GetProperty(MM::g_Keyword_State, value) == DEVICE_OK, "no stale error");
+   Check(GetValue(wheel, MM::g_Keyword_State) == "1", "State 1");
+}
+
+// Every stop at another slot saves the position; the saves go round a
+// ring of EEPROM cells, so no cell takes a write per stop
+void TestEeprom()
+{
+   TestRig rig;
+   Check(rig.Load() == DEVICE_OK, "load");
+   ArduinoBoard& board = rig.Board();
+   MM::Device* wheel = rig.Device("Arduino-FilterWheel");
+
+   // a lap and a half of the ring
+   const long moves = 100;
+   for (long i = 0; i < moves; i++)
+   {
+      long slot = i % 2 == 0 ? 2 : 3;
+      Check(wheel->SetProperty(MM::g_Keyword_State, ToString(slot).c_str()) == DEVICE_OK, "move", slot);
+      Check(WaitForDevice(wheel) == DEVICE_OK, "wheel stops", slot);
+      Check(GetValue(wheel, MM::g_Keyword_State) == ToString(slot), "State", slot);
+   }
+   unsigned long writes = board.GetMostEepromWrites();
+   Check(writes >= 2 && writes <= 3, "EEPROM wear", (long) writes);
+}
+
+// Commands that keep failing at a fast rate move the link to a slower one
+void TestBaudStepDown()
+{
+   TestRig rig;
+   Check(rig.Load() == DEVICE_OK, "load");
+   CArduinoHub* hub = rig.Hub();
+   Check(GetValue(hub, "Baud Rate") == "500000", "fastest rate");
+
+   rig.Probe().BreakAbove(250000);
+   {
+      MMThreadGuard myLock(hub->GetLock());
+      unsigned char reply[3];
+      for (int i = 0; i < 3; i++)
+         Check(hub->Query<ArduinoProtocol::WheelStatus>(reply) == ERR_COMMUNICATION, "broken link", i);
+      Check(hub->Query<ArduinoProtocol::WheelStatus>(reply) == DEVICE_OK, "after stepping down");
+   }
+   Check(GetValue(hub, "Baud Rate") == "250000", "stepped down one rate");
+   Check(rig.Board().GetBaudRate() == 250000, "board at the same rate", rig.Board().GetBaudRate());
+
+   MM::Device* sw = rig.Device("Arduino-Switch");
+   Check(sw->SetProperty(MM::g_Keyword_State, "21") == DEVICE_OK, "switch");
+   Check(rig.Board().GetOutputs() == 21, "outputs");
+}
+
+// Waits up to timeoutMs for the camera output to reach a level, returns
+// how long that took or -1
+double WaitForCameraOutput(ArduinoBoard& board, bool high, double timeoutMs)
+{
+   double start = NowMs();
+   while (board.GetCameraOutput() != high)
+   {
+      if (NowMs() - start > timeoutMs)
+         return -1;
+      board.Wait(10);
+   }
+   return NowMs() - start;
+}
+
+// The camera trigger is held while the wheel turns and played back as
+// wide as it came in, or as long as the input stays high; with the wheel
+// ready it passes straight through
+void TestCameraGate()
+{
+   TestRig rig;
+   Check(rig.Load() == DEVICE_OK, "load");
+   ArduinoBoard& board = rig.Board();
+   MM::Device* wheel = rig.Device("Arduino-FilterWheel");
+   Check(wheel->SetProperty("Hold Camera Trigger", "On") == DEVICE_OK, "hold on");
+   WaitForLoops(board, 2);
+
+   // a 3 ms pulse during the move
+   Check(wheel->SetProperty(MM::g_Keyword_State, "4") == DEVICE_OK, "move to 4");
+   WaitForLoops(board, 2);
+   Check(!board.GetReadyOutput(), "not ready while turning");
+   board.SetCameraInput(true);
+   board.Wait(3000);
+   Check(!board.GetCameraOutput(), "trigger held");
+   board.SetCameraInput(false);
+   Check(WaitForCameraOutput(board, true, g_BusyTimeoutMs) >= 0, "held trigger played");
+   Check(board.GetReadyOutput(), "played once ready");
+   double width = WaitForCameraOutput(board, false, 100);
+   Check(std::fabs(width - 3.0) < 0.2, "pulse width (us)", (long) (width * 1000));
+   Check(WaitForDevice(wheel) == DEVICE_OK, "wheel at 4");
+
+   // passes through with the wheel ready, from the interrupt
+   board.SetCameraInput(true);
+   double delay = WaitForCameraOutput(board, true, 1);
+   Check(delay >= 0 && delay <= 0.1, "input passed through (us)", (long) (delay * 1000));
+   board.SetCameraInput(false);
+   Check(WaitForCameraOutput(board, false, 0.1) >= 0, "input low passed through");
+
+   // an input still high when the wheel settles is followed from there
+   Check(wheel->SetProperty(MM::g_Keyword_State, "2") == DEVICE_OK, "move to 2");
+   WaitForLoops(board, 2);
+   board.SetCameraInput(true);
+   Check(WaitForCameraOutput(board, true, g_BusyTimeoutMs) >= 0, "held level played");
+   board.Wait(20000);
+   Check(board.GetCameraOutput(), "level held");
+   board.SetCameraInput(false);
+   Check(WaitForCameraOutput(board, false, 0.1) >= 0, "level ends with the input");
+   Check(WaitForDevice(wheel) == DEVICE_OK, "wheel at 2");
+
+   // without hold the input passes even while the wheel turns
+   Check(wheel->SetProperty("Hold Camera Trigger", "Off") == DEVICE_OK, "hold off");
+   Check(wheel->SetProperty(MM::g_Keyword_State, "5") == DEVICE_OK, "move to 5");
+   WaitForLoops(board, 2);
+   board.SetCameraInput(true);
+   Check(WaitForCameraOutput(board, true, 0.1) >= 0, "not held");
+   board.SetCameraInput(false);
+   Check(WaitForDevice(wheel) == DEVICE_OK, "wheel at 5");
+}
+
+// The sketch's wheel tracking before it went to half slots: a float
+// position that counts from -10 until the hall sensor sets it to 5.5
+class FloatWheel
+{
+public:
+   FloatWheel() : position_(-10) {}
+
+   void Track(bool hallFired, bool optoFired, int direction)
+   {
+      if (hallFired)
+         position_ = 5.5;
+      if (optoFired)
+      {
+         if (position_ == 5.5)
+            position_ = position_ + (direction * 0.5);
+         else
+            position_ = position_ + direction;
+         if (position_ == 7)
+            position_ = 1;
+         if (position_ == 0)
+            position_ = 6;
+      }
+   }
+
+   bool IsPosition(int pos) const {return position_ == pos;}
+
+private:
+   float position_;
+};
+
+// Plays edges through both models and counts the passes where they
+// disagree on a slot the wheel would stop at
+long CompareWheels(FloatWheel& old, int& halfSlot, bool hallFired, bool optoFired, int direction)
+{
+   old.Track(hallFired, optoFired, direction);
+   halfSlot = FirmwareTrackEdges(halfSlot, hallFired, optoFired, direction);
+   long differences = 0;
+   for (int pos = 1; pos <= 6; pos++)
+   {
+      if (old.IsPosition(pos) != (halfSlot == 2 * (pos - 1)))
+         differences++;
+   }
+   return differences;
+}
+
+// The half-slot tracking stops the wheel where the float tracking did, for
+// any edges once the hall sensor has been seen
+void TestHalfSlots()
+{
+   // the index is 5.5: half a slot on to 6 or back to 5
+   int halfSlot = FirmwareTrackEdges(-1, true, false, 1);
+   Check(halfSlot == 9, "hall sets the index", halfSlot);
+   Check(FirmwareTrackEdges(halfSlot, false, true, 1) == 10, "index forward to 6");
+   Check(FirmwareTrackEdges(halfSlot, false, true, -1) == 8, "index back to 5");
+   Check(FirmwareTrackEdges(0, true, true, 1) == 10, "hall and opto in one pass");
+   // the old 0 and 7 wrap around
+   Check(FirmwareTrackEdges(0, false, true, -1) == 10, "1 back to 6");
+   Check(FirmwareTrackEdges(10, false, true, 1) == 0, "6 forward to 1");
+   // no counting before the index, where the float position started at -10
+   halfSlot = -1;
+   for (int i = 0; i < 20; i++)
+      halfSlot = FirmwareTrackEdges(halfSlot, false, true, 1);
+   Check(halfSlot == -1, "unknown until the index", halfSlot);
+
+   unsigned long rand = 12345;
+   long passes = 0;
+   long differences = 0;
+   for (int run = 0; run < 1000; run++)
+   {
+      FloatWheel old;
+      halfSlot = -1;
+      int direction = 1;
+      differences += CompareWheels(old, halfSlot, true, false, direction);
+      for (int pass = 0; pass < 200; pass++, passes++)
+      {
+         rand = rand * 1103515245 + 12345;
+         unsigned r = (unsigned) (rand >> 16);
+         if (r % 16 == 0)
+            direction = -direction;
+         bool hallFired = (r >> 4) % 32 == 0;
+         bool optoFired = (r >> 9) % 2 == 0;
+         differences += CompareWheels(old, halfSlot, hallFired, optoFired, direction);
+      }
+   }
+   Check(differences == 0, "float and half-slot stops differ", differences);
+   Check(passes == 200000, "passes played");
+}
+
+// Bytes garbled on the line in both directions fail their crc and are
+// sent again, so no command runs with a wrong argument and no reply passes
+// with a wrong payload
+void TestCrc()
+{
+   TestRig rig;
+   Check(rig.Load() == DEVICE_OK, "load");
+   MM::Device* sw = rig.Device("Arduino-Switch");
+   MM::Device* dac = rig.Device("Arduino-DAC1");
+   MM::Device* input = rig.Device("Arduino-Input");
+   ArduinoBoard& board = rig.Board();
+   board.SetDigitalInputs(0x2A);
+
+   // what the devices make of it over a clean line
+   const char* volts[2] = {"1.25", "2.5"};
+   unsigned codes[2];
+   for (unsigned i = 0; i < 2; i++)
+   {
+      Check(dac->SetProperty("Volts", volts[i]) == DEVICE_OK, "clean DAC");
+      codes[i] = board.GetDacCode(0);
+   }
+   std::string inputs = GetValue(input, "DigitalInput");
+
+   FaultyLink line(rig.Probe());
+   rig.Rig().GetCore().SetLink(&line);
+   Check(rig.Hub()->SetProperty("Retries", "6") == DEVICE_OK, "retries");
+   Check(rig.Hub()->SetProperty("Retry Budget (ms)", "1000") == DEVICE_OK, "budget");
+   FaultyLink::Faults faults;
+   faults.corrupt = 0.02;
+   line.SetFaults(faults, faults);
+
+   long failed = 0;
+   long wrong = 0;
+   for (unsigned i = 0; i < 300; i++)
+   {
+      unsigned pattern = i % 2 ? 21 : 42;
+      if (sw->SetProperty(MM::g_Keyword_State, ToString(pattern).c_str()) != DEVICE_OK)
+         failed++;
+      else if (board.GetOutputs() != pattern)
+         wrong++;
+      if (dac->SetProperty("Volts", volts[i % 2]) != DEVICE_OK)
+         failed++;
+      else if (board.GetDacCode(0) != codes[i % 2])
+         wrong++;
+      char value[MM::MaxStrLength];
+      if (input->GetProperty("DigitalInput", value) != DEVICE_OK)
+         failed++;
+      else if (inputs != value)
+         wrong++;
+   }
+   rig.Rig().GetCore().SetLink(&rig.Probe());
+
+   const FaultyLink::Counts& out = line.GetCounts(true);
+   const FaultyLink::Counts& in = line.GetCounts(false);
+   Check(out.corrupted > 10 && in.corrupted > 10, "bytes garbled both ways", (long) (out.corrupted + in.corrupted));
+   Check(wrong == 0, "no wrong results", wrong);
+   Check(failed == 0, "no failed commands", failed);
+}
+
+// Writes to both DACs within the sync window go out as one command; a
+// write without a partner goes out when Busy() is polled after the window,
+// and one that fails to go out stays pending until it does
+void TestDacSync()
+{
+   TestRig rig;
+   Check(rig.Load() == DEVICE_OK, "load");
+   ArduinoBoard& board = rig.Board();
+   MM::Device* dac1 = rig.Device("Arduino-DAC1");
+   MM::Device* dac2 = rig.Device("Arduino-DAC2");
+   Check(rig.Hub()->SetProperty("DAC Sync Window (ms)", "50") == DEVICE_OK, "window");
+
+   unsigned long pairs = rig.Probe().Written(ArduinoProtocol::SetDacs::opcode);
+   unsigned long singles = rig.Probe().Written(ArduinoProtocol::SetDac::opcode);
+   Check(dac1->SetProperty("Volts", "1.0") == DEVICE_OK, "DAC1");
+   Check(dac2->SetProperty("Volts", "2.0") == DEVICE_OK, "DAC2");
+   Check(rig.Probe().Written(ArduinoProtocol::SetDacs::opcode) == pairs + 1, "one frame for both");
+   Check(rig.Probe().Written(ArduinoProtocol::SetDac::opcode) == singles, "no single writes");
+   Check(board.GetDacCode(0) == 819 && board.GetDacCode(1) == 1638, "both codes", board.GetDacCode(0));
+
+   // a lone write
+   Check(dac1->SetProperty("Volts", "3.0") == DEVICE_OK, "lone write");
+   Check(dac1->Busy(), "busy in the window");
+   Check(board.GetDacCode(0) == 819, "held in the window", board.GetDacCode(0));
+   board.Wait(60000);
+   Check(!dac1->Busy(), "flushed after the window");
+   Check(board.GetDacCode(0) == 2457, "lone code", board.GetDacCode(0));
+   Check(rig.Probe().Written(ArduinoProtocol::SetDac::opcode) == singles + 1, "lone write sent alone");
+
+   // a failed flush keeps the write
+   Check(dac1->SetProperty("Volts", "4.0") == DEVICE_OK, "write before a failure");
+   board.Wait(60000);
+   rig.Probe().BreakAbove(1);
+   Check(dac1->Busy(), "busy after a failed send");
+   rig.Probe().BreakAbove(0);
+   Check(WaitForDevice(dac1) == DEVICE_OK, "sent once the link is back");
+   Check(board.GetDacCode(0) == 3276, "code after the failure", board.GetDacCode(0));
+}
+
+// Setting what the board already holds is counted and sends nothing; with
+// the cache off it goes out again
+void TestStateCache()
+{
+   TestRig rig;
+   Check(rig.Load() == DEVICE_OK, "load");
+   CArduinoHub* hub = rig.Hub();
+   MM::Device* sw = rig.Device("Arduino-Switch");
+   MM::Device* dac = rig.Device("Arduino-DAC1");
+   MM::Device* wheel = rig.Device("Arduino-FilterWheel");
+
+   Check(sw->SetProperty(MM::g_Keyword_State, "21") == DEVICE_OK, "switch");
+   Check(dac->SetProperty("Volts", "2.5") == DEVICE_OK, "DAC");
+   Check(wheel->SetProperty(MM::g_Keyword_State, "3") == DEVICE_OK, "wheel");
+   Check(WaitForDevice(wheel) == DEVICE_OK, "wheel at 3");
+
+   long skipped = atol(GetValue(hub, "Skipped Writes").c_str());
+   unsigned long frames = rig.Probe().Written();
+   Check(sw->SetProperty(MM::g_Keyword_State, "21") == DEVICE_OK, "same switch state");
+   Check(dac->SetProperty("Volts", "2.5") == DEVICE_OK, "same DAC value");
+   Check(wheel->SetProperty(MM::g_Keyword_State, "3") == DEVICE_OK, "same slot");
+   Check(rig.Probe().Written() == frames, "no traffic", (long) (rig.Probe().Written() - frames));
+   Check(atol(GetValue(hub, "Skipped Writes").c_str()) == skipped + 3, "skips counted",
+         atol(GetValue(hub, "Skipped Writes").c_str()) - skipped);
+   Check(rig.Board().GetOutputs() == 21, "outputs");
+
+   Check(hub->SetProperty("State Cache", "Off") == DEVICE_OK, "cache off");
+   unsigned long patterns = rig.Probe().Written(ArduinoProtocol::SetPattern::opcode);
+   Check(sw->SetProperty(MM::g_Keyword_State, "21") == DEVICE_OK, "switch without the cache");
+   Check(rig.Probe().Written(ArduinoProtocol::SetPattern::opcode) == patterns + 1, "sent without the cache");
+}
+
+// One preset frame sets the wheel, the outputs and both DACs, and the
+// switch, DAC and wheel devices show what it set.  The volts go through
+// the scale of each DAC device.
+void TestChannelPreset()
+{
+   TestRig rig;
+   rig.Rig().SetPreInitProperty("Arduino-DAC1", "MaxVolt", "10.0");
+   Check(rig.Load() == DEVICE_OK, "load");
+   ArduinoBoard& board = rig.Board();
+   ProbeLink& probe = rig.Probe();
+   MM::Device* channel = rig.Device("Arduino-Channel");
+   MM::Device* sw = rig.Device("Arduino-Switch");
+   MM::Device* dac1 = rig.Device("Arduino-DAC1");
+   MM::Device* dac2 = rig.Device("Arduino-DAC2");
+   MM::Device* wheel = rig.Device("Arduino-FilterWheel");
+
+   Check(channel->SetProperty("Preset 1 Wheel", "4") == DEVICE_OK, "preset wheel");
+   Check(channel->SetProperty("Preset 1 Pattern", "21") == DEVICE_OK, "preset pattern");
+   Check(channel->SetProperty("Preset 1 DAC1 Volts", "5.0") == DEVICE_OK, "preset DAC1");
+   Check(channel->SetProperty("Preset 1 DAC2 Volts", "2.5") == DEVICE_OK, "preset DAC2");
+
+   unsigned long presets = probe.Written(ArduinoProtocol::ChannelPreset::opcode);
+   unsigned long others = probe.Written(ArduinoProtocol::SetPattern::opcode) +
+         probe.Written(ArduinoProtocol::SetDac::opcode) +
+         probe.Written(ArduinoProtocol::SetDacs::opcode) +
+         probe.Written(ArduinoProtocol::WheelMove::opcode);
+   Check(channel->SetProperty(MM::g_Keyword_State, "1") == DEVICE_OK, "apply preset");
+   Check(probe.Written(ArduinoProtocol::ChannelPreset::opcode) == presets + 1, "one preset frame");
+   Check(probe.Written(ArduinoProtocol::SetPattern::opcode) + probe.Written(ArduinoProtocol::SetDac::opcode) +
+         probe.Written(ArduinoProtocol::SetDacs::opcode) + probe.Written(ArduinoProtocol::WheelMove::opcode) == others,
+         "no other writes");
+
+   Check(!board.IsWheelTurning(), "wheel at rest");
+   Check(SlotOffset(board.GetWheelPosition(), 4) < 0.25, "wheel at 4");
+   Check(board.GetOutputs() == 21, "outputs", board.GetOutputs());
+   // half scale on both, DAC1 runs to 10 V
+   Check(board.GetDacCode(0) == 2047, "DAC1 code", board.GetDacCode(0));
+   Check(board.GetDacCode(1) == 2047, "DAC2 code", board.GetDacCode(1));
+
+   Check(GetValue(sw, MM::g_Keyword_State) == "21", "switch State");
+   Check(GetValue(wheel, MM::g_Keyword_State) == "4", "wheel State");
+   Check(std::fabs(atof(GetValue(dac1, "Volts").c_str()) - 5.0) < 0.01, "DAC1 Volts");
+   Check(std::fabs(atof(GetValue(dac2, "Volts").c_str()) - 2.5) < 0.01, "DAC2 Volts");
+
+   // the devices do not write what the preset already set
+   unsigned long frames = probe.Written();
+   Check(sw->SetProperty(MM::g_Keyword_State, "21") == DEVICE_OK, "same switch state");
+   Check(dac1->SetProperty("Volts", GetValue(dac1, "Volts").c_str()) == DEVICE_OK, "same DAC1 value");
+   Check(probe.Written() == frames, "preset state cached", (long) (probe.Written() - frames));
+}
+
+// Polls the wheel's program progress until it reads text, or timeoutMs
+bool WaitForProgress(MM::Device* wheel, const std::string& text, double timeoutMs)
+{
+   double start = NowMs();
+   while (GetValue(wheel, "Program Progress") != text)
+   {
+      if (NowMs() - start > timeoutMs)
+         return false;
+      ArduinoBoard::Instance().Wait(1000);
+   }
+   return true;
+}
+
+// A program runs its steps on the board, in order and for as many dwells
+// and cycles as it was set to, and the progress follows it; a program
+// without end runs until it is stopped
+void TestProgram()
+{
+   TestRig rig;
+   Check(rig.Load() == DEVICE_OK, "load");
+   ArduinoBoard& board = rig.Board();
+   MM::Device* wheel = rig.Device("Arduino-FilterWheel");
+
+   Check(wheel->SetProperty("Program Step 0 Position", "2") == DEVICE_OK, "step 0 position");
+   Check(wheel->SetProperty("Program Step 0 Dwell (ms)", "300") == DEVICE_OK, "step 0 dwell");
+   Check(wheel->SetProperty("Program Step 0 Repeat", "2") == DEVICE_OK, "step 0 repeat");
+   Check(wheel->SetProperty("Program Step 1 Position", "5") == DEVICE_OK, "step 1 position");
+   Check(wheel->SetProperty("Program Step 1 Dwell (ms)", "300") == DEVICE_OK, "step 1 dwell");
+   Check(wheel->SetProperty("Program Step 1 Repeat", "1") == DEVICE_OK, "step 1 repeat");
+   Check(wheel->SetProperty("Program Length", "2") == DEVICE_OK, "length");
+   Check(wheel->SetProperty("Repeat Program", "2") == DEVICE_OK, "repeat");
+   Check(GetValue(wheel, "Program Progress") == "Idle", "idle before the start");
+
+   Check(wheel->SetProperty("Program Mode", "Start") == DEVICE_OK, "start");
+   Check(GetValue(wheel, "Program Mode") == "Running", "running");
+   const char* progress[] = {
+      "Step 0, dwell 1 of 2, cycle 1",
+      "Step 0, dwell 2 of 2, cycle 1",
+      "Step 1, dwell 1 of 1, cycle 1",
+      "Step 0, dwell 1 of 2, cycle 2",
+      "Step 0, dwell 2 of 2, cycle 2",
+      "Step 1, dwell 1 of 1, cycle 2",
+   };
+   const long slots[] = {2, 2, 5, 2, 2, 5};
+   for (unsigned i = 0; i < 6; i++)
+   {
+      Check(WaitForProgress(wheel, progress[i], g_BusyTimeoutMs), progress[i]);
+      // a step shows from the start of its move; its dwell waits for the wheel
+      while (board.IsWheelTurning())
+         board.Wait(1000);
+      Check(SlotOffset(board.GetWheelPosition(), slots[i]) < 0.25, "wheel at the step's slot", i);
+   }
+   Check(WaitForProgress(wheel, "Idle", g_BusyTimeoutMs), "idle after two cycles");
+   Check(GetValue(wheel, "Program Mode") == "Idle", "mode idle");
+   Check(SlotOffset(board.GetWheelPosition(), 5) < 0.25, "wheel at the last step");
+
+   // without end until stopped
+   Check(wheel->SetProperty("Repeat Program", "0") == DEVICE_OK, "repeat forever");
+   Check(wheel->SetProperty("Program Mode", "Start") == DEVICE_OK, "start again");
+   Check(WaitForProgress(wheel, "Step 1, dwell 1 of 1, cycle 3", 3 * g_BusyTimeoutMs), "third cycle");
+   Check(wheel->SetProperty("Program Mode", "Stop") == DEVICE_OK, "stop");
+   Check(GetValue(wheel, "Program Progress") == "Idle", "idle after the stop");
+   Check(GetValue(wheel, "Program Mode") == "Idle", "mode idle after the stop");
+}
+
+// Sends n status queries and returns how many of them were retried
+long QueryStatus(CArduinoHub* hub, unsigned n)
+{
+   long before = atol(GetValue(hub, "Retried Commands").c_str());
+   {
+      MMThreadGuard myLock(hub->GetLock());
+      unsigned char reply[3];
+      for (unsigned i = 0; i < n; i++)
+         Check(hub->Query<ArduinoProtocol::WheelStatus>(reply) == DEVICE_OK, "status query", i);
+   }
+   return atol(GetValue(hub, "Retried Commands").c_str()) - before;
+}
+
+// The reply timeout follows the round trips measured for a command, held
+// between the minimum and maximum timeout: a reply later than the round
+// trips so far is retried, one that stays late is waited for
+void TestAdaptiveTimeout()
+{
+   TestRig rig;
+   Check(rig.Load() == DEVICE_OK, "load");
+   CArduinoHub* hub = rig.Hub();
+   FaultyLink line(rig.Probe());
+   rig.Rig().GetCore().SetLink(&line);
+
+   // round trips well under a millisecond
+   Check(QueryStatus(hub, 16) == 0, "fast link retried");
+
+   // replies 30 ms late, within the minimum
+   FaultyLink::Faults late;
+   late.delay = 1.0;
+   late.delayUs = 30000;
+   line.SetFaults(FaultyLink::Faults(), late);
+   Check(hub->SetProperty("Minimum Timeout (ms)", "40") == DEVICE_OK, "minimum 40");
+   Check(QueryStatus(hub, 1) == 0, "minimum waits for the reply");
+
+   // beyond what the fast round trips allow
+   Check(hub->SetProperty("Minimum Timeout (ms)", "10") == DEVICE_OK, "minimum 10");
+   Check(QueryStatus(hub, 1) == 1, "late reply retried");
+
+   // timed from the first send, the late replies raise the timeout
+   Check(QueryStatus(hub, 20) == 0, "timeout follows the round trips");
+
+   // the maximum caps it
+   Check(hub->SetProperty("Maximum Timeout (ms)", "15") == DEVICE_OK, "maximum 15");
+   Check(QueryStatus(hub, 1) == 1, "maximum cuts the wait");
+
+   rig.Rig().GetCore().SetLink(&rig.Probe());
+}
+
+struct Case
+{
+   const char* name;
+   void (*run)();
+};
+
+const Case g_Cases[] = {
+   {"wheel", TestWheel},
+   {"retry", TestRetry},
+   {"stream", TestStream},
+   {"runlength", TestRunLength},
+   {"trafficlog", TestTrafficLog},
+   {"shutter", TestShutterBurst},
+   {"wavewheel", TestWaveWheel},
+   {"wheeltimeout", TestWheelTimeout},
+   {"eeprom", TestEeprom},
+   {"baudstep", TestBaudStepDown},
+   {"cameragate", TestCameraGate},
+   {"halfslots", TestHalfSlots},
+   {"crc", TestCrc},
+   {"dacsync", TestDacSync},
+   {"statecache", TestStateCache},
+   {"channelpreset", TestChannelPreset},
+   {"program", TestProgram},
+   {"adaptivetimeout", TestAdaptiveTimeout},
+};
+const unsigned g_NumCases = sizeof(g_Cases) / sizeof(g_Cases[0]);
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+   if (argc == 2 && strcmp(argv[1], "--list") == 0)
+   {
+      for (unsigned i = 0; i < g_NumCases; i++)
+         printf("%s\n", g_Cases[i].name);
+      return 0;
+   }
+   for (unsigned i = 0; argc == 2 && i < g_NumCases; i++)
+   {
+      if (strcmp(argv[1], g_Cases[i].name) != 0)
+         continue;
+      g_Cases[i].run();
+      printf("%s: %s\n", g_Cases[i].name, g_Failures == 0 ? "passed" : "FAILED");
+      return g_Failures == 0 ? 0 : 1;
+   }
+   fprintf(stderr, "usage: %s case\n       %s --list\n", argv[0], argv[0]);
+   return 2;
+}